@@ -162,7 +162,7 @@ main(void)
                                   &num_channels, 0);
 
     if (face_texture_data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, face_texture_data);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
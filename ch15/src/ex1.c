@@ -254,7 +254,7 @@ main(void)
                                  &num_channels, 0);
 
     if (diffuse_map_data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, diffuse_map_data);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
@@ -280,7 +280,7 @@ main(void)
                                   &num_channels, 0);
 
     if (specular_map_data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, specular_map_data);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
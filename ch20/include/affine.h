@@ -0,0 +1,53 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include <cglm/cglm.h>
+
+/*
+ * Inverses of model matrices. Model matrices are built from a translation,
+ * a rotation and a scale, so their last row is always 0 0 0 1 and only the
+ * upper 3x3 needs inverting. That is a few cross products rather than the
+ * cofactors of a whole 4x4
+ *
+ * The functions use SSE2 when the compiler targets it and plain C otherwise.
+ * Matrices are loaded and stored unaligned, so they can live anywhere,
+ * including in stb_ds arrays that are only 16-byte aligned
+ */
+
+/**
+ * @brief Inverts an affine matrix
+ *
+ * @param[in] m The matrix. Its last row has to be 0 0 0 1 and its upper 3x3
+ * has to be invertible
+ * @param[out] dest The inverse. Can be m
+ */
+void affine_inverse(mat4 m, mat4 dest);
+
+/**
+ * @brief Inverts a matrix made of only a rotation and a translation. The
+ * rotation is transposed instead of inverted
+ *
+ * @param[in] m The matrix. Its upper 3x3 has to be orthonormal
+ * @param[out] dest The inverse. Can be m
+ */
+void rigid_inverse(mat4 m, mat4 dest);
+
+/**
+ * @brief Computes the normal matrix of a model matrix, the inverse-transpose
+ * of its upper 3x3, without building the inverse first
+ *
+ * @param[in] m The model matrix. Its upper 3x3 has to be invertible
+ * @param[out] dest The normal matrix
+ */
+void normal_matrix(mat4 m, mat3 dest);
+
+/**
+ * @brief The plain C versions of the functions, for checking and timing the
+ * vector ones against
+ */
+void affine_inverse_scalar(mat4 m, mat4 dest);
+void rigid_inverse_scalar(mat4 m, mat4 dest);
+void normal_matrix_scalar(mat4 m, mat3 dest);
+
+#endif
+/* EOF */
@@ -0,0 +1,179 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Allocators that take their memory from the heap once, up front, so frames
+ * and loads do not have to. A linear arena hands out memory by bumping an
+ * offset and gives it all back at once, either to a mark or entirely. An
+ * object pool hands out fixed-size records from a free list
+ *
+ * None of them are thread safe, use each from one thread at a time
+ */
+
+/* Per-frame scratch, reset at the start of every frame */
+#define FRAME_ARENA_SIZE (4u << 20)
+
+/* Shader sources and info logs, kept apart so they count as shader memory */
+#define SHADER_ARENA_SIZE (1u << 20)
+
+/* The most meshes that can exist at once */
+#define MAX_MESHES 4096
+
+typedef struct memory_stats memory_stats;
+typedef struct arena arena;
+typedef struct object_pool object_pool;
+
+/* Called after every allocation, free and reset of any allocator */
+typedef void (*memory_hook)(const memory_stats *stats, void *user);
+
+struct memory_stats
+{
+    const char *name;
+
+    /* In bytes */
+    size_t capacity;
+    size_t used;
+    size_t high_water;
+
+    unsigned long allocations;
+    unsigned long frees;
+
+    /* Requests that did not fit */
+    unsigned long failures;
+};
+
+struct arena
+{
+    unsigned char *base;
+    memory_stats stats;
+};
+
+struct object_pool
+{
+    unsigned char *base;
+    size_t object_size;
+
+    /* The first free record, each holds a pointer to the next */
+    void *free_list;
+
+    memory_stats stats;
+};
+
+extern arena frame_arena;
+extern arena shader_arena;
+
+/**
+ * @brief Creates the frame and shader arenas, each charged to its own
+ * memory category
+ */
+void init_memory(void);
+
+/**
+ * @brief Deletes the frame and shader arenas
+ */
+void shutdown_memory(void);
+
+/**
+ * @brief Sets the function called whenever an allocator's stats change
+ *
+ * @param[in] hook The function, or NULL for none
+ * @param[in] user Passed to the hook
+ */
+void set_memory_hook(memory_hook hook, void *user);
+
+/**
+ * @brief Creates an arena
+ *
+ * @param[out] a The arena
+ * @param[in] name The name in its stats, not copied
+ * @param[in] capacity The number of bytes
+ *
+ * @note Exits if the memory cannot be allocated
+ */
+void create_arena(arena *a, const char *name, size_t capacity);
+
+/**
+ * @brief Allocates memory from an arena
+ *
+ * @param[in, out] a The arena
+ * @param[in] size The number of bytes
+ * @param[in] alignment The alignment, a power of two of at most
+ * _Alignof(max_align_t)
+ *
+ * @return The memory, or NULL if the arena is full
+ */
+void *arena_alloc(arena *a, size_t size, size_t alignment);
+
+/**
+ * @brief Gets a point to roll an arena back to
+ *
+ * @param[in] a The arena
+ *
+ * @return The mark
+ */
+size_t arena_mark(const arena *a);
+
+/**
+ * @brief Frees everything allocated from an arena since a mark
+ *
+ * @param[in, out] a The arena
+ * @param[in] mark The mark, from arena_mark
+ */
+void arena_release(arena *a, size_t mark);
+
+/**
+ * @brief Frees everything allocated from an arena
+ *
+ * @param[in, out] a The arena
+ */
+void reset_arena(arena *a);
+
+/**
+ * @brief Frees an arena's memory
+ *
+ * @param[in, out] a The arena
+ */
+void delete_arena(arena *a);
+
+/**
+ * @brief Creates a pool of fixed-size records
+ *
+ * @param[out] pool The pool
+ * @param[in] name The name in its stats, not copied
+ * @param[in] object_size The size of a record
+ * @param[in] capacity The number of records
+ *
+ * @note Exits if the memory cannot be allocated
+ */
+void create_object_pool(object_pool *pool, const char *name,
+                        size_t object_size, size_t capacity);
+
+/**
+ * @brief Takes a record from a pool
+ *
+ * @param[in, out] pool The pool
+ *
+ * @return The record, uninitialized, or NULL if the pool is empty
+ */
+void *object_pool_alloc(object_pool *pool);
+
+/**
+ * @brief Returns a record to its pool
+ *
+ * @param[in, out] pool The pool
+ * @param[in] object The record, or NULL
+ */
+void object_pool_free(object_pool *pool, void *object);
+
+/**
+ * @brief Frees a pool's memory
+ *
+ * @param[in, out] pool The pool
+ */
+void delete_object_pool(object_pool *pool);
+
+#endif
+/* EOF */
@@ -0,0 +1,30 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include "../include/mesh.h"
+
+/* Helpers linked into every benchmark, but not into main */
+
+/**
+ * @brief Gets a monotonic time stamp
+ *
+ * @return The time in milliseconds
+ */
+double now_ms(void);
+
+/**
+ * @brief Builds a unit UV sphere with counter-clockwise triangles. The
+ * first and last column of vertices share positions but not texture
+ * coordinates, and the rings at the poles only get the triangles that are
+ * not slivers
+ *
+ * @param[in] segments The number of columns around the sphere
+ * @param[in] rings The number of rows from pole to pole
+ * @param[out] vertices The stb_ds vertex array
+ * @param[out] indices The stb_ds index array
+ */
+void build_sphere(unsigned int segments, unsigned int rings,
+                  vertex **vertices, unsigned int **indices);
+
+#endif
+/* EOF */
@@ -0,0 +1,182 @@
+#ifndef CMD_BUFFER_H
+#define CMD_BUFFER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+/*
+ * A linear buffer of plain-data GL commands. Any thread can record into a
+ * buffer it owns, but only the thread that owns the GL context may replay it
+ */
+
+typedef struct cmd_buffer cmd_buffer;
+typedef struct multi_draw multi_draw;
+
+struct cmd_buffer
+{
+    /* stb_ds array of packed, 8-byte aligned commands */
+    unsigned char *data;
+};
+
+/**
+ * @brief Creates an empty command buffer
+ *
+ * @param[out] cb The command buffer to initialize
+ */
+void create_cmd_buffer(cmd_buffer *cb);
+
+/**
+ * @brief Empties the buffer while keeping its memory for the next recording
+ *
+ * @param[in, out] cb The command buffer
+ */
+void reset_cmd_buffer(cmd_buffer *cb);
+
+/**
+ * @brief Frees the memory used by the buffer
+ *
+ * @param[in, out] cb The command buffer
+ */
+void delete_cmd_buffer(cmd_buffer *cb);
+
+/**
+ * @brief Records a state_use_program
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] program The shader program
+ */
+void cmd_use_program(cmd_buffer *cb, unsigned int program);
+
+/**
+ * @brief Records a state_bind_texture
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] unit The texture unit, starting from 0
+ * @param[in] target The texture target
+ * @param[in] texture The texture object
+ */
+void cmd_bind_texture(cmd_buffer *cb, unsigned int unit, GLenum target,
+                      unsigned int texture);
+
+/**
+ * @brief Records a state_bind_vertex_array
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] vao The vertex array object
+ */
+void cmd_bind_vertex_array(cmd_buffer *cb, unsigned int vao);
+
+/**
+ * @brief Records a glUniform1i
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] location The uniform location
+ * @param[in] v0 The value
+ */
+void cmd_uniform_1i(cmd_buffer *cb, int location, int v0);
+
+/**
+ * @brief Records a glUniform1f
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] location The uniform location
+ * @param[in] v0 The value
+ */
+void cmd_uniform_1f(cmd_buffer *cb, int location, float v0);
+
+/**
+ * @brief Records a glUniform3fv with a count of 1
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] location The uniform location
+ * @param[in] value The vector, copied into the buffer
+ */
+void cmd_uniform_3fv(cmd_buffer *cb, int location, const float *value);
+
+/**
+ * @brief Records a glUniformMatrix3fv with a count of 1
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] location The uniform location
+ * @param[in] value The column-major matrix, copied into the buffer
+ */
+void cmd_uniform_mat3fv(cmd_buffer *cb, int location, const float *value);
+
+/**
+ * @brief Records a glUniformMatrix4fv with a count of 1
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] location The uniform location
+ * @param[in] value The column-major matrix, copied into the buffer
+ */
+void cmd_uniform_mat4fv(cmd_buffer *cb, int location, const float *value);
+
+/**
+ * @brief Records a glDrawElements
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] mode The primitive type
+ * @param[in] count The number of indices
+ * @param[in] index_type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+ * @param[in] offset The byte offset into the element array buffer
+ */
+void cmd_draw_elements(cmd_buffer *cb, GLenum mode, int count,
+                       GLenum index_type, size_t offset);
+
+/**
+ * @brief Records a glDrawElementsInstanced
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] mode The primitive type
+ * @param[in] count The number of indices
+ * @param[in] index_type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+ * @param[in] offset The byte offset into the element array buffer
+ * @param[in] instances The number of instances
+ */
+void cmd_draw_elements_instanced(cmd_buffer *cb, GLenum mode, int count,
+                                 GLenum index_type, size_t offset,
+                                 int instances);
+
+/**
+ * @brief Records a draw_multi_draw
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] md The uploaded draw list. Only the pointer is recorded, so it
+ * must stay unchanged until the buffer is replayed
+ * @param[in] mode The primitive type
+ */
+void cmd_multi_draw(cmd_buffer *cb, const multi_draw *md, GLenum mode);
+
+/**
+ * @brief Records the start of a render pass
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] pass The pass, handed to the begin_pass callback on replay
+ */
+void cmd_begin_pass(cmd_buffer *cb, unsigned int pass);
+
+/**
+ * @brief Records the end of a render pass
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] pass The pass, handed to the end_pass callback on replay
+ */
+void cmd_end_pass(cmd_buffer *cb, unsigned int pass);
+
+/**
+ * @brief Issues the recorded commands in order
+ *
+ * @param[in] cb The command buffer
+ * @param[in] begin_pass Called for each recorded pass start, may be NULL
+ * @param[in] end_pass Called for each recorded pass end, may be NULL
+ * @param[in] user Passed through to the pass callbacks
+ *
+ * @note Must be called from the thread that owns the GL context
+ */
+void replay_cmd_buffer(const cmd_buffer *cb,
+                       void (*begin_pass)(unsigned int pass, void *user),
+                       void (*end_pass)(unsigned int pass, void *user),
+                       void *user);
+
+#endif
+/* EOF */
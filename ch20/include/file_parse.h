@@ -0,0 +1,96 @@
+#ifndef FILE_PARSE_H
+#define FILE_PARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Helpers shared by the file formats. The text ones scan a buffer that ends
+ * at end rather than at a terminator, so they work on a mapped file. The
+ * binary ones lay out and check sections that start on an alignment
+ * boundary, as in the cooked mesh and scene files
+ */
+
+/**
+ * @brief Parses a float the way strtof does in the C locale, without
+ * looking at the locale or needing a terminator
+ *
+ * @param[in, out] p The cursor, moved past the number
+ * @param[in] end The end of the text
+ *
+ * @return The number, 0 if there was none. A sign or point on its own is
+ * not a number and leaves the cursor where it was
+ */
+float parse_float(const char **p, const char *end);
+
+/**
+ * @brief Skips spaces and tabs
+ *
+ * @param[in] p The cursor
+ * @param[in] end The end of the text
+ *
+ * @return The first other character
+ */
+const char *skip_blanks(const char *p, const char *end);
+
+/**
+ * @brief Finds the start of the next line
+ *
+ * @param[in] p The cursor
+ * @param[in] end The end of the text
+ *
+ * @return The character after the next newline, or end
+ */
+const char *next_line(const char *p, const char *end);
+
+/**
+ * @brief Checks whether a line starts with a keyword
+ *
+ * @param[in] p The start of the line
+ * @param[in] end The end of the text
+ * @param[in] keyword The keyword
+ *
+ * @return The character after the keyword if it is followed by a blank, or
+ * NULL
+ */
+const char *match_keyword(const char *p, const char *end,
+                          const char *keyword);
+
+/**
+ * @brief Rounds an offset up to a section boundary
+ *
+ * @param[in] offset The offset
+ * @param[in] alignment The boundary, a power of two
+ *
+ * @return The aligned offset
+ */
+uint64_t align_offset(uint64_t offset, uint64_t alignment);
+
+/**
+ * @brief Checks that a section lies inside a file and starts on a boundary
+ *
+ * @param[in] file_size The size of the file
+ * @param[in] offset The start of the section
+ * @param[in] count The number of elements
+ * @param[in] element_size The size of an element
+ * @param[in] alignment The boundary, a power of two
+ *
+ * @return Whether the section is valid
+ */
+bool check_section(size_t file_size, uint64_t offset, uint64_t count,
+                   uint64_t element_size, uint64_t alignment);
+
+/**
+ * @brief Writes zeros up to an offset
+ *
+ * @param[in, out] file The file
+ * @param[in] offset The offset to pad to
+ *
+ * @return Whether the padding was written
+ */
+bool pad_to(FILE *file, uint64_t offset);
+
+#endif
+/* EOF */
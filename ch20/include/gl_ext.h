@@ -0,0 +1,75 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/*
+ * Entry points and tokens from past GL 3.3 that are used when the driver
+ * has them. The loader only covers 3.3 core, so these are looked up by hand
+ */
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef struct gl_extensions gl_extensions;
+
+struct gl_extensions
+{
+    /* ARB_buffer_storage */
+    bool buffer_storage;
+    void (APIENTRYP glBufferStorage)(GLenum target, GLsizeiptr size,
+                                     const void *data, GLbitfield flags);
+
+    /*
+     * ARB_multi_draw_indirect, only set when ARB_base_instance is there too
+     * so the base instance of each command is honored
+     */
+    bool multi_draw_indirect;
+    void (APIENTRYP glMultiDrawElementsIndirect)(GLenum mode, GLenum type,
+                                                 const void *indirect,
+                                                 GLsizei drawcount,
+                                                 GLsizei stride);
+};
+
+/* Filled in by load_gl_extensions */
+extern gl_extensions gl_ext;
+
+/**
+ * @brief Checks which extensions the current context has and loads their
+ * entry points
+ *
+ * @param[in] load The function that looks up GL entry points by name
+ *
+ * @note Must be called with the context current, after GLAD is loaded
+ */
+void load_gl_extensions(GLADloadproc load);
+
+/**
+ * @brief Checks if the current context has an extension
+ *
+ * @param[in] name The extension name, such as "GL_ARB_buffer_storage"
+ *
+ * @return Whether the extension is supported
+ */
+bool has_gl_extension(const char *name);
+
+#endif
+/* EOF */
@@ -0,0 +1,184 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/*
+ * A shadow copy of the GL state that gets changed every frame. Each state_*
+ * function mirrors the gl* call of the same name, but only forwards it to the
+ * driver when the value actually changes.
+ *
+ * Anything that changes this state must go through here, or call
+ * invalidate_gl_state afterwards. Build with -DGL_STATE_DEBUG to compare the
+ * shadow against glGet* after every call
+ */
+
+/* The number of texture units whose bindings are tracked */
+#define STATE_TEXTURE_UNITS 16
+
+/* The number of indexed uniform buffer binding points that are tracked */
+#define STATE_UNIFORM_BINDINGS 16
+
+typedef struct gl_state_stats gl_state_stats;
+
+struct gl_state_stats
+{
+    unsigned long issued;
+    unsigned long filtered;
+};
+
+/**
+ * @brief Marks every shadowed value as unknown so the next call of each kind
+ * reaches the driver
+ *
+ * @note Call once after the context is created and again after any code that
+ * bypasses the cache
+ */
+void invalidate_gl_state(void);
+
+/**
+ * @brief Compares the shadow copy against the driver's state and exits on any
+ * difference
+ *
+ * @note Stalls the pipeline. Called after every cached call when built with
+ * GL_STATE_DEBUG
+ */
+void check_gl_state(void);
+
+/**
+ * @brief Gets the number of calls that were forwarded and filtered out
+ *
+ * @return The counters since the last reset
+ */
+gl_state_stats get_gl_state_stats(void);
+
+/**
+ * @brief Sets the forwarded and filtered counters back to zero
+ */
+void reset_gl_state_stats(void);
+
+/**
+ * @brief Cached glUseProgram
+ *
+ * @param[in] program The shader program
+ */
+void state_use_program(unsigned int program);
+
+/**
+ * @brief Cached glActiveTexture followed by glBindTexture
+ *
+ * @param[in] unit The texture unit, starting from 0 rather than GL_TEXTURE0
+ * @param[in] target GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY. Other targets are
+ * forwarded without caching
+ * @param[in] texture The texture object
+ */
+void state_bind_texture(unsigned int unit, GLenum target, unsigned int texture);
+
+/**
+ * @brief Cached glBindVertexArray
+ *
+ * @param[in] vao The vertex array object
+ */
+void state_bind_vertex_array(unsigned int vao);
+
+/**
+ * @brief Cached glBindBuffer
+ *
+ * @param[in] target The buffer binding target
+ * @param[in] buffer The buffer object
+ *
+ * @note The element array buffer binding belongs to the bound vertex array,
+ * so it is forgotten whenever the vertex array changes
+ */
+void state_bind_buffer(GLenum target, unsigned int buffer);
+
+/**
+ * @brief Cached glBindBufferRange for uniform buffers
+ *
+ * @param[in] index The uniform block binding point
+ * @param[in] buffer The buffer object
+ * @param[in] offset The offset of the range in bytes
+ * @param[in] size The size of the range in bytes
+ */
+void state_bind_uniform_range(unsigned int index, unsigned int buffer,
+                              GLintptr offset, GLsizeiptr size);
+
+/**
+ * @brief Cached glEnable/glDisable
+ *
+ * @param[in] cap GL_DEPTH_TEST, GL_BLEND or GL_CULL_FACE. Other capabilities
+ * are forwarded without caching
+ * @param[in] enabled Whether to enable or disable it
+ */
+void state_set_enabled(GLenum cap, bool enabled);
+
+/**
+ * @brief Cached glDepthFunc
+ *
+ * @param[in] func The depth comparison function
+ */
+void state_depth_func(GLenum func);
+
+/**
+ * @brief Cached glDepthMask
+ *
+ * @param[in] write Whether depth writes are enabled
+ */
+void state_depth_mask(GLboolean write);
+
+/**
+ * @brief Cached glColorMask
+ *
+ * @param[in] write Whether writes to all four color channels are enabled
+ */
+void state_color_mask(GLboolean write);
+
+/**
+ * @brief Cached glBlendFunc
+ *
+ * @param[in] src The source factor
+ * @param[in] dst The destination factor
+ */
+void state_blend_func(GLenum src, GLenum dst);
+
+/**
+ * @brief Cached glViewport
+ *
+ * @param[in] x The left edge in pixels
+ * @param[in] y The bottom edge in pixels
+ * @param[in] width The width in pixels
+ * @param[in] height The height in pixels
+ */
+void state_viewport(int x, int y, int width, int height);
+
+/**
+ * @brief Deletes a texture and forgets any bindings to it
+ *
+ * @param[in] texture The texture object
+ */
+void state_delete_texture(unsigned int texture);
+
+/**
+ * @brief Deletes a buffer and forgets any bindings to it
+ *
+ * @param[in] buffer The buffer object
+ */
+void state_delete_buffer(unsigned int buffer);
+
+/**
+ * @brief Deletes a vertex array and forgets it if it is bound
+ *
+ * @param[in] vao The vertex array object
+ */
+void state_delete_vertex_array(unsigned int vao);
+
+/**
+ * @brief Deletes a shader program and forgets it if it is in use
+ *
+ * @param[in] program The shader program
+ */
+void state_delete_program(unsigned int program);
+
+#endif
+/* EOF */
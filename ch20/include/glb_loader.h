@@ -0,0 +1,106 @@
+#ifndef GLB_LOADER_H
+#define GLB_LOADER_H
+
+#include <stdbool.h>
+
+#include "../include/mesh.h"
+
+#include <cglm/cglm.h>
+
+/*
+ * A binary glTF 2.0 (.glb) importer. The file is mapped and each primitive's
+ * vertex attributes are uploaded straight from the BIN chunk, with the
+ * accessor's own stride, offset and component type, whenever the GL can read
+ * them as they are. Only primitives that cannot be, such as sparse accessors,
+ * misaligned data or byte indices, are converted, into the vertex struct for
+ * create_mesh. Converted vertices are welded first
+ *
+ * Supported: triangle primitives with POSITION, NORMAL and TEXCOORD_0, the
+ * default scene's node hierarchy and material indices. Buffers outside the
+ * BIN chunk, images, skins and animations are not
+ */
+
+#define GLB_MAGIC 0x46546c67u
+#define GLB_CHUNK_JSON 0x4e4f534au
+#define GLB_CHUNK_BIN 0x004e4942u
+
+/* Deeper JSON is rejected rather than risk the stack */
+#define GLB_MAX_JSON_DEPTH 64
+
+typedef struct glb_primitive glb_primitive;
+typedef struct glb_mesh glb_mesh;
+typedef struct glb_node glb_node;
+typedef struct glb_model glb_model;
+
+struct glb_primitive
+{
+    mesh *mesh;
+
+    /* Index into the file's materials, or -1 */
+    int material;
+};
+
+/* A glTF mesh, a run of primitives drawn with the same transform */
+struct glb_mesh
+{
+    unsigned int first_primitive;
+    unsigned int num_primitives;
+};
+
+struct glb_node
+{
+    /* Index into the nodes, -1 for roots. Parents come before children */
+    int parent;
+
+    /* Index into the meshes, or -1 */
+    int mesh;
+
+    mat4 local;
+    mat4 world;
+};
+
+struct glb_model
+{
+    /* stb_ds arrays */
+    glb_primitive *primitives;
+    glb_mesh *meshes;
+    glb_node *nodes;
+
+    /* How many primitives had to be converted before uploading */
+    unsigned int num_converted;
+};
+
+/**
+ * @brief Loads a .glb file, creating a mesh for every triangle primitive
+ *
+ * @param[out] model The model to fill
+ * @param[in] path The path to the file
+ *
+ * @note Primitives that are not triangles are skipped. Vertices without a
+ * normal or texture coordinates leave those attributes disabled
+ *
+ * @return Whether the file was loaded. Errors are printed, and a failed load
+ * deletes any meshes it made
+ */
+bool load_glb(glb_model *model, const char *path);
+
+/**
+ * @brief Recomputes the world transforms of a model's nodes from their local
+ * ones
+ *
+ * @param[in, out] model The model
+ * @param[in] root The transform of the whole model
+ */
+void update_glb_transforms(glb_model *model, mat4 root);
+
+/**
+ * @brief Frees the arrays of a model
+ *
+ * @param[in, out] model The model
+ *
+ * @note The meshes are kept, they belong to whoever draws them
+ */
+void free_glb(glb_model *model);
+
+#endif
+/* EOF */
@@ -0,0 +1,68 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/*
+ * The number of queries each timer cycles through. Results are read back this
+ * many frames after they were issued so that reading them never stalls the
+ * pipeline
+ */
+#define GPU_TIMER_LATENCY 3
+
+typedef struct gpu_timer gpu_timer;
+
+struct gpu_timer
+{
+    unsigned int queries[GPU_TIMER_LATENCY];
+    bool pending[GPU_TIMER_LATENCY];
+    unsigned int current;
+
+    double total_ms;
+    unsigned int num_samples;
+};
+
+/**
+ * @brief Creates the GL_TIME_ELAPSED queries used by the timer
+ *
+ * @param[in, out] timer The timer to initialize
+ */
+void create_gpu_timer(gpu_timer *timer);
+
+/**
+ * @brief Starts timing the GPU work issued after this call
+ *
+ * @param[in, out] timer The timer to start
+ *
+ * @note Only one timer can be running at a time since GL only allows a single
+ * active GL_TIME_ELAPSED query
+ */
+void begin_gpu_timer(gpu_timer *timer);
+
+/**
+ * @brief Stops timing the GPU work issued since begin_gpu_timer
+ *
+ * @param[in, out] timer The timer to stop
+ */
+void end_gpu_timer(gpu_timer *timer);
+
+/**
+ * @brief Gets the average GPU time of the samples collected since the last
+ * call, then starts a new averaging window
+ *
+ * @param[in, out] timer The timer to read
+ *
+ * @return The average time in milliseconds, or 0 if no samples were collected
+ */
+double average_gpu_timer(gpu_timer *timer);
+
+/**
+ * @brief Deletes the timer's queries
+ *
+ * @param[in, out] timer The timer to delete
+ */
+void delete_gpu_timer(gpu_timer *timer);
+
+#endif
+/* EOF */
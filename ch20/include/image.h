@@ -0,0 +1,114 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Image file loading. stb_image decodes everything by default. Building with
+ * -DIMAGE_TURBOJPEG or -DIMAGE_SPNG (and linking -lturbojpeg or -lspng) hands
+ * JPEG or PNG files to those faster decoders instead
+ *
+ * The pixel conversions use AVX2, SSSE3 or SSE2 when the compiler targets
+ * them, for example with -march=native, and plain C otherwise
+ */
+
+/* Flips the rows so the first row is the bottom of the image, as GL expects */
+#define IMAGE_FLIP 0x1
+
+/* Multiplies the color channels of 4-channel images by their alpha */
+#define IMAGE_PREMULTIPLY 0x2
+
+typedef struct image image;
+
+/* A decoded image with tightly packed 8-bit channels */
+struct image
+{
+    unsigned char *pixels;
+    int width;
+    int height;
+    int num_channels;
+};
+
+/**
+ * @brief Decodes an image file, keeping the channels it was stored with
+ *
+ * @param[out] img The image to fill
+ * @param[in] path The path to the file
+ * @param[in] flags IMAGE_FLIP and IMAGE_PREMULTIPLY, or 0
+ *
+ * @note Safe to call from several threads at once
+ *
+ * @return Whether the file was decoded. On failure img->pixels is NULL
+ */
+bool load_image(image *img, const char *path, unsigned int flags);
+
+/**
+ * @brief Frees the pixels of a loaded image
+ *
+ * @param[in, out] img The image
+ */
+void free_image(image *img);
+
+/**
+ * @brief Gets the name of the decoder load_image uses for a file
+ *
+ * @param[in] path The path to the file, only the extension is looked at
+ *
+ * @return The name of the decoder
+ */
+const char *image_decoder_name(const char *path);
+
+/**
+ * @brief Gets the GL formats matching a number of channels
+ *
+ * @param[in] num_channels 1, 2, 3 or 4
+ * @param[out] internal_format The sized internal format to allocate
+ * @param[out] format The format of the pixel data
+ */
+void get_image_formats(int num_channels, int *internal_format,
+                       unsigned int *format);
+
+/**
+ * @brief Expands pixels to RGBA
+ *
+ * @param[out] dst The 4 * count byte RGBA pixels
+ * @param[in] src The pixels to expand, may not overlap dst
+ * @param[in] num_channels 1, 2, 3 or 4
+ * @param[in] count The number of pixels
+ *
+ * @note Missing channels read like GL fills them in: 0 for color, 255 alpha
+ */
+void convert_to_rgba(unsigned char *restrict dst,
+                     const unsigned char *restrict src, int num_channels,
+                     size_t count);
+
+/**
+ * @brief Swaps the red and blue channels of RGBA pixels, turning them into
+ * BGRA and back
+ *
+ * @param[in, out] pixels The pixels
+ * @param[in] count The number of pixels
+ */
+void swap_red_blue(unsigned char *pixels, size_t count);
+
+/**
+ * @brief Multiplies the color channels of RGBA pixels by their alpha
+ *
+ * @param[in, out] pixels The pixels
+ * @param[in] count The number of pixels
+ */
+void premultiply_alpha(unsigned char *pixels, size_t count);
+
+/**
+ * @brief The plain C versions of the conversions, for checking and timing the
+ * vector ones against
+ */
+void convert_to_rgba_scalar(unsigned char *restrict dst,
+                            const unsigned char *restrict src,
+                            int num_channels, size_t count);
+void swap_red_blue_scalar(unsigned char *pixels, size_t count);
+void premultiply_alpha_scalar(unsigned char *pixels, size_t count);
+
+#endif
+/* EOF */
@@ -0,0 +1,118 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stddef.h>
+
+/*
+ * A work-stealing job scheduler. Every thread owns a deque of jobs that it
+ * pushes to and pops from, and idle threads steal from the other end of
+ * someone else's. The thread that started the workers is thread 0 and runs
+ * jobs too whenever it waits on one
+ */
+
+/* The most bytes of data that can be copied into a job */
+#define JOB_DATA_SIZE 40
+
+/*
+ * How many jobs each thread can create before their memory gets reused. Jobs
+ * must be finished by then
+ */
+#define MAX_JOBS_PER_THREAD 4096
+
+typedef struct job job;
+
+/**
+ * @brief The function a job runs
+ *
+ * @param[in, out] j The job itself, may be used as a parent for new jobs
+ * @param[in] data The copy of the data the job was created with
+ */
+typedef void (*job_fn)(job *j, const void *data);
+
+/**
+ * @brief Starts the worker threads
+ *
+ * @param[in] count The number of threads to start besides the calling thread.
+ * 0 runs every job on the calling thread
+ */
+void start_job_system(unsigned int count);
+
+/**
+ * @brief Stops and joins the worker threads
+ *
+ * @note Every job must be finished before stopping
+ */
+void stop_job_system(void);
+
+/**
+ * @brief Gets how many threads run jobs
+ *
+ * @return The number of workers plus the calling thread
+ */
+unsigned int num_job_threads(void);
+
+/**
+ * @brief Creates a job without running it
+ *
+ * @param[in] fn The function to run, may be NULL for a job that only groups
+ * its children
+ * @param[in] data The data handed to fn, copied into the job
+ * @param[in] size The size of data, at most JOB_DATA_SIZE
+ *
+ * @return The job. It is owned by the job system
+ */
+job *create_job(job_fn fn, const void *data, size_t size);
+
+/**
+ * @brief Creates a job that its parent waits on
+ *
+ * @param[in, out] parent The job that is only finished once this one is
+ * @param[in] fn The function to run, may be NULL
+ * @param[in] data The data handed to fn, copied into the job
+ * @param[in] size The size of data, at most JOB_DATA_SIZE
+ *
+ * @note The parent must not have finished yet, so children are created either
+ * before running the parent or from inside it
+ *
+ * @return The job. It is owned by the job system
+ */
+job *create_child_job(job *parent, job_fn fn, const void *data, size_t size);
+
+/**
+ * @brief Queues a job on the calling thread's deque
+ *
+ * @param[in, out] j The job to run
+ */
+void run_job(job *j);
+
+/**
+ * @brief Runs other jobs until a job and all of its children are finished
+ *
+ * @param[in, out] j The job to wait on
+ */
+void wait_job(job *j);
+
+/**
+ * @brief Creates and queues one child job per task
+ *
+ * @param[in, out] parent The job that waits on the tasks
+ * @param[in] num_tasks The number of tasks
+ * @param[in] fn The function to run for each task
+ * @param[in, out] data Passed through to fn, not copied
+ */
+void run_job_tasks(job *parent, unsigned int num_tasks,
+                   void (*fn)(unsigned int task, void *data), void *data);
+
+/**
+ * @brief Runs a function once per task as jobs and returns once every task is
+ * finished
+ *
+ * @param[in] num_tasks The number of tasks
+ * @param[in] fn The function to run for each task
+ * @param[in, out] data Passed through to fn
+ */
+void parallel_for(unsigned int num_tasks,
+                  void (*fn)(unsigned int task, void *data), void *data);
+
+#endif
+/* EOF */
@@ -0,0 +1,148 @@
+#ifndef MEM_TRACKER_H
+#define MEM_TRACKER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Live and high-water bytes of CPU and GPU memory, by category
+ *
+ * Heap memory is counted as it is allocated, in builds with
+ * MEMORY_TRACKING. Those link with --wrap for malloc, calloc, realloc,
+ * aligned_alloc and free, so every call from this program's own code passes
+ * through here and is charged to the calling thread's current category.
+ * Jobs run under the category of the thread that created them. Memory
+ * allocated inside libraries is not seen. A block keeps the category it was
+ * allocated under, even if it is freed or grown from another thread. Other
+ * builds leave the heap calls alone and count GPU memory only
+ *
+ * GPU memory is counted per buffer and texture object. Code that sizes one
+ * reports it with track_gpu_buffer or track_gpu_texture, and the object is
+ * dropped from the count when it is deleted through gl_state
+ */
+
+/* The allocation check counts heap calls, which only a tracking build sees */
+#if defined(MEMORY_DEBUG) && !defined(MEMORY_TRACKING)
+#error "MEMORY_DEBUG needs MEMORY_TRACKING and its --wrap link flags"
+#endif
+
+typedef enum memory_category memory_category;
+typedef struct memory_usage memory_usage;
+
+enum memory_category
+{
+    MEMORY_OTHER,
+    MEMORY_MESH,
+    MEMORY_TEXTURE,
+    MEMORY_SHADER,
+    MEMORY_SCRATCH,
+    MEMORY_CATEGORY_COUNT
+};
+
+struct memory_usage
+{
+    /* In bytes */
+    size_t cpu_live;
+    size_t cpu_high_water;
+    size_t gpu_live;
+    size_t gpu_high_water;
+
+    /* Heap blocks still allocated */
+    size_t cpu_blocks;
+};
+
+/**
+ * @brief Sets the category the calling thread's heap allocations are
+ * charged to
+ *
+ * @param[in] category The category
+ *
+ * @return The category it replaces, to put back afterwards
+ */
+memory_category set_memory_category(memory_category category);
+
+/**
+ * @brief Gets the category the calling thread's heap allocations are
+ * charged to
+ *
+ * @return The category
+ */
+memory_category get_memory_category(void);
+
+/**
+ * @brief Sets the size of a buffer object's storage
+ *
+ * @param[in] buffer The buffer name
+ * @param[in] category What the buffer holds
+ * @param[in] size The size in bytes, replacing any earlier one
+ */
+void track_gpu_buffer(unsigned int buffer, memory_category category,
+                      size_t size);
+
+/**
+ * @brief Sets the size of a texture object's storage
+ *
+ * @param[in] texture The texture name
+ * @param[in] category What the texture holds
+ * @param[in] size The size in bytes of every level and layer, replacing any
+ * earlier one
+ */
+void track_gpu_texture(unsigned int texture, memory_category category,
+                       size_t size);
+
+/**
+ * @brief Drops a deleted buffer object from the count
+ *
+ * @param[in] buffer The buffer name
+ *
+ * @note Called by state_delete_buffer
+ */
+void untrack_gpu_buffer(unsigned int buffer);
+
+/**
+ * @brief Drops a deleted texture object from the count
+ *
+ * @param[in] texture The texture name
+ *
+ * @note Called by state_delete_texture
+ */
+void untrack_gpu_texture(unsigned int texture);
+
+/**
+ * @brief Gets the memory use of a category
+ *
+ * @param[in] category The category
+ *
+ * @return Its usage so far
+ */
+memory_usage get_memory_usage(memory_category category);
+
+/**
+ * @brief Gets the name of a category
+ *
+ * @param[in] category The category
+ *
+ * @return The name, such as "mesh"
+ */
+const char *memory_category_name(memory_category category);
+
+/**
+ * @brief Writes one line of live and high-water usage for every category
+ *
+ * @param[in] fp Where to write it
+ */
+void log_memory_usage(FILE *fp);
+
+/**
+ * @brief Counts the heap allocations the calling thread has made so far
+ *
+ * @note Only calls from this program's objects are seen, not ones made
+ * inside libraries. Calls on other threads, jobs included, are not counted.
+ * Always 0 without MEMORY_TRACKING
+ *
+ * @return The number of malloc, calloc, realloc and aligned_alloc calls
+ */
+unsigned long heap_allocations(void);
+
+#endif
+/* EOF */
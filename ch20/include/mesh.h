@@ -1,19 +1,41 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stddef.h>
+
+#include "../include/render_queue.h"
 #include "../include/shader.h"
 
 #include <cglm/cglm.h>
 
+/* The full mesh and up to three simplified versions of it */
+#define MESH_MAX_LODS 4
+
+/* Only switch to a coarser LOD once its error is this far under the limit */
+#define LOD_HYSTERESIS 0.8f
+
 typedef struct vertex vertex;
+typedef struct vertex_attribute vertex_attribute;
 typedef struct texture texture;
+typedef struct mesh_lod mesh_lod;
 typedef struct mesh mesh;
 
 struct vertex
 {
     vec3 position;
     vec3 normal;
-    vec3 tex_coords;
+    vec2 tex_coords;
+};
+
+/* Where an attribute lives in a vertex buffer, for glVertexAttribPointer */
+struct vertex_attribute
+{
+    unsigned int location;
+    unsigned int components;
+    unsigned int type;
+    unsigned int normalized;
+    unsigned int stride;
+    size_t offset;
 };
 
 struct texture
@@ -22,12 +44,34 @@ struct texture
     const char *type;
 };
 
+/* One level of detail, a range of the mesh's indices */
+struct mesh_lod
+{
+    unsigned int first_index;
+    unsigned int count;
+
+    /* How far the surface moved from the full mesh, in model units */
+    float error;
+};
+
 struct mesh
 {
+    /* NULL for meshes loaded from a file, the GL holds the only copy */
     vertex *vertices;
     unsigned int *indices;
     texture *textures;
 
+    /* GL_UNSIGNED_INT, or GL_UNSIGNED_SHORT for some loaded meshes */
+    unsigned int num_indices;
+    unsigned int index_type;
+
+    /* Finest first, the first one always covers num_indices from index 0 */
+    mesh_lod lods[MESH_MAX_LODS];
+    unsigned int num_lods;
+
+    /* The textures in unit order, for submitting through a render queue */
+    material material;
+
     unsigned int vao;
     unsigned int vbo;
     unsigned int ebo;
@@ -48,6 +92,70 @@ struct mesh
  */
 mesh *create_mesh(vertex *vertices, unsigned int *indices, texture *textures);
 
+/**
+ * @brief Creates a mesh whose index array holds a LOD chain
+ *
+ * @param[in] vertices The mesh's vertices
+ * @param[in] indices Every LOD's indices, as build_lod_chain leaves them
+ * @param[in] textures The mesh's textures
+ * @param[in] lods The ranges of the LODs, finest first
+ * @param[in] num_lods The number of LODs, at most MESH_MAX_LODS
+ *
+ * @return A pointer to the newly created mesh object
+ */
+mesh *create_lod_mesh(vertex *vertices, unsigned int *indices,
+                      texture *textures, const mesh_lod *lods,
+                      unsigned int num_lods);
+
+/**
+ * @brief Creates a mesh from vertex and index data in any layout the GL can
+ * read directly
+ *
+ * @param[in] vertex_data The vertex buffer contents
+ * @param[in] vertex_size The size of vertex_data in bytes
+ * @param[in] attributes The attributes, their offsets relative to
+ * vertex_data
+ * @param[in] num_attributes The number of attributes
+ * @param[in] index_data The indices
+ * @param[in] num_indices The number of indices
+ * @param[in] index_type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+ * @param[in] textures The mesh's textures, an stb_ds array or NULL
+ *
+ * @note Nothing is kept, the data can come from a mapping that is closed
+ * right after
+ *
+ * @return A pointer to the newly created mesh object
+ */
+mesh *create_mesh_from_buffers(const void *vertex_data, size_t vertex_size,
+                               const vertex_attribute *attributes,
+                               unsigned int num_attributes,
+                               const void *index_data, size_t num_indices,
+                               unsigned int index_type, texture *textures);
+
+/**
+ * @brief Creates a mesh from a mesh file
+ *
+ * @param[in] path The path to the mesh file
+ * @param[in] textures The mesh's textures, an stb_ds array or NULL
+ *
+ * @note The file is mapped and its sections go straight to glBufferData, so
+ * the only work is reading the file. Submeshes are drawn as one, open the
+ * file with open_mesh_file to get at them and the material names
+ *
+ * @return A pointer to the newly created mesh object, or NULL if the file
+ * could not be read
+ */
+mesh *load_mesh(const char *path, texture *textures);
+
+/**
+ * @brief Deletes a mesh's GL objects and returns it to the mesh records
+ *
+ * @param[in] mesh The mesh, or NULL
+ *
+ * @note The arrays given to create_mesh still belong to the caller
+ */
+void delete_mesh(mesh *mesh);
+
 /**
  * @brief Draws the mesh
  *
@@ -56,6 +164,62 @@ mesh *create_mesh(vertex *vertices, unsigned int *indices, texture *textures);
  */
 void draw_mesh(mesh *mesh, shader *shader);
 
+/**
+ * @brief Draws one LOD of the mesh
+ *
+ * @param[in] mesh The mesh to draw
+ * @param[in] shader The shader this mesh uses
+ * @param[in] lod The LOD, from select_mesh_lod
+ */
+void draw_mesh_lod(mesh *mesh, shader *shader, unsigned int lod);
+
+/**
+ * @brief Picks the coarsest LOD whose error stays under a limit on screen
+ *
+ * @param[in] mesh The mesh
+ * @param[in] distance The distance from the camera to the mesh, in model
+ * units
+ * @param[in] pixels_per_unit How many pixels a unit covers at distance 1,
+ * the viewport height / (2 * tan(fov_y / 2))
+ * @param[in] max_error The most error allowed, in pixels
+ * @param[in] previous The LOD picked for this instance last frame
+ *
+ * @note Finer LODs are picked as soon as they are needed, coarser ones only
+ * once they are under LOD_HYSTERESIS of the limit, so an instance sitting at
+ * a switching distance does not pop back and forth
+ *
+ * @return The LOD
+ */
+unsigned int select_mesh_lod(const mesh *mesh, float distance,
+                             float pixels_per_unit, float max_error,
+                             unsigned int previous);
+
+/**
+ * @brief Points the shader's material samplers at the units the mesh's
+ * textures are bound to
+ *
+ * @param[in] mesh The mesh whose texture types name the samplers
+ * @param[in] shader The shader this mesh uses
+ *
+ * @note draw_mesh does this every time. Meshes submitted to a render queue
+ * only need it once after the shader is created
+ */
+void set_mesh_samplers(mesh *mesh, shader *shader);
+
+/**
+ * @brief Queues the mesh to be drawn when the render queue is flushed
+ *
+ * @param[in, out] rq The render queue
+ * @param[in] mesh The mesh to draw
+ * @param[in] program The program this mesh uses
+ * @param[in] pass The render_pass to draw the mesh in
+ * @param[in] model The model matrix
+ * @param[in] depth The mesh's view depth normalized to [0, 1]
+ * @param[in] lod The LOD to draw, 0 for the full mesh
+ */
+void submit_mesh(render_queue *rq, mesh *mesh, const program_info *program,
+                 unsigned int pass, mat4 model, float depth, unsigned int lod);
+
 /**
  * @brief Initializes the buffer objects (vao, vbo, ebo)
  *
@@ -0,0 +1,161 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/mesh.h"
+
+/*
+ * A binary mesh format that needs no parsing. The file is a header followed
+ * by the vertex data, the index data, the submeshes and the material names,
+ * each section starting on a MESH_FILE_ALIGNMENT boundary. Loading maps the
+ * file and hands the sections straight to the GL
+ *
+ * Numbers are stored in the byte order of the machine that wrote the file,
+ * the header's byte_order field lets readers reject foreign files
+ */
+
+#define MESH_FILE_MAGIC "MESH"
+
+/* Bumped whenever the layout changes, older files are rejected */
+#define MESH_FILE_VERSION 1
+
+/* Sections start on this boundary, enough for any vertex attribute type */
+#define MESH_FILE_ALIGNMENT 64
+
+#define MESH_FILE_MAX_ATTRIBUTES 8
+
+/* The longest material name, including the terminator */
+#define MESH_FILE_NAME_SIZE 64
+
+/* Written as a native uint32_t, reads back differently on the other order */
+#define MESH_FILE_BYTE_ORDER 0x01020304u
+
+typedef struct mesh_file_attribute mesh_file_attribute;
+typedef struct mesh_file_header mesh_file_header;
+typedef struct mesh_file_submesh mesh_file_submesh;
+typedef struct mesh_file_material mesh_file_material;
+typedef struct mesh_file mesh_file;
+
+/* One vertex attribute, as it is handed to glVertexAttribPointer */
+struct mesh_file_attribute
+{
+    uint32_t location;
+    uint32_t components;
+    uint32_t type;
+    uint32_t normalized;
+    uint32_t offset;
+};
+
+struct mesh_file_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+
+    /* The vertex format */
+    uint32_t vertex_stride;
+    uint32_t num_attributes;
+    mesh_file_attribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+
+    /* GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+    uint32_t index_type;
+
+    uint32_t num_submeshes;
+    uint32_t num_materials;
+
+    uint64_t num_vertices;
+    uint64_t num_indices;
+
+    /* Byte offsets of the sections from the start of the file */
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t material_offset;
+
+    /* The bounds of the whole mesh */
+    float aabb_min[3];
+    float aabb_max[3];
+};
+
+/* A range of indices drawn with one material */
+struct mesh_file_submesh
+{
+    uint32_t first_index;
+    uint32_t count;
+    int32_t base_vertex;
+
+    /* Index into the material names, or ~0 for none */
+    uint32_t material;
+
+    float aabb_min[3];
+    float aabb_max[3];
+};
+
+/* A reference to a material by name, resolved by whoever loads the mesh */
+struct mesh_file_material
+{
+    char name[MESH_FILE_NAME_SIZE];
+};
+
+/* An open mesh file. The pointers point into the mapping */
+struct mesh_file
+{
+    void *mapping;
+    size_t size;
+
+    const mesh_file_header *header;
+    const void *vertices;
+    const void *indices;
+    const mesh_file_submesh *submeshes;
+    const mesh_file_material *materials;
+};
+
+/**
+ * @brief Maps a mesh file and checks that its sections are in bounds
+ *
+ * @param[out] mf The mesh file to fill
+ * @param[in] path The path to the file
+ *
+ * @return Whether the file is a valid mesh file of this version
+ */
+bool open_mesh_file(mesh_file *mf, const char *path);
+
+/**
+ * @brief Unmaps a mesh file
+ *
+ * @param[in, out] mf The mesh file
+ *
+ * @note Every pointer into the file becomes invalid
+ */
+void close_mesh_file(mesh_file *mf);
+
+/**
+ * @brief Writes vertices in the vertex struct layout to a mesh file
+ *
+ * @param[in] path The path to the file
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The indices
+ * @param[in] num_indices The number of indices
+ * @param[in] submeshes The submeshes. Their bounds are computed here, so
+ * only the ranges and materials need to be filled in. NULL writes a single
+ * submesh covering every index
+ * @param[in] num_submeshes The number of submeshes
+ * @param[in] materials The material names
+ * @param[in] num_materials The number of material names
+ *
+ * @note Meshes of at most 65536 vertices are written with 16-bit indices
+ *
+ * @return Whether the file was written
+ */
+bool write_mesh_file(const char *path, const vertex *vertices,
+                     size_t num_vertices, const unsigned int *indices,
+                     size_t num_indices, const mesh_file_submesh *submeshes,
+                     size_t num_submeshes, const char *const *materials,
+                     size_t num_materials);
+
+#endif
+/* EOF */
@@ -0,0 +1,75 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <stddef.h>
+
+#include "../include/mesh.h"
+
+/*
+ * One vertex and one index buffer shared by many meshes behind a single
+ * vertex array, so that draws of different meshes need no state changes in
+ * between and can be merged into multi-draws
+ */
+
+typedef struct pool_mesh pool_mesh;
+typedef struct mesh_pool mesh_pool;
+
+/* Where a mesh lives inside the pool's buffers */
+struct pool_mesh
+{
+    unsigned int first_index;
+    unsigned int count;
+    int base_vertex;
+};
+
+struct mesh_pool
+{
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ebo;
+
+    size_t max_vertices;
+    size_t max_indices;
+
+    size_t num_vertices;
+    size_t num_indices;
+};
+
+/**
+ * @brief Creates an empty mesh pool with room for a fixed amount of geometry
+ *
+ * @param[out] pool The pool to initialize
+ * @param[in] max_vertices The number of vertices the pool can hold
+ * @param[in] max_indices The number of indices the pool can hold
+ */
+void create_mesh_pool(mesh_pool *pool, size_t max_vertices,
+                      size_t max_indices);
+
+/**
+ * @brief Copies a mesh's geometry into the pool
+ *
+ * @param[in, out] pool The mesh pool
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The indices, relative to the first of the vertices
+ * @param[in] num_indices The number of indices
+ *
+ * @note Exits if the pool is full
+ *
+ * @return Where the mesh was placed
+ */
+pool_mesh add_pool_mesh(mesh_pool *pool, const vertex *vertices,
+                        size_t num_vertices, const unsigned int *indices,
+                        size_t num_indices);
+
+/**
+ * @brief Frees the buffers and vertex array of the pool
+ *
+ * @param[in, out] pool The mesh pool
+ *
+ * @note The pool_mesh ranges become invalid
+ */
+void delete_mesh_pool(mesh_pool *pool);
+
+#endif
+/* EOF */
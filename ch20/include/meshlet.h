@@ -0,0 +1,110 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stddef.h>
+
+#include "../include/mesh.h"
+#include "../include/mesh_pool.h"
+#include "../include/multi_draw.h"
+
+#include <cglm/cglm.h>
+
+/*
+ * Meshlets split a large mesh into small clusters of nearby triangles, each
+ * with a bounding sphere and a cone around its triangles' normals. Whole
+ * clusters that are off screen or facing away from the camera are then
+ * dropped on the CPU before anything reaches the GL
+ *
+ * Building reorders the mesh's triangles so every meshlet is one contiguous
+ * range of the index buffer. Upload meshlet_mesh.indices in place of the
+ * original indices, the vertices are untouched
+ */
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct meshlet meshlet;
+typedef struct meshlet_mesh meshlet_mesh;
+typedef struct meshlet_stats meshlet_stats;
+
+struct meshlet
+{
+    /* The range of the reordered indices */
+    unsigned int first_index;
+    unsigned int num_triangles;
+    unsigned int num_vertices;
+
+    vec3 center;
+    float radius;
+
+    /*
+     * The meshlet faces away from any camera that sees its sphere within
+     * the cone. A cutoff of 1 or more means the normals are too spread out
+     * for the cone to ever cull
+     */
+    vec3 cone_axis;
+    float cone_cutoff;
+};
+
+struct meshlet_mesh
+{
+    /* stb_ds arrays */
+    meshlet *meshlets;
+    unsigned int *indices;
+};
+
+/* Counts of a culling pass, reset by the caller once per frame */
+struct meshlet_stats
+{
+    unsigned int meshlets;
+    unsigned int meshlets_drawn;
+    unsigned int triangles;
+    unsigned int triangles_frustum_culled;
+    unsigned int triangles_backface_culled;
+    unsigned int draws;
+};
+
+/**
+ * @brief Partitions a triangle list into meshlets of at most
+ * MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles
+ *
+ * @param[out] mm The meshlets and their reordered indices
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The triangle list
+ * @param[in] num_indices The number of indices
+ *
+ * @note Meant for import or cook time. Each meshlet grows from a seed
+ * triangle by taking the neighboring triangle that adds the fewest new
+ * vertices
+ */
+void build_meshlets(meshlet_mesh *mm, const vertex *vertices,
+                    size_t num_vertices, const unsigned int *indices,
+                    size_t num_indices);
+
+/**
+ * @brief Culls the meshlets of a mesh against the view frustum and their
+ * normal cones, queuing the survivors with adjacent ranges merged into one
+ * draw
+ *
+ * @param[in] mm The meshlets
+ * @param[in] placement Where the reordered mesh lives in its pool
+ * @param[in] model The model matrix, any affine transform
+ * @param[in] planes The world space frustum planes, from glm_frustum_planes
+ * @param[in] camera The world space camera position
+ * @param[in, out] md The draw list to queue the survivors on
+ * @param[in, out] stats The counts to add this pass to
+ */
+void cull_meshlets(const meshlet_mesh *mm, const pool_mesh *placement,
+                   mat4 model, vec4 planes[6], vec3 camera, multi_draw *md,
+                   meshlet_stats *stats);
+
+/**
+ * @brief Frees the arrays of a meshlet mesh
+ *
+ * @param[in, out] mm The meshlets
+ */
+void free_meshlets(meshlet_mesh *mm);
+
+#endif
+/* EOF */
@@ -0,0 +1,99 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/*
+ * Builds RGBA8 mip chains on the CPU instead of with glGenerateMipmap, which
+ * runs on the driver thread (on the CPU itself with software drivers) and
+ * averages sRGB colors as if they were linear. Each level is split into
+ * bands of rows that the job system filters in parallel, and finished chains
+ * can be cached on disk so later runs skip the filtering entirely
+ */
+
+/* Build the chain on the CPU and upload every level, not glGenerateMipmap */
+#define MIP_CPU 0x1
+
+/*
+ * The colors are sRGB, so average them in linear space. Implies MIP_CPU.
+ * Data such as specular maps is already linear and leaves it out
+ */
+#define MIP_SRGB 0x2
+
+/* Enough levels for 32768 texel textures */
+#define MIP_MAX_LEVELS 16
+
+/* Rows of a level filtered per job */
+#define MIP_BAND_ROWS 32
+
+typedef struct mip_chain mip_chain;
+
+struct mip_chain
+{
+    int width;
+    int height;
+    int layers;
+
+    /* The pixels of every level, with the layers one after another */
+    unsigned char *levels[MIP_MAX_LEVELS];
+    int num_levels;
+};
+
+/**
+ * @brief Sets the directory finished mip chains are cached in
+ *
+ * @param[in] dir The directory, created when first written to. NULL turns
+ * the cache off, which is the default
+ *
+ * @note Call before building any chains, the path is not copied
+ */
+void set_mip_cache_dir(const char *dir);
+
+/**
+ * @brief Builds the full mip chain of an RGBA8 image, or reads it from the
+ * cache if this image was built before
+ *
+ * @param[out] chain The mip chain to fill
+ * @param[in] pixels The level 0 pixels, allocated with malloc. The chain
+ * takes them over
+ * @param[in] width The width of level 0
+ * @param[in] height The height of level 0
+ * @param[in] layers The number of layers, filtered separately
+ * @param[in] layer_flags The flags of each layer: MIP_SRGB, or 0 to average
+ * the bytes as they are
+ *
+ * @note Runs the filtering as jobs, so the job system must be started.
+ * Alpha is always averaged as it is
+ */
+void create_mip_chain(mip_chain *chain, unsigned char *pixels, int width,
+                      int height, int layers,
+                      const unsigned int *layer_flags);
+
+/**
+ * @brief Uploads every level of a chain to the bound texture
+ *
+ * @param[in] chain The mip chain
+ * @param[in] target GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+ */
+void upload_mip_chain(const mip_chain *chain, GLenum target);
+
+/**
+ * @brief Frees the levels of a chain
+ *
+ * @param[in, out] chain The mip chain
+ */
+void delete_mip_chain(mip_chain *chain);
+
+/**
+ * @brief Gets the size of a level
+ *
+ * @param[in] size The size of level 0
+ * @param[in] level The level
+ *
+ * @return The size, at least 1
+ */
+int mip_level_size(int size, int level);
+
+#endif
+/* EOF */
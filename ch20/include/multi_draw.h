@@ -0,0 +1,103 @@
+#ifndef MULTI_DRAW_H
+#define MULTI_DRAW_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#include "../include/mesh_pool.h"
+
+/*
+ * A list of draws of pool meshes that goes out in as few calls as possible.
+ * With ARB_multi_draw_indirect the whole list is one
+ * glMultiDrawElementsIndirect. On plain GL 3.3 the single-instance draws are
+ * merged into one glMultiDrawElementsBaseVertex and the rest are drawn one by
+ * one. GL 3.3 has no base instance, so on that path every draw reads its
+ * instanced attributes from the start of the bound instance data
+ */
+
+typedef struct draw_indirect_command draw_indirect_command;
+typedef struct multi_draw multi_draw;
+
+/* The DrawElementsIndirectCommand layout the GL reads */
+struct draw_indirect_command
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+struct multi_draw
+{
+    /* stb_ds array of the queued draws */
+    draw_indirect_command *commands;
+
+    /* The indirect buffer, 0 when falling back */
+    unsigned int buffer;
+    size_t buffer_size;
+
+    /* The merged single-instance draws of the fallback, stb_ds arrays */
+    GLsizei *counts;
+    const void **offsets;
+    GLint *base_vertices;
+};
+
+/**
+ * @brief Creates an empty draw list
+ *
+ * @param[out] md The draw list to initialize
+ *
+ * @note Must be called after load_gl_extensions
+ */
+void create_multi_draw(multi_draw *md);
+
+/**
+ * @brief Empties the list while keeping its memory
+ *
+ * @param[in, out] md The draw list
+ */
+void reset_multi_draw(multi_draw *md);
+
+/**
+ * @brief Queues a draw of a pool mesh
+ *
+ * @param[in, out] md The draw list
+ * @param[in] mesh Where the mesh lives in its pool
+ * @param[in] instance_count The number of instances, usually 1
+ * @param[in] base_instance The first instance of the instanced attributes
+ */
+void push_multi_draw(multi_draw *md, const pool_mesh *mesh,
+                     unsigned int instance_count, unsigned int base_instance);
+
+/**
+ * @brief Hands the queued draws to the GL
+ *
+ * @param[in, out] md The draw list
+ *
+ * @note Call once after the last push and before drawing, from the thread
+ * that owns the GL context
+ */
+void upload_multi_draw(multi_draw *md);
+
+/**
+ * @brief Issues every uploaded draw
+ *
+ * @param[in] md The draw list
+ * @param[in] mode The primitive type
+ *
+ * @note The pool's vertex array must be bound
+ *
+ * @return The number of GL draw calls it took
+ */
+unsigned int draw_multi_draw(const multi_draw *md, GLenum mode);
+
+/**
+ * @brief Frees the memory and indirect buffer used by the list
+ *
+ * @param[in, out] md The draw list
+ */
+void delete_multi_draw(multi_draw *md);
+
+#endif
+/* EOF */
@@ -0,0 +1,85 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <stdbool.h>
+
+#include "../include/mesh.h"
+#include "../include/mesh_file.h"
+
+/*
+ * A Wavefront OBJ and MTL importer. The OBJ file is mapped and cut at line
+ * boundaries into chunks that the job system parses in parallel. The chunks
+ * are then stitched together and every distinct v/vt/vn combination becomes
+ * one vertex, found through a hash table. Vertices that still come out
+ * identical are welded
+ *
+ * Supported: v, vt, vn, f (polygons are fanned into triangles, negative
+ * indices count back from the last element), usemtl and mtllib. Groups,
+ * objects and smoothing groups are skipped
+ */
+
+/* Chunks smaller than this are not worth a job of their own */
+#define OBJ_MIN_CHUNK_BYTES (256 << 10)
+
+/* The longest texture path kept from an MTL file, including the terminator */
+#define OBJ_PATH_SIZE 256
+
+typedef struct obj_material obj_material;
+typedef struct obj_model obj_model;
+
+/* The parts of an MTL material the renderer can use */
+struct obj_material
+{
+    char name[MESH_FILE_NAME_SIZE];
+
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+
+    /* Relative to the working directory, empty if the material has none */
+    char diffuse_map[OBJ_PATH_SIZE];
+    char specular_map[OBJ_PATH_SIZE];
+    char normal_map[OBJ_PATH_SIZE];
+};
+
+struct obj_model
+{
+    /* stb_ds arrays, ready for create_mesh */
+    vertex *vertices;
+    unsigned int *indices;
+
+    /*
+     * stb_ds array, one submesh per run of faces with the same material.
+     * Their bounds are not filled in
+     */
+    mesh_file_submesh *submeshes;
+
+    /* stb_ds array, indexed by the submesh materials */
+    obj_material *materials;
+};
+
+/**
+ * @brief Loads an OBJ file and the MTL files it references
+ *
+ * @param[out] model The model to fill
+ * @param[in] path The path to the OBJ file
+ *
+ * @note The job system must be started. Vertices without a vt or vn get
+ * zeros for them
+ *
+ * @return Whether the file was loaded. Errors are printed
+ */
+bool load_obj(obj_model *model, const char *path);
+
+/**
+ * @brief Frees the arrays of a model
+ *
+ * @param[in, out] model The model
+ *
+ * @note Leave vertices and indices out by setting them to NULL first when
+ * they were handed to create_mesh, which keeps them
+ */
+void free_obj(obj_model *model);
+
+#endif
+/* EOF */
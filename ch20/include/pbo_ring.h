@@ -0,0 +1,76 @@
+#ifndef PBO_RING_H
+#define PBO_RING_H
+
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+/* Uploads in flight before the oldest one has to be finished */
+#define PBO_RING_SIZE 4
+
+/*
+ * A ring of pixel unpack buffers for texture uploads. Pixels are written
+ * into mapped buffer memory and the glTexImage* calls read from the bound
+ * buffer, so they return at once and the copy to the texture happens on the
+ * GPU's schedule instead of inside the call. Each buffer is fenced after its
+ * upload and only reused once the GPU is done with it
+ */
+
+typedef struct pbo_ring pbo_ring;
+
+struct pbo_ring
+{
+    unsigned int buffers[PBO_RING_SIZE];
+    size_t sizes[PBO_RING_SIZE];
+    GLsync fences[PBO_RING_SIZE];
+
+    /* The buffer of the upload in progress, or the next one */
+    unsigned int slot;
+
+    /* Uploads that had to wait on the GPU for a free buffer */
+    unsigned long stalls;
+};
+
+/**
+ * @brief Creates the buffers. They get their storage on first use
+ *
+ * @param[out] ring The ring to initialize
+ */
+void create_pbo_ring(pbo_ring *ring);
+
+/**
+ * @brief Maps the next buffer for writing and binds it as the pixel unpack
+ * buffer
+ *
+ * @param[in, out] ring The ring
+ * @param[in] size The number of bytes to upload
+ *
+ * @return The mapped memory. Offsets into it are what the glTexImage* calls
+ * take as their pixel pointers
+ */
+unsigned char *begin_pixel_upload(pbo_ring *ring, size_t size);
+
+/**
+ * @brief Unmaps the buffer so the glTexImage* calls can read from it
+ *
+ * @param[in, out] ring The ring
+ */
+void end_pixel_upload(pbo_ring *ring);
+
+/**
+ * @brief Fences the buffer after the glTexImage* calls are issued, unbinds
+ * it and moves on to the next one
+ *
+ * @param[in, out] ring The ring
+ */
+void finish_pixel_upload(pbo_ring *ring);
+
+/**
+ * @brief Frees the buffers and fences
+ *
+ * @param[in, out] ring The ring
+ */
+void delete_pbo_ring(pbo_ring *ring);
+
+#endif
+/* EOF */
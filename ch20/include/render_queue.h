@@ -0,0 +1,268 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+
+#include "../include/cmd_buffer.h"
+#include "../include/shader.h"
+
+#include <cglm/cglm.h>
+
+/* The maximum number of texture units a material can use */
+#define MAX_MATERIAL_TEXTURES 4
+
+/*
+ * Sort key layout, from the most to the least significant bit:
+ * | pass (4) | program (8) | material (12) | vao (12) | depth (24) | unused (4) |
+ *
+ * Sorting by key groups draws by pass first, then by the most expensive state
+ * change, and finally front to back within identical state
+ */
+#define KEY_PASS_BITS 4
+#define KEY_PROGRAM_BITS 8
+#define KEY_MATERIAL_BITS 12
+#define KEY_VAO_BITS 12
+#define KEY_DEPTH_BITS 24
+
+#define KEY_DEPTH_SHIFT 4
+#define KEY_VAO_SHIFT (KEY_DEPTH_SHIFT + KEY_DEPTH_BITS)
+#define KEY_MATERIAL_SHIFT (KEY_VAO_SHIFT + KEY_VAO_BITS)
+#define KEY_PROGRAM_SHIFT (KEY_MATERIAL_SHIFT + KEY_MATERIAL_BITS)
+#define KEY_PASS_SHIFT (KEY_PROGRAM_SHIFT + KEY_PROGRAM_BITS)
+
+typedef enum render_pass render_pass;
+typedef struct program_info program_info;
+typedef struct material material;
+typedef struct draw_packet draw_packet;
+typedef struct sort_item sort_item;
+typedef struct render_stats render_stats;
+typedef struct render_queue render_queue;
+typedef struct multi_draw multi_draw;
+
+/* The passes in the order they are drawn */
+enum render_pass
+{
+    PASS_DEPTH,
+    PASS_OPAQUE,
+    PASS_EMISSIVE,
+    PASS_COUNT
+};
+
+/* A shader program and the locations of the per-draw uniforms it uses */
+struct program_info
+{
+    unsigned int id;
+
+    int model_loc;
+    int norm_loc;
+    int shininess_loc;
+};
+
+/* The textures and properties shared by every draw of a surface */
+struct material
+{
+    unsigned int id;
+
+    unsigned int textures[MAX_MATERIAL_TEXTURES];
+    unsigned int num_textures;
+
+    /* GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for texture_array materials */
+    unsigned int texture_target;
+
+    float shininess;
+};
+
+/* Everything needed to issue a single draw call */
+struct draw_packet
+{
+    uint64_t key;
+
+    const program_info *program;
+    const material *material;
+    unsigned int vao;
+    int count;
+
+    /* Where in the element array the draw starts, for meshes with LODs */
+    unsigned int first_index;
+
+    /* GL_UNSIGNED_SHORT or GL_UNSIGNED_INT. Zero is taken as GL_UNSIGNED_INT */
+    unsigned int index_type;
+
+    /*
+     * Non-zero draws that many instances from the per-instance attributes of
+     * the vao, and the model and normal matrices are not set
+     */
+    int instance_count;
+
+    /*
+     * If set, the packet issues this list of pool mesh draws instead, and
+     * count and instance_count are ignored
+     */
+    const multi_draw *multi;
+
+    CGLM_ALIGN_MAT mat4 model;
+    mat3 norm;
+};
+
+struct sort_item
+{
+    uint64_t key;
+    uint32_t index;
+};
+
+/* Counters for the most recently flushed frame */
+struct render_stats
+{
+    unsigned int draws;
+
+    unsigned int program_binds;
+    unsigned int program_skips;
+
+    unsigned int texture_binds;
+    unsigned int texture_skips;
+
+    unsigned int vao_binds;
+    unsigned int vao_skips;
+};
+
+struct render_queue
+{
+    draw_packet *packets;
+
+    sort_item *items;
+    sort_item *scratch;
+    sort_item *sorted;
+
+    /* One command buffer and set of counters per recording thread */
+    cmd_buffer *buffers;
+    render_stats *chunk_stats;
+    unsigned int num_chunks;
+
+    void (*begin_pass)(unsigned int pass, void *user);
+    void (*end_pass)(unsigned int pass, void *user);
+    void *user;
+
+    render_stats stats;
+};
+
+/**
+ * @brief Creates an empty render queue
+ *
+ * @param[in, out] rq The render queue to initialize
+ * @param[in] begin_pass Called before the first draw of each pass, may be NULL
+ * @param[in] end_pass Called after the last draw of each pass, may be NULL
+ * @param[in] user Passed through to the pass callbacks
+ */
+void create_render_queue(render_queue *rq,
+                         void (*begin_pass)(unsigned int pass, void *user),
+                         void (*end_pass)(unsigned int pass, void *user),
+                         void *user);
+
+/**
+ * @brief Looks up the per-draw uniforms of a shader program
+ *
+ * @param[out] info The program info to fill
+ * @param[in] sh The linked shader program
+ *
+ * @note Looks for "model", "norm" and "material.shininess".
+ * Missing uniforms get a location of -1 and are never set
+ */
+void init_program_info(program_info *info, const shader *sh);
+
+/**
+ * @brief Initializes a material and gives it a unique id for sort keys
+ *
+ * @param[out] mat The material to initialize
+ * @param[in] textures The texture ids, bound to units 0 through n - 1
+ * @param[in] num_textures The number of textures
+ * @param[in] shininess The specular exponent
+ *
+ * @note The textures are bound as GL_TEXTURE_2D unless texture_target is
+ * changed afterwards
+ */
+void init_material(material *mat, const unsigned int *textures,
+                   unsigned int num_textures, float shininess);
+
+/**
+ * @brief Packs draw state into a sort key
+ *
+ * @param[in] pass The render_pass the draw belongs to
+ * @param[in] program The shader program id
+ * @param[in] material The material id, 0 if the draw has no material
+ * @param[in] vao The vertex array object
+ * @param[in] depth The view depth normalized to [0, 1]
+ *
+ * @note Ids wider than their field are truncated. That only makes sorting
+ * less effective, the walk compares the actual state before skipping binds
+ *
+ * @return The sort key
+ */
+uint64_t make_render_key(unsigned int pass, unsigned int program,
+                         unsigned int material, unsigned int vao, float depth);
+
+/**
+ * @brief Adds a draw packet to the queue
+ *
+ * @param[in, out] rq The render queue
+ *
+ * @return The packet to fill in. It is only valid until the next push
+ */
+draw_packet *push_draw_packet(render_queue *rq);
+
+/**
+ * @brief Adds several zeroed draw packets to the queue at once
+ *
+ * @param[in, out] rq The render queue
+ * @param[in] count The number of packets
+ *
+ * @note Lets worker threads fill in disjoint ranges of packets without
+ * touching the queue itself
+ *
+ * @return The first of the contiguous packets. They are only valid until the
+ * next push or reserve
+ */
+draw_packet *reserve_draw_packets(render_queue *rq, size_t count);
+
+/**
+ * @brief Sorts the queued packets, issues them while skipping redundant state
+ * changes and empties the queue
+ *
+ * @param[in, out] rq The render queue
+ *
+ * @note Large queues are split into ranges that the worker threads record
+ * into command buffers, which are then replayed in order on this thread.
+ * Per-program uniforms such as the view and projection matrices must be set
+ * before flushing since they are not part of the packets
+ */
+void flush_render_queue(render_queue *rq);
+
+/**
+ * @brief Sorts the queued packets, records them into the command buffers
+ * while skipping redundant state changes and empties the queue. The first
+ * half of flush_render_queue
+ *
+ * @param[in, out] rq The render queue
+ *
+ * @note Touches no GL, so it can run without a context
+ */
+void record_render_queue(render_queue *rq);
+
+/**
+ * @brief Issues the commands of the last record_render_queue and adds up its
+ * counters. The second half of flush_render_queue
+ *
+ * @param[in, out] rq The render queue
+ *
+ * @note Must be called from the thread that owns the GL context
+ */
+void replay_render_queue(render_queue *rq);
+
+/**
+ * @brief Frees the memory used by the queue
+ *
+ * @param[in, out] rq The render queue
+ */
+void delete_render_queue(render_queue *rq);
+
+#endif
+/* EOF */
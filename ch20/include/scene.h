@@ -0,0 +1,153 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/transform.h"
+
+/*
+ * A scene is a list of objects with a transform and a material, the
+ * materials' textures and the lights. It is authored as text, one entry per
+ * line, and can be cooked into a binary file that loads with a few copies
+ *
+ *     # Comments run to the end of the line
+ *     material <diffuse map> <specular map> <shininess>
+ *     dir_light <direction> <ambient> <diffuse> <specular>
+ *     point_light <position> <ambient> <diffuse> <specular> <attenuation>
+ *     spot_light <ambient> <diffuse> <specular> <attenuation> <inner> <outer>
+ *     object <position> <axis> <angle> <scale> <material> [parent]
+ *
+ * Vectors and colors are three numbers, attenuation is the constant, linear
+ * and quadratic factors, and angles are in degrees. Map paths cannot contain
+ * spaces. Materials and objects are numbered from 0 in the order they
+ * appear. An object's transform is relative to its parent, which has to come
+ * before it. The spot light follows the camera, so it has no position or
+ * direction
+ *
+ * The objects are kept as arrays of components rather than as structs, so
+ * the code that walks them only pulls in the components it reads
+ */
+
+#define SCENE_FILE_MAGIC "SCNE"
+
+/* Bumped whenever the layout changes, older files are rejected */
+#define SCENE_FILE_VERSION 2
+
+/* Sections start on this boundary */
+#define SCENE_FILE_ALIGNMENT 64
+
+/* Written as a native uint32_t, reads back differently on the other order */
+#define SCENE_FILE_BYTE_ORDER 0x01020304u
+
+/* The longest texture path, including the terminator */
+#define SCENE_PATH_SIZE 256
+
+typedef enum scene_light_type scene_light_type;
+typedef struct scene_material scene_material;
+typedef struct scene_light scene_light;
+typedef struct scene_file_header scene_file_header;
+typedef struct scene scene;
+
+enum scene_light_type
+{
+    SCENE_DIR_LIGHT,
+    SCENE_POINT_LIGHT,
+    SCENE_SPOT_LIGHT
+};
+
+struct scene_material
+{
+    /* Relative to the working directory */
+    char diffuse_map[SCENE_PATH_SIZE];
+    char specular_map[SCENE_PATH_SIZE];
+
+    float shininess;
+};
+
+/* Stored as it is in the cooked file, so the fields have fixed sizes */
+struct scene_light
+{
+    uint32_t type;
+
+    /* Only the fields of the light's type are set, the rest are zero */
+    float position[3];
+    float direction[3];
+
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    /* Cosines of the cone angles */
+    float inner_cut_off;
+    float outer_cut_off;
+};
+
+struct scene_file_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+
+    uint32_t num_materials;
+    uint32_t num_lights;
+    uint64_t num_objects;
+
+    /* Byte offsets of the sections from the start of the file */
+    uint64_t parent_offset;
+    uint64_t position_offset;
+    uint64_t rotation_offset;
+    uint64_t scale_offset;
+    uint64_t material_id_offset;
+    uint64_t material_offset;
+    uint64_t light_offset;
+};
+
+struct scene
+{
+    /* One node per object, in the order the objects appear */
+    transform_hierarchy transforms;
+
+    /* stb_ds array with one entry per object */
+    unsigned int *material_ids;
+
+    /* stb_ds arrays */
+    scene_material *materials;
+    scene_light *lights;
+};
+
+/**
+ * @brief Loads a scene from a text or cooked file
+ *
+ * @param[out] s The scene to fill
+ * @param[in] path The path to the file. Cooked files are told apart by their
+ * magic number, not their name
+ *
+ * @return Whether the scene was loaded. Errors are printed
+ */
+bool load_scene(scene *s, const char *path);
+
+/**
+ * @brief Writes a scene as a cooked file
+ *
+ * @param[in] s The scene
+ * @param[in] path The path to the file
+ *
+ * @return Whether the file was written
+ */
+bool write_scene_file(const scene *s, const char *path);
+
+/**
+ * @brief Frees the arrays of a scene
+ *
+ * @param[in, out] s The scene
+ */
+void free_scene(scene *s);
+
+#endif
+/* EOF */
@@ -340,5 +340,16 @@ void set_shader_mat4fv(unsigned int id, const char *name, GLsizei count,
  */
 void set_shader_mat3fv(unsigned int id, const char *name, GLsizei count,
                        GLboolean transpose, const float *value);
+
+/**
+ * @brief Assigns a uniform block within the shader program to a binding point
+ * @note Calls glUniformBlockBinding
+ *
+ * @param[in] id The shader's ID
+ * @param[in] name The name of the uniform block
+ * @param[in] binding The uniform buffer binding point
+ */
+void set_shader_block_binding(unsigned int id, const char *name,
+                              unsigned int binding);
 #endif
 /* EOF */
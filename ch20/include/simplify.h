@@ -0,0 +1,63 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stddef.h>
+
+#include "../include/mesh.h"
+
+/*
+ * Quadric error metric simplification by edge collapse. Vertices only ever
+ * collapse onto other existing vertices, so every LOD indexes the original
+ * vertex buffer and a LOD chain is nothing more than extra index ranges
+ *
+ * Open borders, non-manifold edges and attribute seams (vertices sharing a
+ * position but not a normal or texture coordinate) are kept in place so
+ * the silhouette and the texture mapping hold up
+ */
+
+/* Each LOD keeps this fraction of the triangles of the one before */
+#define LOD_RATIO 0.5f
+
+/* LODs that remove less than this fraction of triangles are not kept */
+#define LOD_MIN_REDUCTION 0.1f
+
+/**
+ * @brief Simplifies a triangle list towards a target index count
+ *
+ * @param[out] dst The simplified indices, room for num_indices
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The triangle list
+ * @param[in] num_indices The number of indices
+ * @param[in] target_indices The number of indices to stop at
+ * @param[out] error The largest distance the surface moved, roughly, in the
+ * units of the positions. May be NULL
+ *
+ * @note The target may be missed when only locked vertices remain
+ *
+ * @return The number of indices written to dst
+ */
+size_t simplify_mesh(unsigned int *dst, const vertex *vertices,
+                     size_t num_vertices, const unsigned int *indices,
+                     size_t num_indices, size_t target_indices, float *error);
+
+/**
+ * @brief Appends a chain of simplified LODs to an index array, each with
+ * LOD_RATIO of the triangles of the last
+ *
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in, out] indices The stb_ds index array, the full mesh on entry
+ * @param[out] lods The ranges of the LODs, the full mesh first
+ * @param[in] max_lods The most LODs to make, at most MESH_MAX_LODS
+ *
+ * @note Meant for import or cook time, every LOD is made from the full mesh
+ *
+ * @return The number of LODs, including the full mesh
+ */
+unsigned int build_lod_chain(const vertex *vertices, size_t num_vertices,
+                             unsigned int **indices, mesh_lod *lods,
+                             unsigned int max_lods);
+
+#endif
+/* EOF */
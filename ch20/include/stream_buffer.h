@@ -0,0 +1,90 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+/* Frames of data in flight. The CPU fills one region while the GPU reads */
+#define STREAM_REGIONS 3
+
+/*
+ * A ring of per-frame regions in one buffer object for data that is rewritten
+ * every frame. Each region is fenced once the frame that used it is
+ * submitted, and only waited on when the ring comes back around to it
+ */
+
+typedef struct stream_buffer stream_buffer;
+
+struct stream_buffer
+{
+    unsigned int buffer;
+
+    size_t region_size;
+    unsigned int region;
+    size_t offset;
+
+    /* Allocations start on multiples of this, so they can back any UBO */
+    size_t alignment;
+
+    /* The whole buffer when persistently mapped, NULL otherwise */
+    unsigned char *persistent;
+
+    /* The region being written this frame */
+    unsigned char *mapped;
+
+    GLsync fences[STREAM_REGIONS];
+    bool started;
+
+    /* Frames that had to wait on the GPU before writing */
+    unsigned long stalls;
+};
+
+/**
+ * @brief Creates the buffer, persistently mapped when ARB_buffer_storage is
+ * available and mapped each frame without synchronization otherwise
+ *
+ * @param[out] sb The stream buffer to initialize
+ * @param[in] region_size The most bytes a single frame can write
+ *
+ * @note load_gl_extensions must have been called
+ */
+void create_stream_buffer(stream_buffer *sb, size_t region_size);
+
+/**
+ * @brief Moves on to the next region and makes it writable. Fences the
+ * previous region, so everything that reads it must already be submitted
+ *
+ * @param[in, out] sb The stream buffer
+ */
+void begin_stream_frame(stream_buffer *sb);
+
+/**
+ * @brief Reserves space in the current region
+ *
+ * @param[in, out] sb The stream buffer
+ * @param[in] size The number of bytes
+ * @param[out] offset The byte offset of the space within the buffer object
+ *
+ * @return Where to write the data. Only valid until end_stream_frame
+ */
+void *stream_alloc(stream_buffer *sb, size_t size, size_t *offset);
+
+/**
+ * @brief Makes the writes of this frame visible to the GPU. Draws may source
+ * the buffer from here until the next begin_stream_frame
+ *
+ * @param[in, out] sb The stream buffer
+ */
+void end_stream_frame(stream_buffer *sb);
+
+/**
+ * @brief Deletes the buffer and its fences
+ *
+ * @param[in, out] sb The stream buffer
+ */
+void delete_stream_buffer(stream_buffer *sb);
+
+#endif
+/* EOF */
@@ -0,0 +1,139 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+/*
+ * Many textures behind one GL_TEXTURE_2D_ARRAY so that draws with different
+ * materials need no texture binds in between. Images of the layer size take
+ * a layer each, smaller ones are packed into shared layers like an atlas and
+ * get a UV rectangle to remap their texture coordinates into.
+ *
+ * Layers are put together in memory and only reach the GL when the array is
+ * finished, either all at once or through a texture_streamer
+ */
+
+#include <stdbool.h>
+
+#include "../include/mipmap.h"
+#include "../include/texture_streamer.h"
+
+/* The gap in texels between packed images, keeps mips from bleeding */
+#define ATLAS_PADDING 4
+
+/* Color and data images are filtered differently, so never share a layer */
+#define ATLAS_COLOR 0
+#define ATLAS_DATA 1
+
+typedef struct texture_region texture_region;
+typedef struct atlas_shelf atlas_shelf;
+typedef struct texture_array texture_array;
+
+/* Where an image ended up in the array */
+struct texture_region
+{
+    int layer;
+
+    /* The UV offset in xy and scale in zw: uv' = rect.xy + uv * rect.zw */
+    float rect[4];
+};
+
+/* The shelf packer of the layer smaller images are being packed into */
+struct atlas_shelf
+{
+    /* -1 until an image needs it */
+    int layer;
+
+    int x;
+    int y;
+    int height;
+};
+
+struct texture_array
+{
+    /* 0 until the array is finished */
+    unsigned int id;
+
+    /* The texture belongs to a streamer rather than the array */
+    bool streamed;
+
+    /* The RGBA8 layers, one after another */
+    unsigned char *pixels;
+
+    /* The mip flags of each layer, from the images in it */
+    unsigned int *layer_flags;
+
+    int width;
+    int height;
+
+    int max_layers;
+    int num_layers;
+
+    /* Indexed by ATLAS_COLOR and ATLAS_DATA */
+    atlas_shelf shelves[2];
+};
+
+/**
+ * @brief Creates an empty texture array
+ *
+ * @param[out] ta The texture array to initialize
+ * @param[in] width The width of every layer
+ * @param[in] height The height of every layer
+ * @param[in] max_layers The most layers the images may take up
+ *
+ * @note Storage is RGBA8 whatever the format of the images added
+ */
+void create_texture_array(texture_array *ta, int width, int height,
+                          int max_layers);
+
+/**
+ * @brief Copies an image into the array
+ *
+ * @param[in, out] ta The texture array
+ * @param[in] pixels The tightly packed 8-bit pixels
+ * @param[in] width The image width, at most the layer width
+ * @param[in] height The image height, at most the layer height
+ * @param[in] num_channels 1, 2, 3 or 4
+ * @param[in] mip_flags MIP_SRGB for color images, or 0 for data such as
+ * specular maps, which is already linear
+ *
+ * @note Exits if the image does not fit in the remaining layers
+ *
+ * @return Where the image was placed
+ */
+texture_region add_texture_image(texture_array *ta,
+                                 const unsigned char *pixels, int width,
+                                 int height, int num_channels,
+                                 unsigned int mip_flags);
+
+/**
+ * @brief Uploads the layers that were used with a full set of mipmaps and
+ * frees the memory copy
+ *
+ * @param[in, out] ta The texture array
+ * @param[in] mip_flags MIP_CPU to build the chain on the CPU, or 0 for
+ * glGenerateMipmap. Arrays with sRGB layers are always built on the CPU
+ */
+void finish_texture_array(texture_array *ta, unsigned int mip_flags);
+
+/**
+ * @brief Hands the layers that were used to a texture streamer instead,
+ * which keeps only as many mipmaps resident as the views need
+ *
+ * @param[in, out] ta The texture array
+ * @param[in, out] ts The texture streamer, which takes over the memory copy
+ *
+ * @note Streamed mips are always built on the CPU, each layer filtered as
+ * its images asked
+ *
+ * @return The streamed texture handle
+ */
+unsigned int stream_texture_array(texture_array *ta, texture_streamer *ts);
+
+/**
+ * @brief Frees the texture, unless a streamer owns it, and any memory copy
+ *
+ * @param[in, out] ta The texture array
+ */
+void delete_texture_array(texture_array *ta);
+
+#endif
+/* EOF */
@@ -0,0 +1,154 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#include "../include/mipmap.h"
+#include "../include/pbo_ring.h"
+
+/*
+ * Keeps texture memory within a fixed budget. Every texture keeps its whole
+ * mip chain in memory, but the GL only holds the levels from the finest one
+ * the draws asked for down to the smallest. New textures start with only
+ * their coarsest levels, finer ones are uploaded a level per frame as draws
+ * ask for them, and the fine levels of textures nobody asked for are dropped
+ * least recently used first
+ */
+
+/* Levels this size and smaller are always resident */
+#define STREAM_MIN_SIZE 32
+
+/* Frames without a request before a texture drops to its coarsest levels */
+#define STREAM_EVICT_FRAMES 120
+
+/* The most bytes uploaded in one update, keeps refinement from stalling */
+#define STREAM_UPLOAD_BYTES (4 << 20)
+
+typedef struct streamed_texture streamed_texture;
+typedef struct texture_streamer texture_streamer;
+
+struct streamed_texture
+{
+    unsigned int id;
+    GLenum target;
+
+    int width;
+    int height;
+    int layers;
+
+    /* The RGBA8 pixels of every level, with the layers one after another */
+    unsigned char *levels[MIP_MAX_LEVELS];
+    int num_levels;
+
+    /* The coarsest level the texture is ever dropped to */
+    int floor;
+
+    /* The finest level the GL holds */
+    int resident;
+
+    /* The finest level any draw asked for since the last update */
+    int wanted;
+
+    /* The frame of the last request */
+    unsigned long last_used;
+};
+
+struct texture_streamer
+{
+    /* stb_ds array, indexed by handle */
+    streamed_texture *textures;
+
+    /* Uploads go through these pixel buffers, or client memory if NULL */
+    pbo_ring *uploads;
+
+    size_t budget;
+    size_t resident_bytes;
+
+    unsigned long frame;
+
+    /* What the last update did */
+    size_t uploaded_bytes;
+    unsigned int evictions;
+};
+
+/**
+ * @brief Creates an empty texture streamer
+ *
+ * @param[out] ts The texture streamer to initialize
+ * @param[in] budget The most bytes of texture memory to keep resident
+ * @param[in, out] uploads The pixel buffers to upload through, may be NULL
+ *
+ * @note The coarsest levels are kept regardless of the budget, so it only
+ * holds if those fit in it
+ */
+void create_texture_streamer(texture_streamer *ts, size_t budget,
+                             pbo_ring *uploads);
+
+/**
+ * @brief Builds the mip chain of an image and uploads its coarsest levels
+ *
+ * @param[in, out] ts The texture streamer
+ * @param[in] target GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+ * @param[in] width The width of level 0
+ * @param[in] height The height of level 0
+ * @param[in] layers The number of layers, 1 for GL_TEXTURE_2D
+ * @param[in] pixels The RGBA8 level 0, allocated with malloc. The streamer
+ * takes it over
+ * @param[in] layer_flags The mip flags of each layer, MIP_SRGB for color
+ * or 0 for data
+ *
+ * @note The chain is built with create_mip_chain, so on the job system and
+ * through the mip cache if one is set
+ *
+ * @return The handle of the texture
+ */
+unsigned int add_streamed_texture(texture_streamer *ts, GLenum target,
+                                  int width, int height, int layers,
+                                  unsigned char *pixels,
+                                  const unsigned int *layer_flags);
+
+/**
+ * @brief Gets the texture object of a streamed texture
+ *
+ * @param[in] ts The texture streamer
+ * @param[in] handle The streamed texture
+ *
+ * @note The object stays the same while its levels come and go
+ *
+ * @return The texture object
+ */
+unsigned int streamed_texture_id(const texture_streamer *ts,
+                                 unsigned int handle);
+
+/**
+ * @brief Asks for enough detail to draw a texture at a size on screen
+ *
+ * @param[in, out] ts The texture streamer
+ * @param[in] handle The streamed texture
+ * @param[in] screen_size How many pixels the texture spans on screen
+ *
+ * @note Call for every draw that uses the texture, the largest size wins
+ */
+void request_texture_detail(texture_streamer *ts, unsigned int handle,
+                            float screen_size);
+
+/**
+ * @brief Uploads and drops levels for the requests since the last update
+ *
+ * @param[in, out] ts The texture streamer
+ *
+ * @note Call once per frame, from the thread that owns the GL context. Its
+ * scratch memory comes from frame_arena
+ */
+void update_texture_streamer(texture_streamer *ts);
+
+/**
+ * @brief Frees every streamed texture and its memory copy
+ *
+ * @param[in, out] ts The texture streamer
+ */
+void delete_texture_streamer(texture_streamer *ts);
+
+#endif
+/* EOF */
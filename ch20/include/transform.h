@@ -0,0 +1,125 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cglm/cglm.h>
+
+/*
+ * A transform hierarchy kept as arrays sorted so every parent comes before
+ * its children. World matrices and normal matrices are cached, and updating
+ * walks the arrays once from front to back, so a parent's world matrix is
+ * always ready when its children need it
+ *
+ * Changing a local transform marks the node dirty. The update starts at the
+ * first dirty node, recomputes every node that is dirty or has a parent that
+ * was recomputed, and skips the rest. A frame where nothing moved costs one
+ * comparison
+ */
+
+/* The parent of root nodes */
+#define TRANSFORM_NO_PARENT UINT32_MAX
+
+typedef struct transform_hierarchy transform_hierarchy;
+
+struct transform_hierarchy
+{
+    /* stb_ds arrays of the local transforms, one entry per node */
+    unsigned int *parents;
+    vec3 *positions;
+    versor *rotations;
+    vec3 *scales;
+
+    /* stb_ds array, nonzero for nodes to recompute on the next update */
+    unsigned char *dirty;
+
+    /* Caches filled by update_world_transforms */
+    mat4 *world;
+    mat3 *normal;
+
+    /*
+     * Set while the shader makes the normal matrices. Updates then leave
+     * normal alone, so it is stale for every node they recompute
+     */
+    bool skip_normals;
+
+    /*
+     * Whether the world matrix scales every axis the same. For those the
+     * normal matrix is the upper 3x3 of the world matrix up to length
+     */
+    bool *uniform_scale;
+
+    /* The number of nodes, and the most the caches hold before growing */
+    size_t count;
+    size_t capacity;
+
+    /* Every node before this one is clean */
+    size_t first_dirty;
+};
+
+/**
+ * @brief Adds a node after every existing one
+ *
+ * @param[in, out] h The hierarchy
+ * @param[in] parent An existing node, or TRANSFORM_NO_PARENT
+ * @param[in] position The local position
+ * @param[in] rotation The local rotation
+ * @param[in] scale The local scale
+ *
+ * @return The index of the node. Its world matrix is ready after the next
+ * update
+ */
+unsigned int add_transform(transform_hierarchy *h, unsigned int parent,
+                           vec3 position, versor rotation, vec3 scale);
+
+/**
+ * @brief Replaces the local transform of a node
+ *
+ * @param[in, out] h The hierarchy
+ * @param[in] node The node
+ * @param[in] position The local position
+ * @param[in] rotation The local rotation
+ * @param[in] scale The local scale
+ */
+void set_transform(transform_hierarchy *h, unsigned int node, vec3 position,
+                   versor rotation, vec3 scale);
+
+/**
+ * @brief Marks a node to be recomputed, after its local transform was
+ * written in place
+ *
+ * @param[in, out] h The hierarchy
+ * @param[in] node The node
+ */
+void mark_transform_dirty(transform_hierarchy *h, unsigned int node);
+
+/**
+ * @brief Turns the normal matrix cache on or off. Turning it back on marks
+ * every node dirty, as any of them may have moved while it was off
+ *
+ * @param[in, out] h The hierarchy
+ * @param[in] skip Whether updates leave the normal matrices alone
+ */
+void skip_normal_matrices(transform_hierarchy *h, bool skip);
+
+/**
+ * @brief Recomputes the world and normal matrices of dirty nodes and their
+ * descendants. The normal matrices are left alone while they are skipped
+ *
+ * @param[in, out] h The hierarchy
+ *
+ * @return The number of nodes recomputed
+ */
+size_t update_world_transforms(transform_hierarchy *h);
+
+/**
+ * @brief Frees the arrays of a hierarchy
+ *
+ * @param[in, out] h The hierarchy
+ */
+void free_transforms(transform_hierarchy *h);
+
+#endif
+/* EOF */
@@ -0,0 +1,72 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+ * A lock-free exchange between one writer and one reader thread. The writer
+ * fills its back slot and publishes it, the reader always gets the most
+ * recently published slot. Neither side ever waits on the other, the writer
+ * simply overwrites snapshots the reader did not get to
+ */
+
+typedef struct triple_buffer triple_buffer;
+
+struct triple_buffer
+{
+    unsigned char *data;
+    size_t size;
+
+    /* The slot in between, plus a flag set when it holds a new snapshot */
+    atomic_uint middle;
+
+    /* Only touched by the writer */
+    unsigned int back;
+
+    /* Only touched by the reader */
+    unsigned int front;
+};
+
+/**
+ * @brief Creates a triple buffer with zeroed slots
+ *
+ * @param[out] tb The triple buffer to initialize
+ * @param[in] size The size of each slot in bytes
+ */
+void create_triple_buffer(triple_buffer *tb, size_t size);
+
+/**
+ * @brief Gets the slot the writer fills next
+ *
+ * @param[in] tb The triple buffer
+ *
+ * @return The back slot. Its contents are stale and must be fully rewritten
+ */
+void *write_triple_buffer(triple_buffer *tb);
+
+/**
+ * @brief Hands the back slot over to the reader
+ *
+ * @param[in, out] tb The triple buffer
+ */
+void publish_triple_buffer(triple_buffer *tb);
+
+/**
+ * @brief Gets the most recently published slot
+ *
+ * @param[in, out] tb The triple buffer
+ *
+ * @return The front slot. Stays valid and unchanged until the next read
+ */
+const void *read_triple_buffer(triple_buffer *tb);
+
+/**
+ * @brief Frees the memory used by the triple buffer
+ *
+ * @param[in, out] tb The triple buffer
+ */
+void delete_triple_buffer(triple_buffer *tb);
+
+#endif
+/* EOF */
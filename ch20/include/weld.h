@@ -0,0 +1,46 @@
+#ifndef WELD_H
+#define WELD_H
+
+#include <stddef.h>
+
+#include "../include/mesh.h"
+
+/*
+ * Merges duplicate and nearly duplicate vertices of an indexed mesh before it
+ * is uploaded. Vertices are bucketed by position in a hash grid with cells
+ * the size of the position epsilon, so a vertex is only compared against the
+ * vertices in its own and the neighboring cells
+ *
+ * Two vertices are duplicates when every component of each attribute is
+ * within that attribute's epsilon. The first vertex of a group is kept as it
+ * is, later ones are compared against it and never against each other, so
+ * welds do not chain across a surface
+ */
+
+typedef struct weld_epsilon weld_epsilon;
+
+struct weld_epsilon
+{
+    float position;
+    float normal;
+    float tex_coords;
+};
+
+/**
+ * @brief Welds the vertices of a mesh in place
+ *
+ * @param[in, out] vertices The stb_ds vertex array, shrunk to the kept
+ * vertices in their original order
+ * @param[in, out] indices The stb_ds index array, rewritten to the kept
+ * vertices. If NULL, the vertices are read as a triangle list and the array
+ * is created
+ * @param[in] epsilon The tolerance of each attribute, 0 for exact matches.
+ * NULL welds exact matches only
+ *
+ * @return The number of vertices removed
+ */
+size_t weld_vertices(vertex **vertices, unsigned int **indices,
+                     const weld_epsilon *epsilon);
+
+#endif
+/* EOF */
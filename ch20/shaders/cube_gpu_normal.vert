@@ -0,0 +1,45 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+// Per-instance attributes, see cube_instance_compact in main.c
+layout (location = 3) in mat4 aModel;
+
+// Bit i is set if point light i is close enough to reach this instance
+layout (location = 10) in int aLightMask;
+
+// The index into the Materials block of the fragment shader
+layout (location = 11) in int aMaterial;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out int LightMask;
+flat out int MaterialIndex;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// Must match depth_prepass.vert exactly so the depth test can use GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+        FragPos = vec3(aModel * vec4(aPos, 1.0));
+
+        // Only drawn when every instance is scaled the same on all axes. The
+        // transpose of the inverse is then the upper left of the model matrix
+        // divided by the scale squared, which only changes the length, and
+        // the fragment shader normalizes anyway
+        Normal = mat3(aModel) * aNormal;
+
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+
+        TexCoords = aTexCoords;
+        LightMask = aLightMask;
+        MaterialIndex = aMaterial;
+}
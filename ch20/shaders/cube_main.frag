@@ -1,15 +1,21 @@
 #version 330 core
 
 #define NUM_POINT_LIGHTS 4
+#define MAX_MATERIALS 64
 out vec4 FragColor;
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
+// Where the textures of a material live in materialTextures
 struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
+    // UV offset in xy and scale in zw
+    vec4 diffuseRect;
+    vec4 specularRect;
+
+    int diffuseLayer;
+    int specularLayer;
     float shininess;
 };
 
@@ -84,24 +90,58 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 // @return The intensity value
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
-uniform Material material;
+// Every material's textures, packed into layers
+uniform sampler2DArray materialTextures;
+
+// Matches material_block in main.c
+layout (std140) uniform Materials {
+    Material materials[MAX_MATERIALS];
+};
+
+// Matches camera_block in main.c
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// Matches lights_block in main.c
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NUM_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
+// Bit i is set if pointLights[i] is close enough to reach this object
+flat in int LightMask;
 
-uniform DirLight dirLight;
-uniform PointLight pointLights[NUM_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// The index into materials of this object
+flat in int MaterialIndex;
 
-uniform vec3 viewPos;
+// The material's texels and shininess at this fragment, read once in main
+vec3 diffuseTexel;
+vec3 specularTexel;
+float shininess;
 
 // Calculate the light contribution from all light sources
 void main()
 {
+    Material material = materials[MaterialIndex];
+
+    diffuseTexel = texture(materialTextures, vec3(material.diffuseRect.xy
+        + TexCoords * material.diffuseRect.zw, material.diffuseLayer)).rgb;
+    specularTexel = texture(materialTextures, vec3(material.specularRect.xy
+        + TexCoords * material.specularRect.zw, material.specularLayer)).rgb;
+    shininess = material.shininess;
+
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
 
     for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+        if ((LightMask & (1 << i)) != 0)
+            result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
     }
 
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
@@ -117,13 +157,13 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseTexel;
     vec3 diffuse = light.diffuse * diff
-                   * texture(material.diffuse, TexCoords).rgb;
+                   * diffuseTexel;
     vec3 specular = light.specular * spec
-                    * texture(material.specular, TexCoords).rgb;
+                    * specularTexel;
 
     return (ambient + diffuse + specular);
 }
@@ -136,18 +176,18 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
 
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
 
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance
                         + light.quadratic * (distance * distance));
 
     vec3 ambient = light.ambient * attenuation
-                   * texture(material.diffuse, TexCoords).rgb;
+                   * diffuseTexel;
     vec3 diffuse = light.diffuse * diff * attenuation
-                   * texture(material.diffuse, TexCoords).rgb;
+                   * diffuseTexel;
     vec3 specular = light.specular * diff * attenuation
-                    * texture(material.specular, TexCoords).rgb;
+                    * specularTexel;
 
     return (ambient + diffuse + specular);
 }
@@ -161,17 +201,17 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.innerCutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseTexel;
 
     vec3 norm = normalize(Normal);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = light.diffuse * diff
-                   * texture(material.diffuse, TexCoords).rgb;
+                   * diffuseTexel;
 
     vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     vec3 specular = light.specular * spec
-                    * texture(material.specular, TexCoords).rgb;
+                    * specularTexel;
 
     float distance = length(light.position - FragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance
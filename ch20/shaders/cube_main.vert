@@ -3,24 +3,42 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// Per-instance attributes, see cube_instance in main.c
+layout (location = 3) in mat4 aModel;
+
+// The transpose of the inverse of the upper left of the model matrix
+// Used for proper normal calculations when scaling and such
+layout (location = 7) in mat3 aNorm;
+
+// Bit i is set if point light i is close enough to reach this instance
+layout (location = 10) in int aLightMask;
+
+// The index into the Materials block of the fragment shader
+layout (location = 11) in int aMaterial;
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out int LightMask;
+flat out int MaterialIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
-// The transpose of the inverse of the upper left of the model matrix
-// Used for proper normal calculations when scaling and such
-uniform mat3 norm;
+// Must match depth_prepass.vert exactly so the depth test can use GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
-        FragPos = vec3(model * vec4(aPos, 1.0));
-        Normal = norm * aNormal;
+        FragPos = vec3(aModel * vec4(aPos, 1.0));
+        Normal = aNorm * aNormal;
 
         gl_Position = projection * view * vec4(FragPos, 1.0);
 
         TexCoords = aTexCoords;
+        LightMask = aLightMask;
+        MaterialIndex = aMaterial;
 }
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Per-instance attributes, see cube_instance in main.c
+layout (location = 3) in mat4 aModel;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// Must match cube_main.vert exactly so the main pass can use GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+        vec3 fragPos = vec3(aModel * vec4(aPos, 1.0));
+
+        gl_Position = projection * view * vec4(fragPos, 1.0);
+}
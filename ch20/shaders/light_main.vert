@@ -1,11 +1,21 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-instance attributes, see light_instance in main.c
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec3 aColor;
+
+flat out vec3 LightColor;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
 void main()
 {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
+        gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+
+        LightColor = aColor;
 }
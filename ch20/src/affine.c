@@ -0,0 +1,247 @@
+#include "../include/affine.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <cglm/cglm.h>
+
+#if defined(__SSE2__)
+/**
+ * @brief Crosses the xyz parts of two vectors
+ *
+ * @param[in] a The first vector
+ * @param[in] b The second vector
+ *
+ * @return The cross product, with w as a.w * b.w - a.w * b.w, so 0
+ */
+static __m128 cross_sse(__m128 a, __m128 b);
+
+/**
+ * @brief Dots two vectors
+ *
+ * @param[in] a The first vector
+ * @param[in] b The second vector
+ *
+ * @return The dot product of all four lanes, in every lane
+ */
+static __m128 dot_sse(__m128 a, __m128 b);
+
+/**
+ * @brief Moves a point by the inverse of a 3x3, given its columns
+ *
+ * @param[in] c0 The first column of the inverse, with w as 0
+ * @param[in] c1 The second column of the inverse, with w as 0
+ * @param[in] c2 The third column of the inverse, with w as 0
+ * @param[in] t The translation of the matrix being inverted
+ *
+ * @return The translation of the inverse, with w as 1
+ */
+static __m128 inverse_translation_sse(__m128 c0, __m128 c1, __m128 c2,
+                                      __m128 t);
+#endif
+
+/**
+ * @brief Computes the rows of the inverse of the upper 3x3 of a matrix. They
+ * are the cross products of its columns over the determinant
+ *
+ * @param[in] m The matrix
+ * @param[out] rows The rows of the inverse
+ */
+static void inverse_rows_scalar(mat4 m, vec3 rows[3]);
+
+void
+affine_inverse(mat4 m, mat4 dest)
+{
+#if defined(__SSE2__)
+    __m128 c0 = _mm_loadu_ps(m[0]);
+    __m128 c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]);
+    __m128 t = _mm_loadu_ps(m[3]);
+    __m128 r0 = cross_sse(c1, c2);
+    __m128 r1 = cross_sse(c2, c0);
+    __m128 r2 = cross_sse(c0, c1);
+    __m128 r3 = _mm_setzero_ps();
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), dot_sse(c0, r0));
+
+    r0 = _mm_mul_ps(r0, inv_det);
+    r1 = _mm_mul_ps(r1, inv_det);
+    r2 = _mm_mul_ps(r2, inv_det);
+
+    /* The rows of the inverse become its columns */
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    _mm_storeu_ps(dest[0], r0);
+    _mm_storeu_ps(dest[1], r1);
+    _mm_storeu_ps(dest[2], r2);
+    _mm_storeu_ps(dest[3], inverse_translation_sse(r0, r1, r2, t));
+#else
+    affine_inverse_scalar(m, dest);
+#endif
+}
+
+void
+rigid_inverse(mat4 m, mat4 dest)
+{
+#if defined(__SSE2__)
+    __m128 c0 = _mm_loadu_ps(m[0]);
+    __m128 c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]);
+    __m128 t = _mm_loadu_ps(m[3]);
+    __m128 c3 = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    _mm_storeu_ps(dest[0], c0);
+    _mm_storeu_ps(dest[1], c1);
+    _mm_storeu_ps(dest[2], c2);
+    _mm_storeu_ps(dest[3], inverse_translation_sse(c0, c1, c2, t));
+#else
+    rigid_inverse_scalar(m, dest);
+#endif
+}
+
+void
+normal_matrix(mat4 m, mat3 dest)
+{
+#if defined(__SSE2__)
+    __m128 c0 = _mm_loadu_ps(m[0]);
+    __m128 c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]);
+    __m128 r0 = cross_sse(c1, c2);
+    __m128 r1 = cross_sse(c2, c0);
+    __m128 r2 = cross_sse(c0, c1);
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), dot_sse(c0, r0));
+
+    /*
+     * The rows of the inverse are the columns of its transpose, so no
+     * shuffling is needed. A mat3 is 9 packed floats, so each 4-wide store
+     * spills into the next column before that column is written, and the
+     * last one is stored in two parts to stay inside dest
+     */
+    _mm_storeu_ps(dest[0], _mm_mul_ps(r0, inv_det));
+    _mm_storeu_ps(dest[1], _mm_mul_ps(r1, inv_det));
+    r2 = _mm_mul_ps(r2, inv_det);
+    _mm_storel_pi((__m64 *)dest[2], r2);
+    _mm_store_ss(&dest[2][2], _mm_movehl_ps(r2, r2));
+#else
+    normal_matrix_scalar(m, dest);
+#endif
+}
+
+void
+affine_inverse_scalar(mat4 m, mat4 dest)
+{
+    vec3 rows[3];
+    vec3 t;
+    unsigned int i;
+
+    inverse_rows_scalar(m, rows);
+    glm_vec3_copy(m[3], t);
+
+    for (i = 0; i < 3; i++) {
+        dest[i][0] = rows[0][i];
+        dest[i][1] = rows[1][i];
+        dest[i][2] = rows[2][i];
+        dest[i][3] = 0.0f;
+    }
+
+    dest[3][0] = -glm_vec3_dot(rows[0], t);
+    dest[3][1] = -glm_vec3_dot(rows[1], t);
+    dest[3][2] = -glm_vec3_dot(rows[2], t);
+    dest[3][3] = 1.0f;
+}
+
+void
+rigid_inverse_scalar(mat4 m, mat4 dest)
+{
+    vec3 rows[3];
+    vec3 t;
+    unsigned int i;
+
+    /* The rows of the inverse are the columns of the rotation */
+    for (i = 0; i < 3; i++)
+        glm_vec3_copy(m[i], rows[i]);
+
+    glm_vec3_copy(m[3], t);
+
+    for (i = 0; i < 3; i++) {
+        dest[i][0] = rows[0][i];
+        dest[i][1] = rows[1][i];
+        dest[i][2] = rows[2][i];
+        dest[i][3] = 0.0f;
+    }
+
+    dest[3][0] = -glm_vec3_dot(rows[0], t);
+    dest[3][1] = -glm_vec3_dot(rows[1], t);
+    dest[3][2] = -glm_vec3_dot(rows[2], t);
+    dest[3][3] = 1.0f;
+}
+
+void
+normal_matrix_scalar(mat4 m, mat3 dest)
+{
+    vec3 rows[3];
+    unsigned int i;
+
+    inverse_rows_scalar(m, rows);
+
+    for (i = 0; i < 3; i++)
+        glm_vec3_copy(rows[i], dest[i]);
+}
+
+static void
+inverse_rows_scalar(mat4 m, vec3 rows[3])
+{
+    float inv_det;
+
+    glm_vec3_cross(m[1], m[2], rows[0]);
+    glm_vec3_cross(m[2], m[0], rows[1]);
+    glm_vec3_cross(m[0], m[1], rows[2]);
+
+    inv_det = 1.0f / glm_vec3_dot(m[0], rows[0]);
+
+    glm_vec3_scale(rows[0], inv_det, rows[0]);
+    glm_vec3_scale(rows[1], inv_det, rows[1]);
+    glm_vec3_scale(rows[2], inv_det, rows[2]);
+}
+
+#if defined(__SSE2__)
+static __m128
+cross_sse(__m128 a, __m128 b)
+{
+    /* (a * b.yzx - a.yzx * b).yzx saves a shuffle over the textbook form */
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static __m128
+dot_sse(__m128 a, __m128 b)
+{
+    __m128 p = _mm_mul_ps(a, b);
+
+    p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+static __m128
+inverse_translation_sse(__m128 c0, __m128 c1, __m128 c2, __m128 t)
+{
+    __m128 moved;
+
+    moved = _mm_mul_ps(c0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+    moved = _mm_add_ps(moved, _mm_mul_ps(c1, _mm_shuffle_ps(
+                                             t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+    moved = _mm_add_ps(moved, _mm_mul_ps(c2, _mm_shuffle_ps(
+                                             t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+
+    /* 0 0 0 1 minus the moved point */
+    return _mm_sub_ps(_mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f), moved);
+}
+#endif
+
+/* EOF */
@@ -0,0 +1,232 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/allocator.h"
+#include "../include/mem_tracker.h"
+
+arena frame_arena;
+arena shader_arena;
+
+static memory_hook stats_hook;
+static void *stats_hook_user;
+
+/**
+ * @brief Calls the hook, if any, after an allocator's stats change
+ *
+ * @param[in] stats The allocator's stats
+ */
+static void notify(const memory_stats *stats);
+
+/**
+ * @brief Fills in the stats of a new allocator
+ *
+ * @param[out] stats The stats
+ * @param[in] name The allocator's name
+ * @param[in] capacity The allocator's size in bytes
+ */
+static void init_stats(memory_stats *stats, const char *name,
+                       size_t capacity);
+
+void
+init_memory(void)
+{
+    /*
+     * An arena is one heap block, charged when it is created, so each gets
+     * the category of what will be carved from it
+     */
+    memory_category category = set_memory_category(MEMORY_SCRATCH);
+
+    create_arena(&frame_arena, "frame", FRAME_ARENA_SIZE);
+
+    set_memory_category(MEMORY_SHADER);
+    create_arena(&shader_arena, "shader", SHADER_ARENA_SIZE);
+
+    set_memory_category(category);
+}
+
+void
+shutdown_memory(void)
+{
+    delete_arena(&frame_arena);
+    delete_arena(&shader_arena);
+}
+
+void
+set_memory_hook(memory_hook hook, void *user)
+{
+    stats_hook = hook;
+    stats_hook_user = user;
+}
+
+void
+create_arena(arena *a, const char *name, size_t capacity)
+{
+    a->base = malloc(capacity);
+
+    if (a->base == NULL) {
+        fprintf(stderr, "Error: Could not allocate the %s arena\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    init_stats(&a->stats, name, capacity);
+}
+
+void *
+arena_alloc(arena *a, size_t size, size_t alignment)
+{
+    size_t offset = (a->stats.used + alignment - 1) & ~(alignment - 1);
+
+    if (offset > a->stats.capacity || size > a->stats.capacity - offset) {
+        a->stats.failures++;
+        notify(&a->stats);
+        return NULL;
+    }
+
+    a->stats.used = offset + size;
+    a->stats.allocations++;
+
+    if (a->stats.used > a->stats.high_water)
+        a->stats.high_water = a->stats.used;
+
+    notify(&a->stats);
+
+    return a->base + offset;
+}
+
+size_t
+arena_mark(const arena *a)
+{
+    return a->stats.used;
+}
+
+void
+arena_release(arena *a, size_t mark)
+{
+    if (mark < a->stats.used) {
+        a->stats.used = mark;
+        a->stats.frees++;
+        notify(&a->stats);
+    }
+}
+
+void
+reset_arena(arena *a)
+{
+    arena_release(a, 0);
+}
+
+void
+delete_arena(arena *a)
+{
+    free(a->base);
+    a->base = NULL;
+    a->stats.capacity = 0;
+    a->stats.used = 0;
+}
+
+void
+create_object_pool(object_pool *pool, const char *name, size_t object_size,
+                   size_t capacity)
+{
+    size_t i;
+
+    /* Every record must hold the free list link and keep the next aligned */
+    if (object_size < sizeof(void *))
+        object_size = sizeof(void *);
+
+    object_size = (object_size + alignof(max_align_t) - 1)
+                  & ~(alignof(max_align_t) - 1);
+
+    pool->base = malloc(object_size * capacity);
+
+    if (pool->base == NULL) {
+        fprintf(stderr, "Error: Could not allocate the %s pool\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    pool->object_size = object_size;
+    pool->free_list = NULL;
+
+    /* Linked back to front so records are handed out in address order */
+    for (i = capacity; i-- > 0; ) {
+        void *object = pool->base + i * object_size;
+
+        *(void **)object = pool->free_list;
+        pool->free_list = object;
+    }
+
+    init_stats(&pool->stats, name, object_size * capacity);
+}
+
+void *
+object_pool_alloc(object_pool *pool)
+{
+    void *object = pool->free_list;
+
+    if (object == NULL) {
+        pool->stats.failures++;
+        notify(&pool->stats);
+        return NULL;
+    }
+
+    pool->free_list = *(void **)object;
+
+    pool->stats.used += pool->object_size;
+    pool->stats.allocations++;
+
+    if (pool->stats.used > pool->stats.high_water)
+        pool->stats.high_water = pool->stats.used;
+
+    notify(&pool->stats);
+
+    return object;
+}
+
+void
+object_pool_free(object_pool *pool, void *object)
+{
+    if (object == NULL)
+        return;
+
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+
+    pool->stats.used -= pool->object_size;
+    pool->stats.frees++;
+
+    notify(&pool->stats);
+}
+
+void
+delete_object_pool(object_pool *pool)
+{
+    free(pool->base);
+    pool->base = NULL;
+    pool->free_list = NULL;
+    pool->stats.capacity = 0;
+    pool->stats.used = 0;
+}
+
+static void
+notify(const memory_stats *stats)
+{
+    if (stats_hook != NULL)
+        stats_hook(stats, stats_hook_user);
+}
+
+static void
+init_stats(memory_stats *stats, const char *name, size_t capacity)
+{
+    stats->name = name;
+    stats->capacity = capacity;
+    stats->used = 0;
+    stats->high_water = 0;
+    stats->allocations = 0;
+    stats->frees = 0;
+    stats->failures = 0;
+}
+
+/* EOF */
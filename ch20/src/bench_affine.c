@@ -0,0 +1,367 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/affine.h"
+#include "../include/bench_common.h"
+
+#include <cglm/cglm.h>
+
+#define NUM_OBJECTS 1000000
+
+#define NUM_RUNS 5
+
+/* The largest difference from cglm allowed, relative to the value */
+#define TOLERANCE 1e-4f
+
+/* The instance counts to time filling instances for */
+static const size_t instance_counts[] = {10, 10000, 1000000};
+
+typedef void (*inverse_fn)(mat4 m, mat4 dest);
+typedef void (*normal_fn)(mat4 m, mat3 dest);
+
+typedef struct bench_instance bench_instance;
+typedef struct bench_instance_compact bench_instance_compact;
+
+/* Laid out as cube_instance in main.c */
+struct bench_instance
+{
+    float model[4][4];
+    float norm[3][3];
+    int light_mask;
+    int material;
+};
+
+/* Laid out as cube_instance_compact in main.c */
+struct bench_instance_compact
+{
+    float model[4][4];
+    int light_mask;
+    int material;
+};
+
+/**
+ * @brief Builds model matrices the way the scene does, scaled, then rotated,
+ * then moved into place
+ *
+ * @param[out] models The matrices
+ * @param[in] count The number of matrices
+ * @param[in] scaled Whether to give them non-uniform scales, or to leave them
+ * rigid
+ */
+void build_models(mat4 *models, size_t count, bool scaled);
+
+/**
+ * @brief Times an inverse over every matrix
+ *
+ * @param[in] fn The inverse
+ * @param[in] models The matrices
+ * @param[out] inverses The inverses
+ * @param[in] count The number of matrices
+ *
+ * @return The average nanoseconds per matrix
+ */
+double time_inverse(inverse_fn fn, mat4 *models, mat4 *inverses,
+                    size_t count);
+
+/**
+ * @brief Times a normal matrix computation over every matrix
+ *
+ * @param[in] fn The normal matrix computation
+ * @param[in] models The matrices
+ * @param[out] normals The normal matrices
+ * @param[in] count The number of matrices
+ *
+ * @return The average nanoseconds per matrix
+ */
+double time_normal(normal_fn fn, mat4 *models, mat3 *normals, size_t count);
+
+/**
+ * @brief Times filling a frame's instances three ways. With the normal
+ * matrices computed every frame, copied from a cache as the transform
+ * hierarchy keeps them, and left out for the vertex shader to derive
+ *
+ * @param[in] models The model matrices
+ * @param[in] normals Their cached normal matrices
+ * @param[in] count The number of instances
+ */
+void time_instance_fill(mat4 *models, mat3 *normals, size_t count);
+
+/**
+ * @brief Checks results against cglm's, exiting with an error if any are
+ * further off than TOLERANCE
+ *
+ * @param[in] name The name of the function being checked
+ * @param[in] values The results, as packed floats
+ * @param[in] expected cglm's results, as packed floats
+ * @param[in] count The number of floats
+ */
+void check_against_cglm(const char *name, const float *values,
+                        const float *expected, size_t count);
+
+/**
+ * @brief The general 4x4 inverse, wrapped so it can be passed around
+ *
+ * @param[in] m The matrix
+ * @param[out] dest The inverse
+ */
+void cglm_inverse(mat4 m, mat4 dest);
+
+/**
+ * @brief The normal matrix as main used to compute it, from the general 4x4
+ * inverse
+ *
+ * @param[in] m The model matrix
+ * @param[out] dest The normal matrix
+ */
+void cglm_normal(mat4 m, mat3 dest);
+
+int
+main(void)
+{
+    mat4 *models = aligned_alloc(_Alignof(mat4), NUM_OBJECTS * sizeof(mat4));
+    mat4 *expected = aligned_alloc(_Alignof(mat4), NUM_OBJECTS * sizeof(mat4));
+    mat4 *inverses = aligned_alloc(_Alignof(mat4), NUM_OBJECTS * sizeof(mat4));
+    mat3 *expected_normals = malloc(NUM_OBJECTS * sizeof(mat3));
+    mat3 *normals = malloc(NUM_OBJECTS * sizeof(mat3));
+    double cglm_ns;
+    double scalar_ns;
+    double vector_ns;
+    size_t i;
+
+    if (models == NULL || expected == NULL || inverses == NULL
+        || expected_normals == NULL || normals == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the matrices\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%d objects, %d runs\n", NUM_OBJECTS, NUM_RUNS);
+    printf("\n%-16s %10s %10s %10s %8s\n", "per object", "cglm ns",
+           "scalar ns", "vector ns", "speedup");
+
+    /* Scaled models, as the scene has */
+    build_models(models, NUM_OBJECTS, true);
+
+    cglm_ns = time_normal(cglm_normal, models, expected_normals, NUM_OBJECTS);
+    scalar_ns = time_normal(normal_matrix_scalar, models, normals,
+                            NUM_OBJECTS);
+    check_against_cglm("normal_matrix_scalar", normals[0][0],
+                       expected_normals[0][0], NUM_OBJECTS * 9);
+    vector_ns = time_normal(normal_matrix, models, normals, NUM_OBJECTS);
+    check_against_cglm("normal_matrix", normals[0][0],
+                       expected_normals[0][0], NUM_OBJECTS * 9);
+
+    printf("%-16s %10.2f %10.2f %10.2f %7.2fx\n", "normal matrix", cglm_ns,
+           scalar_ns, vector_ns, cglm_ns / vector_ns);
+
+    cglm_ns = time_inverse(cglm_inverse, models, expected, NUM_OBJECTS);
+    scalar_ns = time_inverse(affine_inverse_scalar, models, inverses,
+                             NUM_OBJECTS);
+    check_against_cglm("affine_inverse_scalar", inverses[0][0],
+                       expected[0][0], NUM_OBJECTS * 16);
+    vector_ns = time_inverse(affine_inverse, models, inverses, NUM_OBJECTS);
+    check_against_cglm("affine_inverse", inverses[0][0], expected[0][0],
+                       NUM_OBJECTS * 16);
+
+    printf("%-16s %10.2f %10.2f %10.2f %7.2fx\n", "affine inverse", cglm_ns,
+           scalar_ns, vector_ns, cglm_ns / vector_ns);
+
+    /* Rotations and translations only, as a camera has */
+    build_models(models, NUM_OBJECTS, false);
+
+    cglm_ns = time_inverse(cglm_inverse, models, expected, NUM_OBJECTS);
+    scalar_ns = time_inverse(rigid_inverse_scalar, models, inverses,
+                             NUM_OBJECTS);
+    check_against_cglm("rigid_inverse_scalar", inverses[0][0],
+                       expected[0][0], NUM_OBJECTS * 16);
+    vector_ns = time_inverse(rigid_inverse, models, inverses, NUM_OBJECTS);
+    check_against_cglm("rigid_inverse", inverses[0][0], expected[0][0],
+                       NUM_OBJECTS * 16);
+
+    printf("%-16s %10.2f %10.2f %10.2f %7.2fx\n", "rigid inverse", cglm_ns,
+           scalar_ns, vector_ns, cglm_ns / vector_ns);
+
+    /* The rigid models have uniform scale, so the GPU path applies */
+    for (i = 0; i < NUM_OBJECTS; i++)
+        normal_matrix(models[i], normals[i]);
+
+    printf("\n%-10s %12s %12s %12s\n", "instances", "computed us",
+           "cached us", "gpu us");
+
+    for (i = 0; i < sizeof(instance_counts) / sizeof(instance_counts[0]); i++)
+        time_instance_fill(models, normals, instance_counts[i]);
+
+    printf("Instances are %zu bytes with a normal matrix, %zu without\n",
+           sizeof(bench_instance), sizeof(bench_instance_compact));
+
+    free(models);
+    free(expected);
+    free(inverses);
+    free(expected_normals);
+    free(normals);
+
+    return 0;
+}
+
+void
+build_models(mat4 *models, size_t count, bool scaled)
+{
+    vec3 axis;
+    vec3 scale = {1.0f, 1.0f, 1.0f};
+    size_t i;
+
+    srand(1);
+
+    for (i = 0; i < count; i++) {
+        axis[0] = rand() / (float)RAND_MAX - 0.5f;
+        axis[1] = rand() / (float)RAND_MAX + 0.1f;
+        axis[2] = rand() / (float)RAND_MAX - 0.5f;
+
+        if (scaled) {
+            scale[0] = 0.5f + rand() / (float)RAND_MAX * 2.0f;
+            scale[1] = 0.5f + rand() / (float)RAND_MAX * 2.0f;
+            scale[2] = 0.5f + rand() / (float)RAND_MAX * 2.0f;
+        }
+
+        glm_translate_make(models[i],
+                           (vec3){rand() % 200 - 100.0f, rand() % 200 - 100.0f,
+                                  rand() % 200 - 100.0f});
+        glm_rotate(models[i], rand() / (float)RAND_MAX * GLM_PIf * 2.0f,
+                   axis);
+        glm_scale(models[i], scale);
+    }
+}
+
+double
+time_inverse(inverse_fn fn, mat4 *models, mat4 *inverses, size_t count)
+{
+    unsigned int run;
+    size_t i;
+    double start;
+    double total = 0.0;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        for (i = 0; i < count; i++)
+            fn(models[i], inverses[i]);
+
+        total += now_ms() - start;
+    }
+
+    return total * 1000000.0 / ((double)NUM_RUNS * count);
+}
+
+double
+time_normal(normal_fn fn, mat4 *models, mat3 *normals, size_t count)
+{
+    unsigned int run;
+    size_t i;
+    double start;
+    double total = 0.0;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        for (i = 0; i < count; i++)
+            fn(models[i], normals[i]);
+
+        total += now_ms() - start;
+    }
+
+    return total * 1000000.0 / ((double)NUM_RUNS * count);
+}
+
+void
+time_instance_fill(mat4 *models, mat3 *normals, size_t count)
+{
+    bench_instance *instances = malloc(count * sizeof(*instances));
+    bench_instance_compact *compact = malloc(count * sizeof(*compact));
+    double us[3] = {0.0};
+    unsigned int runs = count < 10000 ? 100000 : NUM_RUNS * 10;
+    unsigned int run;
+    size_t i;
+    double start;
+
+    if (instances == NULL || compact == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the instances\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* The first run faults the pages in and is not counted */
+    for (run = 0; run <= runs; run++) {
+        if (run == 1)
+            us[0] = us[1] = us[2] = 0.0;
+
+        start = now_ms();
+
+        for (i = 0; i < count; i++) {
+            memcpy(instances[i].model, models[i], sizeof(instances[i].model));
+            normal_matrix(models[i], instances[i].norm);
+            instances[i].light_mask = 1;
+            instances[i].material = 0;
+        }
+
+        us[0] += (now_ms() - start) * 1000.0;
+        start = now_ms();
+
+        for (i = 0; i < count; i++) {
+            memcpy(instances[i].model, models[i], sizeof(instances[i].model));
+            memcpy(instances[i].norm, normals[i], sizeof(instances[i].norm));
+            instances[i].light_mask = 1;
+            instances[i].material = 0;
+        }
+
+        us[1] += (now_ms() - start) * 1000.0;
+        start = now_ms();
+
+        for (i = 0; i < count; i++) {
+            memcpy(compact[i].model, models[i], sizeof(compact[i].model));
+            compact[i].light_mask = 1;
+            compact[i].material = 0;
+        }
+
+        us[2] += (now_ms() - start) * 1000.0;
+    }
+
+    printf("%-10zu %12.2f %12.2f %12.2f\n", count, us[0] / runs,
+           us[1] / runs, us[2] / runs);
+
+    free(instances);
+    free(compact);
+}
+
+void
+check_against_cglm(const char *name, const float *values,
+                   const float *expected, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (fabsf(values[i] - expected[i])
+            > TOLERANCE * fmaxf(1.0f, fabsf(expected[i]))) {
+            fprintf(stderr, "Error: %s gave %g where cglm gave %g (float %zu)"
+                    "\n", name, values[i], expected[i], i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void
+cglm_inverse(mat4 m, mat4 dest)
+{
+    glm_mat4_inv(m, dest);
+}
+
+void
+cglm_normal(mat4 m, mat3 dest)
+{
+    mat4 inverse;
+
+    glm_mat4_inv(m, inverse);
+    glm_mat4_pick3t(inverse, dest);
+}
+
+/* EOF */
@@ -0,0 +1,72 @@
+#include <math.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "../include/bench_common.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+double
+now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void
+build_sphere(unsigned int segments, unsigned int rings, vertex **vertices,
+             unsigned int **indices)
+{
+    unsigned int ring;
+    unsigned int segment;
+    unsigned int a;
+    unsigned int b;
+    float theta;
+    float phi;
+    vertex v;
+
+    *vertices = NULL;
+    *indices = NULL;
+
+    for (ring = 0; ring <= rings; ring++) {
+        for (segment = 0; segment <= segments; segment++) {
+            theta = GLM_PIf * ring / rings;
+            phi = 2.0f * GLM_PIf * segment / segments;
+
+            v.position[0] = sinf(theta) * cosf(phi);
+            v.position[1] = cosf(theta);
+            v.position[2] = sinf(theta) * sinf(phi);
+            glm_vec3_copy(v.position, v.normal);
+            v.tex_coords[0] = (float)segment / segments;
+            v.tex_coords[1] = (float)ring / rings;
+
+            arrput(*vertices, v);
+        }
+    }
+
+    for (ring = 0; ring < rings; ring++) {
+        for (segment = 0; segment < segments; segment++) {
+            a = ring * (segments + 1) + segment;
+            b = a + segments + 1;
+
+            /* The rings at the poles would only make slivers */
+            if (ring > 0) {
+                arrput(*indices, a);
+                arrput(*indices, a + 1);
+                arrput(*indices, b);
+            }
+
+            if (ring < rings - 1) {
+                arrput(*indices, a + 1);
+                arrput(*indices, b + 1);
+                arrput(*indices, b);
+            }
+        }
+    }
+}
+
+/* EOF */
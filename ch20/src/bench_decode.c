@@ -0,0 +1,336 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bench_common.h"
+#include "../include/image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+/* The res/ images are scaled up to this before being timed */
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+
+#define NUM_RUNS 5
+
+/* Quality of the re-encoded JPEGs, close to what photo tools save with */
+#define JPEG_QUALITY 90
+
+/**
+ * @brief Scales an image up with bilinear filtering, so the encoded file has
+ * smooth detail rather than the flat blocks nearest filtering would give
+ *
+ * @param[in] src The image to scale
+ * @param[out] dst The scaled image, BENCH_WIDTH by BENCH_HEIGHT
+ */
+void scale_image(const image *src, image *dst);
+
+/**
+ * @brief Writes an image to a file of the same type as the source
+ *
+ * @param[in] img The image
+ * @param[in] source The file the image came from
+ * @param[out] path The path written to
+ * @param[in] size The size of path
+ *
+ * @return Whether the file was written
+ */
+bool write_image(const image *img, const char *source, char *path,
+                 size_t size);
+
+/**
+ * @brief Times decoding a file
+ *
+ * @param[in] path The file
+ * @param[out] num_channels The channels the file decoded to
+ *
+ * @return The average milliseconds per decode, or a negative value on failure
+ */
+double time_decode(const char *path, int *num_channels);
+
+/**
+ * @brief Times the plain C and vector versions of the pixel conversions and
+ * checks that they agree
+ *
+ * @param[in] rgb A BENCH_WIDTH by BENCH_HEIGHT RGB image
+ */
+void time_conversions(const unsigned char *rgb);
+
+/**
+ * @brief Overwrites the alpha of RGBA pixels with a spread of values, so
+ * premultiplying has rounding to get wrong. The edge cases 0, 1, 127, 128,
+ * 254 and 255 come up in every run of 16 pixels
+ *
+ * @param[in, out] pixels The pixels
+ * @param[in] count The number of pixels
+ */
+void seed_alpha(unsigned char *pixels, size_t count);
+
+int
+main(void)
+{
+    DIR *dir;
+    struct dirent *entry;
+    const char *extension;
+    char source[512];
+    char path[1024];
+    image img;
+    image scaled;
+    unsigned char *rgb;
+    int num_channels;
+    double ms;
+    size_t i;
+
+    dir = opendir("res");
+
+    if (dir == NULL) {
+        fprintf(stderr, "Error: Could not open res/, run from the chapter "
+                "directory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    scaled.width = BENCH_WIDTH;
+    scaled.height = BENCH_HEIGHT;
+    scaled.pixels = malloc((size_t)BENCH_WIDTH * BENCH_HEIGHT * 4);
+    rgb = malloc((size_t)BENCH_WIDTH * BENCH_HEIGHT * 3);
+
+    if (scaled.pixels == NULL || rgb == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the images\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Any image works for the conversions, so start from a gradient */
+    for (i = 0; i < (size_t)BENCH_WIDTH * BENCH_HEIGHT * 3; i++)
+        rgb[i] = (unsigned char)(i * 7 / 3);
+
+    printf("%dx%d, average of %d decodes\n", BENCH_WIDTH, BENCH_HEIGHT,
+           NUM_RUNS);
+    printf("%-32s %-14s %8s %10s %8s\n", "image", "decoder", "channels",
+           "ms", "MP/s");
+
+    while ((entry = readdir(dir)) != NULL) {
+        extension = strrchr(entry->d_name, '.');
+
+        if (extension == NULL
+            || (strcmp(extension, ".png") != 0
+                && strcmp(extension, ".jpg") != 0))
+            continue;
+
+        snprintf(source, sizeof(source), "res/%s", entry->d_name);
+
+        if (!load_image(&img, source, 0)) {
+            fprintf(stderr, "Error: Failed to load %s\n", source);
+            continue;
+        }
+
+        scaled.num_channels = img.num_channels;
+        scale_image(&img, &scaled);
+        free_image(&img);
+
+        if (!write_image(&scaled, source, path, sizeof(path))) {
+            fprintf(stderr, "Error: Failed to write %s\n", path);
+            continue;
+        }
+
+        ms = time_decode(path, &num_channels);
+        remove(path);
+
+        if (ms < 0.0) {
+            fprintf(stderr, "Error: Failed to decode %s\n", path);
+            continue;
+        }
+
+        printf("%-32s %-14s %8d %10.2f %8.1f\n", entry->d_name,
+               image_decoder_name(path), num_channels, ms,
+               (double)BENCH_WIDTH * BENCH_HEIGHT / 1000.0 / ms);
+    }
+
+    closedir(dir);
+
+    time_conversions(rgb);
+
+    free(scaled.pixels);
+    free(rgb);
+
+    return 0;
+}
+
+void
+scale_image(const image *src, image *dst)
+{
+    int x;
+    int y;
+    int c;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    float fx;
+    float fy;
+    float top;
+    float bottom;
+    int channels = src->num_channels;
+
+    for (y = 0; y < dst->height; y++) {
+        fy = (y + 0.5f) * src->height / dst->height - 0.5f;
+        fy = fy < 0.0f ? 0.0f : fy;
+        y0 = (int)fy;
+        y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        fy -= y0;
+
+        for (x = 0; x < dst->width; x++) {
+            fx = (x + 0.5f) * src->width / dst->width - 0.5f;
+            fx = fx < 0.0f ? 0.0f : fx;
+            x0 = (int)fx;
+            x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            fx -= x0;
+
+            for (c = 0; c < channels; c++) {
+                top = src->pixels[((size_t)y0 * src->width + x0) * channels + c]
+                      * (1.0f - fx)
+                      + src->pixels[((size_t)y0 * src->width + x1) * channels
+                                    + c] * fx;
+                bottom = src->pixels[((size_t)y1 * src->width + x0) * channels
+                                     + c] * (1.0f - fx)
+                         + src->pixels[((size_t)y1 * src->width + x1)
+                                       * channels + c] * fx;
+
+                dst->pixels[((size_t)y * dst->width + x) * channels + c] =
+                    (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+}
+
+bool
+write_image(const image *img, const char *source, char *path, size_t size)
+{
+    const char *temp_dir = getenv("TMPDIR");
+    const char *name = strrchr(source, '/');
+
+    if (temp_dir == NULL)
+        temp_dir = "/tmp";
+
+    if (snprintf(path, size, "%s/bench_decode_%s", temp_dir,
+                 name != NULL ? name + 1 : source) >= (int)size)
+        return false;
+
+    if (strcmp(strrchr(source, '.'), ".jpg") == 0)
+        return stbi_write_jpg(path, img->width, img->height, img->num_channels,
+                              img->pixels, JPEG_QUALITY);
+
+    return stbi_write_png(path, img->width, img->height, img->num_channels,
+                          img->pixels, img->width * img->num_channels);
+}
+
+double
+time_decode(const char *path, int *num_channels)
+{
+    image img;
+    unsigned int run;
+    double start;
+    double total = 0.0;
+
+    /* The first decode warms the file cache and is not counted */
+    for (run = 0; run <= NUM_RUNS; run++) {
+        start = now_ms();
+
+        if (!load_image(&img, path, IMAGE_FLIP))
+            return -1.0;
+
+        if (run > 0)
+            total += now_ms() - start;
+
+        *num_channels = img.num_channels;
+        free_image(&img);
+    }
+
+    return total / NUM_RUNS;
+}
+
+void
+time_conversions(const unsigned char *rgb)
+{
+    size_t count = (size_t)BENCH_WIDTH * BENCH_HEIGHT;
+    unsigned char *scalar = malloc(count * 4);
+    unsigned char *vector = malloc(count * 4);
+    double scalar_ms[3] = {0.0};
+    double vector_ms[3] = {0.0};
+    const char *names[3] = {"rgb to rgba", "swap red/blue", "premultiply"};
+    unsigned int run;
+    unsigned int i;
+    double start;
+
+    if (scalar == NULL || vector == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the images\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+        convert_to_rgba_scalar(scalar, rgb, 3, count);
+        scalar_ms[0] += now_ms() - start;
+
+        start = now_ms();
+        convert_to_rgba(vector, rgb, 3, count);
+        vector_ms[0] += now_ms() - start;
+
+        start = now_ms();
+        swap_red_blue_scalar(scalar, count);
+        scalar_ms[1] += now_ms() - start;
+
+        start = now_ms();
+        swap_red_blue(vector, count);
+        vector_ms[1] += now_ms() - start;
+
+        if (memcmp(scalar, vector, count * 4) != 0) {
+            fprintf(stderr, "Error: The vector conversions do not match the "
+                    "plain C ones\n");
+            exit(EXIT_FAILURE);
+        }
+
+        /* Converted RGB is opaque, which would make premultiplying a copy */
+        seed_alpha(scalar, count);
+        seed_alpha(vector, count);
+
+        start = now_ms();
+        premultiply_alpha_scalar(scalar, count);
+        scalar_ms[2] += now_ms() - start;
+
+        start = now_ms();
+        premultiply_alpha(vector, count);
+        vector_ms[2] += now_ms() - start;
+
+        if (memcmp(scalar, vector, count * 4) != 0) {
+            fprintf(stderr, "Error: The vector premultiply does not match the "
+                    "plain C one\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("\n%-16s %10s %10s %8s\n", "conversion", "scalar ms", "vector ms",
+           "speedup");
+
+    for (i = 0; i < 3; i++)
+        printf("%-16s %10.2f %10.2f %7.2fx\n", names[i],
+               scalar_ms[i] / NUM_RUNS, vector_ms[i] / NUM_RUNS,
+               scalar_ms[i] / vector_ms[i]);
+
+    free(scalar);
+    free(vector);
+}
+
+void
+seed_alpha(unsigned char *pixels, size_t count)
+{
+    static const unsigned char edges[6] = {0, 1, 127, 128, 254, 255};
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        pixels[i * 4 + 3] = i % 16 < 6 ? edges[i % 16]
+                                       : (unsigned char)(i * 151 / 7);
+}
+
+/* EOF */
@@ -0,0 +1,327 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/allocator.h"
+#include "../include/bench_common.h"
+#include "../include/job.h"
+#include "../include/mem_tracker.h"
+#include "../include/render_queue.h"
+#include "../include/transform.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+/* The check counts heap calls, which only a tracking build sees */
+#ifndef MEMORY_TRACKING
+#error "bench_frame needs MEMORY_TRACKING and its --wrap link flags"
+#endif
+
+/* A grid of spinning roots, each with a ring of cubes around it */
+#define GRID_SIZE 10
+#define GRID_SPACING 10.0f
+#define CUBES_PER_ROOT 100
+#define RING_RADIUS 3.0f
+
+#define NUM_PROGRAMS 2
+#define NUM_MATERIALS 4
+#define NUM_VAOS 3
+
+#define FAR_PLANE 100.0f
+
+/* The camera goes a quarter of the way round over this many frames */
+#define NUM_FRAMES 200
+
+typedef struct frame_scene frame_scene;
+
+/* Everything a frame touches, built once */
+struct frame_scene
+{
+    transform_hierarchy transforms;
+    render_queue queue;
+
+    program_info depth_program;
+    program_info programs[NUM_PROGRAMS];
+    material materials[NUM_MATERIALS];
+
+    unsigned int num_roots;
+};
+
+/**
+ * @brief Builds the hierarchy, the programs and the materials
+ *
+ * @param[out] scene The scene
+ */
+void build_scene(frame_scene *scene);
+
+/**
+ * @brief Does the CPU side of one frame the way main does: spins the roots,
+ * updates the transforms, culls the cubes, queues a depth and an opaque
+ * packet for each visible one and records the queue. Nothing is replayed, so
+ * no GL is needed
+ *
+ * @param[in, out] scene The scene
+ * @param[in] frame The frame number, which sets the spin and the camera
+ *
+ * @return The number of packets recorded
+ */
+unsigned int record_frame(frame_scene *scene, unsigned int frame);
+
+/**
+ * @brief Records the frames twice, the first time to let the arrays grow to
+ * what they need. Times the second pass and counts the heap allocations it
+ * makes on this thread
+ *
+ * @param[in, out] scene The scene
+ * @param[out] num_packets The packets of the last frame
+ * @param[out] num_allocations The heap allocations of the second pass
+ *
+ * @return The average milliseconds per frame of the second pass
+ */
+double time_frames(frame_scene *scene, unsigned int *num_packets,
+                   unsigned long *num_allocations);
+
+int
+main(void)
+{
+    frame_scene scene;
+    unsigned int num_workers[2];
+    unsigned int num_packets;
+    unsigned int i;
+    unsigned long num_allocations;
+    long num_cpus;
+    double ms;
+
+    init_memory();
+
+    /* Anything the frames allocate is per frame work, as in main */
+    set_memory_category(MEMORY_SCRATCH);
+
+    build_scene(&scene);
+
+    /* With no workers every job runs here, so the count covers all of it */
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers[0] = 0;
+    num_workers[1] = num_cpus > 1 ? num_cpus - 1 : 0;
+
+    printf("%zu cubes under %u roots, %u steady-state frames\n",
+           scene.transforms.count - scene.num_roots, scene.num_roots,
+           NUM_FRAMES);
+    printf("%-8s %10s %10s %12s\n", "threads", "packets", "ms",
+           "allocations");
+
+    for (i = 0; i < 2; i++) {
+        start_job_system(num_workers[i]);
+        ms = time_frames(&scene, &num_packets, &num_allocations);
+
+        printf("%-8u %10u %10.3f %12lu\n", num_job_threads(), num_packets, ms,
+               num_allocations);
+
+        stop_job_system();
+
+        if (num_allocations != 0) {
+            fprintf(stderr, "Error: Steady-state frames made %lu heap "
+                    "allocations\n", num_allocations);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("Steady-state frames made no heap allocations\n");
+
+    delete_render_queue(&scene.queue);
+    free_transforms(&scene.transforms);
+    shutdown_memory();
+
+    return 0;
+}
+
+void
+build_scene(frame_scene *scene)
+{
+    unsigned int texture;
+    unsigned int root;
+    unsigned int x;
+    unsigned int z;
+    unsigned int i;
+    float angle;
+    vec3 position;
+    vec3 scale = {1.0f, 1.0f, 1.0f};
+    versor rotation;
+
+    memset(scene, 0, sizeof(*scene));
+
+    create_render_queue(&scene->queue, NULL, NULL, NULL);
+
+    /* Only the ids and locations matter, nothing is ever issued */
+    scene->depth_program.id = 1;
+    scene->depth_program.model_loc = 0;
+    scene->depth_program.norm_loc = -1;
+    scene->depth_program.shininess_loc = -1;
+
+    for (i = 0; i < NUM_PROGRAMS; i++) {
+        scene->programs[i].id = 2 + i;
+        scene->programs[i].model_loc = 0;
+        scene->programs[i].norm_loc = 1;
+        scene->programs[i].shininess_loc = 2;
+    }
+
+    for (i = 0; i < NUM_MATERIALS; i++) {
+        texture = 1 + i;
+        init_material(&scene->materials[i], &texture, 1, 32.0f);
+    }
+
+    glm_quat_identity(rotation);
+
+    for (z = 0; z < GRID_SIZE; z++) {
+        for (x = 0; x < GRID_SIZE; x++) {
+            position[0] = x * GRID_SPACING;
+            position[1] = 0.0f;
+            position[2] = z * GRID_SPACING;
+
+            root = add_transform(&scene->transforms, TRANSFORM_NO_PARENT,
+                                 position, rotation, scale);
+            scene->num_roots++;
+
+            for (i = 0; i < CUBES_PER_ROOT; i++) {
+                angle = 2.0f * GLM_PIf * i / CUBES_PER_ROOT;
+
+                position[0] = RING_RADIUS * cosf(angle);
+                position[1] = 0.0f;
+                position[2] = RING_RADIUS * sinf(angle);
+
+                add_transform(&scene->transforms, root, position, rotation,
+                              scale);
+            }
+        }
+    }
+}
+
+unsigned int
+record_frame(frame_scene *scene, unsigned int frame)
+{
+    transform_hierarchy *h = &scene->transforms;
+    const program_info *program;
+    const material *mat;
+    draw_packet *packet;
+    unsigned int *visible;
+    unsigned int num_visible = 0;
+    unsigned int num_packets;
+    unsigned int vao;
+    size_t node;
+    unsigned int i;
+    unsigned int p;
+    float angle = 0.5f * GLM_PIf * frame / NUM_FRAMES;
+    float center = (GRID_SIZE - 1) * GRID_SPACING * 0.5f;
+    float depth;
+    float *position;
+    vec3 camera;
+    vec3 target = {center, 0.0f, center};
+    vec4 planes[6];
+    versor rotation;
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+
+    reset_arena(&frame_arena);
+
+    /* Every root turns, so every cube is recomputed */
+    glm_quatv(rotation, angle, GLM_YUP);
+
+    for (node = 0; node < h->count; node += CUBES_PER_ROOT + 1)
+        set_transform(h, node, h->positions[node], rotation,
+                      h->scales[node]);
+
+    update_world_transforms(h);
+
+    /* Circles the grid from close enough that part of it is off screen */
+    camera[0] = center + 40.0f * sinf(angle);
+    camera[1] = 15.0f;
+    camera[2] = center + 40.0f * cosf(angle);
+
+    glm_lookat(camera, target, GLM_YUP, view);
+    glm_perspective(glm_rad(45.0f), 800.0f / 600.0f, 0.1f, FAR_PLANE,
+                    projection);
+    glm_mat4_mul(projection, view, view_projection);
+    glm_frustum_planes(view_projection, planes);
+
+    visible = arena_alloc(&frame_arena, h->count * sizeof(*visible),
+                          sizeof(*visible));
+
+    if (visible == NULL) {
+        fprintf(stderr, "Error: The frame arena is too small\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (node = 0; node < h->count; node++) {
+        if (h->parents[node] == TRANSFORM_NO_PARENT)
+            continue;
+
+        position = h->world[node][3];
+
+        for (p = 0; p < 6; p++)
+            if (glm_vec3_dot(planes[p], position) + planes[p][3] < -1.0f)
+                break;
+
+        if (p == 6)
+            visible[num_visible++] = node;
+    }
+
+    for (i = 0; i < num_visible; i++) {
+        node = visible[i];
+        depth = glm_vec3_distance(camera, h->world[node][3]) / FAR_PLANE;
+        program = &scene->programs[node % NUM_PROGRAMS];
+        mat = &scene->materials[node % NUM_MATERIALS];
+        vao = 1 + node % NUM_VAOS;
+
+        packet = push_draw_packet(&scene->queue);
+
+        packet->key = make_render_key(PASS_DEPTH, scene->depth_program.id, 0,
+                                      vao, depth);
+        packet->program = &scene->depth_program;
+        packet->vao = vao;
+        packet->count = 36;
+        glm_mat4_copy(h->world[node], packet->model);
+
+        packet = push_draw_packet(&scene->queue);
+
+        packet->key = make_render_key(PASS_OPAQUE, program->id, mat->id, vao,
+                                      depth);
+        packet->program = program;
+        packet->material = mat;
+        packet->vao = vao;
+        packet->count = 36;
+        glm_mat4_copy(h->world[node], packet->model);
+        glm_mat3_copy(h->normal[node], packet->norm);
+    }
+
+    num_packets = arrlen(scene->queue.packets);
+    record_render_queue(&scene->queue);
+
+    return num_packets;
+}
+
+double
+time_frames(frame_scene *scene, unsigned int *num_packets,
+            unsigned long *num_allocations)
+{
+    unsigned int frame;
+    unsigned long before;
+    double start;
+
+    for (frame = 0; frame < NUM_FRAMES; frame++)
+        record_frame(scene, frame);
+
+    before = heap_allocations();
+    start = now_ms();
+
+    for (frame = 0; frame < NUM_FRAMES; frame++)
+        *num_packets = record_frame(scene, frame);
+
+    *num_allocations = heap_allocations() - before;
+
+    return (now_ms() - start) / NUM_FRAMES;
+}
+
+/* EOF */
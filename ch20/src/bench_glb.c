@@ -0,0 +1,350 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../include/bench_common.h"
+#include "../include/gl_ext.h"
+#include "../include/gl_state.h"
+#include "../include/glb_loader.h"
+#include "../include/mem_tracker.h"
+
+#include <stb_ds.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+/* A grid of this many quads per side, written as two triangles each */
+#define GRID_SIZE 500
+
+#define NUM_RUNS 5
+
+/* The ways write_grid can lay out a file */
+#define GLB_DIRECT 0
+#define GLB_MISALIGNED 1
+#define GLB_BAD_INDEX 2
+
+/**
+ * @brief Writes a grid as a .glb file, with interleaved float positions,
+ * normals and texture coordinates and 32-bit indices
+ *
+ * @param[in] path The path to the file
+ * @param[in] layout GLB_DIRECT for a file the GL can read as it is,
+ * GLB_MISALIGNED to start the vertices off a 4 byte boundary so they have
+ * to be converted, or GLB_BAD_INDEX to add a second mesh after the grid
+ * whose indices go past its vertices
+ */
+void write_grid(const char *path, unsigned int layout);
+
+/**
+ * @brief Times loading a file and deleting what it made
+ *
+ * @param[in] path The .glb file
+ * @param[out] num_converted How many primitives had to be converted
+ *
+ * @return The average milliseconds per load
+ */
+double time_load(const char *path, unsigned int *num_converted);
+
+/**
+ * @brief Deletes the meshes of a model and frees it
+ *
+ * @param[in, out] model The model
+ */
+void delete_glb_meshes(glb_model *model);
+
+/**
+ * @brief Gets the GPU memory held by meshes, to check nothing leaked
+ *
+ * @return The live bytes
+ */
+size_t mesh_gpu_bytes(void);
+
+int
+main(void)
+{
+    static const char *const names[3] = {"direct", "misaligned", "bad"};
+
+    GLFWwindow *window;
+    glb_model model;
+    struct stat info;
+    char paths[3][1024];
+    const char *temp_dir = getenv("TMPDIR");
+    unsigned int num_converted;
+    unsigned int i;
+    size_t before;
+    double ms;
+
+    if (temp_dir == NULL)
+        temp_dir = "/tmp";
+
+    /* The loader uploads as it goes, so it needs a context */
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    window = glfwCreateWindow(64, 64, "bench_glb", NULL, NULL);
+
+    if (window == NULL) {
+        fprintf(stderr, "Error: Failed to create GLFW window\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "Error: Failed to initialize GLAD\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    invalidate_gl_state();
+    load_gl_extensions((GLADloadproc)glfwGetProcAddress);
+
+    for (i = 0; i < 3; i++) {
+        if (snprintf(paths[i], sizeof(paths[i]), "%s/bench_glb_%s.glb",
+                     temp_dir, names[i]) >= (int)sizeof(paths[i])) {
+            fprintf(stderr, "Error: TMPDIR is too long\n");
+            exit(EXIT_FAILURE);
+        }
+
+        write_grid(paths[i], i);
+    }
+
+    printf("%u triangles per grid\n", GRID_SIZE * GRID_SIZE * 2);
+    printf("%-12s %10s %10s %10s\n", "file", "MB", "ms", "converted");
+
+    for (i = GLB_DIRECT; i <= GLB_MISALIGNED; i++) {
+        if (stat(paths[i], &info) != 0) {
+            fprintf(stderr, "Error: Could not write %s\n", paths[i]);
+            exit(EXIT_FAILURE);
+        }
+
+        ms = time_load(paths[i], &num_converted);
+
+        printf("%-12s %10.1f %10.2f %10u\n", names[i],
+               info.st_size / 1048576.0, ms, num_converted);
+    }
+
+    /* The grid loads before the bad mesh fails, and has to be deleted */
+    before = mesh_gpu_bytes();
+
+    if (load_glb(&model, paths[GLB_BAD_INDEX])) {
+        fprintf(stderr, "Error: %s loaded despite its bad index\n",
+                paths[GLB_BAD_INDEX]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (mesh_gpu_bytes() != before) {
+        fprintf(stderr, "Error: A failed load left %zu bytes of meshes\n",
+                mesh_gpu_bytes() - before);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("A failed load left no meshes behind\n");
+
+    for (i = 0; i < 3; i++)
+        remove(paths[i]);
+
+    glfwTerminate();
+
+    return 0;
+}
+
+void
+write_grid(const char *path, unsigned int layout)
+{
+    static const unsigned int bad_indices[3] = {0, 1, 0xffffff};
+
+    FILE *fp;
+    char json[2048];
+    size_t side = GRID_SIZE + 1;
+    size_t num_vertices = side * side;
+    size_t num_indices = (size_t)GRID_SIZE * GRID_SIZE * 6;
+    size_t vertex_start = layout == GLB_MISALIGNED ? 2 : 0;
+    size_t index_start = (vertex_start + num_vertices * 32 + 3) & ~(size_t)3;
+    size_t bad_start = index_start + num_indices * 4;
+    size_t bin_size = bad_start + (layout == GLB_BAD_INDEX ? 12 : 0);
+    size_t json_size;
+    size_t x;
+    size_t z;
+    uint32_t header[5];
+    uint32_t *indices;
+    unsigned char *bin;
+    float vertex[8];
+    int length;
+
+    length = snprintf(
+        json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,"
+        "\"scenes\":[{\"nodes\":[0%s]}],"
+        "\"nodes\":[{\"mesh\":0}%s],"
+        "\"buffers\":[{\"byteLength\":%zu}],"
+        "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,"
+        "\"byteStride\":32},"
+        "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},"
+        "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":12}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"componentType\":5126,\"count\":%zu,"
+        "\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,"
+        "\"count\":%zu,\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,"
+        "\"count\":%zu,\"type\":\"VEC2\"},"
+        "{\"bufferView\":1,\"componentType\":5125,\"count\":%zu,"
+        "\"type\":\"SCALAR\"},"
+        "{\"bufferView\":2,\"componentType\":5125,\"count\":3,"
+        "\"type\":\"SCALAR\"}],"
+        "\"meshes\":["
+        "{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,"
+        "\"TEXCOORD_0\":2},\"indices\":3}]}%s]}",
+        layout == GLB_BAD_INDEX ? ",1" : "",
+        layout == GLB_BAD_INDEX ? ",{\"mesh\":1}" : "", bin_size,
+        vertex_start, num_vertices * 32, index_start, num_indices * 4,
+        bad_start, num_vertices, num_vertices, num_vertices, num_indices,
+        layout == GLB_BAD_INDEX
+            ? ",{\"primitives\":[{\"attributes\":{\"POSITION\":0},"
+              "\"indices\":4}]}"
+            : "");
+
+    if (length < 0 || length >= (int)sizeof(json)) {
+        fprintf(stderr, "Error: The glb JSON does not fit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Chunks are padded to 4 bytes, JSON with spaces */
+    json_size = (length + 3) & ~3;
+    memset(json + length, ' ', json_size - length);
+
+    bin_size = (bin_size + 3) & ~(size_t)3;
+    bin = calloc(bin_size, 1);
+
+    if (bin == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the grid\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Copied in, as the misaligned layout puts them off a float boundary */
+    vertex[1] = 0.0f;
+    vertex[3] = 0.0f;
+    vertex[4] = 1.0f;
+    vertex[5] = 0.0f;
+
+    for (z = 0; z < side; z++) {
+        for (x = 0; x < side; x++) {
+            vertex[0] = (float)x;
+            vertex[2] = (float)z;
+            vertex[6] = (float)x / GRID_SIZE;
+            vertex[7] = (float)z / GRID_SIZE;
+
+            memcpy(bin + vertex_start + (z * side + x) * sizeof(vertex),
+                   vertex, sizeof(vertex));
+        }
+    }
+
+    indices = (uint32_t *)(bin + index_start);
+
+    for (z = 0; z < GRID_SIZE; z++) {
+        for (x = 0; x < GRID_SIZE; x++) {
+            *indices++ = z * side + x;
+            *indices++ = (z + 1) * side + x;
+            *indices++ = z * side + x + 1;
+            *indices++ = z * side + x + 1;
+            *indices++ = (z + 1) * side + x;
+            *indices++ = (z + 1) * side + x + 1;
+        }
+    }
+
+    if (layout == GLB_BAD_INDEX)
+        memcpy(bin + bad_start, bad_indices, sizeof(bad_indices));
+
+    header[0] = GLB_MAGIC;
+    header[1] = 2;
+    header[2] = 12 + 8 + json_size + 8 + bin_size;
+    header[3] = json_size;
+    header[4] = GLB_CHUNK_JSON;
+
+    fp = fopen(path, "wb");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fwrite(header, sizeof(header), 1, fp);
+    fwrite(json, json_size, 1, fp);
+
+    header[0] = bin_size;
+    header[1] = GLB_CHUNK_BIN;
+
+    fwrite(header, 2 * sizeof(*header), 1, fp);
+    fwrite(bin, bin_size, 1, fp);
+    fclose(fp);
+
+    free(bin);
+}
+
+double
+time_load(const char *path, unsigned int *num_converted)
+{
+    glb_model model;
+    unsigned int run;
+    size_t before = mesh_gpu_bytes();
+    double start;
+    double total = 0.0;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        if (!load_glb(&model, path)) {
+            fprintf(stderr, "Error: Could not load %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        /* Includes the upload, which is most of what loading is */
+        glFinish();
+        total += now_ms() - start;
+
+        if (arrlen(model.primitives) != 1
+            || model.primitives[0].mesh->num_indices
+                   != (size_t)GRID_SIZE * GRID_SIZE * 6) {
+            fprintf(stderr, "Error: %s did not load as one grid\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        *num_converted = model.num_converted;
+        delete_glb_meshes(&model);
+    }
+
+    if (mesh_gpu_bytes() != before) {
+        fprintf(stderr, "Error: Deleting %s left %zu bytes of meshes\n",
+                path, mesh_gpu_bytes() - before);
+        exit(EXIT_FAILURE);
+    }
+
+    return total / NUM_RUNS;
+}
+
+void
+delete_glb_meshes(glb_model *model)
+{
+    size_t i;
+
+    for (i = 0; i < arrlenu(model->primitives); i++)
+        delete_mesh(model->primitives[i].mesh);
+
+    free_glb(model);
+}
+
+size_t
+mesh_gpu_bytes(void)
+{
+    return get_memory_usage(MEMORY_MESH).gpu_live;
+}
+
+/* EOF */
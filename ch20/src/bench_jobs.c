@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../include/bench_common.h"
+#include "../include/job.h"
+
+#include <cglm/cglm.h>
+
+/* Enough objects that a frame of work is well above the scheduling cost */
+#define NUM_OBJECTS (1 << 18)
+
+/* Objects per job */
+#define BATCH_SIZE 1024
+
+#define NUM_FRAMES 20
+
+typedef struct bench_scene bench_scene;
+
+/* The same per-object work the renderer hands to the job system */
+struct bench_scene
+{
+    vec3 *positions;
+    mat4 *models;
+    mat3 *norms;
+    bool *visible;
+
+    vec4 planes[6];
+    float angle;
+};
+
+/**
+ * @brief Builds the model and normal matrices of one batch of objects
+ *
+ * @param[in] task The index of the batch
+ * @param[in, out] data The bench_scene
+ */
+void bench_transforms(unsigned int task, void *data);
+
+/**
+ * @brief Tests one batch of objects against the frustum
+ *
+ * @param[in] task The index of the batch
+ * @param[in, out] data The bench_scene
+ */
+void bench_cull(unsigned int task, void *data);
+
+/**
+ * @brief Runs the benchmark frames on the running job system
+ *
+ * @param[in, out] scene The scene to update
+ *
+ * @return The average milliseconds per frame
+ */
+double run_frames(bench_scene *scene);
+
+int
+main(void)
+{
+    bench_scene scene;
+
+    CGLM_ALIGN_MAT mat4 view_projection;
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int i;
+    double base_ms = 0.0;
+    double ms;
+
+    scene.positions = malloc(NUM_OBJECTS * sizeof(*scene.positions));
+    scene.models = malloc(NUM_OBJECTS * sizeof(*scene.models));
+    scene.norms = malloc(NUM_OBJECTS * sizeof(*scene.norms));
+    scene.visible = malloc(NUM_OBJECTS * sizeof(*scene.visible));
+
+    if (scene.positions == NULL || scene.models == NULL || scene.norms == NULL
+        || scene.visible == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the scene\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        scene.positions[i][0] = (rand() / (float)RAND_MAX - 0.5f) * 200.0f;
+        scene.positions[i][1] = (rand() / (float)RAND_MAX - 0.5f) * 200.0f;
+        scene.positions[i][2] = (rand() / (float)RAND_MAX - 0.5f) * 200.0f;
+    }
+
+    glm_perspective(glm_rad(45.0f), 800.0f / 600.0f, 0.1f, 100.0f,
+                    view_projection);
+    glm_frustum_planes(view_projection, scene.planes);
+
+    if (num_cpus < 1)
+        num_cpus = 1;
+
+    printf("%d objects, %d frames\n", NUM_OBJECTS, NUM_FRAMES);
+    printf("threads  ms/frame  speedup\n");
+
+    for (i = 1; i <= (unsigned int)num_cpus; i++) {
+        start_job_system(i - 1);
+        ms = run_frames(&scene);
+        stop_job_system();
+
+        if (i == 1)
+            base_ms = ms;
+
+        printf("%7u  %8.3f  %6.2fx\n", i, ms, base_ms / ms);
+    }
+
+    free(scene.positions);
+    free(scene.models);
+    free(scene.norms);
+    free(scene.visible);
+
+    return 0;
+}
+
+void
+bench_transforms(unsigned int task, void *data)
+{
+    bench_scene *scene = data;
+    unsigned int i;
+    mat4 inverse;
+
+    for (i = task * BATCH_SIZE; i < (task + 1) * BATCH_SIZE; i++) {
+        glm_mat4_identity(scene->models[i]);
+        glm_translate(scene->models[i], scene->positions[i]);
+        glm_rotate(scene->models[i], scene->angle + i,
+                   (vec3){1.0f, 0.3f, 0.5f});
+
+        glm_mat4_inv(scene->models[i], inverse);
+        glm_mat4_pick3t(inverse, scene->norms[i]);
+    }
+}
+
+void
+bench_cull(unsigned int task, void *data)
+{
+    bench_scene *scene = data;
+    unsigned int i;
+    unsigned int p;
+    vec3 center;
+
+    for (i = task * BATCH_SIZE; i < (task + 1) * BATCH_SIZE; i++) {
+        glm_vec3_copy(scene->models[i][3], center);
+        scene->visible[i] = true;
+
+        for (p = 0; p < 6; p++) {
+            if (glm_vec3_dot(scene->planes[p], center) + scene->planes[p][3]
+                < -0.8660254f) {
+                scene->visible[i] = false;
+                break;
+            }
+        }
+    }
+}
+
+double
+run_frames(bench_scene *scene)
+{
+    job *group;
+    unsigned int frame;
+    double start;
+
+    /* Warm up so thread start-up is not part of the timing */
+    scene->angle = 0.0f;
+    parallel_for(NUM_OBJECTS / BATCH_SIZE, bench_transforms, scene);
+
+    start = now_ms();
+
+    for (frame = 0; frame < NUM_FRAMES; frame++) {
+        scene->angle = frame * 0.01f;
+
+        group = create_job(NULL, NULL, 0);
+        run_job_tasks(group, NUM_OBJECTS / BATCH_SIZE, bench_transforms,
+                      scene);
+        run_job(group);
+        wait_job(group);
+
+        /* Culling reads the translations the transform jobs wrote */
+        group = create_job(NULL, NULL, 0);
+        run_job_tasks(group, NUM_OBJECTS / BATCH_SIZE, bench_cull, scene);
+        run_job(group);
+        wait_job(group);
+    }
+
+    return (now_ms() - start) / NUM_FRAMES;
+}
+
+/* EOF */
@@ -0,0 +1,228 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/bench_common.h"
+#include "../include/mesh_file.h"
+
+/* A grid of this many quads per side is just over 10M triangles */
+#define GRID_SIZE 2237
+
+#define NUM_RUNS 5
+
+/**
+ * @brief Builds a flat grid mesh
+ *
+ * @param[out] vertices The vertices, to be freed by the caller
+ * @param[out] num_vertices The number of vertices
+ * @param[out] indices The indices, to be freed by the caller
+ * @param[out] num_indices The number of indices
+ */
+void build_grid(vertex **vertices, size_t *num_vertices,
+                unsigned int **indices, size_t *num_indices);
+
+/**
+ * @brief Times mapping a mesh file and copying its sections out, the same
+ * work glBufferData does with the mapping
+ *
+ * @param[in] path The mesh file
+ * @param[out] buffer Where the sections are copied, as big as the file
+ *
+ * @return The average milliseconds per load
+ */
+double time_mapped_load(const char *path, unsigned char *buffer);
+
+/**
+ * @brief Times reading the whole file with read(), the least any loader
+ * could do
+ *
+ * @param[in] path The mesh file
+ * @param[out] buffer Where the file is read to, as big as the file
+ * @param[in] size The size of the file
+ *
+ * @return The average milliseconds per read
+ */
+double time_read(const char *path, unsigned char *buffer, size_t size);
+
+int
+main(void)
+{
+    vertex *vertices;
+    unsigned int *indices;
+    size_t num_vertices;
+    size_t num_indices;
+    unsigned char *buffer;
+    char path[1024];
+    const char *temp_dir = getenv("TMPDIR");
+    mesh_file mf;
+    size_t size;
+    double mapped_ms;
+    double read_ms;
+
+    if (temp_dir == NULL)
+        temp_dir = "/tmp";
+
+    snprintf(path, sizeof(path), "%s/bench_mesh.mesh", temp_dir);
+
+    build_grid(&vertices, &num_vertices, &indices, &num_indices);
+
+    if (!write_mesh_file(path, vertices, num_vertices, indices, num_indices,
+                         NULL, 0, NULL, 0)) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    free(vertices);
+    free(indices);
+
+    if (!open_mesh_file(&mf, path)) {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size = mf.size;
+    close_mesh_file(&mf);
+
+    buffer = malloc(size);
+
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mapped_ms = time_mapped_load(path, buffer);
+    read_ms = time_read(path, buffer, size);
+
+    printf("%zu triangles, %zu vertices, %.1f MB file, cached in memory\n",
+           num_indices / 3, num_vertices, size / 1048576.0);
+    printf("%-12s %10s %10s\n", "load", "ms", "MB/s");
+    printf("%-12s %10.2f %10.0f\n", "mapped", mapped_ms,
+           size / 1048576.0 / (mapped_ms / 1000.0));
+    printf("%-12s %10.2f %10.0f\n", "read()", read_ms,
+           size / 1048576.0 / (read_ms / 1000.0));
+
+    free(buffer);
+    remove(path);
+
+    return 0;
+}
+
+void
+build_grid(vertex **vertices, size_t *num_vertices, unsigned int **indices,
+           size_t *num_indices)
+{
+    size_t side = GRID_SIZE + 1;
+    size_t x;
+    size_t z;
+    vertex *v;
+    unsigned int *i;
+
+    *num_vertices = side * side;
+    *num_indices = (size_t)GRID_SIZE * GRID_SIZE * 6;
+    *vertices = malloc(*num_vertices * sizeof(**vertices));
+    *indices = malloc(*num_indices * sizeof(**indices));
+
+    if (*vertices == NULL || *indices == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the grid\n");
+        exit(EXIT_FAILURE);
+    }
+
+    v = *vertices;
+    i = *indices;
+
+    for (z = 0; z < side; z++) {
+        for (x = 0; x < side; x++, v++) {
+            v->position[0] = (float)x;
+            v->position[1] = 0.0f;
+            v->position[2] = (float)z;
+            v->normal[0] = 0.0f;
+            v->normal[1] = 1.0f;
+            v->normal[2] = 0.0f;
+            v->tex_coords[0] = (float)x / GRID_SIZE;
+            v->tex_coords[1] = (float)z / GRID_SIZE;
+        }
+    }
+
+    for (z = 0; z < GRID_SIZE; z++) {
+        for (x = 0; x < GRID_SIZE; x++) {
+            *i++ = z * side + x;
+            *i++ = (z + 1) * side + x;
+            *i++ = z * side + x + 1;
+            *i++ = z * side + x + 1;
+            *i++ = (z + 1) * side + x;
+            *i++ = (z + 1) * side + x + 1;
+        }
+    }
+}
+
+double
+time_mapped_load(const char *path, unsigned char *buffer)
+{
+    mesh_file mf;
+    unsigned int run;
+    double start;
+    double total = 0.0;
+    size_t vertex_bytes;
+    size_t index_bytes;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        if (!open_mesh_file(&mf, path)) {
+            fprintf(stderr, "Error: Could not open %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        vertex_bytes = mf.header->num_vertices * mf.header->vertex_stride;
+        index_bytes = mf.header->num_indices
+                      * (mf.header->index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+
+        memcpy(buffer, mf.vertices, vertex_bytes);
+        memcpy(buffer + vertex_bytes, mf.indices, index_bytes);
+
+        close_mesh_file(&mf);
+
+        total += now_ms() - start;
+    }
+
+    return total / NUM_RUNS;
+}
+
+double
+time_read(const char *path, unsigned char *buffer, size_t size)
+{
+    unsigned int run;
+    double start;
+    double total = 0.0;
+    size_t done;
+    ssize_t got;
+    int fd;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        fd = open(path, O_RDONLY);
+
+        if (fd < 0) {
+            fprintf(stderr, "Error: Could not open %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        for (done = 0; done < size; done += got) {
+            got = read(fd, buffer + done, size - done);
+
+            if (got <= 0)
+                break;
+        }
+
+        close(fd);
+
+        total += now_ms() - start;
+    }
+
+    return total / NUM_RUNS;
+}
+
+/* EOF */
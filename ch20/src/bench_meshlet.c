@@ -0,0 +1,159 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bench_common.h"
+#include "../include/meshlet.h"
+#include "../include/multi_draw.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+/* A unit sphere of this many segments and rings is about 160k triangles */
+#define SPHERE_SEGMENTS 400
+#define SPHERE_RINGS 200
+
+/* The camera circles the sphere once over this many frames */
+#define NUM_FRAMES 8
+#define ORBIT_RADIUS 3.0f
+
+#define NUM_RUNS 100
+
+/**
+ * @brief Builds the frustum planes of a frame. The camera circles the
+ * sphere and looks further off to the side of it each frame, so the later
+ * frames lose more to the frustum
+ *
+ * @param[in] frame The frame
+ * @param[out] camera The camera position
+ * @param[out] planes The frustum planes
+ */
+void frame_view(unsigned int frame, vec3 camera, vec4 planes[6]);
+
+int
+main(void)
+{
+    vertex *vertices;
+    unsigned int *indices;
+    meshlet_mesh mm;
+    meshlet_stats stats;
+    multi_draw md;
+    pool_mesh placement;
+    mat4 model;
+    vec4 planes[6];
+    vec3 camera;
+    unsigned int frame;
+    unsigned int run;
+    unsigned int queued;
+    unsigned int culled;
+    unsigned int total_culled = 0;
+    unsigned int total_triangles = 0;
+    size_t i;
+    double start;
+    double build_ms;
+    double cull_ms;
+
+    build_sphere(SPHERE_SEGMENTS, SPHERE_RINGS, &vertices, &indices);
+
+    start = now_ms();
+    build_meshlets(&mm, vertices, arrlen(vertices), indices, arrlen(indices));
+    build_ms = now_ms() - start;
+
+    printf("%zu triangles, %zu meshlets in %.0f ms\n",
+           (size_t)arrlen(indices) / 3, (size_t)arrlen(mm.meshlets),
+           build_ms);
+
+    /* Never drawn, so the list needs no GL and stays on the CPU */
+    create_multi_draw(&md);
+
+    placement.first_index = 0;
+    placement.count = arrlen(mm.indices);
+    placement.base_vertex = 0;
+
+    glm_mat4_identity(model);
+
+    printf("%-6s %10s %10s %10s %8s %6s %8s\n", "frame", "drawn", "frustum",
+           "backface", "culled", "draws", "us");
+
+    for (frame = 0; frame < NUM_FRAMES; frame++) {
+        frame_view(frame, camera, planes);
+
+        start = now_ms();
+
+        for (run = 0; run < NUM_RUNS; run++) {
+            memset(&stats, 0, sizeof(stats));
+            reset_multi_draw(&md);
+            cull_meshlets(&mm, &placement, model, planes, camera, &md,
+                          &stats);
+        }
+
+        cull_ms = (now_ms() - start) / NUM_RUNS;
+
+        /* What goes to the GL has to be exactly what was counted as drawn */
+        queued = 0;
+
+        for (i = 0; i < arrlenu(md.commands); i++)
+            queued += md.commands[i].count / 3;
+
+        culled = stats.triangles_frustum_culled
+                 + stats.triangles_backface_culled;
+
+        if (queued != stats.triangles - culled
+            || arrlenu(md.commands) != stats.draws) {
+            fprintf(stderr, "Error: Frame %u queued %u triangles in %zu "
+                    "draws but counted %u in %u\n", frame, queued,
+                    (size_t)arrlenu(md.commands), stats.triangles - culled,
+                    stats.draws);
+            exit(EXIT_FAILURE);
+        }
+
+        total_culled += culled;
+        total_triangles += stats.triangles;
+
+        printf("%-6u %10u %10u %10u %7.1f%% %6u %8.1f\n", frame, queued,
+               stats.triangles_frustum_culled,
+               stats.triangles_backface_culled,
+               100.0 * culled / stats.triangles, stats.draws,
+               cull_ms * 1000.0);
+    }
+
+    printf("%.1f%% of triangles culled over %u frames\n",
+           100.0 * total_culled / total_triangles, NUM_FRAMES);
+
+    delete_multi_draw(&md);
+    free_meshlets(&mm);
+    arrfree(vertices);
+    arrfree(indices);
+
+    return 0;
+}
+
+void
+frame_view(unsigned int frame, vec3 camera, vec4 planes[6])
+{
+    float angle = 2.0f * GLM_PIf * frame / NUM_FRAMES;
+    vec3 target;
+    vec3 side;
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+
+    camera[0] = ORBIT_RADIUS * sinf(angle);
+    camera[1] = 1.0f;
+    camera[2] = ORBIT_RADIUS * cosf(angle);
+
+    /* Looks up to 2 units to the side of the center */
+    side[0] = cosf(angle);
+    side[1] = 0.0f;
+    side[2] = -sinf(angle);
+    glm_vec3_scale(side, 2.0f * frame / (NUM_FRAMES - 1), target);
+
+    glm_lookat(camera, target, GLM_YUP, view);
+    glm_perspective(glm_rad(45.0f), 800.0f / 600.0f, 0.1f, 100.0f,
+                    projection);
+    glm_mat4_mul(projection, view, view_projection);
+    glm_frustum_planes(view_projection, planes);
+}
+
+/* EOF */
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/bench_common.h"
+#include "../include/job.h"
+#include "../include/obj_loader.h"
+
+#include <stb_ds.h>
+
+/* A grid of this many quads per side, written as two triangles each */
+#define GRID_SIZE 1000
+
+#define NUM_RUNS 3
+
+/**
+ * @brief Writes a grid as an OBJ file, with a position and texture
+ * coordinate per grid point and one shared normal
+ *
+ * @param[in] path The path to the file
+ */
+void write_grid(const char *path);
+
+/**
+ * @brief Loads an OBJ file the way most tutorials do, with fscanf and one
+ * vertex per face corner
+ *
+ * @param[in] path The path to the file
+ * @param[out] num_vertices The number of vertices made
+ */
+void load_naive(const char *path, size_t *num_vertices);
+
+int
+main(void)
+{
+    obj_model model;
+    struct stat info;
+    char path[1024];
+    const char *temp_dir = getenv("TMPDIR");
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    size_t naive_vertices = 0;
+    unsigned int run;
+    double start;
+    double obj_ms = 0.0;
+    double naive_ms = 0.0;
+    double mb;
+    long num_cpus;
+
+    if (temp_dir == NULL)
+        temp_dir = "/tmp";
+
+    if (snprintf(path, sizeof(path), "%s/bench_obj.obj", temp_dir)
+        >= (int)sizeof(path)) {
+        fprintf(stderr, "Error: TMPDIR is too long\n");
+        exit(EXIT_FAILURE);
+    }
+
+    write_grid(path);
+
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    mb = info.st_size / 1048576.0;
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    start_job_system(num_cpus > 1 ? num_cpus - 1 : 0);
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        start = now_ms();
+
+        if (!load_obj(&model, path))
+            exit(EXIT_FAILURE);
+
+        obj_ms += now_ms() - start;
+        num_vertices = arrlen(model.vertices);
+        num_indices = arrlen(model.indices);
+
+        free_obj(&model);
+    }
+
+    /* Slow enough that one run says enough */
+    start = now_ms();
+    load_naive(path, &naive_vertices);
+    naive_ms = now_ms() - start;
+
+    obj_ms /= NUM_RUNS;
+
+    printf("%zu triangles, %.1f MB file, cached in memory, %u threads\n",
+           num_indices / 3, mb, num_job_threads());
+    printf("%-12s %10s %10s %10s\n", "load", "ms", "MB/s", "vertices");
+    printf("%-12s %10.2f %10.0f %10zu\n", "load_obj", obj_ms,
+           mb / (obj_ms / 1000.0), num_vertices);
+    printf("%-12s %10.2f %10.0f %10zu\n", "fscanf", naive_ms,
+           mb / (naive_ms / 1000.0), naive_vertices);
+    printf("speedup %.1fx\n", naive_ms / obj_ms);
+
+    stop_job_system();
+    remove(path);
+
+    return 0;
+}
+
+void
+write_grid(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    size_t side = GRID_SIZE + 1;
+    size_t a;
+    size_t b;
+    size_t x;
+    size_t z;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(file, "# %d x %d grid\n", GRID_SIZE, GRID_SIZE);
+
+    for (z = 0; z < side; z++) {
+        for (x = 0; x < side; x++) {
+            fprintf(file, "v %f %f %f\n", x * 0.1f,
+                    (float)((x * 7 + z * 13) % 17) / 17.0f, z * 0.1f);
+            fprintf(file, "vt %f %f\n", (float)x / GRID_SIZE,
+                    (float)z / GRID_SIZE);
+        }
+    }
+
+    fprintf(file, "vn 0.000000 1.000000 0.000000\n");
+
+    for (z = 0; z < GRID_SIZE; z++) {
+        for (x = 0; x < GRID_SIZE; x++) {
+            a = z * side + x + 1;
+            b = a + side;
+
+            fprintf(file, "f %zu/%zu/1 %zu/%zu/1 %zu/%zu/1\n", a, a, b, b,
+                    a + 1, a + 1);
+            fprintf(file, "f %zu/%zu/1 %zu/%zu/1 %zu/%zu/1\n", a + 1, a + 1,
+                    b, b, b + 1, b + 1);
+        }
+    }
+
+    fclose(file);
+}
+
+void
+load_naive(const char *path, size_t *num_vertices)
+{
+    FILE *file = fopen(path, "r");
+    vec3 *positions = NULL;
+    vec2 *tex_coords = NULL;
+    vec3 *normals = NULL;
+    vertex *vertices = NULL;
+    vertex v;
+    char keyword[128];
+    unsigned int p[3];
+    unsigned int t[3];
+    unsigned int n[3];
+    float *values;
+    int i;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fscanf(file, "%127s", keyword) == 1) {
+        if (strcmp(keyword, "v") == 0) {
+            values = *arraddnptr(positions, 1);
+            fscanf(file, "%f %f %f", &values[0], &values[1], &values[2]);
+        }
+        else if (strcmp(keyword, "vt") == 0) {
+            values = *arraddnptr(tex_coords, 1);
+            fscanf(file, "%f %f", &values[0], &values[1]);
+        }
+        else if (strcmp(keyword, "vn") == 0) {
+            values = *arraddnptr(normals, 1);
+            fscanf(file, "%f %f %f", &values[0], &values[1], &values[2]);
+        }
+        else if (strcmp(keyword, "f") == 0) {
+            fscanf(file, "%u/%u/%u %u/%u/%u %u/%u/%u", &p[0], &t[0], &n[0],
+                   &p[1], &t[1], &n[1], &p[2], &t[2], &n[2]);
+
+            for (i = 0; i < 3; i++) {
+                memcpy(v.position, positions[p[i] - 1], sizeof(v.position));
+                memcpy(v.tex_coords, tex_coords[t[i] - 1],
+                       sizeof(v.tex_coords));
+                memcpy(v.normal, normals[n[i] - 1], sizeof(v.normal));
+                arrput(vertices, v);
+            }
+        }
+        else {
+            fscanf(file, "%*[^\n]");
+        }
+    }
+
+    fclose(file);
+
+    *num_vertices = arrlen(vertices);
+
+    arrfree(positions);
+    arrfree(tex_coords);
+    arrfree(normals);
+    arrfree(vertices);
+}
+
+/* EOF */
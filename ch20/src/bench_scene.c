@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../include/bench_common.h"
+#include "../include/scene.h"
+
+#include <stb_ds.h>
+
+#define NUM_RUNS 3
+
+/* The scene sizes to generate and time */
+static const size_t scene_sizes[] = {10, 10000, 1000000};
+
+/**
+ * @brief Writes a scene of cubes on a grid around the origin, with the
+ * materials and lights of the default scene. The first cube of each row is
+ * the parent of the rest of the row
+ *
+ * @param[in] path The path to the file
+ * @param[in] num_objects The number of cubes
+ */
+void write_grid_scene(const char *path, size_t num_objects);
+
+/**
+ * @brief Loads a scene a number of times
+ *
+ * @param[in] path The path to the file
+ * @param[out] s The scene of the last run, to be freed by the caller
+ *
+ * @return The average time of a load in milliseconds
+ */
+double time_load(const char *path, scene *s);
+
+/**
+ * @brief Times updating the world transforms of a scene when everything, one
+ * row, and nothing has moved
+ *
+ * @param[in, out] s The scene, with nothing computed yet
+ */
+void time_updates(scene *s);
+
+/**
+ * @brief Gets the size of a file
+ *
+ * @param[in] path The path to the file
+ *
+ * @return The size in megabytes
+ */
+double file_mb(const char *path);
+
+int
+main(void)
+{
+    scene s;
+    char text_path[1024];
+    char cooked_path[1024];
+    const char *temp_dir = getenv("TMPDIR");
+    double text_ms;
+    double cooked_ms;
+    double text_mb;
+    double cooked_mb;
+    scene loaded[sizeof(scene_sizes) / sizeof(scene_sizes[0])];
+    size_t i;
+
+    if (temp_dir == NULL)
+        temp_dir = "/tmp";
+
+    printf("%-10s %10s %10s %10s %10s %10s\n", "objects", "text ms", "MB/s",
+           "cooked ms", "MB/s", "speedup");
+
+    for (i = 0; i < sizeof(scene_sizes) / sizeof(scene_sizes[0]); i++) {
+        if (snprintf(text_path, sizeof(text_path), "%s/scene_%zu.scene",
+                     temp_dir, scene_sizes[i]) >= (int)sizeof(text_path)
+            || snprintf(cooked_path, sizeof(cooked_path), "%s/scene_%zu.scnb",
+                        temp_dir, scene_sizes[i])
+               >= (int)sizeof(cooked_path)) {
+            fprintf(stderr, "Error: TMPDIR is too long\n");
+            exit(EXIT_FAILURE);
+        }
+
+        write_grid_scene(text_path, scene_sizes[i]);
+
+        text_ms = time_load(text_path, &s);
+
+        if (!write_scene_file(&s, cooked_path)) {
+            fprintf(stderr, "Error: Could not write %s\n", cooked_path);
+            exit(EXIT_FAILURE);
+        }
+
+        free_scene(&s);
+
+        cooked_ms = time_load(cooked_path, &s);
+
+        if (s.transforms.count != scene_sizes[i]) {
+            fprintf(stderr, "Error: %s has %zu objects, not %zu\n",
+                    cooked_path, s.transforms.count, scene_sizes[i]);
+            exit(EXIT_FAILURE);
+        }
+
+        loaded[i] = s;
+
+        text_mb = file_mb(text_path);
+        cooked_mb = file_mb(cooked_path);
+
+        printf("%-10zu %10.2f %10.0f %10.2f %10.0f %9.1fx\n", scene_sizes[i],
+               text_ms, text_mb / (text_ms / 1000.0), cooked_ms,
+               cooked_mb / (cooked_ms / 1000.0), text_ms / cooked_ms);
+    }
+
+    printf("\n%-10s %10s %10s %10s %10s\n", "objects", "all ms", "row ms",
+           "row nodes", "static ms");
+
+    for (i = 0; i < sizeof(scene_sizes) / sizeof(scene_sizes[0]); i++) {
+        time_updates(&loaded[i]);
+        free_scene(&loaded[i]);
+    }
+
+    /* The scenes are kept so they can be rendered */
+    printf("Scenes are in %s, run bin/main.o %s/scene_10000.scnb to see one\n",
+           temp_dir, temp_dir);
+
+    return 0;
+}
+
+void
+write_grid_scene(const char *path, size_t num_objects)
+{
+    FILE *file = fopen(path, "w");
+    size_t side = 1;
+    size_t x;
+    size_t y;
+    size_t z;
+    size_t i;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The smallest cube of grid points that holds every object */
+    while (side * side * side < num_objects)
+        side++;
+
+    fprintf(file, "# %zu cubes on a %zu x %zu x %zu grid\n", num_objects,
+            side, side, side);
+
+    fprintf(file, "material res/container.png res/container_specular.png "
+            "32\n");
+    fprintf(file, "material res/container.jpg "
+            "res/container_specular_colored.png 32\n");
+
+    fprintf(file, "dir_light -0.2 -1.0 -0.3  0.05 0.05 0.05  0.4 0.4 0.4  "
+            "0.5 0.5 0.5\n");
+    fprintf(file, "point_light 0.7 0.2 2.0  0.05 0.05 0.05  0.8 0.8 0.8  "
+            "1 1 1  1 0.09 0.032\n");
+    fprintf(file, "point_light 2.3 -3.3 -4.0  0.05 0.05 0.05  0.8 0.8 0.8  "
+            "1 1 1  1 0.09 0.032\n");
+    fprintf(file, "spot_light 0 0 0  1 1 1  1 1 1  1 0.09 0.032  12.5 17.5\n");
+
+    for (i = 0; i < num_objects; i++) {
+        x = i % side;
+        y = i / side % side;
+        z = i / (side * side);
+
+        /* The rest of a row is placed relative to its first cube */
+        if (x == 0)
+            fprintf(file, "object %.2f %.2f %.2f  1 0.3 0.5 %zu  1 1 1  "
+                    "%zu\n", side * -1.0, (y - side * 0.5) * 2.0,
+                    -(double)z * 2.0 - 3.0, i * 20 % 360, i % 2);
+        else
+            fprintf(file, "object %.2f 0 0  1 0.3 0.5 %zu  1 1 1  %zu %zu\n",
+                    x * 2.0, i * 20 % 360, i % 2, i - x);
+    }
+
+    fclose(file);
+}
+
+double
+time_load(const char *path, scene *s)
+{
+    unsigned int run;
+    double start;
+    double total = 0.0;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        if (run > 0)
+            free_scene(s);
+
+        start = now_ms();
+
+        if (!load_scene(s, path))
+            exit(EXIT_FAILURE);
+
+        total += now_ms() - start;
+    }
+
+    return total / NUM_RUNS;
+}
+
+void
+time_updates(scene *s)
+{
+    transform_hierarchy *t = &s->transforms;
+    unsigned int row = t->count / 2;
+    unsigned int run;
+    size_t row_nodes = 0;
+    double start;
+    double all_ms;
+    double row_ms = 0.0;
+    double static_ms = 0.0;
+
+    start = now_ms();
+    update_world_transforms(t);
+    all_ms = now_ms() - start;
+
+    /* The middle row's first cube moves and the rest of the row follows */
+    if (t->parents[row] != TRANSFORM_NO_PARENT)
+        row = t->parents[row];
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        t->positions[row][1] += 0.1f;
+        mark_transform_dirty(t, row);
+
+        start = now_ms();
+        row_nodes = update_world_transforms(t);
+        row_ms += now_ms() - start;
+
+        start = now_ms();
+        update_world_transforms(t);
+        static_ms += now_ms() - start;
+    }
+
+    printf("%-10zu %10.3f %10.4f %10zu %10.4f\n", t->count, all_ms,
+           row_ms / NUM_RUNS, row_nodes, static_ms / NUM_RUNS);
+}
+
+double
+file_mb(const char *path)
+{
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Error: Could not stat %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    return info.st_size / 1048576.0;
+}
+
+/* EOF */
@@ -0,0 +1,171 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bench_common.h"
+#include "../include/mesh.h"
+#include "../include/simplify.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+/* A unit sphere of this many segments and rings is about 160k triangles */
+#define SPHERE_SEGMENTS 400
+#define SPHERE_RINGS 200
+
+/*
+ * The viewport height and field of view the LODs are picked for. The sphere
+ * is fine enough that a smaller screen would take the coarsest LOD as soon
+ * as the camera is outside it
+ */
+#define VIEWPORT_HEIGHT 2160.0f
+#define FOV 45.0f
+
+/* The largest error a LOD may show, in pixels */
+#define MAX_PIXEL_ERROR 0.5f
+
+/* The camera walks out to this distance and back in, in steps of a quarter */
+#define MAX_DISTANCE 4.0f
+
+/**
+ * @brief Checks a LOD and measures how far it strays from the sphere
+ *
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The index array of the whole chain
+ * @param[in] lod The LOD to check
+ * @param[out] flipped The number of triangles facing against their vertex
+ * normals
+ *
+ * @return The largest distance of a triangle centroid from the surface,
+ * relative to the radius
+ */
+float check_lod(const vertex *vertices, size_t num_vertices,
+                const unsigned int *indices, const mesh_lod *lod,
+                unsigned int *flipped);
+
+int
+main(void)
+{
+    vertex *vertices;
+    unsigned int *indices;
+    mesh sphere;
+    unsigned int num_triangles;
+    unsigned int flipped;
+    unsigned int lod = 0;
+    unsigned int lods_out[(unsigned int)(MAX_DISTANCE * 4.0f) + 1];
+    unsigned int lods_back[(unsigned int)(MAX_DISTANCE * 4.0f) + 1];
+    unsigned int i;
+    float deviation;
+    float pixels_per_unit;
+    float distance;
+    double start;
+    double build_ms;
+
+    /* The seam shares positions but not texture coordinates, so is locked */
+    build_sphere(SPHERE_SEGMENTS, SPHERE_RINGS, &vertices, &indices);
+    num_triangles = arrlen(indices) / 3;
+
+    memset(&sphere, 0, sizeof(sphere));
+
+    start = now_ms();
+    sphere.num_lods = build_lod_chain(vertices, arrlen(vertices), &indices,
+                                      sphere.lods, MESH_MAX_LODS);
+    build_ms = now_ms() - start;
+
+    printf("%u triangles, %zu vertices, %u LODs in %.0f ms\n", num_triangles,
+           (size_t)arrlen(vertices), sphere.num_lods, build_ms);
+    printf("%-6s %10s %10s %10s %10s\n", "lod", "triangles", "error",
+           "deviation", "flipped");
+
+    for (i = 0; i < sphere.num_lods; i++) {
+        deviation = check_lod(vertices, arrlen(vertices), indices,
+                              &sphere.lods[i], &flipped);
+
+        printf("%-6u %10u %10.5f %10.5f %10u\n", i, sphere.lods[i].count / 3,
+               sphere.lods[i].error, deviation, flipped);
+    }
+
+    /*
+     * The LOD each distance gets, walking away from the sphere and back. The
+     * way back switches to finer LODs a little closer than the way out went
+     * to coarser ones
+     */
+    pixels_per_unit = VIEWPORT_HEIGHT / (2.0f * tanf(glm_rad(FOV) * 0.5f));
+
+    printf("\n%-10s %6s %6s\n", "distance", "out", "back");
+
+    for (distance = 1.0f; distance <= MAX_DISTANCE; distance += 0.25f) {
+        lod = select_mesh_lod(&sphere, distance, pixels_per_unit,
+                              MAX_PIXEL_ERROR, lod);
+        lods_out[(unsigned int)(distance * 4.0f)] = lod;
+    }
+
+    for (distance = MAX_DISTANCE; distance >= 1.0f; distance -= 0.25f) {
+        lod = select_mesh_lod(&sphere, distance, pixels_per_unit,
+                              MAX_PIXEL_ERROR, lod);
+        lods_back[(unsigned int)(distance * 4.0f)] = lod;
+    }
+
+    for (distance = 1.0f; distance <= MAX_DISTANCE; distance += 0.25f) {
+        printf("%-10.2f %6u %6u\n", distance,
+               lods_out[(unsigned int)(distance * 4.0f)],
+               lods_back[(unsigned int)(distance * 4.0f)]);
+    }
+
+    arrfree(vertices);
+    arrfree(indices);
+
+    return 0;
+}
+
+float
+check_lod(const vertex *vertices, size_t num_vertices,
+          const unsigned int *indices, const mesh_lod *lod,
+          unsigned int *flipped)
+{
+    const float *p[3];
+    vec3 normals;
+    vec3 e1;
+    vec3 e2;
+    vec3 face;
+    vec3 centroid;
+    float deviation = 0.0f;
+    unsigned int i;
+    unsigned int k;
+
+    *flipped = 0;
+
+    for (i = lod->first_index; i < lod->first_index + lod->count; i += 3) {
+        glm_vec3_zero(normals);
+
+        for (k = 0; k < 3; k++) {
+            if (indices[i + k] >= num_vertices) {
+                fprintf(stderr, "Error: Index %u is out of range\n",
+                        indices[i + k]);
+                exit(EXIT_FAILURE);
+            }
+
+            p[k] = vertices[indices[i + k]].position;
+            glm_vec3_add(normals, (float *)vertices[indices[i + k]].normal,
+                         normals);
+        }
+
+        glm_vec3_sub((float *)p[1], (float *)p[0], e1);
+        glm_vec3_sub((float *)p[2], (float *)p[0], e2);
+        glm_vec3_cross(e1, e2, face);
+
+        if (glm_vec3_dot(face, normals) < 0.0f)
+            (*flipped)++;
+
+        for (k = 0; k < 3; k++)
+            centroid[k] = (p[0][k] + p[1][k] + p[2][k]) / 3.0f;
+
+        deviation = glm_max(deviation, 1.0f - glm_vec3_norm(centroid));
+    }
+
+    return deviation;
+}
+
+/* EOF */
@@ -0,0 +1,190 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bench_common.h"
+#include "../include/weld.h"
+
+#include <stb_ds.h>
+
+/* A sphere of this many segments and rings is a 478k vertex soup */
+#define SPHERE_SEGMENTS 400
+#define SPHERE_RINGS 200
+
+/* How far the jittered soup moves its positions, less than its epsilon */
+#define JITTER 1e-5f
+
+#define NUM_RUNS 5
+
+/**
+ * @brief Builds the shared UV sphere as a triangle soup, three vertices of
+ * its own for every triangle
+ *
+ * @param[in] jitter How far to move each position at random on each axis
+ *
+ * @return The stb_ds vertex array
+ */
+vertex *build_soup(float jitter);
+
+/**
+ * @brief Times welding a soup, starting over from a copy each run
+ *
+ * @param[in] soup The soup
+ * @param[in] epsilon The tolerances, NULL for exact welds
+ * @param[out] num_kept The number of vertices left
+ *
+ * @return The average milliseconds per weld
+ */
+double time_weld(const vertex *soup, const weld_epsilon *epsilon,
+                 size_t *num_kept);
+
+/**
+ * @brief Checks that every corner of a welded soup is within epsilon of the
+ * vertex it had, and exits with an error if not
+ *
+ * @param[in] soup The soup before welding
+ * @param[in] epsilon The tolerances, NULL for exact welds
+ */
+void check_weld(const vertex *soup, const weld_epsilon *epsilon);
+
+int
+main(void)
+{
+    const weld_epsilon epsilon = { 1e-4f, 1e-3f, 1e-3f };
+    vertex *soup;
+    vertex *jittered;
+    size_t exact_kept;
+    size_t near_kept;
+    double exact_ms;
+    double near_ms;
+
+    srand(1);
+    soup = build_soup(0.0f);
+    jittered = build_soup(JITTER);
+
+    check_weld(soup, NULL);
+    check_weld(jittered, &epsilon);
+
+    exact_ms = time_weld(soup, NULL, &exact_kept);
+    near_ms = time_weld(jittered, &epsilon, &near_kept);
+
+    printf("%zu vertex soup of %zu triangles\n", (size_t)arrlen(soup),
+           (size_t)arrlen(soup) / 3);
+    printf("%-10s %10s %10s\n", "weld", "vertices", "ms");
+    printf("%-10s %10zu %10.1f\n", "exact", exact_kept, exact_ms);
+    printf("%-10s %10zu %10.1f\n", "epsilon", near_kept, near_ms);
+
+    arrfree(soup);
+    arrfree(jittered);
+
+    return 0;
+}
+
+vertex *
+build_soup(float jitter)
+{
+    vertex *vertices;
+    vertex *soup = NULL;
+    unsigned int *indices;
+    size_t i;
+    unsigned int k;
+    vertex v;
+
+    build_sphere(SPHERE_SEGMENTS, SPHERE_RINGS, &vertices, &indices);
+
+    /* Every corner gets a copy of its vertex, undoing the sharing */
+    for (i = 0; i < arrlenu(indices); i++) {
+        v = vertices[indices[i]];
+
+        for (k = 0; k < 3; k++)
+            v.position[k] += jitter * (2.0f * rand() / RAND_MAX - 1.0f);
+
+        arrput(soup, v);
+    }
+
+    arrfree(vertices);
+    arrfree(indices);
+
+    return soup;
+}
+
+double
+time_weld(const vertex *soup, const weld_epsilon *epsilon, size_t *num_kept)
+{
+    vertex *vertices = NULL;
+    unsigned int *indices = NULL;
+    unsigned int run;
+    double start;
+    double total = 0.0;
+
+    for (run = 0; run < NUM_RUNS; run++) {
+        arrsetlen(vertices, arrlen(soup));
+        memcpy(vertices, soup, arrlen(soup) * sizeof(*soup));
+
+        start = now_ms();
+        weld_vertices(&vertices, &indices, epsilon);
+        total += now_ms() - start;
+
+        *num_kept = arrlen(vertices);
+        arrfree(indices);
+    }
+
+    arrfree(vertices);
+
+    return total / NUM_RUNS;
+}
+
+void
+check_weld(const vertex *soup, const weld_epsilon *epsilon)
+{
+    const weld_epsilon exact = { 0.0f, 0.0f, 0.0f };
+    vertex *vertices = NULL;
+    unsigned int *indices = NULL;
+    const vertex *a;
+    const vertex *b;
+    size_t i;
+    unsigned int k;
+    bool ok = true;
+
+    if (epsilon == NULL)
+        epsilon = &exact;
+
+    arrsetlen(vertices, arrlen(soup));
+    memcpy(vertices, soup, arrlen(soup) * sizeof(*soup));
+    weld_vertices(&vertices, &indices, epsilon);
+
+    if (arrlenu(indices) != arrlenu(soup)) {
+        fprintf(stderr, "Error: Welding made %zu indices for %zu vertices\n",
+                (size_t)arrlenu(indices), (size_t)arrlenu(soup));
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < arrlenu(soup) && ok; i++) {
+        a = &soup[i];
+        b = &vertices[indices[i]];
+
+        for (k = 0; k < 3; k++) {
+            ok = ok && fabsf(a->position[k] - b->position[k])
+                           <= epsilon->position
+                 && fabsf(a->normal[k] - b->normal[k]) <= epsilon->normal;
+        }
+
+        for (k = 0; k < 2; k++) {
+            ok = ok && fabsf(a->tex_coords[k] - b->tex_coords[k])
+                           <= epsilon->tex_coords;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Corner %zu was welded onto a vertex too far "
+                "from it\n", i - 1);
+        exit(EXIT_FAILURE);
+    }
+
+    arrfree(vertices);
+    arrfree(indices);
+}
+
+/* EOF */
@@ -0,0 +1,354 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/cmd_buffer.h"
+#include "../include/gl_state.h"
+#include "../include/multi_draw.h"
+
+#include <stb_ds.h>
+#include <glad/glad.h>
+
+/* Every command starts on a multiple of this many bytes */
+#define CMD_ALIGN 8
+
+enum cmd_type
+{
+    CMD_USE_PROGRAM,
+    CMD_BIND_TEXTURE,
+    CMD_BIND_VERTEX_ARRAY,
+    CMD_UNIFORM_1I,
+    CMD_UNIFORM_1F,
+    CMD_UNIFORM_3F,
+    CMD_UNIFORM_MAT3,
+    CMD_UNIFORM_MAT4,
+    CMD_DRAW_ELEMENTS,
+    CMD_DRAW_ELEMENTS_INSTANCED,
+    CMD_MULTI_DRAW,
+    CMD_BEGIN_PASS,
+    CMD_END_PASS
+};
+
+struct cmd_header
+{
+    uint16_t type;
+    uint16_t size;
+};
+
+struct cmd_object
+{
+    struct cmd_header header;
+    unsigned int object;
+};
+
+struct cmd_texture
+{
+    struct cmd_header header;
+    unsigned int unit;
+    unsigned int target;
+    unsigned int texture;
+};
+
+struct cmd_uniform_int
+{
+    struct cmd_header header;
+    int location;
+    int value;
+};
+
+struct cmd_uniform
+{
+    struct cmd_header header;
+    int location;
+    float value[];
+};
+
+struct cmd_draw
+{
+    struct cmd_header header;
+    unsigned int mode;
+    int count;
+    int instances;
+    unsigned int index_type;
+    uint64_t offset;
+};
+
+struct cmd_multi
+{
+    struct cmd_header header;
+    unsigned int mode;
+    const multi_draw *list;
+};
+
+/**
+ * @brief Reserves space for a command at the end of the buffer
+ *
+ * @param[in, out] cb The command buffer
+ * @param[in] type The command type
+ * @param[in] size The size of the command, including its header
+ *
+ * @return The command, with its header filled in. It is only valid until the
+ * next command is recorded
+ */
+static void *push_cmd(cmd_buffer *cb, enum cmd_type type, size_t size);
+
+void
+create_cmd_buffer(cmd_buffer *cb)
+{
+    cb->data = NULL;
+}
+
+void
+reset_cmd_buffer(cmd_buffer *cb)
+{
+    if (cb->data != NULL)
+        arrsetlen(cb->data, 0);
+}
+
+void
+delete_cmd_buffer(cmd_buffer *cb)
+{
+    arrfree(cb->data);
+}
+
+void
+cmd_use_program(cmd_buffer *cb, unsigned int program)
+{
+    struct cmd_object *cmd = push_cmd(cb, CMD_USE_PROGRAM, sizeof(*cmd));
+
+    cmd->object = program;
+}
+
+void
+cmd_bind_texture(cmd_buffer *cb, unsigned int unit, GLenum target,
+                 unsigned int texture)
+{
+    struct cmd_texture *cmd = push_cmd(cb, CMD_BIND_TEXTURE, sizeof(*cmd));
+
+    cmd->unit = unit;
+    cmd->target = target;
+    cmd->texture = texture;
+}
+
+void
+cmd_bind_vertex_array(cmd_buffer *cb, unsigned int vao)
+{
+    struct cmd_object *cmd = push_cmd(cb, CMD_BIND_VERTEX_ARRAY, sizeof(*cmd));
+
+    cmd->object = vao;
+}
+
+void
+cmd_uniform_1i(cmd_buffer *cb, int location, int v0)
+{
+    struct cmd_uniform_int *cmd = push_cmd(cb, CMD_UNIFORM_1I, sizeof(*cmd));
+
+    cmd->location = location;
+    cmd->value = v0;
+}
+
+void
+cmd_uniform_1f(cmd_buffer *cb, int location, float v0)
+{
+    struct cmd_uniform *cmd = push_cmd(cb, CMD_UNIFORM_1F,
+                                       sizeof(*cmd) + sizeof(float));
+
+    cmd->location = location;
+    cmd->value[0] = v0;
+}
+
+void
+cmd_uniform_3fv(cmd_buffer *cb, int location, const float *value)
+{
+    struct cmd_uniform *cmd = push_cmd(cb, CMD_UNIFORM_3F,
+                                       sizeof(*cmd) + 3 * sizeof(float));
+
+    cmd->location = location;
+    memcpy(cmd->value, value, 3 * sizeof(float));
+}
+
+void
+cmd_uniform_mat3fv(cmd_buffer *cb, int location, const float *value)
+{
+    struct cmd_uniform *cmd = push_cmd(cb, CMD_UNIFORM_MAT3,
+                                       sizeof(*cmd) + 9 * sizeof(float));
+
+    cmd->location = location;
+    memcpy(cmd->value, value, 9 * sizeof(float));
+}
+
+void
+cmd_uniform_mat4fv(cmd_buffer *cb, int location, const float *value)
+{
+    struct cmd_uniform *cmd = push_cmd(cb, CMD_UNIFORM_MAT4,
+                                       sizeof(*cmd) + 16 * sizeof(float));
+
+    cmd->location = location;
+    memcpy(cmd->value, value, 16 * sizeof(float));
+}
+
+void
+cmd_draw_elements(cmd_buffer *cb, GLenum mode, int count, GLenum index_type,
+                  size_t offset)
+{
+    struct cmd_draw *cmd = push_cmd(cb, CMD_DRAW_ELEMENTS, sizeof(*cmd));
+
+    cmd->mode = mode;
+    cmd->count = count;
+    cmd->instances = 1;
+    cmd->index_type = index_type;
+    cmd->offset = offset;
+}
+
+void
+cmd_draw_elements_instanced(cmd_buffer *cb, GLenum mode, int count,
+                            GLenum index_type, size_t offset, int instances)
+{
+    struct cmd_draw *cmd = push_cmd(cb, CMD_DRAW_ELEMENTS_INSTANCED,
+                                    sizeof(*cmd));
+
+    cmd->mode = mode;
+    cmd->count = count;
+    cmd->instances = instances;
+    cmd->index_type = index_type;
+    cmd->offset = offset;
+}
+
+void
+cmd_multi_draw(cmd_buffer *cb, const multi_draw *md, GLenum mode)
+{
+    struct cmd_multi *cmd = push_cmd(cb, CMD_MULTI_DRAW, sizeof(*cmd));
+
+    cmd->mode = mode;
+    cmd->list = md;
+}
+
+void
+cmd_begin_pass(cmd_buffer *cb, unsigned int pass)
+{
+    struct cmd_object *cmd = push_cmd(cb, CMD_BEGIN_PASS, sizeof(*cmd));
+
+    cmd->object = pass;
+}
+
+void
+cmd_end_pass(cmd_buffer *cb, unsigned int pass)
+{
+    struct cmd_object *cmd = push_cmd(cb, CMD_END_PASS, sizeof(*cmd));
+
+    cmd->object = pass;
+}
+
+void
+replay_cmd_buffer(const cmd_buffer *cb,
+                  void (*begin_pass)(unsigned int pass, void *user),
+                  void (*end_pass)(unsigned int pass, void *user),
+                  void *user)
+{
+    const unsigned char *pos = cb->data;
+    const unsigned char *end = cb->data + arrlen(cb->data);
+
+    const struct cmd_header *header;
+    const struct cmd_object *object;
+    const struct cmd_texture *texture;
+    const struct cmd_uniform_int *uniform_int;
+    const struct cmd_uniform *uniform;
+    const struct cmd_draw *draw;
+    const struct cmd_multi *multi;
+
+    while (pos < end) {
+        header = (const struct cmd_header *)pos;
+
+        object = (const struct cmd_object *)pos;
+        texture = (const struct cmd_texture *)pos;
+        uniform_int = (const struct cmd_uniform_int *)pos;
+        uniform = (const struct cmd_uniform *)pos;
+        draw = (const struct cmd_draw *)pos;
+        multi = (const struct cmd_multi *)pos;
+
+        switch (header->type) {
+        case CMD_USE_PROGRAM:
+            state_use_program(object->object);
+            break;
+
+        case CMD_BIND_TEXTURE:
+            state_bind_texture(texture->unit, texture->target,
+                               texture->texture);
+            break;
+
+        case CMD_BIND_VERTEX_ARRAY:
+            state_bind_vertex_array(object->object);
+            break;
+
+        case CMD_UNIFORM_1I:
+            glUniform1i(uniform_int->location, uniform_int->value);
+            break;
+
+        case CMD_UNIFORM_1F:
+            glUniform1f(uniform->location, uniform->value[0]);
+            break;
+
+        case CMD_UNIFORM_3F:
+            glUniform3fv(uniform->location, 1, uniform->value);
+            break;
+
+        case CMD_UNIFORM_MAT3:
+            glUniformMatrix3fv(uniform->location, 1, GL_FALSE, uniform->value);
+            break;
+
+        case CMD_UNIFORM_MAT4:
+            glUniformMatrix4fv(uniform->location, 1, GL_FALSE, uniform->value);
+            break;
+
+        case CMD_DRAW_ELEMENTS:
+            glDrawElements(draw->mode, draw->count, draw->index_type,
+                           (void *)(uintptr_t)draw->offset);
+            break;
+
+        case CMD_DRAW_ELEMENTS_INSTANCED:
+            glDrawElementsInstanced(draw->mode, draw->count,
+                                    draw->index_type,
+                                    (void *)(uintptr_t)draw->offset,
+                                    draw->instances);
+            break;
+
+        case CMD_MULTI_DRAW:
+            draw_multi_draw(multi->list, multi->mode);
+            break;
+
+        case CMD_BEGIN_PASS:
+            if (begin_pass != NULL)
+                begin_pass(object->object, user);
+            break;
+
+        case CMD_END_PASS:
+            if (end_pass != NULL)
+                end_pass(object->object, user);
+            break;
+
+        default:
+            fprintf(stderr, "Error: Unknown command %u in command buffer\n",
+                    header->type);
+            exit(EXIT_FAILURE);
+        }
+
+        pos += header->size;
+    }
+}
+
+static void *
+push_cmd(cmd_buffer *cb, enum cmd_type type, size_t size)
+{
+    struct cmd_header *header;
+
+    size = (size + CMD_ALIGN - 1) & ~(size_t)(CMD_ALIGN - 1);
+
+    header = (struct cmd_header *)arraddnptr(cb->data, size);
+    header->type = type;
+    header->size = size;
+
+    return header;
+}
+
+/* EOF */
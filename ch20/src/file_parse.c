@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/file_parse.h"
+
+/* How many zeros pad_to writes at a time */
+#define PAD_CHUNK 64
+
+float
+parse_float(const char **p, const char *end)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *s = *p;
+    const char *digits;
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int exp_value = 0;
+    bool negative = false;
+    bool exp_negative = false;
+    double value;
+
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    digits = s;
+
+    /* 19 digits always fit in 64 bits, the rest only move the exponent */
+    for (; s < end && *s >= '0' && *s <= '9'; s++) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            significant += mantissa != 0;
+        }
+        else {
+            exponent++;
+        }
+    }
+
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    /* A sign or point on its own is not a number */
+    if (s == digits || (s == digits + 1 && *digits == '.'))
+        return 0.0f;
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+
+        if (s < end && (*s == '-' || *s == '+'))
+            exp_negative = *s++ == '-';
+
+        for (; s < end && *s >= '0' && *s <= '9'; s++)
+            if (exp_value < 10000)
+                exp_value = exp_value * 10 + (*s - '0');
+
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    *p = s;
+    value = (double)mantissa;
+
+    for (; exponent > 22; exponent -= 22)
+        value *= 1e22;
+    for (; exponent < -22; exponent += 22)
+        value /= 1e22;
+
+    value = exponent < 0 ? value / powers[-exponent]
+                         : value * powers[exponent];
+
+    return negative ? (float)-value : (float)value;
+}
+
+const char *
+skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+    return p;
+}
+
+const char *
+next_line(const char *p, const char *end)
+{
+    p = memchr(p, '\n', end - p);
+
+    return p != NULL ? p + 1 : end;
+}
+
+const char *
+match_keyword(const char *p, const char *end, const char *keyword)
+{
+    for (; *keyword != '\0'; p++, keyword++)
+        if (p == end || *p != *keyword)
+            return NULL;
+
+    return p < end && (*p == ' ' || *p == '\t') ? p : NULL;
+}
+
+uint64_t
+align_offset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+bool
+check_section(size_t file_size, uint64_t offset, uint64_t count,
+              uint64_t element_size, uint64_t alignment)
+{
+    /* Division rather than multiplication so huge counts cannot overflow */
+    return offset % alignment == 0 && offset <= file_size
+           && (element_size == 0
+               || count <= (file_size - offset) / element_size);
+}
+
+bool
+pad_to(FILE *file, uint64_t offset)
+{
+    static const char zeros[PAD_CHUNK];
+    long position = ftell(file);
+    uint64_t left;
+    size_t size;
+
+    if (position < 0 || (uint64_t)position > offset)
+        return false;
+
+    for (left = offset - position; left > 0; left -= size) {
+        size = left < PAD_CHUNK ? left : PAD_CHUNK;
+
+        if (fwrite(zeros, 1, size, file) != size)
+            return false;
+    }
+
+    return true;
+}
+
+/* EOF */
@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/gl_ext.h"
+
+#include <glad/glad.h>
+
+gl_extensions gl_ext;
+
+void
+load_gl_extensions(GLADloadproc load)
+{
+    memset(&gl_ext, 0, sizeof(gl_ext));
+
+    if (has_gl_extension("GL_ARB_buffer_storage")) {
+        gl_ext.glBufferStorage = load("glBufferStorage");
+        gl_ext.buffer_storage = gl_ext.glBufferStorage != NULL;
+    }
+
+    if (has_gl_extension("GL_ARB_multi_draw_indirect")
+        && has_gl_extension("GL_ARB_base_instance")) {
+        gl_ext.glMultiDrawElementsIndirect =
+            load("glMultiDrawElementsIndirect");
+        gl_ext.multi_draw_indirect =
+            gl_ext.glMultiDrawElementsIndirect != NULL;
+    }
+
+    printf("GL extensions: buffer storage %s, multi-draw indirect %s\n",
+           gl_ext.buffer_storage ? "yes" : "no",
+           gl_ext.multi_draw_indirect ? "yes" : "no");
+}
+
+bool
+has_gl_extension(const char *name)
+{
+    GLint count = 0;
+    GLint i;
+
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (i = 0; i < count; i++)
+        if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+
+    return false;
+}
+
+/* EOF */
@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+
+#include <glad/glad.h>
+
+/* Not part of GL 3.3, but tracked for the indirect draw path */
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_DRAW_INDIRECT_BUFFER_BINDING
+#define GL_DRAW_INDIRECT_BUFFER_BINDING 0x8F43
+#endif
+
+/* Marks shadowed state whose value is not known */
+#define UNKNOWN_STATE (~0u)
+
+#ifdef GL_STATE_DEBUG
+#define DEBUG_CHECK() check_gl_state()
+#else
+#define DEBUG_CHECK() ((void)0)
+#endif
+
+enum texture_target
+{
+    TEXTURE_TARGET_2D,
+    TEXTURE_TARGET_2D_ARRAY,
+    TEXTURE_TARGET_COUNT
+};
+
+enum buffer_target
+{
+    BUFFER_TARGET_ARRAY,
+    BUFFER_TARGET_ELEMENT_ARRAY,
+    BUFFER_TARGET_UNIFORM,
+    BUFFER_TARGET_PIXEL_PACK,
+    BUFFER_TARGET_PIXEL_UNPACK,
+    BUFFER_TARGET_COPY_READ,
+    BUFFER_TARGET_COPY_WRITE,
+    BUFFER_TARGET_DRAW_INDIRECT,
+    BUFFER_TARGET_COUNT
+};
+
+enum capability
+{
+    CAP_DEPTH_TEST,
+    CAP_BLEND,
+    CAP_CULL_FACE,
+    CAP_COUNT
+};
+
+struct uniform_range
+{
+    unsigned int buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+/* The shadow copy. There is only ever one context, like glad's entry points */
+static struct
+{
+    unsigned int program;
+
+    unsigned int active_unit;
+    unsigned int textures[STATE_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+
+    unsigned int vao;
+    unsigned int buffers[BUFFER_TARGET_COUNT];
+    struct uniform_range uniform_ranges[STATE_UNIFORM_BINDINGS];
+
+    unsigned int caps[CAP_COUNT];
+    unsigned int depth_func;
+    unsigned int depth_mask;
+    unsigned int color_mask;
+    unsigned int blend_src;
+    unsigned int blend_dst;
+
+    bool viewport_known;
+    int viewport[4];
+
+    gl_state_stats stats;
+} state;
+
+static const GLenum texture_targets[TEXTURE_TARGET_COUNT] = {
+    GL_TEXTURE_2D,
+    GL_TEXTURE_2D_ARRAY
+};
+
+static const GLenum texture_bindings[TEXTURE_TARGET_COUNT] = {
+    GL_TEXTURE_BINDING_2D,
+    GL_TEXTURE_BINDING_2D_ARRAY
+};
+
+static const GLenum buffer_targets[BUFFER_TARGET_COUNT] = {
+    GL_ARRAY_BUFFER,
+    GL_ELEMENT_ARRAY_BUFFER,
+    GL_UNIFORM_BUFFER,
+    GL_PIXEL_PACK_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER,
+    GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER
+};
+
+static const GLenum buffer_bindings[BUFFER_TARGET_COUNT] = {
+    GL_ARRAY_BUFFER_BINDING,
+    GL_ELEMENT_ARRAY_BUFFER_BINDING,
+    GL_UNIFORM_BUFFER_BINDING,
+    GL_PIXEL_PACK_BUFFER_BINDING,
+    GL_PIXEL_UNPACK_BUFFER_BINDING,
+    GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER_BINDING
+};
+
+static const GLenum capabilities[CAP_COUNT] = {
+    GL_DEPTH_TEST,
+    GL_BLEND,
+    GL_CULL_FACE
+};
+
+/**
+ * @brief Finds the shadow slot of a texture target
+ *
+ * @param[in] target The GL texture target
+ *
+ * @return The texture_target, or -1 if the target is not cached
+ */
+static int find_texture_target(GLenum target);
+
+/**
+ * @brief Finds the shadow slot of a buffer target
+ *
+ * @param[in] target The GL buffer target
+ *
+ * @return The buffer_target, or -1 if the target is not cached
+ */
+static int find_buffer_target(GLenum target);
+
+/**
+ * @brief Finds the shadow slot of a capability
+ *
+ * @param[in] cap The GL capability
+ *
+ * @return The capability, or -1 if the capability is not cached
+ */
+static int find_capability(GLenum cap);
+
+/**
+ * @brief Reports a mismatch between the shadow copy and the driver, then exits
+ *
+ * @param[in] what The name of the mismatched state
+ * @param[in] index The unit or binding point, or -1 if there is none
+ * @param[in] shadow The value the cache thinks is set
+ * @param[in] actual The value the driver reports
+ */
+static void report_desync(const char *what, int index, long shadow,
+                          long actual);
+
+void
+invalidate_gl_state(void)
+{
+    unsigned int i;
+    unsigned int j;
+
+    state.program = UNKNOWN_STATE;
+    state.active_unit = UNKNOWN_STATE;
+
+    for (i = 0; i < STATE_TEXTURE_UNITS; i++)
+        for (j = 0; j < TEXTURE_TARGET_COUNT; j++)
+            state.textures[i][j] = UNKNOWN_STATE;
+
+    state.vao = UNKNOWN_STATE;
+
+    for (i = 0; i < BUFFER_TARGET_COUNT; i++)
+        state.buffers[i] = UNKNOWN_STATE;
+
+    for (i = 0; i < STATE_UNIFORM_BINDINGS; i++)
+        state.uniform_ranges[i].buffer = UNKNOWN_STATE;
+
+    for (i = 0; i < CAP_COUNT; i++)
+        state.caps[i] = UNKNOWN_STATE;
+
+    state.depth_func = UNKNOWN_STATE;
+    state.depth_mask = UNKNOWN_STATE;
+    state.color_mask = UNKNOWN_STATE;
+    state.blend_src = UNKNOWN_STATE;
+    state.blend_dst = UNKNOWN_STATE;
+    state.viewport_known = false;
+}
+
+void
+check_gl_state(void)
+{
+    GLint value;
+    GLint64 value64;
+    GLint viewport[4];
+    GLboolean mask[4];
+    GLint active_texture;
+    unsigned int i;
+    unsigned int j;
+
+    if (state.program != UNKNOWN_STATE) {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+        if ((unsigned int)value != state.program)
+            report_desync("program", -1, state.program, value);
+    }
+
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+
+    if (state.active_unit != UNKNOWN_STATE
+        && (unsigned int)active_texture - GL_TEXTURE0 != state.active_unit)
+        report_desync("active texture unit", -1, state.active_unit,
+                      active_texture - GL_TEXTURE0);
+
+    for (i = 0; i < STATE_TEXTURE_UNITS; i++) {
+        for (j = 0; j < TEXTURE_TARGET_COUNT; j++) {
+            if (state.textures[i][j] == UNKNOWN_STATE)
+                continue;
+
+            glActiveTexture(GL_TEXTURE0 + i);
+            glGetIntegerv(texture_bindings[j], &value);
+
+            if ((unsigned int)value != state.textures[i][j])
+                report_desync(j == TEXTURE_TARGET_2D ? "texture 2D"
+                                                     : "texture 2D array",
+                              i, state.textures[i][j], value);
+        }
+    }
+
+    glActiveTexture(active_texture);
+
+    if (state.vao != UNKNOWN_STATE) {
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+        if ((unsigned int)value != state.vao)
+            report_desync("vertex array", -1, state.vao, value);
+    }
+
+    for (i = 0; i < BUFFER_TARGET_COUNT; i++) {
+        if (state.buffers[i] == UNKNOWN_STATE)
+            continue;
+
+        glGetIntegerv(buffer_bindings[i], &value);
+        if ((unsigned int)value != state.buffers[i])
+            report_desync("buffer", i, state.buffers[i], value);
+    }
+
+    for (i = 0; i < STATE_UNIFORM_BINDINGS; i++) {
+        if (state.uniform_ranges[i].buffer == UNKNOWN_STATE)
+            continue;
+
+        glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, i, &value);
+        if ((unsigned int)value != state.uniform_ranges[i].buffer)
+            report_desync("uniform buffer binding", i,
+                          state.uniform_ranges[i].buffer, value);
+
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_START, i, &value64);
+        if (value64 != state.uniform_ranges[i].offset)
+            report_desync("uniform buffer offset", i,
+                          state.uniform_ranges[i].offset, value64);
+    }
+
+    for (i = 0; i < CAP_COUNT; i++) {
+        if (state.caps[i] == UNKNOWN_STATE)
+            continue;
+
+        value = glIsEnabled(capabilities[i]);
+        if ((unsigned int)value != state.caps[i])
+            report_desync("capability", i, state.caps[i], value);
+    }
+
+    if (state.depth_func != UNKNOWN_STATE) {
+        glGetIntegerv(GL_DEPTH_FUNC, &value);
+        if ((unsigned int)value != state.depth_func)
+            report_desync("depth func", -1, state.depth_func, value);
+    }
+
+    if (state.depth_mask != UNKNOWN_STATE) {
+        glGetBooleanv(GL_DEPTH_WRITEMASK, mask);
+        if (mask[0] != state.depth_mask)
+            report_desync("depth mask", -1, state.depth_mask, mask[0]);
+    }
+
+    if (state.color_mask != UNKNOWN_STATE) {
+        glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+        for (i = 0; i < 4; i++)
+            if (mask[i] != state.color_mask)
+                report_desync("color mask", i, state.color_mask, mask[i]);
+    }
+
+    if (state.blend_src != UNKNOWN_STATE) {
+        glGetIntegerv(GL_BLEND_SRC_RGB, &value);
+        if ((unsigned int)value != state.blend_src)
+            report_desync("blend src", -1, state.blend_src, value);
+
+        glGetIntegerv(GL_BLEND_DST_RGB, &value);
+        if ((unsigned int)value != state.blend_dst)
+            report_desync("blend dst", -1, state.blend_dst, value);
+    }
+
+    if (state.viewport_known) {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        for (i = 0; i < 4; i++)
+            if (viewport[i] != state.viewport[i])
+                report_desync("viewport", i, state.viewport[i], viewport[i]);
+    }
+}
+
+gl_state_stats
+get_gl_state_stats(void)
+{
+    return state.stats;
+}
+
+void
+reset_gl_state_stats(void)
+{
+    state.stats.issued = 0;
+    state.stats.filtered = 0;
+}
+
+void
+state_use_program(unsigned int program)
+{
+    if (state.program == program) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glUseProgram(program);
+    state.program = program;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_bind_texture(unsigned int unit, GLenum target, unsigned int texture)
+{
+    int slot = find_texture_target(target);
+
+    if (slot >= 0 && unit < STATE_TEXTURE_UNITS
+        && state.textures[unit][slot] == texture) {
+        state.stats.filtered++;
+        return;
+    }
+
+    if (state.active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.active_unit = unit;
+        state.stats.issued++;
+    }
+
+    glBindTexture(target, texture);
+    state.stats.issued++;
+
+    if (slot >= 0 && unit < STATE_TEXTURE_UNITS)
+        state.textures[unit][slot] = texture;
+
+    DEBUG_CHECK();
+}
+
+void
+state_bind_vertex_array(unsigned int vao)
+{
+    if (state.vao == vao) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    state.vao = vao;
+    state.stats.issued++;
+
+    /* The element array binding is part of the vertex array's state */
+    state.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = UNKNOWN_STATE;
+
+    DEBUG_CHECK();
+}
+
+void
+state_bind_buffer(GLenum target, unsigned int buffer)
+{
+    int slot = find_buffer_target(target);
+
+    if (slot >= 0 && state.buffers[slot] == buffer) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glBindBuffer(target, buffer);
+    state.stats.issued++;
+
+    if (slot >= 0)
+        state.buffers[slot] = buffer;
+
+    DEBUG_CHECK();
+}
+
+void
+state_bind_uniform_range(unsigned int index, unsigned int buffer,
+                         GLintptr offset, GLsizeiptr size)
+{
+    struct uniform_range *range = NULL;
+
+    if (index < STATE_UNIFORM_BINDINGS) {
+        range = &state.uniform_ranges[index];
+
+        if (range->buffer == buffer && range->offset == offset
+            && range->size == size) {
+            state.stats.filtered++;
+            return;
+        }
+    }
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+    state.stats.issued++;
+
+    /* Binding an indexed target also binds the generic one */
+    state.buffers[BUFFER_TARGET_UNIFORM] = buffer;
+
+    if (range != NULL) {
+        range->buffer = buffer;
+        range->offset = offset;
+        range->size = size;
+    }
+
+    DEBUG_CHECK();
+}
+
+void
+state_set_enabled(GLenum cap, bool enabled)
+{
+    int slot = find_capability(cap);
+
+    if (slot >= 0 && state.caps[slot] == enabled) {
+        state.stats.filtered++;
+        return;
+    }
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+
+    state.stats.issued++;
+
+    if (slot >= 0)
+        state.caps[slot] = enabled;
+
+    DEBUG_CHECK();
+}
+
+void
+state_depth_func(GLenum func)
+{
+    if (state.depth_func == func) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glDepthFunc(func);
+    state.depth_func = func;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_depth_mask(GLboolean write)
+{
+    if (state.depth_mask == write) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glDepthMask(write);
+    state.depth_mask = write;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_color_mask(GLboolean write)
+{
+    if (state.color_mask == write) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glColorMask(write, write, write, write);
+    state.color_mask = write;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_blend_func(GLenum src, GLenum dst)
+{
+    if (state.blend_src == src && state.blend_dst == dst) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glBlendFunc(src, dst);
+    state.blend_src = src;
+    state.blend_dst = dst;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_viewport(int x, int y, int width, int height)
+{
+    if (state.viewport_known && state.viewport[0] == x
+        && state.viewport[1] == y && state.viewport[2] == width
+        && state.viewport[3] == height) {
+        state.stats.filtered++;
+        return;
+    }
+
+    glViewport(x, y, width, height);
+    state.viewport[0] = x;
+    state.viewport[1] = y;
+    state.viewport[2] = width;
+    state.viewport[3] = height;
+    state.viewport_known = true;
+    state.stats.issued++;
+
+    DEBUG_CHECK();
+}
+
+void
+state_delete_texture(unsigned int texture)
+{
+    unsigned int i;
+    unsigned int j;
+
+    glDeleteTextures(1, &texture);
+    untrack_gpu_texture(texture);
+
+    /* Deleting a bound texture reverts its bindings to 0 */
+    for (i = 0; i < STATE_TEXTURE_UNITS; i++)
+        for (j = 0; j < TEXTURE_TARGET_COUNT; j++)
+            if (state.textures[i][j] == texture)
+                state.textures[i][j] = 0;
+}
+
+void
+state_delete_buffer(unsigned int buffer)
+{
+    unsigned int i;
+
+    glDeleteBuffers(1, &buffer);
+    untrack_gpu_buffer(buffer);
+
+    for (i = 0; i < BUFFER_TARGET_COUNT; i++)
+        if (state.buffers[i] == buffer)
+            state.buffers[i] = 0;
+
+    /* Whether indexed bindings revert differs between GL versions */
+    for (i = 0; i < STATE_UNIFORM_BINDINGS; i++)
+        if (state.uniform_ranges[i].buffer == buffer)
+            state.uniform_ranges[i].buffer = UNKNOWN_STATE;
+}
+
+void
+state_delete_vertex_array(unsigned int vao)
+{
+    glDeleteVertexArrays(1, &vao);
+
+    if (state.vao == vao) {
+        state.vao = 0;
+        state.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = UNKNOWN_STATE;
+    }
+}
+
+void
+state_delete_program(unsigned int program)
+{
+    glDeleteProgram(program);
+
+    /*
+     * A program in use is only flagged for deletion, but its name can be
+     * reused once it is released, so stop trusting the shadow
+     */
+    if (state.program == program)
+        state.program = UNKNOWN_STATE;
+}
+
+static int
+find_texture_target(GLenum target)
+{
+    int i;
+
+    for (i = 0; i < TEXTURE_TARGET_COUNT; i++)
+        if (texture_targets[i] == target)
+            return i;
+
+    return -1;
+}
+
+static int
+find_buffer_target(GLenum target)
+{
+    int i;
+
+    for (i = 0; i < BUFFER_TARGET_COUNT; i++)
+        if (buffer_targets[i] == target)
+            return i;
+
+    return -1;
+}
+
+static int
+find_capability(GLenum cap)
+{
+    int i;
+
+    for (i = 0; i < CAP_COUNT; i++)
+        if (capabilities[i] == cap)
+            return i;
+
+    return -1;
+}
+
+static void
+report_desync(const char *what, int index, long shadow, long actual)
+{
+    if (index >= 0)
+        fprintf(stderr, "Error: GL state cache out of sync: %s[%d] is %ld, "
+                "expected %ld\n", what, index, actual, shadow);
+    else
+        fprintf(stderr, "Error: GL state cache out of sync: %s is %ld, "
+                "expected %ld\n", what, actual, shadow);
+
+    exit(EXIT_FAILURE);
+}
+
+/* EOF */
@@ -0,0 +1,1292 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/glb_loader.h"
+#include "../include/weld.h"
+
+#include <stb_ds.h>
+
+#include <glad/glad.h>
+
+#define JSON_OBJECT 0
+#define JSON_ARRAY 1
+#define JSON_STRING 2
+#define JSON_PRIMITIVE 3
+
+/* The attributes read, at the locations setup_mesh gives the vertex struct */
+#define NUM_ATTRIBUTES 3
+
+/*
+ * Vertex data is uploaded in place as the span of the BIN chunk holding the
+ * attributes. When other data between them would make that span more than
+ * this many times what the attributes need, they are packed instead
+ */
+#define MAX_SPAN_RATIO 2
+
+typedef struct json_token json_token;
+typedef struct glb_file glb_file;
+typedef struct glb_accessor glb_accessor;
+
+struct json_token
+{
+    unsigned int type;
+
+    /* The text of the token, without the quotes for strings */
+    unsigned int start;
+    unsigned int length;
+
+    /* The members of an object or the elements of an array */
+    unsigned int size;
+
+    /* The index of the first token after this one and its children */
+    unsigned int next;
+};
+
+/* A mapped .glb file, with its JSON chunk tokenized */
+struct glb_file
+{
+    void *mapping;
+    size_t size;
+
+    const char *json;
+
+    /* stb_ds array, the root object is token 0 */
+    json_token *tokens;
+
+    const unsigned char *bin;
+    size_t bin_size;
+};
+
+/* An accessor resolved against its buffer view and checked to be in bounds */
+struct glb_accessor
+{
+    /* NULL for an accessor without a buffer view, which reads as zeros */
+    const unsigned char *data;
+
+    /* The offset of data from the start of the BIN chunk */
+    size_t offset;
+
+    size_t count;
+    unsigned int components;
+    unsigned int component_type;
+    unsigned int component_size;
+    unsigned int normalized;
+    unsigned int stride;
+
+    /* The token of the sparse object, or -1 */
+    int sparse;
+};
+
+/**
+ * @brief Maps a .glb file, finds its chunks and tokenizes the JSON
+ *
+ * @param[out] glb The file to fill
+ * @param[in] path The path to the file
+ *
+ * @return Whether the file is a valid version 2 .glb
+ */
+static bool open_glb(glb_file *glb, const char *path);
+
+/**
+ * @brief Unmaps a .glb file and frees its tokens
+ *
+ * @param[in, out] glb The file
+ */
+static void close_glb(glb_file *glb);
+
+/**
+ * @brief Creates the mesh of one triangle primitive
+ *
+ * @param[in] glb The file
+ * @param[in] token The primitive object
+ * @param[out] primitive The primitive, its mesh is NULL if it has no vertices
+ * @param[out] converted Whether the data had to be converted
+ *
+ * @return Whether the primitive was valid
+ */
+static bool load_primitive(const glb_file *glb, int token,
+                           glb_primitive *primitive, bool *converted);
+
+/**
+ * @brief Reads the default scene's node hierarchy into a model
+ *
+ * @param[in] glb The file
+ * @param[in, out] model The model
+ *
+ * @return Whether the hierarchy was a valid tree
+ */
+static bool load_nodes(const glb_file *glb, glb_model *model);
+
+/**
+ * @brief Reads the local transform of a node
+ *
+ * @param[in] glb The file
+ * @param[in] token The node object
+ * @param[out] local The transform
+ */
+static void node_transform(const glb_file *glb, int token, mat4 local);
+
+/**
+ * @brief Resolves an accessor and checks it against its buffer view
+ *
+ * @param[in] glb The file
+ * @param[in] index The index of the accessor
+ * @param[out] accessor The accessor
+ *
+ * @return Whether the accessor exists and lies inside the BIN chunk
+ */
+static bool get_accessor(const glb_file *glb, size_t index,
+                         glb_accessor *accessor);
+
+/**
+ * @brief Finds the bytes of a buffer view
+ *
+ * @param[in] glb The file
+ * @param[in] index The index of the buffer view
+ * @param[out] offset The offset of the view in the BIN chunk
+ * @param[out] length The length of the view
+ * @param[out] stride The view's byte stride, 0 if it has none
+ *
+ * @return Whether the view exists and lies inside the BIN chunk
+ */
+static bool get_buffer_view(const glb_file *glb, size_t index, size_t *offset,
+                            size_t *length, unsigned int *stride);
+
+/**
+ * @brief Checks whether the GL can read an accessor as a vertex attribute
+ * where it lies
+ *
+ * @param[in] accessor The accessor
+ *
+ * @return Whether it can
+ */
+static bool is_direct_attribute(const glb_accessor *accessor);
+
+/**
+ * @brief Packs a primitive's attributes into the vertex struct
+ *
+ * @param[in] glb The file
+ * @param[in] accessors The attributes, in location order
+ * @param[in] present Which of the attributes the primitive has
+ *
+ * @return The vertices as an stb_ds array, or NULL on a bad sparse accessor
+ */
+static vertex *convert_vertices(const glb_file *glb,
+                                const glb_accessor *accessors,
+                                const bool *present);
+
+/**
+ * @brief Widens indices to 32 bits, or makes them up for a primitive without
+ * any
+ *
+ * @param[in] accessor The index accessor, or NULL
+ * @param[in] num_vertices The number of vertices
+ *
+ * @return The indices as an stb_ds array
+ */
+static unsigned int *convert_indices(const glb_accessor *accessor,
+                                     size_t num_vertices);
+
+/**
+ * @brief Checks that every index refers to an existing vertex
+ *
+ * @param[in] accessor The index accessor
+ * @param[in] num_vertices The number of vertices
+ *
+ * @return Whether all of the indices are below num_vertices
+ */
+static bool indices_in_range(const glb_accessor *accessor,
+                             size_t num_vertices);
+
+/**
+ * @brief Reads an accessor as floats
+ *
+ * @param[in] glb The file
+ * @param[in] accessor The accessor
+ * @param[out] dst Where the first element goes
+ * @param[in] dst_stride The floats between elements in dst
+ *
+ * @return Whether its sparse part, if any, was valid
+ */
+static bool read_floats(const glb_file *glb, const glb_accessor *accessor,
+                        float *dst, size_t dst_stride);
+
+/**
+ * @brief Reads one component as a float
+ *
+ * @param[in] p The component, may be unaligned
+ * @param[in] type The GL component type
+ * @param[in] normalized Whether integers map to [0, 1] or [-1, 1]
+ *
+ * @return The value
+ */
+static float read_component(const unsigned char *p, unsigned int type,
+                            unsigned int normalized);
+
+/**
+ * @brief Reads one unsigned index
+ *
+ * @param[in] p The index, may be unaligned
+ * @param[in] type GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+ *
+ * @return The index
+ */
+static uint32_t read_index(const unsigned char *p, unsigned int type);
+
+/**
+ * @brief Gets the size of a GL component type
+ *
+ * @param[in] type The type
+ *
+ * @return The size in bytes, 0 for types glTF does not allow
+ */
+static unsigned int component_size(unsigned int type);
+
+/**
+ * @brief Parses a JSON value and its children into tokens
+ *
+ * @param[in, out] glb The file whose tokens to add to
+ * @param[in, out] cursor The cursor, moved past the value
+ * @param[in] end The end of the JSON chunk
+ * @param[in] depth How deep the value is nested
+ *
+ * @return The token of the value, or -1 on a syntax error
+ */
+static int parse_json(glb_file *glb, const char **cursor, const char *end,
+                      int depth);
+
+/**
+ * @brief Finds a member of a JSON object
+ *
+ * @param[in] glb The file
+ * @param[in] object The object token, may be -1
+ * @param[in] key The member name
+ *
+ * @return The token of the value, or -1
+ */
+static int json_get(const glb_file *glb, int object, const char *key);
+
+/**
+ * @brief Finds an element of a JSON array
+ *
+ * @param[in] glb The file
+ * @param[in] array The array token, may be -1
+ * @param[in] index The index
+ *
+ * @return The token of the element, or -1
+ */
+static int json_at(const glb_file *glb, int array, size_t index);
+
+/**
+ * @brief Reads a JSON number
+ *
+ * @param[in] glb The file
+ * @param[in] token The token, may be -1
+ * @param[in] fallback The value for a missing token
+ *
+ * @return The number
+ */
+static double json_number(const glb_file *glb, int token, double fallback);
+
+/**
+ * @brief Reads a JSON number used as a count, index or offset
+ *
+ * @param[in] glb The file
+ * @param[in] token The token, may be -1
+ * @param[in] fallback The value for a missing token
+ *
+ * @return The number, SIZE_MAX if it is negative or too large
+ */
+static size_t json_size(const glb_file *glb, int token, size_t fallback);
+
+/**
+ * @brief Compares a JSON string or primitive with a C string
+ *
+ * @param[in] glb The file
+ * @param[in] token The token, may be -1
+ * @param[in] str The string
+ *
+ * @return Whether they are equal
+ */
+static bool json_equals(const glb_file *glb, int token, const char *str);
+
+/**
+ * @brief Skips JSON whitespace
+ *
+ * @param[in] p The cursor
+ * @param[in] end The end of the text
+ *
+ * @return The first other character
+ */
+static const char *skip_json_space(const char *p, const char *end);
+
+bool
+load_glb(glb_model *model, const char *path)
+{
+    glb_file glb;
+    glb_mesh range;
+    glb_primitive primitive;
+    unsigned int num_skipped = 0;
+    size_t m;
+    size_t p;
+    int meshes;
+    int primitives;
+    int token;
+    bool converted;
+    bool ok = true;
+
+    memset(model, 0, sizeof(*model));
+
+    if (!open_glb(&glb, path)) {
+        fprintf(stderr, "Error: Could not read glb file: %s\n", path);
+        return false;
+    }
+
+    meshes = json_get(&glb, 0, "meshes");
+
+    for (m = 0; ok && (token = json_at(&glb, meshes, m)) >= 0; m++) {
+        range.first_primitive = arrlen(model->primitives);
+        primitives = json_get(&glb, token, "primitives");
+
+        for (p = 0; ok && (token = json_at(&glb, primitives, p)) >= 0; p++) {
+            /* Only triangle lists, the default mode */
+            if (json_number(&glb, json_get(&glb, token, "mode"), 4) != 4) {
+                num_skipped++;
+                continue;
+            }
+
+            ok = load_primitive(&glb, token, &primitive, &converted);
+
+            if (ok && primitive.mesh != NULL) {
+                arrput(model->primitives, primitive);
+                model->num_converted += converted;
+            }
+        }
+
+        range.num_primitives = arrlen(model->primitives)
+                               - range.first_primitive;
+        arrput(model->meshes, range);
+    }
+
+    ok = ok && load_nodes(&glb, model);
+
+    close_glb(&glb);
+
+    if (!ok) {
+        /* Nothing else can reach the meshes made so far */
+        fprintf(stderr, "Error: Invalid glb file: %s\n", path);
+
+        for (m = 0; m < arrlenu(model->primitives); m++)
+            delete_mesh(model->primitives[m].mesh);
+
+        free_glb(model);
+        return false;
+    }
+
+    if (num_skipped > 0)
+        fprintf(stderr, "Warning: Skipped %u non-triangle primitives in %s\n",
+                num_skipped, path);
+
+    return true;
+}
+
+void
+update_glb_transforms(glb_model *model, mat4 root)
+{
+    glb_node *node;
+    size_t i;
+
+    for (i = 0; i < arrlen(model->nodes); i++) {
+        node = &model->nodes[i];
+
+        if (node->parent < 0)
+            glm_mat4_mul(root, node->local, node->world);
+        else
+            glm_mat4_mul(model->nodes[node->parent].world, node->local,
+                         node->world);
+    }
+}
+
+void
+free_glb(glb_model *model)
+{
+    arrfree(model->primitives);
+    arrfree(model->meshes);
+    arrfree(model->nodes);
+    model->num_converted = 0;
+}
+
+static bool
+open_glb(glb_file *glb, const char *path)
+{
+    const unsigned char *base;
+    const char *cursor;
+    struct stat info;
+    uint32_t header[3];
+    uint32_t chunk[2];
+    uint32_t json_length;
+    size_t offset;
+    int fd;
+
+    memset(glb, 0, sizeof(*glb));
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &info) != 0 || info.st_size < 20) {
+        close(fd);
+        return false;
+    }
+
+    glb->size = info.st_size;
+    glb->mapping = mmap(NULL, glb->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (glb->mapping == MAP_FAILED) {
+        glb->mapping = NULL;
+        return false;
+    }
+
+    base = glb->mapping;
+    memcpy(header, base, sizeof(header));
+    memcpy(chunk, base + 12, sizeof(chunk));
+
+    /* The JSON chunk always comes first */
+    if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > glb->size
+        || header[2] < 20 || chunk[1] != GLB_CHUNK_JSON
+        || chunk[0] > header[2] - 20) {
+        close_glb(glb);
+        return false;
+    }
+
+    glb->json = (const char *)base + 20;
+    json_length = chunk[0];
+    offset = 20 + (((size_t)json_length + 3) & ~(size_t)3);
+
+    /* The BIN chunk is optional, chunks after it are skipped */
+    if (offset + 8 <= header[2]) {
+        memcpy(chunk + 0, base + offset, 4);
+        memcpy(chunk + 1, base + offset + 4, 4);
+
+        if (chunk[1] == GLB_CHUNK_BIN && chunk[0] <= header[2] - offset - 8) {
+            glb->bin = base + offset + 8;
+            glb->bin_size = chunk[0];
+        }
+    }
+
+    cursor = glb->json;
+
+    if (parse_json(glb, &cursor, glb->json + json_length, 0) != 0
+        || glb->tokens[0].type != JSON_OBJECT) {
+        close_glb(glb);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+close_glb(glb_file *glb)
+{
+    if (glb->mapping != NULL)
+        munmap(glb->mapping, glb->size);
+
+    arrfree(glb->tokens);
+    memset(glb, 0, sizeof(*glb));
+}
+
+static bool
+load_primitive(const glb_file *glb, int token, glb_primitive *primitive,
+               bool *converted)
+{
+    static const char *const names[NUM_ATTRIBUTES] = {
+        "POSITION", "NORMAL", "TEXCOORD_0"
+    };
+    static const unsigned int components[NUM_ATTRIBUTES] = {3, 3, 2};
+
+    glb_accessor accessors[NUM_ATTRIBUTES];
+    glb_accessor indices;
+    vertex_attribute attributes[NUM_ATTRIBUTES];
+    bool present[NUM_ATTRIBUTES];
+    unsigned int num_attributes = 0;
+    unsigned int *converted_indices;
+    vertex *vertices;
+    size_t span_start = SIZE_MAX;
+    size_t span_end = 0;
+    size_t needed = 0;
+    size_t end;
+    bool direct_vertices = true;
+    bool direct_indices;
+    bool has_indices;
+    int members = json_get(glb, token, "attributes");
+    int index;
+    int a;
+
+    primitive->mesh = NULL;
+    index = json_get(glb, token, "material");
+    primitive->material = index >= 0 && json_size(glb, index, 0) < INT_MAX
+                              ? (int)json_size(glb, index, 0)
+                              : -1;
+
+    for (a = 0; a < NUM_ATTRIBUTES; a++) {
+        index = json_get(glb, members, names[a]);
+        present[a] = index >= 0;
+
+        if (!present[a])
+            continue;
+
+        if (!get_accessor(glb, json_size(glb, index, SIZE_MAX), &accessors[a])
+            || accessors[a].components != components[a]
+            || (a > 0 && present[0]
+                && accessors[a].count != accessors[0].count))
+            return false;
+    }
+
+    index = json_get(glb, token, "indices");
+    has_indices = index >= 0;
+
+    if (!present[0]
+        || (has_indices
+            && (!get_accessor(glb, json_size(glb, index, SIZE_MAX), &indices)
+                || indices.components != 1 || indices.sparse >= 0
+                || indices.component_type == GL_FLOAT
+                || indices.count > UINT_MAX))
+        || accessors[0].count > UINT_MAX)
+        return false;
+
+    if (accessors[0].count == 0)
+        return true;
+
+    /* Indices go to the GPU as they are, where a bad one reads past the end */
+    if (has_indices && !indices_in_range(&indices, accessors[0].count))
+        return false;
+
+    for (a = 0; a < NUM_ATTRIBUTES; a++) {
+        if (!present[a])
+            continue;
+
+        direct_vertices = direct_vertices && is_direct_attribute(&accessors[a]);
+
+        if (!direct_vertices)
+            break;
+
+        end = accessors[a].offset
+              + accessors[a].stride * (accessors[a].count - 1)
+              + accessors[a].components * accessors[a].component_size;
+
+        if (accessors[a].offset < span_start)
+            span_start = accessors[a].offset;
+        if (end > span_end)
+            span_end = end;
+
+        needed += accessors[a].count * accessors[a].components
+                  * accessors[a].component_size;
+    }
+
+    direct_vertices = direct_vertices
+                      && span_end - span_start <= needed * MAX_SPAN_RATIO;
+
+    /* Byte indices work in GL but many drivers convert them on every draw */
+    direct_indices = has_indices && indices.data != NULL
+                     && (indices.component_type == GL_UNSIGNED_SHORT
+                         || indices.component_type == GL_UNSIGNED_INT)
+                     && indices.stride == indices.component_size
+                     && indices.offset % indices.component_size == 0;
+
+    *converted = !direct_vertices || !direct_indices;
+
+    if (!direct_vertices) {
+        vertices = convert_vertices(glb, accessors, present);
+
+        if (vertices == NULL)
+            return false;
+
+        converted_indices = convert_indices(has_indices ? &indices : NULL,
+                                            accessors[0].count);
+
+        /*
+         * Exporters often split vertices that end up identical once
+         * converted. The direct paths below upload the file's bytes as they
+         * are and are left alone
+         */
+        weld_vertices(&vertices, &converted_indices, NULL);
+
+        primitive->mesh = create_mesh(vertices, converted_indices, NULL);
+        return true;
+    }
+
+    for (a = 0; a < NUM_ATTRIBUTES; a++) {
+        if (!present[a])
+            continue;
+
+        attributes[num_attributes].location = a;
+        attributes[num_attributes].components = components[a];
+        attributes[num_attributes].type = accessors[a].component_type;
+        attributes[num_attributes].normalized = accessors[a].normalized;
+        attributes[num_attributes].stride = accessors[a].stride;
+        attributes[num_attributes].offset = accessors[a].offset - span_start;
+        num_attributes++;
+    }
+
+    if (direct_indices) {
+        primitive->mesh = create_mesh_from_buffers(
+            glb->bin + span_start, span_end - span_start, attributes,
+            num_attributes, indices.data, indices.count,
+            indices.component_type, NULL);
+    }
+    else {
+        converted_indices = convert_indices(has_indices ? &indices : NULL,
+                                            accessors[0].count);
+
+        primitive->mesh = create_mesh_from_buffers(
+            glb->bin + span_start, span_end - span_start, attributes,
+            num_attributes, converted_indices, arrlen(converted_indices),
+            GL_UNSIGNED_INT, NULL);
+
+        arrfree(converted_indices);
+    }
+
+    return true;
+}
+
+static bool
+load_nodes(const glb_file *glb, glb_model *model)
+{
+    glb_node node;
+    mat4 identity = GLM_MAT4_IDENTITY_INIT;
+    size_t num_nodes;
+    size_t source;
+    size_t i;
+    size_t c;
+    int nodes = json_get(glb, 0, "nodes");
+    int scene;
+    int roots;
+    int children;
+    int token;
+    int mesh;
+    int *sources = NULL;
+    bool *seen;
+    bool ok = true;
+
+    memset(&node, 0, sizeof(node));
+
+    num_nodes = nodes >= 0 && glb->tokens[nodes].type == JSON_ARRAY
+                    ? glb->tokens[nodes].size
+                    : 0;
+
+    seen = calloc(num_nodes + 1, sizeof(*seen));
+
+    if (seen == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for glb nodes\n");
+        exit(EXIT_FAILURE);
+    }
+
+    scene = json_at(glb, json_get(glb, 0, "scenes"),
+                    json_size(glb, json_get(glb, 0, "scene"), 0));
+    roots = json_get(glb, scene, "nodes");
+
+    /* Without a scene, every node no other node lists as a child is a root */
+    if (roots < 0) {
+        for (i = 0; i < num_nodes; i++) {
+            children = json_get(glb, json_at(glb, nodes, i), "children");
+
+            for (c = 0; (token = json_at(glb, children, c)) >= 0; c++)
+                if ((source = json_size(glb, token, SIZE_MAX)) < num_nodes)
+                    seen[source] = true;
+        }
+    }
+
+    for (i = 0; ok; i++) {
+        if (roots >= 0) {
+            if ((token = json_at(glb, roots, i)) < 0)
+                break;
+
+            source = json_size(glb, token, SIZE_MAX);
+        }
+        else {
+            if (i >= num_nodes)
+                break;
+            if (seen[i])
+                continue;
+
+            source = i;
+        }
+
+        node.parent = -1;
+        arrput(model->nodes, node);
+        arrput(sources, source);
+    }
+
+    if (roots < 0)
+        memset(seen, 0, num_nodes * sizeof(*seen));
+
+    /* Breadth first, so every parent lands before its children */
+    for (i = 0; ok && i < arrlen(sources); i++) {
+        source = sources[i];
+        ok = source < num_nodes && !seen[source];
+
+        if (!ok)
+            break;
+
+        seen[source] = true;
+        token = json_at(glb, nodes, source);
+
+        mesh = json_get(glb, token, "mesh");
+        ok = mesh < 0 || json_size(glb, mesh, 0) < arrlen(model->meshes);
+
+        if (!ok)
+            break;
+
+        model->nodes[i].mesh = mesh < 0 ? -1 : (int)json_size(glb, mesh, 0);
+
+        node_transform(glb, token, model->nodes[i].local);
+
+        children = json_get(glb, token, "children");
+
+        for (c = 0; (token = json_at(glb, children, c)) >= 0; c++) {
+            node.parent = i;
+            arrput(model->nodes, node);
+            arrput(sources, json_size(glb, token, SIZE_MAX));
+        }
+    }
+
+    arrfree(sources);
+    free(seen);
+
+    if (ok)
+        update_glb_transforms(model, identity);
+
+    return ok;
+}
+
+static void
+node_transform(const glb_file *glb, int token, mat4 local)
+{
+    vec3 translation = GLM_VEC3_ZERO_INIT;
+    vec3 scale = GLM_VEC3_ONE_INIT;
+    versor rotation = {0.0f, 0.0f, 0.0f, 1.0f};
+    mat4 rotate;
+    int matrix = json_get(glb, token, "matrix");
+    int values;
+    int i;
+
+    /* Column major, the same as cglm */
+    if (matrix >= 0) {
+        for (i = 0; i < 16; i++)
+            local[i / 4][i % 4] = json_number(glb, json_at(glb, matrix, i),
+                                              i % 5 == 0);
+        return;
+    }
+
+    values = json_get(glb, token, "translation");
+
+    for (i = 0; i < 3; i++)
+        translation[i] = json_number(glb, json_at(glb, values, i), 0.0);
+
+    values = json_get(glb, token, "rotation");
+
+    for (i = 0; i < 4; i++)
+        rotation[i] = json_number(glb, json_at(glb, values, i), i == 3);
+
+    values = json_get(glb, token, "scale");
+
+    for (i = 0; i < 3; i++)
+        scale[i] = json_number(glb, json_at(glb, values, i), 1.0);
+
+    /* T * R * S */
+    glm_translate_make(local, translation);
+    glm_quat_mat4(rotation, rotate);
+    glm_mat4_mul(local, rotate, local);
+    glm_scale(local, scale);
+}
+
+static bool
+get_accessor(const glb_file *glb, size_t index, glb_accessor *accessor)
+{
+    int token = json_at(glb, json_get(glb, 0, "accessors"), index);
+    int type;
+    size_t view_offset;
+    size_t view_length;
+    size_t byte_offset;
+    size_t element_size;
+    unsigned int view_stride;
+
+    if (token < 0)
+        return false;
+
+    memset(accessor, 0, sizeof(*accessor));
+
+    accessor->count = json_size(glb, json_get(glb, token, "count"), SIZE_MAX);
+    accessor->component_type =
+        json_number(glb, json_get(glb, token, "componentType"), 0);
+    accessor->component_size = component_size(accessor->component_type);
+    accessor->normalized = json_equals(glb, json_get(glb, token, "normalized"),
+                                       "true");
+    accessor->sparse = json_get(glb, token, "sparse");
+
+    type = json_get(glb, token, "type");
+
+    if (json_equals(glb, type, "SCALAR"))
+        accessor->components = 1;
+    else if (json_equals(glb, type, "VEC2"))
+        accessor->components = 2;
+    else if (json_equals(glb, type, "VEC3"))
+        accessor->components = 3;
+    else if (json_equals(glb, type, "VEC4"))
+        accessor->components = 4;
+
+    element_size = accessor->components * accessor->component_size;
+
+    if (element_size == 0 || accessor->count == SIZE_MAX)
+        return false;
+
+    accessor->stride = element_size;
+
+    /* Zeros, possibly with a sparse part on top */
+    if (json_get(glb, token, "bufferView") < 0)
+        return true;
+
+    if (!get_buffer_view(glb,
+                         json_size(glb, json_get(glb, token, "bufferView"),
+                                   SIZE_MAX),
+                         &view_offset, &view_length, &view_stride))
+        return false;
+
+    byte_offset = json_size(glb, json_get(glb, token, "byteOffset"), 0);
+
+    if (view_stride != 0)
+        accessor->stride = view_stride;
+
+    /* Every element takes at least a byte, so the products cannot overflow */
+    if (byte_offset > view_length || accessor->count > view_length
+        || (accessor->count > 0
+            && accessor->stride * (accessor->count - 1) + element_size
+               > view_length - byte_offset))
+        return false;
+
+    accessor->offset = view_offset + byte_offset;
+    accessor->data = glb->bin + accessor->offset;
+
+    return true;
+}
+
+static bool
+get_buffer_view(const glb_file *glb, size_t index, size_t *offset,
+                size_t *length, unsigned int *stride)
+{
+    int token = json_at(glb, json_get(glb, 0, "bufferViews"), index);
+
+    /* Only buffer 0, the BIN chunk */
+    if (token < 0 || json_size(glb, json_get(glb, token, "buffer"), 0) != 0)
+        return false;
+
+    *offset = json_size(glb, json_get(glb, token, "byteOffset"), 0);
+    *length = json_size(glb, json_get(glb, token, "byteLength"), SIZE_MAX);
+    *stride = json_size(glb, json_get(glb, token, "byteStride"), 0);
+
+    return *offset <= glb->bin_size && *length <= glb->bin_size - *offset
+           && *stride <= 252;
+}
+
+static bool
+is_direct_attribute(const glb_accessor *accessor)
+{
+    /* The GL wants attributes on 4 byte boundaries */
+    return accessor->data != NULL && accessor->sparse < 0
+           && accessor->component_type != GL_UNSIGNED_INT
+           && accessor->offset % 4 == 0 && accessor->stride % 4 == 0;
+}
+
+static vertex *
+convert_vertices(const glb_file *glb, const glb_accessor *accessors,
+                 const bool *present)
+{
+    vertex *vertices = NULL;
+    size_t stride = sizeof(vertex) / sizeof(float);
+
+    arrsetlen(vertices, accessors[0].count);
+    memset(vertices, 0, accessors[0].count * sizeof(*vertices));
+
+    if (!read_floats(glb, &accessors[0], vertices[0].position, stride)
+        || (present[1]
+            && !read_floats(glb, &accessors[1], vertices[0].normal, stride))
+        || (present[2]
+            && !read_floats(glb, &accessors[2], vertices[0].tex_coords,
+                            stride))) {
+        arrfree(vertices);
+        return NULL;
+    }
+
+    return vertices;
+}
+
+static unsigned int *
+convert_indices(const glb_accessor *accessor, size_t num_vertices)
+{
+    unsigned int *indices = NULL;
+    size_t count = accessor != NULL ? accessor->count : num_vertices;
+    size_t i;
+
+    arrsetlen(indices, count);
+
+    for (i = 0; i < count; i++)
+        indices[i] = accessor == NULL ? i
+                     : accessor->data == NULL
+                         ? 0
+                         : read_index(accessor->data + i * accessor->stride,
+                                      accessor->component_type);
+
+    return indices;
+}
+
+static bool
+indices_in_range(const glb_accessor *accessor, size_t num_vertices)
+{
+    size_t i;
+
+    /* Without a buffer view every index is 0 */
+    if (accessor->data == NULL)
+        return true;
+
+    for (i = 0; i < accessor->count; i++)
+        if (read_index(accessor->data + i * accessor->stride,
+                       accessor->component_type) >= num_vertices)
+            return false;
+
+    return true;
+}
+
+static bool
+read_floats(const glb_file *glb, const glb_accessor *accessor, float *dst,
+            size_t dst_stride)
+{
+    const unsigned char *element;
+    const unsigned char *sparse_indices;
+    const unsigned char *sparse_values;
+    size_t count;
+    size_t offset;
+    size_t length;
+    size_t byte_offset;
+    size_t target;
+    size_t i;
+    unsigned int index_type;
+    unsigned int stride;
+    unsigned int c;
+    int token;
+
+    for (i = 0; i < accessor->count && accessor->data != NULL; i++) {
+        element = accessor->data + i * accessor->stride;
+
+        for (c = 0; c < accessor->components; c++)
+            dst[i * dst_stride + c] = read_component(
+                element + c * accessor->component_size,
+                accessor->component_type, accessor->normalized);
+    }
+
+    if (accessor->sparse < 0)
+        return true;
+
+    count = json_size(glb, json_get(glb, accessor->sparse, "count"),
+                      SIZE_MAX);
+
+    /* The indices of the replaced elements, tightly packed */
+    token = json_get(glb, accessor->sparse, "indices");
+    index_type = json_number(glb, json_get(glb, token, "componentType"), 0);
+    byte_offset = json_size(glb, json_get(glb, token, "byteOffset"), 0);
+
+    if (count > accessor->count || component_size(index_type) == 0
+        || index_type == GL_FLOAT
+        || !get_buffer_view(glb,
+                            json_size(glb, json_get(glb, token, "bufferView"),
+                                      SIZE_MAX),
+                            &offset, &length, &stride)
+        || byte_offset > length
+        || count * component_size(index_type) > length - byte_offset)
+        return false;
+
+    sparse_indices = glb->bin + offset + byte_offset;
+
+    /* Their new values, tightly packed in the accessor's own format */
+    token = json_get(glb, accessor->sparse, "values");
+    byte_offset = json_size(glb, json_get(glb, token, "byteOffset"), 0);
+
+    if (!get_buffer_view(glb,
+                         json_size(glb, json_get(glb, token, "bufferView"),
+                                   SIZE_MAX),
+                         &offset, &length, &stride)
+        || byte_offset > length
+        || count * accessor->components * accessor->component_size
+           > length - byte_offset)
+        return false;
+
+    sparse_values = glb->bin + offset + byte_offset;
+
+    for (i = 0; i < count; i++) {
+        target = read_index(sparse_indices + i * component_size(index_type),
+                            index_type);
+
+        if (target >= accessor->count)
+            return false;
+
+        element = sparse_values
+                  + i * accessor->components * accessor->component_size;
+
+        for (c = 0; c < accessor->components; c++)
+            dst[target * dst_stride + c] = read_component(
+                element + c * accessor->component_size,
+                accessor->component_type, accessor->normalized);
+    }
+
+    return true;
+}
+
+static float
+read_component(const unsigned char *p, unsigned int type,
+               unsigned int normalized)
+{
+    int16_t s;
+    uint16_t us;
+    uint32_t ui;
+    float f;
+
+    switch (type) {
+    case GL_BYTE:
+        return normalized ? glm_max((int8_t)p[0] / 127.0f, -1.0f)
+                          : (int8_t)p[0];
+    case GL_UNSIGNED_BYTE:
+        return normalized ? p[0] / 255.0f : p[0];
+    case GL_SHORT:
+        memcpy(&s, p, sizeof(s));
+        return normalized ? glm_max(s / 32767.0f, -1.0f) : s;
+    case GL_UNSIGNED_SHORT:
+        memcpy(&us, p, sizeof(us));
+        return normalized ? us / 65535.0f : us;
+    case GL_UNSIGNED_INT:
+        memcpy(&ui, p, sizeof(ui));
+        return ui;
+    default:
+        memcpy(&f, p, sizeof(f));
+        return f;
+    }
+}
+
+static uint32_t
+read_index(const unsigned char *p, unsigned int type)
+{
+    uint16_t us;
+    uint32_t ui;
+
+    if (type == GL_UNSIGNED_BYTE)
+        return p[0];
+
+    if (type == GL_UNSIGNED_SHORT) {
+        memcpy(&us, p, sizeof(us));
+        return us;
+    }
+
+    memcpy(&ui, p, sizeof(ui));
+
+    return ui;
+}
+
+static unsigned int
+component_size(unsigned int type)
+{
+    switch (type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static int
+parse_json(glb_file *glb, const char **cursor, const char *end, int depth)
+{
+    json_token token = {0};
+    const char *p = skip_json_space(*cursor, end);
+    char close;
+    int index;
+    int key;
+
+    if (p == end || depth > GLB_MAX_JSON_DEPTH)
+        return -1;
+
+    index = arrlen(glb->tokens);
+    token.start = p - glb->json;
+    arrput(glb->tokens, token);
+
+    if (*p == '{' || *p == '[') {
+        close = *p == '{' ? '}' : ']';
+        glb->tokens[index].type = *p == '{' ? JSON_OBJECT : JSON_ARRAY;
+        p = skip_json_space(p + 1, end);
+
+        if (p < end && *p == close) {
+            p++;
+        }
+        else {
+            for (;;) {
+                if (close == '}') {
+                    key = parse_json(glb, &p, end, depth + 1);
+
+                    if (key < 0 || glb->tokens[key].type != JSON_STRING)
+                        return -1;
+
+                    p = skip_json_space(p, end);
+
+                    if (p == end || *p++ != ':')
+                        return -1;
+                }
+
+                if (parse_json(glb, &p, end, depth + 1) < 0)
+                    return -1;
+
+                glb->tokens[index].size++;
+                p = skip_json_space(p, end);
+
+                if (p == end)
+                    return -1;
+                if (*p == close) {
+                    p++;
+                    break;
+                }
+                if (*p++ != ',')
+                    return -1;
+            }
+        }
+    }
+    else if (*p == '"') {
+        glb->tokens[index].type = JSON_STRING;
+        glb->tokens[index].start++;
+
+        /* Escapes are kept, glTF names and keys do not need them */
+        for (p++; p < end && *p != '"'; p++)
+            if (*p == '\\' && ++p == end)
+                return -1;
+
+        if (p == end)
+            return -1;
+
+        glb->tokens[index].length = p - glb->json - glb->tokens[index].start;
+        p++;
+    }
+    else {
+        glb->tokens[index].type = JSON_PRIMITIVE;
+
+        while (p < end && strchr(",:]} \t\r\n", *p) == NULL)
+            p++;
+
+        glb->tokens[index].length = p - glb->json - glb->tokens[index].start;
+
+        if (glb->tokens[index].length == 0)
+            return -1;
+    }
+
+    glb->tokens[index].next = arrlen(glb->tokens);
+    *cursor = p;
+
+    return index;
+}
+
+static int
+json_get(const glb_file *glb, int object, const char *key)
+{
+    unsigned int i;
+    int token;
+
+    if (object < 0 || glb->tokens[object].type != JSON_OBJECT)
+        return -1;
+
+    for (i = 0, token = object + 1; i < glb->tokens[object].size; i++) {
+        if (json_equals(glb, token, key))
+            return token + 1;
+
+        token = glb->tokens[token + 1].next;
+    }
+
+    return -1;
+}
+
+static int
+json_at(const glb_file *glb, int array, size_t index)
+{
+    size_t i;
+    int token;
+
+    if (array < 0 || glb->tokens[array].type != JSON_ARRAY
+        || index >= glb->tokens[array].size)
+        return -1;
+
+    for (i = 0, token = array + 1; i < index; i++)
+        token = glb->tokens[token].next;
+
+    return token;
+}
+
+static double
+json_number(const glb_file *glb, int token, double fallback)
+{
+    char text[64];
+    unsigned int length;
+
+    if (token < 0 || glb->tokens[token].type != JSON_PRIMITIVE)
+        return fallback;
+
+    length = glb->tokens[token].length < sizeof(text) - 1
+                 ? glb->tokens[token].length
+                 : sizeof(text) - 1;
+
+    memcpy(text, glb->json + glb->tokens[token].start, length);
+    text[length] = '\0';
+
+    return strtod(text, NULL);
+}
+
+static size_t
+json_size(const glb_file *glb, int token, size_t fallback)
+{
+    double value = json_number(glb, token, -1.0);
+
+    if (token < 0)
+        return fallback;
+
+    /* Anything past 2^53 is not a byte count any file here could have */
+    return value >= 0.0 && value < 9007199254740992.0 ? (size_t)value
+                                                      : SIZE_MAX;
+}
+
+static bool
+json_equals(const glb_file *glb, int token, const char *str)
+{
+    size_t length = strlen(str);
+
+    return token >= 0 && glb->tokens[token].length == length
+           && memcmp(glb->json + glb->tokens[token].start, str, length) == 0;
+}
+
+static const char *
+skip_json_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+
+    return p;
+}
+
+/* EOF */
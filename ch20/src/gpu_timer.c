@@ -0,0 +1,77 @@
+#include <string.h>
+
+#include "../include/gpu_timer.h"
+
+#include <glad/glad.h>
+
+/**
+ * @brief Reads the result of one of the timer's queries into its running total
+ *
+ * @param[in, out] timer The timer that owns the query
+ * @param[in] slot The index of the query to read
+ */
+static void collect_query(gpu_timer *timer, unsigned int slot);
+
+void
+create_gpu_timer(gpu_timer *timer)
+{
+    memset(timer, 0, sizeof(*timer));
+    glGenQueries(GPU_TIMER_LATENCY, timer->queries);
+}
+
+void
+begin_gpu_timer(gpu_timer *timer)
+{
+    /*
+     * The query we are about to reuse was issued GPU_TIMER_LATENCY frames ago,
+     * so its result is almost always available by now
+     */
+    if (timer->pending[timer->current])
+        collect_query(timer, timer->current);
+
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->current]);
+}
+
+void
+end_gpu_timer(gpu_timer *timer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+
+    timer->pending[timer->current] = true;
+    timer->current = (timer->current + 1) % GPU_TIMER_LATENCY;
+}
+
+double
+average_gpu_timer(gpu_timer *timer)
+{
+    double average = 0.0;
+
+    if (timer->num_samples > 0)
+        average = timer->total_ms / timer->num_samples;
+
+    timer->total_ms = 0.0;
+    timer->num_samples = 0;
+
+    return average;
+}
+
+void
+delete_gpu_timer(gpu_timer *timer)
+{
+    glDeleteQueries(GPU_TIMER_LATENCY, timer->queries);
+    memset(timer, 0, sizeof(*timer));
+}
+
+static void
+collect_query(gpu_timer *timer, unsigned int slot)
+{
+    GLuint64 elapsed_ns = 0;
+
+    glGetQueryObjectui64v(timer->queries[slot], GL_QUERY_RESULT, &elapsed_ns);
+
+    timer->total_ms += elapsed_ns / 1000000.0;
+    timer->num_samples++;
+    timer->pending[slot] = false;
+}
+
+/* EOF */
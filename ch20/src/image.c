@@ -0,0 +1,598 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "../include/image.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(IMAGE_TURBOJPEG)
+#include <turbojpeg.h>
+#endif
+
+#if defined(IMAGE_SPNG)
+#include <spng.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <glad/glad.h>
+
+/**
+ * @brief Reverses the order of the rows of an image
+ *
+ * @param[in, out] img The image
+ */
+static void flip_rows(image *img);
+
+#if defined(IMAGE_TURBOJPEG) || defined(IMAGE_SPNG)
+/**
+ * @brief Checks the extension of a path
+ *
+ * @param[in] path The path
+ * @param[in] extension The extension, including the dot
+ *
+ * @return Whether the path ends in the extension, ignoring case
+ */
+static bool has_extension(const char *path, const char *extension);
+
+/**
+ * @brief Reads a whole file into memory
+ *
+ * @param[in] path The path to the file
+ * @param[out] size The size of the file
+ *
+ * @return The contents, to be freed by the caller, or NULL on failure
+ */
+static unsigned char *read_file(const char *path, size_t *size);
+#endif
+
+#if defined(IMAGE_TURBOJPEG)
+/**
+ * @brief Decodes a JPEG file with libjpeg-turbo
+ *
+ * @param[out] img The image to fill
+ * @param[in] path The path to the file
+ * @param[in] flip Whether to decode the rows bottom up
+ *
+ * @return Whether the file was decoded
+ */
+static bool load_turbojpeg(image *img, const char *path, bool flip);
+#endif
+
+#if defined(IMAGE_SPNG)
+/**
+ * @brief Decodes a PNG file with libspng
+ *
+ * @param[out] img The image to fill
+ * @param[in] path The path to the file
+ *
+ * @return Whether the file was decoded
+ */
+static bool load_spng(image *img, const char *path);
+#endif
+
+bool
+load_image(image *img, const char *path, unsigned int flags)
+{
+    bool flipped = false;
+
+    img->pixels = NULL;
+
+#if defined(IMAGE_TURBOJPEG)
+    /* libjpeg-turbo writes the rows bottom up itself */
+    if ((has_extension(path, ".jpg") || has_extension(path, ".jpeg"))
+        && load_turbojpeg(img, path, flags & IMAGE_FLIP))
+        flipped = true;
+#endif
+
+#if defined(IMAGE_SPNG)
+    if (img->pixels == NULL && has_extension(path, ".png"))
+        load_spng(img, path);
+#endif
+
+    /*
+     * Anything the optional decoders skip or fail on goes to stb_image. Its
+     * flip setting is global, so the rows are flipped here instead to keep
+     * loads on different threads independent
+     */
+    if (img->pixels == NULL)
+        img->pixels = stbi_load(path, &img->width, &img->height,
+                                &img->num_channels, 0);
+
+    if (img->pixels == NULL)
+        return false;
+
+    if ((flags & IMAGE_FLIP) && !flipped)
+        flip_rows(img);
+
+    if ((flags & IMAGE_PREMULTIPLY) && img->num_channels == 4)
+        premultiply_alpha(img->pixels,
+                          (size_t)img->width * img->height);
+
+    return true;
+}
+
+void
+free_image(image *img)
+{
+    /* Every decoder allocates with malloc, stb_image included */
+    free(img->pixels);
+    img->pixels = NULL;
+}
+
+const char *
+image_decoder_name(const char *path)
+{
+#if defined(IMAGE_TURBOJPEG)
+    if (has_extension(path, ".jpg") || has_extension(path, ".jpeg"))
+        return "libjpeg-turbo";
+#endif
+
+#if defined(IMAGE_SPNG)
+    if (has_extension(path, ".png"))
+        return "libspng";
+#endif
+
+    (void)path;
+
+    return "stb_image";
+}
+
+void
+get_image_formats(int num_channels, int *internal_format, unsigned int *format)
+{
+    switch (num_channels) {
+    case 1:
+        *internal_format = GL_R8;
+        *format = GL_RED;
+        break;
+    case 2:
+        *internal_format = GL_RG8;
+        *format = GL_RG;
+        break;
+    case 3:
+        *internal_format = GL_RGB8;
+        *format = GL_RGB;
+        break;
+    default:
+        *internal_format = GL_RGBA8;
+        *format = GL_RGBA;
+        break;
+    }
+}
+
+void
+convert_to_rgba(unsigned char *restrict dst, const unsigned char *restrict src,
+                int num_channels, size_t count)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    __m128i in;
+    __m128i lo;
+    __m128i hi;
+#endif
+
+#if defined(__SSSE3__)
+    /* Spreads 4 RGB pixels out to the low 3 bytes of each 32-bit lane */
+    const __m128i rgb_shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                              6, 7, 8, -1, 9, 10, 11, -1);
+#endif
+
+#if defined(__AVX2__)
+    const __m256i rgb_shuffle8 = _mm256_broadcastsi128_si256(rgb_shuffle);
+    const __m256i alpha8 = _mm256_set1_epi32((int)0xff000000);
+    __m256i in8;
+#endif
+
+    switch (num_channels) {
+    case 4:
+        memcpy(dst, src, count * 4);
+        return;
+
+    case 3:
+#if defined(__AVX2__)
+        /* Each 16-byte load only uses 12 bytes, so stop while 4 more remain */
+        for (; i + 10 <= count; i += 8) {
+            in8 = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i *)(src + i * 3))),
+                _mm_loadu_si128((const __m128i *)(src + i * 3 + 12)), 1);
+            in8 = _mm256_or_si256(_mm256_shuffle_epi8(in8, rgb_shuffle8),
+                                  alpha8);
+            _mm256_storeu_si256((__m256i *)(dst + i * 4), in8);
+        }
+#endif
+#if defined(__SSSE3__)
+        for (; i + 6 <= count; i += 4) {
+            in = _mm_loadu_si128((const __m128i *)(src + i * 3));
+            in = _mm_or_si128(_mm_shuffle_epi8(in, rgb_shuffle), alpha);
+            _mm_storeu_si128((__m128i *)(dst + i * 4), in);
+        }
+#endif
+        break;
+
+    case 2:
+#if defined(__SSE2__)
+        /* Zero-extending each 16-bit RG pair leaves B at 0 */
+        for (; i + 8 <= count; i += 8) {
+            in = _mm_loadu_si128((const __m128i *)(src + i * 2));
+            lo = _mm_or_si128(_mm_unpacklo_epi16(in, zero), alpha);
+            hi = _mm_or_si128(_mm_unpackhi_epi16(in, zero), alpha);
+            _mm_storeu_si128((__m128i *)(dst + i * 4), lo);
+            _mm_storeu_si128((__m128i *)(dst + i * 4 + 16), hi);
+        }
+#endif
+        break;
+
+    case 1:
+#if defined(__SSE2__)
+        for (; i + 16 <= count; i += 16) {
+            in = _mm_loadu_si128((const __m128i *)(src + i));
+            lo = _mm_unpacklo_epi8(in, zero);
+            hi = _mm_unpackhi_epi8(in, zero);
+            _mm_storeu_si128((__m128i *)(dst + i * 4),
+                             _mm_or_si128(_mm_unpacklo_epi16(lo, zero), alpha));
+            _mm_storeu_si128((__m128i *)(dst + i * 4 + 16),
+                             _mm_or_si128(_mm_unpackhi_epi16(lo, zero), alpha));
+            _mm_storeu_si128((__m128i *)(dst + i * 4 + 32),
+                             _mm_or_si128(_mm_unpacklo_epi16(hi, zero), alpha));
+            _mm_storeu_si128((__m128i *)(dst + i * 4 + 48),
+                             _mm_or_si128(_mm_unpackhi_epi16(hi, zero), alpha));
+        }
+#endif
+        break;
+    }
+
+    /* Whatever the vector loops left over */
+    convert_to_rgba_scalar(dst + i * 4, src + i * num_channels, num_channels,
+                           count - i);
+}
+
+void
+swap_red_blue(unsigned char *pixels, size_t count)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+    __m128i in;
+    __m128i rb;
+#endif
+
+#if defined(__AVX2__)
+    const __m256i rb_mask8 = _mm256_set1_epi32(0x00ff00ff);
+    __m256i in8;
+    __m256i rb8;
+
+    for (; i + 8 <= count; i += 8) {
+        in8 = _mm256_loadu_si256((const __m256i *)(pixels + i * 4));
+        rb8 = _mm256_and_si256(in8, rb_mask8);
+        rb8 = _mm256_or_si256(_mm256_slli_epi32(rb8, 16),
+                              _mm256_srli_epi32(rb8, 16));
+        in8 = _mm256_or_si256(_mm256_andnot_si256(rb_mask8, in8), rb8);
+        _mm256_storeu_si256((__m256i *)(pixels + i * 4), in8);
+    }
+#endif
+
+#if defined(__SSE2__)
+    /* Moving R up and B down by 16 bits swaps them, G and A stay put */
+    for (; i + 4 <= count; i += 4) {
+        in = _mm_loadu_si128((const __m128i *)(pixels + i * 4));
+        rb = _mm_and_si128(in, rb_mask);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        in = _mm_or_si128(_mm_andnot_si128(rb_mask, in), rb);
+        _mm_storeu_si128((__m128i *)(pixels + i * 4), in);
+    }
+#endif
+
+    swap_red_blue_scalar(pixels + i * 4, count - i);
+}
+
+void
+premultiply_alpha(unsigned char *pixels, size_t count)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep_alpha = _mm_set1_epi64x(0x00ff000000000000);
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i in;
+    __m128i lo;
+    __m128i hi;
+    __m128i a;
+#endif
+
+#if defined(__AVX2__)
+    const __m256i zero8 = _mm256_setzero_si256();
+    const __m256i keep_alpha8 = _mm256_set1_epi64x(0x00ff000000000000);
+    const __m256i round8 = _mm256_set1_epi16(128);
+    __m256i in8;
+    __m256i lo8;
+    __m256i hi8;
+    __m256i a8;
+#endif
+
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        in8 = _mm256_loadu_si256((const __m256i *)(pixels + i * 4));
+
+        lo8 = _mm256_unpacklo_epi8(in8, zero8);
+        a8 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo8, 0xff), 0xff);
+        a8 = _mm256_or_si256(_mm256_andnot_si256(keep_alpha8, a8),
+                             keep_alpha8);
+        lo8 = _mm256_add_epi16(_mm256_mullo_epi16(lo8, a8), round8);
+        lo8 = _mm256_srli_epi16(
+            _mm256_add_epi16(lo8, _mm256_srli_epi16(lo8, 8)), 8);
+
+        hi8 = _mm256_unpackhi_epi8(in8, zero8);
+        a8 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi8, 0xff), 0xff);
+        a8 = _mm256_or_si256(_mm256_andnot_si256(keep_alpha8, a8),
+                             keep_alpha8);
+        hi8 = _mm256_add_epi16(_mm256_mullo_epi16(hi8, a8), round8);
+        hi8 = _mm256_srli_epi16(
+            _mm256_add_epi16(hi8, _mm256_srli_epi16(hi8, 8)), 8);
+
+        /* Unpacking and packing both work per 128-bit lane, so order holds */
+        _mm256_storeu_si256((__m256i *)(pixels + i * 4),
+                            _mm256_packus_epi16(lo8, hi8));
+    }
+#endif
+
+#if defined(__SSE2__)
+    /*
+     * Two pixels per register as 16-bit channels. Alpha is multiplied by 255
+     * so it survives the same divide by 255 as the colors
+     */
+    for (; i + 4 <= count; i += 4) {
+        in = _mm_loadu_si128((const __m128i *)(pixels + i * 4));
+
+        lo = _mm_unpacklo_epi8(in, zero);
+        a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+        a = _mm_or_si128(_mm_andnot_si128(keep_alpha, a), keep_alpha);
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, a), round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+
+        hi = _mm_unpackhi_epi8(in, zero);
+        a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+        a = _mm_or_si128(_mm_andnot_si128(keep_alpha, a), keep_alpha);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, a), round);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)(pixels + i * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    premultiply_alpha_scalar(pixels + i * 4, count - i);
+}
+
+void
+convert_to_rgba_scalar(unsigned char *restrict dst,
+                       const unsigned char *restrict src, int num_channels,
+                       size_t count)
+{
+    size_t i;
+    int c;
+
+    for (i = 0; i < count; i++, dst += 4, src += num_channels)
+        for (c = 0; c < 4; c++)
+            dst[c] = c < num_channels ? src[c] : (c == 3 ? 255 : 0);
+}
+
+void
+swap_red_blue_scalar(unsigned char *pixels, size_t count)
+{
+    size_t i;
+    unsigned char temp;
+
+    for (i = 0; i < count; i++, pixels += 4) {
+        temp = pixels[0];
+        pixels[0] = pixels[2];
+        pixels[2] = temp;
+    }
+}
+
+void
+premultiply_alpha_scalar(unsigned char *pixels, size_t count)
+{
+    size_t i;
+    unsigned int t;
+    int c;
+
+    /* (t + (t >> 8)) >> 8 is t / 255 rounded, for every t up to 255 * 255 */
+    for (i = 0; i < count; i++, pixels += 4) {
+        for (c = 0; c < 3; c++) {
+            t = pixels[c] * pixels[3] + 128;
+            pixels[c] = (t + (t >> 8)) >> 8;
+        }
+    }
+}
+
+static void
+flip_rows(image *img)
+{
+    size_t stride = (size_t)img->width * img->num_channels;
+    unsigned char *top = img->pixels;
+    unsigned char *bottom = img->pixels + (img->height - 1) * stride;
+    unsigned char temp[256];
+    size_t offset;
+    size_t chunk;
+
+    /* Swapped through a small buffer so no row-sized allocation is needed */
+    for (; top < bottom; top += stride, bottom -= stride) {
+        for (offset = 0; offset < stride; offset += chunk) {
+            chunk = stride - offset < sizeof(temp) ? stride - offset
+                                                   : sizeof(temp);
+            memcpy(temp, top + offset, chunk);
+            memcpy(top + offset, bottom + offset, chunk);
+            memcpy(bottom + offset, temp, chunk);
+        }
+    }
+}
+
+#if defined(IMAGE_TURBOJPEG) || defined(IMAGE_SPNG)
+static bool
+has_extension(const char *path, const char *extension)
+{
+    size_t path_length = strlen(path);
+    size_t extension_length = strlen(extension);
+
+    return path_length >= extension_length
+           && strcasecmp(path + path_length - extension_length, extension)
+              == 0;
+}
+
+static unsigned char *
+read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    unsigned char *data = NULL;
+    long length;
+
+    if (file == NULL)
+        return NULL;
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0
+        && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(length);
+
+        if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+
+        *size = length;
+    }
+
+    fclose(file);
+
+    return data;
+}
+#endif
+
+#if defined(IMAGE_TURBOJPEG)
+static bool
+load_turbojpeg(image *img, const char *path, bool flip)
+{
+    tjhandle decoder;
+    unsigned char *data;
+    size_t size;
+    int subsampling;
+    int colorspace;
+    int pixel_format;
+    int tj_flags = TJFLAG_FASTDCT;
+    bool ok = false;
+
+    data = read_file(path, &size);
+
+    if (data == NULL)
+        return false;
+
+    decoder = tjInitDecompress();
+
+    if (decoder != NULL
+        && tjDecompressHeader3(decoder, data, size, &img->width, &img->height,
+                               &subsampling, &colorspace) == 0) {
+        /* Same channels stb_image would give: 1 for grayscale, 3 otherwise */
+        img->num_channels = colorspace == TJCS_GRAY ? 1 : 3;
+        pixel_format = colorspace == TJCS_GRAY ? TJPF_GRAY : TJPF_RGB;
+
+        if (flip)
+            tj_flags |= TJFLAG_BOTTOMUP;
+
+        img->pixels = malloc((size_t)img->width * img->height
+                             * img->num_channels);
+
+        ok = img->pixels != NULL
+             && tjDecompress2(decoder, data, size, img->pixels, img->width, 0,
+                              img->height, pixel_format, tj_flags) == 0;
+    }
+
+    if (!ok) {
+        free(img->pixels);
+        img->pixels = NULL;
+    }
+
+    if (decoder != NULL)
+        tjDestroy(decoder);
+
+    free(data);
+
+    return ok;
+}
+#endif
+
+#if defined(IMAGE_SPNG)
+static bool
+load_spng(image *img, const char *path)
+{
+    spng_ctx *ctx;
+    struct spng_ihdr ihdr;
+    unsigned char *data;
+    size_t size;
+    size_t out_size;
+    int format;
+    bool ok = false;
+
+    data = read_file(path, &size);
+
+    if (data == NULL)
+        return false;
+
+    ctx = spng_ctx_new(0);
+
+    if (ctx != NULL && spng_set_png_buffer(ctx, data, size) == 0
+        && spng_get_ihdr(ctx, &ihdr) == 0) {
+        /*
+         * 8-bit RGB and grayscale keep their channels, everything else
+         * (alpha, palettes, 16-bit) comes out as RGBA8
+         */
+        if (ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR
+            && ihdr.bit_depth == 8) {
+            format = SPNG_FMT_RGB8;
+            img->num_channels = 3;
+        }
+        else if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE
+                 && ihdr.bit_depth == 8) {
+            format = SPNG_FMT_G8;
+            img->num_channels = 1;
+        }
+        else {
+            format = SPNG_FMT_RGBA8;
+            img->num_channels = 4;
+        }
+
+        img->width = ihdr.width;
+        img->height = ihdr.height;
+
+        if (spng_decoded_image_size(ctx, format, &out_size) == 0) {
+            img->pixels = malloc(out_size);
+
+            ok = img->pixels != NULL
+                 && spng_decode_image(ctx, img->pixels, out_size, format,
+                                      SPNG_DECODE_TRNS) == 0;
+        }
+    }
+
+    if (!ok) {
+        free(img->pixels);
+        img->pixels = NULL;
+    }
+
+    spng_ctx_free(ctx);
+    free(data);
+
+    return ok;
+}
+#endif
+
+/* EOF */
@@ -0,0 +1,511 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/job.h"
+#include "../include/mem_tracker.h"
+
+/* Failed steals in a row before a worker goes to sleep */
+#define MAX_FAILED_STEALS 64
+
+/* One cache line per job so jobs on different threads never share one */
+struct job
+{
+    _Alignas(64) job_fn fn;
+    job *parent;
+
+    /* The job itself plus its unfinished children */
+    atomic_int unfinished;
+
+    /* Whatever thread runs the job charges its heap use to its creator's */
+    unsigned int category;
+
+    _Alignas(8) unsigned char data[JOB_DATA_SIZE];
+};
+
+/*
+ * A Chase-Lev deque. The owner pushes and pops at the bottom, thieves take
+ * from the top. Only holds pointers into the owner's job pool, so it can
+ * never need more than MAX_JOBS_PER_THREAD slots
+ */
+struct deque
+{
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+
+    _Atomic(job *) jobs[MAX_JOBS_PER_THREAD];
+};
+
+struct worker
+{
+    pthread_t thread;
+
+    struct deque deque;
+
+    job pool[MAX_JOBS_PER_THREAD];
+    unsigned int next_job;
+
+    /* State of the xorshift generator that picks who to steal from */
+    uint32_t rng;
+};
+
+/* Data of the jobs run_job_tasks creates */
+struct task_data
+{
+    void (*fn)(unsigned int task, void *data);
+    void *data;
+    unsigned int task;
+};
+
+static struct
+{
+    struct worker *workers;
+    unsigned int num_threads;
+
+    /* Jobs sitting in a deque, so sleeping workers know when to wake */
+    atomic_int num_queued;
+    atomic_int num_sleeping;
+    atomic_bool quit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} sys;
+
+/* The index of the calling thread's worker, 0 for the main thread */
+static _Thread_local unsigned int thread_index;
+
+/**
+ * @brief Adds a job to the bottom of a deque. Only called by the owner
+ *
+ * @param[in, out] d The deque
+ * @param[in] j The job
+ */
+static void push_deque(struct deque *d, job *j);
+
+/**
+ * @brief Takes the most recently pushed job of a deque. Only called by the
+ * owner
+ *
+ * @param[in, out] d The deque
+ *
+ * @return The job or NULL if the deque is empty
+ */
+static job *pop_deque(struct deque *d);
+
+/**
+ * @brief Takes the oldest job of a deque. Safe from any thread
+ *
+ * @param[in, out] d The deque
+ *
+ * @return The job or NULL if the deque is empty or another thread won
+ */
+static job *steal_deque(struct deque *d);
+
+/**
+ * @brief Gets the next job for the calling thread, from its own deque first
+ * and from a random other thread otherwise
+ *
+ * @return The job or NULL if none was found
+ */
+static job *find_job(void);
+
+/**
+ * @brief Runs a job and marks it finished
+ *
+ * @param[in, out] j The job
+ */
+static void execute_job(job *j);
+
+/**
+ * @brief Marks a job finished and finishes its parent if it was the last
+ * child
+ *
+ * @param[in, out] j The job
+ */
+static void finish_job(job *j);
+
+/**
+ * @brief Runs a single task of run_job_tasks
+ *
+ * @param[in] j The job
+ * @param[in] data The task_data
+ */
+static void run_task(job *j, const void *data);
+
+/**
+ * @brief The main function of each worker thread
+ *
+ * @param[in] arg The worker index, cast to a pointer
+ *
+ * @return NULL
+ */
+static void *worker_main(void *arg);
+
+void
+start_job_system(unsigned int count)
+{
+    unsigned int i;
+
+    sys.num_threads = count + 1;
+    sys.workers = aligned_alloc(_Alignof(struct worker),
+                                sys.num_threads * sizeof(*sys.workers));
+
+    if (sys.workers == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for the job "
+                "system\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(sys.workers, 0, sys.num_threads * sizeof(*sys.workers));
+
+    atomic_init(&sys.num_queued, 0);
+    atomic_init(&sys.num_sleeping, 0);
+    atomic_init(&sys.quit, false);
+
+    pthread_mutex_init(&sys.lock, NULL);
+    pthread_cond_init(&sys.wake, NULL);
+
+    for (i = 0; i < sys.num_threads; i++) {
+        atomic_init(&sys.workers[i].deque.top, 0);
+        atomic_init(&sys.workers[i].deque.bottom, 0);
+        sys.workers[i].rng = 2463534242u + i * 7919u;
+    }
+
+    thread_index = 0;
+
+    for (i = 1; i < sys.num_threads; i++) {
+        if (pthread_create(&sys.workers[i].thread, NULL, worker_main,
+                           (void *)(uintptr_t)i) != 0) {
+            fprintf(stderr, "Error: Could not create worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void
+stop_job_system(void)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&sys.lock);
+    atomic_store(&sys.quit, true);
+    pthread_cond_broadcast(&sys.wake);
+    pthread_mutex_unlock(&sys.lock);
+
+    for (i = 1; i < sys.num_threads; i++)
+        pthread_join(sys.workers[i].thread, NULL);
+
+    pthread_cond_destroy(&sys.wake);
+    pthread_mutex_destroy(&sys.lock);
+
+    free(sys.workers);
+    sys.workers = NULL;
+    sys.num_threads = 0;
+}
+
+unsigned int
+num_job_threads(void)
+{
+    return sys.num_threads;
+}
+
+job *
+create_job(job_fn fn, const void *data, size_t size)
+{
+    struct worker *w = &sys.workers[thread_index];
+    job *j;
+
+    if (size > JOB_DATA_SIZE) {
+        fprintf(stderr, "Error: Job data is %zu bytes, the limit is %d\n",
+                size, JOB_DATA_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    j = &w->pool[w->next_job++ & (MAX_JOBS_PER_THREAD - 1)];
+
+    j->fn = fn;
+    j->parent = NULL;
+    j->category = get_memory_category();
+    atomic_store_explicit(&j->unfinished, 1, memory_order_relaxed);
+
+    if (size > 0)
+        memcpy(j->data, data, size);
+
+    return j;
+}
+
+job *
+create_child_job(job *parent, job_fn fn, const void *data, size_t size)
+{
+    job *j = create_job(fn, data, size);
+
+    atomic_fetch_add(&parent->unfinished, 1);
+    j->parent = parent;
+
+    return j;
+}
+
+void
+run_job(job *j)
+{
+    push_deque(&sys.workers[thread_index].deque, j);
+    atomic_fetch_add(&sys.num_queued, 1);
+
+    /* The lock makes sure a worker on its way to sleep sees the new job */
+    if (atomic_load(&sys.num_sleeping) > 0) {
+        pthread_mutex_lock(&sys.lock);
+        pthread_cond_signal(&sys.wake);
+        pthread_mutex_unlock(&sys.lock);
+    }
+}
+
+void
+wait_job(job *j)
+{
+    job *next;
+
+    while (atomic_load_explicit(&j->unfinished, memory_order_acquire) > 0) {
+        next = find_job();
+
+        if (next != NULL)
+            execute_job(next);
+        else
+            sched_yield();
+    }
+}
+
+void
+run_job_tasks(job *parent, unsigned int num_tasks,
+              void (*fn)(unsigned int task, void *data), void *data)
+{
+    struct task_data td;
+    unsigned int i;
+
+    td.fn = fn;
+    td.data = data;
+
+    for (i = 0; i < num_tasks; i++) {
+        td.task = i;
+        run_job(create_child_job(parent, run_task, &td, sizeof(td)));
+    }
+}
+
+void
+parallel_for(unsigned int num_tasks,
+             void (*fn)(unsigned int task, void *data), void *data)
+{
+    job *root;
+    unsigned int i;
+
+    if (num_tasks == 0)
+        return;
+
+    /* Not worth going through the deques for */
+    if (num_tasks == 1 || sys.num_threads <= 1) {
+        for (i = 0; i < num_tasks; i++)
+            fn(i, data);
+        return;
+    }
+
+    root = create_job(NULL, NULL, 0);
+    run_job_tasks(root, num_tasks, fn, data);
+    run_job(root);
+    wait_job(root);
+}
+
+static void
+push_deque(struct deque *d, job *j)
+{
+    long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+
+    if (bottom - top >= MAX_JOBS_PER_THREAD) {
+        fprintf(stderr, "Error: More than %d jobs queued on one thread\n",
+                MAX_JOBS_PER_THREAD);
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_store_explicit(&d->jobs[bottom & (MAX_JOBS_PER_THREAD - 1)], j,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+}
+
+static job *
+pop_deque(struct deque *d)
+{
+    long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    long top;
+    job *j;
+
+    atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        /* Empty, undo the claim */
+        atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    j = atomic_load_explicit(&d->jobs[bottom & (MAX_JOBS_PER_THREAD - 1)],
+                             memory_order_relaxed);
+
+    if (top == bottom) {
+        /* The last job, a thief may be after it too */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            j = NULL;
+
+        atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return j;
+}
+
+static job *
+steal_deque(struct deque *d)
+{
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    long bottom;
+    job *j;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+        return NULL;
+
+    j = atomic_load_explicit(&d->jobs[top & (MAX_JOBS_PER_THREAD - 1)],
+                             memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return NULL;
+
+    return j;
+}
+
+static job *
+find_job(void)
+{
+    struct worker *self = &sys.workers[thread_index];
+    unsigned int victim;
+    unsigned int i;
+    job *j;
+
+    j = pop_deque(&self->deque);
+
+    if (j != NULL) {
+        atomic_fetch_sub(&sys.num_queued, 1);
+        return j;
+    }
+
+    if (sys.num_threads <= 1)
+        return NULL;
+
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+
+    /* Start at a random thread so thieves do not all pile onto the same one */
+    victim = self->rng % sys.num_threads;
+
+    for (i = 0; i < sys.num_threads; i++, victim++) {
+        if (victim >= sys.num_threads)
+            victim = 0;
+
+        if (victim == thread_index)
+            continue;
+
+        j = steal_deque(&sys.workers[victim].deque);
+
+        if (j != NULL) {
+            atomic_fetch_sub(&sys.num_queued, 1);
+            return j;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+execute_job(job *j)
+{
+    memory_category category;
+
+    if (j->fn != NULL) {
+        category = set_memory_category(j->category);
+        j->fn(j, j->data);
+        set_memory_category(category);
+    }
+
+    finish_job(j);
+}
+
+static void
+finish_job(job *j)
+{
+    job *parent = j->parent;
+
+    /* Read the parent first, a waiter may reuse the job once it hits 0 */
+    if (atomic_fetch_sub_explicit(&j->unfinished, 1, memory_order_acq_rel) == 1
+        && parent != NULL)
+        finish_job(parent);
+}
+
+static void
+run_task(job *j, const void *data)
+{
+    const struct task_data *td = data;
+
+    (void)j;
+
+    td->fn(td->task, td->data);
+}
+
+static void *
+worker_main(void *arg)
+{
+    unsigned int failed_steals = 0;
+    job *j;
+
+    thread_index = (uintptr_t)arg;
+
+    while (!atomic_load(&sys.quit)) {
+        j = find_job();
+
+        if (j != NULL) {
+            execute_job(j);
+            failed_steals = 0;
+            continue;
+        }
+
+        if (++failed_steals < MAX_FAILED_STEALS) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&sys.lock);
+        atomic_fetch_add(&sys.num_sleeping, 1);
+
+        while (!atomic_load(&sys.quit) && atomic_load(&sys.num_queued) == 0)
+            pthread_cond_wait(&sys.wake, &sys.lock);
+
+        atomic_fetch_sub(&sys.num_sleeping, 1);
+        pthread_mutex_unlock(&sys.lock);
+
+        failed_steals = 0;
+    }
+
+    return NULL;
+}
+
+/* EOF */
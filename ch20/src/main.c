@@ -1,19 +1,282 @@
 #include <cglm/mat4.h>
 #include <cglm/vec3.h>
+#include <float.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-
+#include <unistd.h>
+
+#include "../include/affine.h"
+#include "../include/allocator.h"
+#include "../include/gl_ext.h"
+#include "../include/gl_state.h"
+#include "../include/gpu_timer.h"
+#include "../include/image.h"
+#include "../include/job.h"
+#include "../include/mem_tracker.h"
+#include "../include/mesh_pool.h"
+#include "../include/mipmap.h"
+#include "../include/multi_draw.h"
+#include "../include/pbo_ring.h"
+#include "../include/render_queue.h"
+#include "../include/scene.h"
 #include "../include/shader.h"
+#include "../include/stream_buffer.h"
+#include "../include/texture_array.h"
+#include "../include/texture_streamer.h"
+#include "../include/triple_buffer.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
+#include <stb_ds.h>
 #include <cglm/cglm.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+/* The scene loaded when none is given on the command line */
+#define SCENE_PATH "res/scenes/default.scene"
+
+/* The most point lights the shaders take, the rest of a scene's are unused */
+#define NUM_POINT_LIGHTS 4
+
+/* The radius of the sphere around a unit cube */
+#define CUBE_RADIUS 0.8660254f
+
+/* Seconds per simulation tick */
+#define SIM_TICK (1.0 / 120.0)
+
+/* After a stall longer than this, the simulation skips ahead */
+#define MAX_CATCH_UP 0.25
+
+/* Uniform block binding points shared by every program */
+#define CAMERA_BLOCK 0
+#define LIGHTS_BLOCK 1
+#define MATERIALS_BLOCK 2
+
+/* The size of the Materials block */
+#define MAX_MATERIALS 64
+
+/* Every material texture is packed into layers of this size */
+#define TEXTURE_LAYER_SIZE 512
+#define MAX_TEXTURE_LAYERS 8
+
+/* The most bytes of texture memory the streamer keeps resident */
+#define TEXTURE_BUDGET (8 << 20)
+
+/* Built mip chains are kept with the binaries, so make clean clears them */
+#define MIP_CACHE_DIR "bin/mip_cache"
+
+/* The most bytes of per-frame data streamed to the GPU, besides the cubes */
+#define STREAM_REGION_SIZE (1 << 20)
+
+/* The size of the shared geometry buffers */
+#define POOL_VERTICES (1 << 16)
+#define POOL_INDICES (3 << 16)
+
+/* The first attribute location of the per-instance data */
+#define INSTANCE_ATTRIB 3
+
+/* Frames the alloc_check build allows heap allocations in while warming up */
+#define HEAP_WARMUP_FRAMES 120
+
+typedef struct sim_state sim_state;
+typedef struct sim_snapshot sim_snapshot;
+typedef struct pass_state pass_state;
+typedef struct camera_block camera_block;
+typedef struct dir_light_block dir_light_block;
+typedef struct point_light_block point_light_block;
+typedef struct spot_light_block spot_light_block;
+typedef struct lights_block lights_block;
+typedef struct material_block material_block;
+typedef struct cube_instance cube_instance;
+typedef struct cube_instance_compact cube_instance_compact;
+typedef struct light_instance light_instance;
+typedef struct cube_batch cube_batch;
+typedef struct image_load image_load;
+typedef struct transform_update transform_update;
+
+/* Everything the simulation updates each tick that rendering needs */
+struct sim_state
+{
+    vec3 camera_pos;
+    vec3 camera_front;
+    vec3 camera_up;
+    float fov;
+
+    vec3 light_colors[NUM_POINT_LIGHTS];
+};
+
+/*
+ * What the simulation hands to the render thread after every tick. The last
+ * two ticks are both included so rendering can interpolate between them
+ */
+struct sim_snapshot
+{
+    sim_state prev;
+    sim_state curr;
+
+    /* The time curr was simulated for, on the glfwGetTime clock */
+    double tick_time;
+
+    int width;
+    int height;
+
+    bool depth_prepass;
+    bool gpu_normals;
+};
+
+/* What the pass callbacks need, owned by the render thread */
+struct pass_state
+{
+    gpu_timer timers[PASS_COUNT];
+    bool depth_prepass;
+};
+
+/* The Camera uniform block, std140 */
+struct camera_block
+{
+    float view[4][4];
+    float projection[4][4];
+    float view_pos[3];
+    float pad;
+};
+
+/* DirLight in std140, every vec3 takes up a vec4 */
+struct dir_light_block
+{
+    float direction[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+};
+
+/* PointLight in std140, constant fills the last slot of specular */
+struct point_light_block
+{
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[3];
+    float constant;
+    float linear;
+    float quadratic;
+    float pad[2];
+};
+
+/* SpotLight in std140, constant fills the last slot of specular */
+struct spot_light_block
+{
+    float position[4];
+    float direction[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[3];
+    float constant;
+    float linear;
+    float quadratic;
+    float inner_cut_off;
+    float outer_cut_off;
+};
+
+/* The Lights uniform block, std140 */
+struct lights_block
+{
+    dir_light_block dir_light;
+    point_light_block point_lights[NUM_POINT_LIGHTS];
+    spot_light_block spot_light;
+};
+
+/* Material in std140, where the textures of a material are in the array */
+struct material_block
+{
+    float diffuse_rect[4];
+    float specular_rect[4];
+    int diffuse_layer;
+    int specular_layer;
+    float shininess;
+    float pad;
+};
+
+/* The per-instance attributes of cube_main.vert and depth_prepass.vert */
+struct cube_instance
+{
+    float model[4][4];
+    float norm[3][3];
+    int light_mask;
+    int material;
+};
+
+/*
+ * The per-instance attributes of cube_gpu_normal.vert, which derives the
+ * normal matrix from the model matrix instead of reading one
+ */
+struct cube_instance_compact
+{
+    float model[4][4];
+    int light_mask;
+    int material;
+};
+
+/* The per-instance attributes of light_main.vert */
+struct light_instance
+{
+    float model[4][4];
+    float color[3];
+};
+
+_Static_assert(sizeof(camera_block) == 144, "Camera block is not std140");
+_Static_assert(sizeof(lights_block) == 480, "Lights block is not std140");
+_Static_assert(sizeof(material_block) == 48, "Material is not std140");
+
+/* What the jobs need to cull, bin and transform the cubes of a frame */
+struct cube_batch
+{
+    /* Every object of the scene is a cube */
+    const scene *world;
+    unsigned int num_cubes;
+    unsigned int num_tasks;
+
+    vec4 planes[6];
+
+    vec3 *light_pos;
+    float *light_radii;
+    unsigned int num_lights;
+
+    /* Written by the culling and binning jobs, one entry per cube */
+    bool *visible;
+    unsigned int *light_masks;
+
+    /* The cubes that survived culling and the instances to fill for them */
+    unsigned int *visible_ids;
+    unsigned int num_visible;
+    cube_instance *instances;
+
+    /* Filled instead of instances when the vertex shader does the normals */
+    bool gpu_normals;
+    cube_instance_compact *compact_instances;
+};
+
+/* An image decoded by a job, uploaded to GL afterwards on the main thread */
+struct image_load
+{
+    const char *path;
+
+    /* MIP_SRGB for diffuse maps, 0 for specular maps */
+    unsigned int mip_flags;
+
+    image img;
+};
+
+/* The transform update of a frame, run as a job while the frame is set up */
+struct transform_update
+{
+    transform_hierarchy *transforms;
+    size_t updated;
+};
+
 /**
  * @brief The function called whenever the viewport is resized
  *
@@ -27,8 +290,9 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height);
  * @brief Responds to any input from the user on the current window
  *
  * @param[in] window The GLFW window whose input is being read
+ * @param[in] dt The length of the simulation tick in seconds
  */
-void process_input(GLFWwindow *window);
+void process_input(GLFWwindow *window, float dt);
 
 /**
  * @brief The function called whenever a mouse event is detected
@@ -48,13 +312,203 @@ void mouse_callback(GLFWwindow *window, double x_pos, double y_pos);
  */
 void scroll_callback(GLFWwindow *window, double x_offset, double y_offset);
 
+/**
+ * @brief The function called whenever a key is pressed, repeated or released
+ *
+ * @param[in] window The GLFW window
+ * @param[in] key The GLFW key code
+ * @param[in] scancode The platform-specific scancode
+ * @param[in] action GLFW_PRESS, GLFW_REPEAT or GLFW_RELEASE
+ * @param[in] mods The modifier keys that were held down
+ */
+void key_callback(GLFWwindow *window, int key, int scancode, int action,
+                  int mods);
+
+/**
+ * @brief Advances the simulation by one tick and publishes a snapshot
+ *
+ * @param[in] window The GLFW window whose input is being read
+ * @param[in] tick_time The time the new tick is for
+ */
+void run_sim_tick(GLFWwindow *window, double tick_time);
+
+/**
+ * @brief Fills a sim_state from the simulation's globals
+ *
+ * @param[out] state The state to fill
+ * @param[in] tick_time The time the state is for
+ */
+void capture_sim_state(sim_state *state, double tick_time);
+
+/**
+ * @brief Blends two simulation states
+ *
+ * @param[in] a The older state
+ * @param[in] b The newer state
+ * @param[in] t How far to go from a to b, from 0 to 1
+ * @param[out] dest The blended state
+ */
+void lerp_sim_state(const sim_state *a, const sim_state *b, float t,
+                    sim_state *dest);
+
+/**
+ * @brief The main function of the render thread, which owns the GL context
+ *
+ * @param[in] arg The GLFW window
+ *
+ * @return NULL
+ */
+void *render_main(void *arg);
+
+/**
+ * @brief Sets up the fixed-function state of a pass and starts its timer
+ *
+ * @param[in] pass The render_pass that is starting
+ * @param[in, out] user The pass_state of the render thread
+ */
+void begin_pass(unsigned int pass, void *user);
+
+/**
+ * @brief Restores the fixed-function state after a pass and stops its timer
+ *
+ * @param[in] pass The render_pass that just finished
+ * @param[in, out] user The pass_state of the render thread
+ */
+void end_pass(unsigned int pass, void *user);
+
+/**
+ * @brief Gets the distance after which a point light no longer visibly lights
+ * anything
+ *
+ * @param[in] light The point light
+ *
+ * @return The radius of the light volume
+ */
+float point_light_radius(const scene_light *light);
+
+/**
+ * @brief Gets the radius of the sphere around a cube
+ *
+ * @param[in] world The scene
+ * @param[in] id The cube's object
+ *
+ * @return The radius
+ */
+float cube_radius(const scene *world, unsigned int id);
+
+/**
+ * @brief Gets the first and one past the last item of a job's slice
+ *
+ * @param[in] task The index of the slice
+ * @param[in] num_tasks The number of slices
+ * @param[in] count The number of items
+ * @param[out] start The first item of the slice
+ * @param[out] end One past the last item of the slice
+ */
+void job_slice(unsigned int task, unsigned int num_tasks, unsigned int count,
+               unsigned int *start, unsigned int *end);
+
+/**
+ * @brief Tests one slice of the cubes against the view frustum. Runs as a job
+ *
+ * @param[in] task The index of the slice
+ * @param[in, out] data The cube_batch of the frame
+ */
+void cull_cubes(unsigned int task, void *data);
+
+/**
+ * @brief Finds the point lights that reach each cube of a slice. Runs as a
+ * job
+ *
+ * @param[in] task The index of the slice
+ * @param[in, out] data The cube_batch of the frame
+ */
+void bin_lights(unsigned int task, void *data);
+
+/**
+ * @brief Copies the cached transforms of one slice of the visible cubes into
+ * their instance data. Runs as a job
+ *
+ * @param[in] task The index of the slice
+ * @param[in, out] data The cube_batch of the frame
+ */
+void fill_cube_instances(unsigned int task, void *data);
+
+/**
+ * @brief Decodes an image file. Runs as a job
+ *
+ * @param[in] j The job
+ * @param[in] data A pointer to the image_load to fill
+ */
+void decode_image(job *j, const void *data);
+
+/**
+ * @brief Recomputes the dirty transforms of a frame. Runs as a job
+ *
+ * @param[in] j The job
+ * @param[in] data A pointer to the transform_update to run
+ */
+void update_transforms(job *j, const void *data);
+
+/**
+ * @brief Adds a decoded image to a texture array and frees the pixels
+ *
+ * @param[in, out] textures The texture array
+ * @param[in, out] load The decoded image
+ *
+ * @return Where the image was placed. Images that failed to load get all of
+ * layer 0
+ */
+texture_region upload_image(texture_array *textures, image_load *load);
+
+/**
+ * @brief Fills in the lights of a frame
+ *
+ * @param[out] lights The block to fill, in mapped memory so it is only written
+ * @param[in] frame The interpolated simulation state
+ * @param[in] world The scene, whose first directional and spot lights and
+ * first NUM_POINT_LIGHTS point lights are used. Missing lights are black
+ */
+void fill_lights_block(lights_block *lights, const sim_state *frame,
+                       const scene *world);
+
+/**
+ * @brief Copies one light of a scene into a point light block
+ *
+ * @param[out] point The block, in mapped memory so it is only written
+ * @param[in] light The light, or NULL for a black one
+ */
+void fill_point_light(point_light_block *point, const scene_light *light);
+
+/**
+ * @brief Points the instance attributes of a cube vertex array at this frame's
+ * cube_instance or cube_instance_compact array
+ *
+ * @param[in] vao The vertex array object
+ * @param[in] buffer The buffer holding the instances
+ * @param[in] offset The byte offset of the first instance
+ * @param[in] compact Whether the instances are compact, with no normal matrix
+ *
+ * @note GL 3.3 has no base instance, so the attributes are respecified
+ * whenever the data moves
+ */
+void set_cube_instances(unsigned int vao, unsigned int buffer, size_t offset,
+                        bool compact);
+
+/**
+ * @brief Points the instance attributes of the light vertex array at this
+ * frame's light_instance array
+ *
+ * @param[in] vao The vertex array object
+ * @param[in] buffer The buffer holding the instances
+ * @param[in] offset The byte offset of the first instance
+ */
+void set_light_instances(unsigned int vao, unsigned int buffer, size_t offset);
+
 vec3 camera_pos = {0.0f, 0.0f, 3.0f};
 vec3 camera_front = {0.0f, 0.0f, -1.0f};
 vec3 camera_up = {0.0f, 1.0f, 0.0f};
 
-float delta_time = 0.0f;
-float last_frame = 0.0f;
-
 bool first_mouse = true;
 
 float last_x = 400.0f;
@@ -65,55 +519,243 @@ float pitch;
 
 float fov = 45.0f;
 
+/* Toggled with P. Lays down depth first so the cube pass only shades once */
+bool depth_prepass = false;
+
+/*
+ * Toggled with N. Leaves the normal matrices to the vertex shader, which
+ * shrinks each instance from 108 to 72 bytes, as long as no visible cube is
+ * scaled unevenly
+ */
+bool gpu_normals = false;
+
+int framebuffer_width = 800;
+int framebuffer_height = 600;
+
+/* The last simulated state, kept to be the previous one of the next tick */
+sim_state last_state;
+
+/* Snapshots from the simulation on this thread to the render thread */
+triple_buffer snapshots;
+
+/* Set by the main thread once the window closes */
+atomic_bool render_quit;
+
+/* Set by the render thread if it could not start, before closing the window */
+atomic_bool render_failed;
+
+/* Loaded before the render thread starts, which owns it from then on */
+scene world;
+
 int
-main(void)
+main(int argc, char **argv)
 {
-    unsigned int vbo;
-    unsigned int vao;
-    unsigned int ebo;
+    GLFWwindow *window = NULL;
+    pthread_t render_thread;
+    const char *scene_path = argc > 1 ? argv[1] : SCENE_PATH;
 
-    unsigned int light_vao;
+    double next_tick;
+    double now;
 
-    vec3 light_color = GLM_VEC3_ONE_INIT;
-    vec3 diffuse_color = GLM_VEC3_ONE_INIT;
-    vec3 ambient_color = GLM_VEC3_ONE_INIT;
+    /* GLFW init. Events and the simulation stay on this thread */
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    int width;
-    int height;
-    int num_channels;
+    window = glfwCreateWindow(800, 600, "Multiple Lights", NULL, NULL);
 
-    unsigned int diffuse_map;
-    unsigned char *diffuse_map_data = NULL;
-    const char *diffuse_map_path = "res/container.png";
+    if (window == NULL) {
+        fprintf(stderr, "Error: Failed to create GLFW window\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
-    unsigned int specular_map;
-    unsigned char *specular_map_data = NULL;
-    const char *specular_map_path = "res/container_specular.png";
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
+
+    if (!load_scene(&world, scene_path)) {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    if (arrlenu(world.materials) == 0
+        || arrlenu(world.materials) > MAX_MATERIALS) {
+        fprintf(stderr, "Error: %s has %zu materials, it needs 1 to %d\n",
+                scene_path, arrlenu(world.materials), MAX_MATERIALS);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    /* The render thread needs a snapshot to start from */
+    create_triple_buffer(&snapshots, sizeof(sim_snapshot));
+
+    next_tick = glfwGetTime();
+    capture_sim_state(&last_state, next_tick);
+    run_sim_tick(window, next_tick);
+
+    atomic_init(&render_quit, false);
+    atomic_init(&render_failed, false);
+
+    /* The render thread owns the arenas from here on */
+    init_memory();
+
+    if (pthread_create(&render_thread, NULL, render_main, window) != 0) {
+        fprintf(stderr, "Error: Could not create render thread\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * Input is sampled every tick no matter how long frames take, so a GPU
+     * stall delays the picture but not the response to it
+     */
+    while (!glfwWindowShouldClose(window)) {
+        now = glfwGetTime();
+
+        if (next_tick + SIM_TICK > now)
+            glfwWaitEventsTimeout(next_tick + SIM_TICK - now);
+        else
+            glfwPollEvents();
+
+        now = glfwGetTime();
+
+        if (now - next_tick > MAX_CATCH_UP)
+            next_tick = now - SIM_TICK;
+
+        while (next_tick + SIM_TICK <= now) {
+            next_tick += SIM_TICK;
+            run_sim_tick(window, next_tick);
+        }
+    }
+
+    atomic_store(&render_quit, true);
+    pthread_join(render_thread, NULL);
+
+    free_scene(&world);
+    shutdown_memory();
+    delete_triple_buffer(&snapshots);
+
+    /* Everything has been deleted, so whatever is still live leaked */
+    log_memory_usage(stdout);
+
+    glfwTerminate();
+
+    return atomic_load(&render_failed) ? EXIT_FAILURE : 0;
+}
+
+void *
+render_main(void *arg)
+{
+    mesh_pool pool;
+    pool_mesh cube_mesh;
+    unsigned int vao;
+    unsigned int light_vao;
+
+    /* The cube and light draws of a frame, each one instanced pool mesh */
+    multi_draw cube_draws;
+    multi_draw light_draws;
+
+    /* The diffuse and specular maps of each material, in that order */
+    image_load *images;
+    texture_region *regions;
+    unsigned int num_materials = arrlenu(world.materials);
+
+    texture_array textures;
+    texture_streamer streamer;
+    pbo_ring pixel_uploads;
+    unsigned int textures_handle;
+    float pixels_per_unit;
+    float distance;
+    material_block materials[MAX_MATERIALS] = {0};
+    unsigned int materials_ubo;
+    image_load *load;
+    job *group;
 
     shader cube_shader;
+    shader cube_gpu_shader;
     shader light_shader;
+    shader depth_shader;
 
     const char *cube_vert_shader_path = "shaders/cube_main.vert";
     const char *cube_frag_shader_path = "shaders/cube_main.frag";
+    const char *cube_gpu_vert_shader_path = "shaders/cube_gpu_normal.vert";
 
     const char *light_vert_shader_path = "shaders/light_main.vert";
     const char *light_frag_shader_path = "shaders/light_main.frag";
 
-    GLFWwindow *window = NULL;
+    const char *depth_vert_shader_path = "shaders/depth_prepass.vert";
+    const char *depth_frag_shader_path = "shaders/depth_prepass.frag";
+
+    program_info cube_program;
+    program_info cube_gpu_program;
+    program_info *cube_pass_program;
+    program_info light_program;
+    program_info depth_program;
+
+    material cube_material;
+
+    render_queue queue;
+    draw_packet *packet;
+    cube_batch cubes;
+
+    stream_buffer stream;
+    camera_block *camera;
+    lights_block *lights;
+    light_instance *light_instances;
+
+    size_t camera_offset;
+    size_t lights_offset;
+    size_t cube_offset;
+    size_t light_offset;
+    long num_cpus;
+
+    pass_state passes;
+    double last_report = 0.0;
+    size_t transforms_updated = 0;
+    transform_update update;
+    transform_update *update_ptr = &update;
+    job *update_job;
+    unsigned int num_uneven;
+    unsigned int report_frames = 0;
+    double fill_start;
+    double fill_time = 0.0;
+
+    GLFWwindow *window = arg;
+
+    const sim_snapshot *snapshot;
+    sim_state frame;
+    float blend;
+
+    int viewport_width = 0;
+    int viewport_height = 0;
 
-    CGLM_ALIGN_MAT mat4 model = GLM_MAT4_IDENTITY_INIT;
     CGLM_ALIGN_MAT mat4 view = GLM_MAT4_IDENTITY_INIT;
     CGLM_ALIGN_MAT mat4 projection = GLM_MAT4_IDENTITY_INIT;
 
     vec3 temp_vec3 = GLM_VEC3_ZERO_INIT;
     mat4 temp_mat4 = GLM_MAT4_ZERO_INIT;
-    mat3 norm = GLM_MAT3_ZERO_INIT;
+
+    /* The point lights of the scene the shaders can take */
+    vec3 light_pos[NUM_POINT_LIGHTS];
+    float light_radii[NUM_POINT_LIGHTS];
+    unsigned int num_lights = 0;
 
     unsigned int i;
-    float angle;
+    CGLM_ALIGN_MAT mat4 view_projection;
 
     float current_frame;
 
+#ifdef MEMORY_DEBUG
+    unsigned long frame_count = 0;
+    unsigned long heap_before;
+#endif
+
     /* Vertices and indices */
     float vertices[] = {
         /*         Positions              Normals    U     V */
@@ -174,372 +816,491 @@ main(void)
         23, 21, 20
     };
 
-    vec3 cube_pos[] = {
-        GLM_VEC3_ZERO_INIT,
-        { 2.0f,  5.0f, -15.0f},
-        {-1.5f, -2.2f,  -2.5f},
-        {-3.8f, -2.0f, -12.3f},
-        { 2.4f, -0.4f,  -3.5f},
-        {-1.7f,  3.0f,  -7.5f},
-        { 1.3f, -2.0f,  -2.5f},
-        { 1.5f,  2.0f,  -2.5f},
-        { 1.5f,  0.2f,  -1.5f},
-        {-1.3f,  1.0f,  -1.5f},
-    };
+    /* GLAD loading on the thread the context is current on */
+    glfwMakeContextCurrent(window);
 
-    vec3 light_pos[] = {
-        { 0.7f,  0.2f,   2.0f},
-        { 2.3f, -3.3f,  -4.0f},
-        {-4.0f,  2.0f, -12.0f},
-        { 0.0f,  0.0f,  -3.0f}
-    };
+    /* GLFW is torn down on the main thread, so this only asks it to stop */
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "Error: Failed to initialize GLAD\n");
+        atomic_store(&render_failed, true);
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+        glfwPostEmptyEvent();
+        return NULL;
+    }
 
-    /* GLFW/GLAD init/loading */
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    invalidate_gl_state();
+    load_gl_extensions((GLADloadproc)glfwGetProcAddress);
 
-    window = glfwCreateWindow(800, 600, "Multiple Lights", NULL, NULL);
+    /* Every cube may be visible at once */
+    create_stream_buffer(&stream, STREAM_REGION_SIZE
+                         + world.transforms.count * sizeof(cube_instance));
 
-    if (window == NULL) {
-        fprintf(stderr, "Error: Failed to create GLFW window\n");
-        glfwTerminate();
-        exit(EXIT_FAILURE);
+    for (i = 0; i < arrlenu(world.lights); i++) {
+        if (world.lights[i].type != SCENE_POINT_LIGHT)
+            continue;
+
+        if (num_lights == NUM_POINT_LIGHTS) {
+            fprintf(stderr, "Error: Only the first %d point lights of the "
+                    "scene are used\n", NUM_POINT_LIGHTS);
+            break;
+        }
+
+        glm_vec3_copy(world.lights[i].position, light_pos[num_lights]);
+        light_radii[num_lights] = point_light_radius(&world.lights[i]);
+        num_lights++;
     }
 
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    cubes.world = &world;
+    cubes.num_cubes = world.transforms.count;
+    cubes.light_pos = light_pos;
+    cubes.light_radii = light_radii;
+    cubes.num_lights = num_lights;
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    
-    glfwSetScrollCallback(window, scroll_callback);
+    cubes.visible = malloc(cubes.num_cubes * sizeof(*cubes.visible));
+    cubes.light_masks = malloc(cubes.num_cubes * sizeof(*cubes.light_masks));
+    cubes.visible_ids = malloc(cubes.num_cubes * sizeof(*cubes.visible_ids));
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        fprintf(stderr, "Error: Failed to initialize GLAD\n");
-        glfwTerminate();
+    images = calloc(2 * num_materials, sizeof(*images));
+    regions = malloc(2 * num_materials * sizeof(*regions));
+
+    if ((cubes.num_cubes > 0 && (cubes.visible == NULL
+                                 || cubes.light_masks == NULL
+                                 || cubes.visible_ids == NULL))
+        || images == NULL || regions == NULL) {
+        fprintf(stderr, "Error: Failed to allocate scene memory\n");
         exit(EXIT_FAILURE);
     }
 
-    glViewport(0, 0, 800, 600);
-    glEnable(GL_DEPTH_TEST);
+    for (i = 0; i < num_materials; i++) {
+        images[2 * i].path = world.materials[i].diffuse_map;
+        images[2 * i].mip_flags = MIP_SRGB;
+        images[2 * i + 1].path = world.materials[i].specular_map;
+        images[2 * i + 1].mip_flags = 0;
+    }
 
-    /* Vertex loading and creation */
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
-    
-    glBindVertexArray(vao);
+    /* One worker per extra core, this thread makes up the last one */
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    start_job_system(num_cpus > 1 ? num_cpus - 1 : 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    state_set_enabled(GL_DEPTH_TEST, true);
+    state_depth_func(GL_LESS);
+    state_depth_mask(GL_TRUE);
+    state_color_mask(GL_TRUE);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-                 GL_STATIC_DRAW);
+    /* Vertex loading and creation, the vertices match the vertex struct */
+    set_memory_category(MEMORY_MESH);
+    create_mesh_pool(&pool, POOL_VERTICES, POOL_INDICES);
+    cube_mesh = add_pool_mesh(&pool, (const vertex *)vertices,
+                              sizeof(vertices) / (8 * sizeof(float)), indices,
+                              sizeof(indices) / sizeof(indices[0]));
+    vao = pool.vao;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    create_multi_draw(&cube_draws);
+    create_multi_draw(&light_draws);
 
+    /* The lights share the pool buffers but have their own instance data */
     glGenVertexArrays(1, &light_vao);
-    glBindVertexArray(light_vao);
+    state_bind_vertex_array(light_vao);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    state_bind_buffer(GL_ARRAY_BUFFER, pool.vbo);
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
                           (void *)0);
     glEnableVertexAttribArray(0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    state_bind_buffer(GL_ARRAY_BUFFER, 0);
+    state_bind_vertex_array(0);
 
-    /* Texture loading and creation */
-    glGenTextures(1, &diffuse_map);
-    glBindTexture(GL_TEXTURE_2D, diffuse_map);
+    /* Texture decoding runs as jobs while the shaders compile */
+    set_memory_category(MEMORY_TEXTURE);
+    group = create_job(NULL, NULL, 0);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_set_flip_vertically_on_load(true);
+    for (i = 0; i < 2 * num_materials; i++) {
+        load = &images[i];
+        run_job(create_child_job(group, decode_image, &load, sizeof(load)));
+    }
 
-    diffuse_map_data = stbi_load(diffuse_map_path, &width, &height,
-                                 &num_channels, 0);
+    run_job(group);
 
-    if (diffuse_map_data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, diffuse_map_data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else {
-        fprintf(stderr, "Error: Failed to load texture: %s",
-                diffuse_map_path);
+    set_memory_category(MEMORY_SHADER);
+    create_shader(&cube_shader, cube_vert_shader_path, cube_frag_shader_path);
+    create_shader(&cube_gpu_shader, cube_gpu_vert_shader_path,
+                  cube_frag_shader_path);
+    create_shader(&light_shader, light_vert_shader_path,
+                  light_frag_shader_path);
+    create_shader(&depth_shader, depth_vert_shader_path,
+                  depth_frag_shader_path);
+
+    set_shader_block_binding(cube_shader.ID, "Camera", CAMERA_BLOCK);
+    set_shader_block_binding(cube_shader.ID, "Lights", LIGHTS_BLOCK);
+    set_shader_block_binding(cube_shader.ID, "Materials", MATERIALS_BLOCK);
+    set_shader_block_binding(cube_gpu_shader.ID, "Camera", CAMERA_BLOCK);
+    set_shader_block_binding(cube_gpu_shader.ID, "Lights", LIGHTS_BLOCK);
+    set_shader_block_binding(cube_gpu_shader.ID, "Materials",
+                             MATERIALS_BLOCK);
+    set_shader_block_binding(light_shader.ID, "Camera", CAMERA_BLOCK);
+    set_shader_block_binding(depth_shader.ID, "Camera", CAMERA_BLOCK);
+
+    wait_job(group);
+
+    /* Every material shares one texture so one draw covers all of them */
+    set_memory_category(MEMORY_TEXTURE);
+    create_texture_array(&textures, TEXTURE_LAYER_SIZE, TEXTURE_LAYER_SIZE,
+                         MAX_TEXTURE_LAYERS);
+
+    for (i = 0; i < 2 * num_materials; i++)
+        regions[i] = upload_image(&textures, &images[i]);
+
+    /*
+     * The array starts with its coarse levels and sharpens as it is seen.
+     * Diffuse layers hold sRGB color, so their mips are filtered in linear
+     * space. Specular layers are already linear and are averaged as they are
+     */
+    set_mip_cache_dir(MIP_CACHE_DIR);
+    create_pbo_ring(&pixel_uploads);
+    create_texture_streamer(&streamer, TEXTURE_BUDGET, &pixel_uploads);
+    textures_handle = stream_texture_array(&textures, &streamer);
+
+    for (i = 0; i < num_materials; i++) {
+        memcpy(materials[i].diffuse_rect, regions[2 * i].rect,
+               sizeof(materials[i].diffuse_rect));
+        memcpy(materials[i].specular_rect, regions[2 * i + 1].rect,
+               sizeof(materials[i].specular_rect));
+
+        materials[i].diffuse_layer = regions[2 * i].layer;
+        materials[i].specular_layer = regions[2 * i + 1].layer;
+        materials[i].shininess = world.materials[i].shininess;
     }
 
-    stbi_image_free(diffuse_map_data);
-    diffuse_map_data = NULL;
-
-    glGenTextures(1, &specular_map);
-    glBindTexture(GL_TEXTURE_2D, specular_map);
+    free(images);
+    free(regions);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    /* The whole block is allocated, drivers may check its size on draw */
+    glGenBuffers(1, &materials_ubo);
+    state_bind_buffer(GL_UNIFORM_BUFFER, materials_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(materials), materials,
+                 GL_STATIC_DRAW);
+    track_gpu_buffer(materials_ubo, MEMORY_OTHER, sizeof(materials));
 
-    stbi_set_flip_vertically_on_load(true);
+    set_memory_category(MEMORY_OTHER);
 
-    specular_map_data = stbi_load(specular_map_path, &width, &height,
-                                  &num_channels, 0);
+    init_program_info(&cube_program, &cube_shader);
+    init_program_info(&cube_gpu_program, &cube_gpu_shader);
+    init_program_info(&light_program, &light_shader);
+    init_program_info(&depth_program, &depth_shader);
 
-    if (specular_map_data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, specular_map_data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else {
-        fprintf(stderr, "Error: Failed to load texture: %s",
-                specular_map_path);
-    }
+    init_material(&cube_material, &textures.id, 1, 32.0f);
+    cube_material.texture_target = GL_TEXTURE_2D_ARRAY;
 
-    stbi_image_free(specular_map_data);
-    specular_map_data = NULL;
+    for (i = 0; i < PASS_COUNT; i++)
+        create_gpu_timer(&passes.timers[i]);
 
-    create_shader(&cube_shader, cube_vert_shader_path, cube_frag_shader_path);
-    create_shader(&light_shader, light_vert_shader_path,
-                  light_frag_shader_path);
+    create_render_queue(&queue, begin_pass, end_pass, &passes);
 
-    glUseProgram(cube_shader.ID);
-    set_shader_1i(cube_shader.ID, "material.diffuse", 0);
-    set_shader_1i(cube_shader.ID, "material.specular", 1);
+    state_use_program(cube_shader.ID);
+    set_shader_1i(cube_shader.ID, "materialTextures", 0);
+    state_use_program(cube_gpu_shader.ID);
+    set_shader_1i(cube_gpu_shader.ID, "materialTextures", 0);
 
-    while (!glfwWindowShouldClose(window)) {
-        process_input(window);
+    /* Anything the frames allocate is per frame work */
+    set_memory_category(MEMORY_SCRATCH);
 
+    while (!atomic_load(&render_quit)) {
         current_frame = glfwGetTime();
-        delta_time = current_frame - last_frame;
-        last_frame = current_frame;
+
+        reset_arena(&frame_arena);
+
+#ifdef MEMORY_DEBUG
+        heap_before = heap_allocations();
+#endif
+
+        /* Lags a tick behind so there is always a newer state to blend to */
+        snapshot = read_triple_buffer(&snapshots);
+        blend = (current_frame - snapshot->tick_time) / SIM_TICK;
+        lerp_sim_state(&snapshot->prev, &snapshot->curr,
+                       glm_clamp(blend, 0.0f, 1.0f), &frame);
+
+        /*
+         * Only cubes that moved, and their children, are recomputed. The
+         * shader makes the normal matrices in GPU mode, so the cache skips
+         * them. Nothing else reads the transforms until culling, so the
+         * update runs while this thread clears and fills the stream
+         */
+        skip_normal_matrices(&world.transforms, snapshot->gpu_normals);
+
+        update.transforms = &world.transforms;
+        update_job = create_job(update_transforms, &update_ptr,
+                                sizeof(update_ptr));
+        run_job(update_job);
+
+        passes.depth_prepass = snapshot->depth_prepass;
+
+        if (snapshot->width != viewport_width
+            || snapshot->height != viewport_height) {
+            viewport_width = snapshot->width;
+            viewport_height = snapshot->height;
+            state_viewport(0, 0, viewport_width, viewport_height);
+        }
 
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        /* Draw the actual cube */
-        glUseProgram(cube_shader.ID);
-
-        glm_vec3_mul(diffuse_color, (vec3){0.2f, 0.2f, 0.2f}, ambient_color);
-
-        /* Spot light properties */
-        set_shader_3fv(cube_shader.ID, "spotLight.position", 1, camera_pos);
-        set_shader_3fv(cube_shader.ID, "spotLight.direction", 1, camera_front);
-
-        set_shader_3fv(cube_shader.ID, "spotLight.ambient", 1, GLM_VEC3_ZERO);
-        set_shader_3fv(cube_shader.ID, "spotLight.diffuse", 1, GLM_VEC3_ONE);
-        set_shader_3fv(cube_shader.ID, "spotLight.specular", 1, GLM_VEC3_ONE);
-
-        set_shader_1f(cube_shader.ID, "spotLight.constant", 1.0f);
-        set_shader_1f(cube_shader.ID, "spotLight.linear", 0.09f);
-        set_shader_1f(cube_shader.ID, "spotLight.quadratic", 0.032f);
-
-        set_shader_1f(cube_shader.ID, "spotLight.innerCutOff",
-                      cosf(glm_rad(12.5f)));
-        set_shader_1f(cube_shader.ID, "spotLight.outerCutOff",
-                      cosf(glm_rad(17.5f)));
-
-        /* Directional light properties */
-        set_shader_3f(cube_shader.ID, "dirLight.direction",
-                      -0.2f, -1.0f, -0.3f);
-
-        set_shader_3f(cube_shader.ID, "dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        set_shader_3f(cube_shader.ID, "dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        set_shader_3f(cube_shader.ID, "dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-        /* Point light 0 */
-        set_shader_3fv(cube_shader.ID, "pointLights[0].position", 1,
-                       light_pos[0]);
-
-        set_shader_3f(cube_shader.ID, "pointLights[0].ambient",
-                      0.05f, 0.05f, 0.05f);
-        set_shader_3f(cube_shader.ID, "pointLights[0].diffuse",
-                      0.8f, 0.8f, 0.8f);
-        set_shader_3fv(cube_shader.ID, "pointLights[0].specular", 1,
-                       GLM_VEC3_ONE);
-
-        set_shader_1f(cube_shader.ID, "pointLights[0].constant", 1.0f);
-        set_shader_1f(cube_shader.ID, "pointLights[0].linear", 0.09f);
-        set_shader_1f(cube_shader.ID, "pointLights[0].constant", 0.032f);
-
-        /* Point light 1 */
-        set_shader_3fv(cube_shader.ID, "pointLights[1].position", 1,
-                       light_pos[1]);
-
-        set_shader_3f(cube_shader.ID, "pointLights[1].ambient",
-                      0.05f, 0.05f, 0.05f);
-        set_shader_3f(cube_shader.ID, "pointLights[1].diffuse",
-                      0.8f, 0.8f, 0.8f);
-        set_shader_3fv(cube_shader.ID, "pointLights[1].specular", 1,
-                       GLM_VEC3_ONE);
-
-        set_shader_1f(cube_shader.ID, "pointLights[1].constant", 1.0f);
-        set_shader_1f(cube_shader.ID, "pointLights[1].linear", 0.09f);
-        set_shader_1f(cube_shader.ID, "pointLights[1].constant", 0.032f);
-
-        /* Point light 2 */
-        set_shader_3fv(cube_shader.ID, "pointLights[2].position", 1,
-                       light_pos[2]);
-
-        set_shader_3f(cube_shader.ID, "pointLights[2].ambient",
-                      0.05f, 0.05f, 0.05f);
-        set_shader_3f(cube_shader.ID, "pointLights[2].diffuse",
-                      0.8f, 0.8f, 0.8f);
-        set_shader_3fv(cube_shader.ID, "pointLights[2].specular", 1,
-                       GLM_VEC3_ONE);
-
-        set_shader_1f(cube_shader.ID, "pointLights[2].constant", 1.0f);
-        set_shader_1f(cube_shader.ID, "pointLights[2].linear", 0.09f);
-        set_shader_1f(cube_shader.ID, "pointLights[2].constant", 0.032f);
-
-        /* Point light 3 */
-        set_shader_3fv(cube_shader.ID, "pointLights[3].position", 1,
-                       light_pos[3]);
-
-        set_shader_3f(cube_shader.ID, "pointLights[3].ambient",
-                      0.05f, 0.05f, 0.05f);
-        set_shader_3f(cube_shader.ID, "pointLights[3].diffuse",
-                      0.8f, 0.8f, 0.8f);
-        set_shader_3fv(cube_shader.ID, "pointLights[3].specular", 1,
-                       GLM_VEC3_ONE);
-
-        set_shader_1f(cube_shader.ID, "pointLights[3].constant", 1.0f);
-        set_shader_1f(cube_shader.ID, "pointLights[3].linear", 0.09f);
-        set_shader_1f(cube_shader.ID, "pointLights[3].constant", 0.032f);
-
-        /* Camera position uniform */
-        set_shader_3fv(cube_shader.ID, "viewPos", 1, camera_pos);
-
-        /* Cube properties */
-        set_shader_1f(cube_shader.ID, "material.shininess", 32.0f);
-
-        /* Camera Model-View-Projection Matrix creation */
+        reset_gl_state_stats();
+
+        /* Camera View-Projection matrix creation */
         glm_mat4_identity(view);
-        glm_vec3_add(camera_pos, camera_front, temp_vec3);
-        glm_lookat(camera_pos, temp_vec3, camera_up, view);
-        set_shader_mat4fv(cube_shader.ID, "view", 1, GL_FALSE, (float *)view);
+        glm_vec3_add(frame.camera_pos, frame.camera_front, temp_vec3);
+        glm_lookat(frame.camera_pos, temp_vec3, frame.camera_up, view);
 
         glm_mat4_identity(projection);
-        glm_perspective(glm_rad(fov), 800.0f / 600.0f, 0.1f, 100.0f,
+        glm_perspective(glm_rad(frame.fov), 800.0f / 600.0f, 0.1f, 100.0f,
                         projection);
-        set_shader_mat4fv(cube_shader.ID, "projection", 1, GL_FALSE,
-                          (float *)projection);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuse_map);
+        /* Per-frame data is written straight into the stream buffer */
+        begin_stream_frame(&stream);
+
+        camera = stream_alloc(&stream, sizeof(*camera), &camera_offset);
+        memcpy(camera->view, view, sizeof(camera->view));
+        memcpy(camera->projection, projection, sizeof(camera->projection));
+        glm_vec3_copy(frame.camera_pos, camera->view_pos);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specular_map);
+        lights = stream_alloc(&stream, sizeof(*lights), &lights_offset);
+        fill_lights_block(lights, &frame, &world);
 
-        glBindVertexArray(vao);
+        /* Culling reads the world matrices */
+        wait_job(update_job);
+        transforms_updated += update.updated;
 
         /* "Instantiate" the cubes */
-        for (i = 0; i < 10; i++) {
-            glm_mat4_identity(model);
-            glm_translate(model, cube_pos[i]);
-
-            angle = 20.0f * i;
-            glm_rotate(model, glm_rad(angle), (vec3){1.0f, 0.3f, 0.5f});
-            set_shader_mat4fv(cube_shader.ID, "model", 1, GL_FALSE,
-                              (float *)model);
-
-            /* 
-             * Calculate the normal matrix here so we don't have to within the
-             * vertex shader
-             */
-            glm_mat4_inv(model, temp_mat4);
-            glm_mat4_pick3t(temp_mat4, norm);
-            set_shader_mat3fv(cube_shader.ID, "norm", 1, GL_FALSE,
-                              (float *)norm);
-
-            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        glm_mat4_mul(projection, view, view_projection);
+        glm_frustum_planes(view_projection, cubes.planes);
+
+        cubes.num_tasks = num_job_threads();
+
+        /* Culling and light binning only need positions, so they overlap */
+        group = create_job(NULL, NULL, 0);
+        run_job_tasks(group, cubes.num_tasks, cull_cubes, &cubes);
+        run_job_tasks(group, cubes.num_tasks, bin_lights, &cubes);
+        run_job(group);
+        wait_job(group);
+
+        cubes.num_visible = 0;
+        num_uneven = 0;
+
+        for (i = 0; i < cubes.num_cubes; i++) {
+            if (cubes.visible[i]) {
+                cubes.visible_ids[cubes.num_visible++] = i;
+                num_uneven += !world.transforms.uniform_scale[i];
+            }
         }
 
-        /* Draw the light cube */
-        glUseProgram(light_shader.ID);
+        /* One unevenly scaled cube needs the normal matrices sent after all */
+        cubes.gpu_normals = snapshot->gpu_normals && num_uneven == 0;
 
-        /* Light Model-View-Projection matrix creation */
-        set_shader_mat4fv(light_shader.ID, "view", 1, GL_FALSE, (float *)view);
+        /* Each visible cube asks for texture detail by its size on screen */
+        pixels_per_unit = viewport_height
+            / (2.0f * tanf(glm_rad(frame.fov) * 0.5f));
+
+        for (i = 0; i < cubes.num_visible; i++) {
+            distance = glm_vec3_distance(
+                frame.camera_pos,
+                world.transforms.world[cubes.visible_ids[i]][3]);
+            request_texture_detail(&streamer, textures_handle,
+                                   pixels_per_unit / glm_max(distance, 0.1f));
+        }
 
-        set_shader_mat4fv(light_shader.ID, "projection", 1, GL_FALSE,
-                          (float *)projection);
+        update_texture_streamer(&streamer);
 
-        glBindVertexArray(light_vao);
+        /* Instances wait on culling so hidden cubes cost nothing */
+        if (cubes.gpu_normals)
+            cubes.compact_instances = stream_alloc(
+                &stream, cubes.num_visible * sizeof(*cubes.compact_instances),
+                &cube_offset);
+        else
+            cubes.instances = stream_alloc(&stream, cubes.num_visible
+                                           * sizeof(*cubes.instances),
+                                           &cube_offset);
+
+        fill_start = glfwGetTime();
+        parallel_for(cubes.num_tasks, fill_cube_instances, &cubes);
+        fill_time += glfwGetTime() - fill_start;
+        report_frames++;
 
         /* "Instantiate" the point lights */
-        for (i = 0; i < 4; i++) {
-            light_color[0] = sinf((float)glfwGetTime() * 0.2f * (i + 1))
-                             + 1.0f;
-            light_color[1] = sinf((float)glfwGetTime() * 0.35f * (i + 1))
-                             + 1.0f;
-            light_color[2] = sinf((float)glfwGetTime() * 0.27f * (i + 1))
-                             + 1.0f;
-
-            set_shader_3fv(light_shader.ID, "lightColor", 1,
-                           (float *)light_color);
-
-            glm_mat4_identity(model);
-            glm_translate(model, light_pos[i]);
-            glm_scale(model, (vec3){0.2f, 0.2f, 0.2f});
-            set_shader_mat4fv(light_shader.ID, "model", 1, GL_FALSE,
-                              (float *)model);
-
-            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        light_instances = stream_alloc(&stream, num_lights
+                                       * sizeof(*light_instances),
+                                       &light_offset);
+
+        for (i = 0; i < num_lights; i++) {
+            glm_mat4_identity(temp_mat4);
+            glm_translate(temp_mat4, light_pos[i]);
+            glm_scale(temp_mat4, (vec3){0.2f, 0.2f, 0.2f});
+
+            memcpy(light_instances[i].model, temp_mat4,
+                   sizeof(light_instances[i].model));
+            glm_vec3_copy(frame.light_colors[i], light_instances[i].color);
+        }
+
+        end_stream_frame(&stream);
+
+        state_bind_uniform_range(CAMERA_BLOCK, stream.buffer, camera_offset,
+                                 sizeof(*camera));
+        state_bind_uniform_range(LIGHTS_BLOCK, stream.buffer, lights_offset,
+                                 sizeof(*lights));
+        state_bind_uniform_range(MATERIALS_BLOCK, materials_ubo, 0,
+                                 sizeof(materials));
+
+        set_cube_instances(vao, stream.buffer, cube_offset, cubes.gpu_normals);
+        set_light_instances(light_vao, stream.buffer, light_offset);
+
+        /* One instanced draw per pass covers every visible cube */
+        reset_multi_draw(&cube_draws);
+        push_multi_draw(&cube_draws, &cube_mesh, cubes.num_visible, 0);
+        upload_multi_draw(&cube_draws);
+
+        reset_multi_draw(&light_draws);
+        push_multi_draw(&light_draws, &cube_mesh, num_lights, 0);
+        upload_multi_draw(&light_draws);
+
+        if (cubes.num_visible > 0) {
+            cube_pass_program = cubes.gpu_normals ? &cube_gpu_program
+                                                  : &cube_program;
+            packet = push_draw_packet(&queue);
+
+            packet->key = make_render_key(PASS_OPAQUE, cube_pass_program->id,
+                                          cube_material.id, vao, 0.0f);
+            packet->program = cube_pass_program;
+            packet->material = &cube_material;
+            packet->vao = vao;
+            packet->multi = &cube_draws;
+
+            if (passes.depth_prepass) {
+                packet = push_draw_packet(&queue);
+
+                packet->key = make_render_key(PASS_DEPTH, depth_program.id, 0,
+                                              vao, 0.0f);
+                packet->program = &depth_program;
+                packet->vao = vao;
+                packet->multi = &cube_draws;
+            }
+        }
+
+        packet = push_draw_packet(&queue);
+
+        packet->key = make_render_key(PASS_EMISSIVE, light_program.id, 0,
+                                      light_vao, 0.0f);
+        packet->program = &light_program;
+        packet->vao = light_vao;
+        packet->multi = &light_draws;
+
+        flush_render_queue(&queue);
+
+        /* GPU times averaged over the last second, binds of this frame */
+        if (current_frame - last_report >= 1.0) {
+            printf("GPU ms: pre-pass %.3f, cubes %.3f, lights %.3f "
+                   "(depth pre-pass %s)\n",
+                   average_gpu_timer(&passes.timers[PASS_DEPTH]),
+                   average_gpu_timer(&passes.timers[PASS_OPAQUE]),
+                   average_gpu_timer(&passes.timers[PASS_EMISSIVE]),
+                   passes.depth_prepass ? "on" : "off");
+            printf("Binds: %u draws, programs %u (%u skipped), "
+                   "textures %u (%u skipped), VAOs %u (%u skipped)\n",
+                   queue.stats.draws,
+                   queue.stats.program_binds, queue.stats.program_skips,
+                   queue.stats.texture_binds, queue.stats.texture_skips,
+                   queue.stats.vao_binds, queue.stats.vao_skips);
+            printf("State cache: %lu calls issued, %lu filtered\n",
+                   get_gl_state_stats().issued, get_gl_state_stats().filtered);
+            printf("Stream buffer: %lu frames stalled on the GPU\n",
+                   stream.stalls);
+            printf("Textures: %zu of %zu KB resident, %zu KB uploaded, "
+                   "%u evictions, %lu upload stalls\n",
+                   streamer.resident_bytes / 1024, streamer.budget / 1024,
+                   streamer.uploaded_bytes / 1024, streamer.evictions,
+                   pixel_uploads.stalls);
+            printf("Transforms: %zu recomputed\n", transforms_updated);
+            printf("Instances: %u cubes of %zu bytes, filled in %.3f ms, "
+                   "normal matrices on the %s\n", cubes.num_visible,
+                   cubes.gpu_normals ? sizeof(cube_instance_compact)
+                                     : sizeof(cube_instance),
+                   fill_time * 1000.0 / report_frames,
+                   cubes.gpu_normals ? "GPU"
+                   : snapshot->gpu_normals ? "CPU (uneven scales in view)"
+                                           : "CPU");
+            log_memory_usage(stdout);
+            transforms_updated = 0;
+            fill_time = 0.0;
+            report_frames = 0;
+            last_report = current_frame;
         }
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
+
+#ifdef MEMORY_DEBUG
+        /*
+         * Once warmed up, every frame should live off the arenas and pools.
+         * Only this thread is counted, so loads on other threads do not trip it
+         */
+        if (++frame_count > HEAP_WARMUP_FRAMES
+            && heap_allocations() != heap_before) {
+            fprintf(stderr, "Error: Frame %lu made %lu heap allocations\n",
+                    frame_count, heap_allocations() - heap_before);
+            exit(EXIT_FAILURE);
+        }
+#endif
     }
 
-    glDeleteVertexArrays(1, &vao);
-    glDeleteVertexArrays(1, &light_vao);
+    state_delete_vertex_array(light_vao);
+    delete_mesh_pool(&pool);
 
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ebo);
+    delete_multi_draw(&cube_draws);
+    delete_multi_draw(&light_draws);
 
-    glDeleteProgram(cube_shader.ID);
-    glDeleteProgram(light_shader.ID);
+    state_delete_program(cube_shader.ID);
+    state_delete_program(cube_gpu_shader.ID);
+    state_delete_program(light_shader.ID);
+    state_delete_program(depth_shader.ID);
 
-    glDeleteTextures(1, &diffuse_map);
-    glDeleteTextures(1, &specular_map);
+    for (i = 0; i < PASS_COUNT; i++)
+        delete_gpu_timer(&passes.timers[i]);
 
-    glfwTerminate();
-    return 0;
+    delete_render_queue(&queue);
+    delete_stream_buffer(&stream);
+    stop_job_system();
+
+    delete_texture_array(&textures);
+    delete_texture_streamer(&streamer);
+    delete_pbo_ring(&pixel_uploads);
+    state_delete_buffer(materials_ubo);
+
+    free(cubes.visible);
+    free(cubes.light_masks);
+    free(cubes.visible_ids);
+
+    glfwMakeContextCurrent(NULL);
+    return NULL;
 }
 
 void 
 framebuffer_size_callback(GLFWwindow *window, int width, int height) 
 {
-    glViewport(0, 0, width, height);
+    /* Applied by the render thread, which owns the context */
+    framebuffer_width = width;
+    framebuffer_height = height;
 }
 
 void
-process_input(GLFWwindow *window)
+process_input(GLFWwindow *window, float dt)
 {
     float camera_speed;
 
     if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-        camera_speed = 4.5f * delta_time;
+        camera_speed = 4.5f * dt;
     else if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-        camera_speed = 0.5f * delta_time;
+        camera_speed = 0.5f * dt;
     else
-        camera_speed = 2.5f * delta_time;
+        camera_speed = 2.5f * dt;
 
     vec3 temp_vec3 = GLM_VEC3_ZERO_INIT;
 
@@ -636,4 +1397,494 @@ scroll_callback(GLFWwindow *window, double x_offset, double y_offset)
     if (fov > 45.0f)
         fov = 45.0f;
 }
+
+void
+key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_P) {
+        depth_prepass = !depth_prepass;
+        printf("Depth pre-pass %s\n", depth_prepass ? "enabled" : "disabled");
+    }
+
+    if (key == GLFW_KEY_N) {
+        gpu_normals = !gpu_normals;
+        printf("Normal matrices on the %s\n", gpu_normals ? "GPU" : "CPU");
+    }
+}
+
+void
+run_sim_tick(GLFWwindow *window, double tick_time)
+{
+    sim_snapshot *snapshot = write_triple_buffer(&snapshots);
+
+    process_input(window, SIM_TICK);
+
+    snapshot->prev = last_state;
+    capture_sim_state(&snapshot->curr, tick_time);
+    last_state = snapshot->curr;
+
+    snapshot->tick_time = tick_time;
+    snapshot->width = framebuffer_width;
+    snapshot->height = framebuffer_height;
+    snapshot->depth_prepass = depth_prepass;
+    snapshot->gpu_normals = gpu_normals;
+
+    publish_triple_buffer(&snapshots);
+}
+
+void
+capture_sim_state(sim_state *state, double tick_time)
+{
+    unsigned int i;
+
+    glm_vec3_copy(camera_pos, state->camera_pos);
+    glm_vec3_copy(camera_front, state->camera_front);
+    glm_vec3_copy(camera_up, state->camera_up);
+    state->fov = fov;
+
+    /* The light colors cycle on the simulation clock */
+    for (i = 0; i < NUM_POINT_LIGHTS; i++) {
+        state->light_colors[i][0] = sinf(tick_time * 0.2f * (i + 1)) + 1.0f;
+        state->light_colors[i][1] = sinf(tick_time * 0.35f * (i + 1)) + 1.0f;
+        state->light_colors[i][2] = sinf(tick_time * 0.27f * (i + 1)) + 1.0f;
+    }
+}
+
+void
+lerp_sim_state(const sim_state *a, const sim_state *b, float t,
+               sim_state *dest)
+{
+    unsigned int i;
+
+    glm_vec3_lerp((float *)a->camera_pos, (float *)b->camera_pos, t,
+                  dest->camera_pos);
+    glm_vec3_lerp((float *)a->camera_front, (float *)b->camera_front, t,
+                  dest->camera_front);
+    glm_vec3_normalize(dest->camera_front);
+    glm_vec3_lerp((float *)a->camera_up, (float *)b->camera_up, t,
+                  dest->camera_up);
+    dest->fov = glm_lerp(a->fov, b->fov, t);
+
+    for (i = 0; i < NUM_POINT_LIGHTS; i++)
+        glm_vec3_lerp((float *)a->light_colors[i],
+                      (float *)b->light_colors[i], t, dest->light_colors[i]);
+}
+
+void
+fill_lights_block(lights_block *lights, const sim_state *frame,
+                  const scene *world)
+{
+    dir_light_block *dir = &lights->dir_light;
+    spot_light_block *spot = &lights->spot_light;
+    const scene_light *dir_light = NULL;
+    const scene_light *spot_light = NULL;
+    const scene_light *light;
+    unsigned int num_points = 0;
+    unsigned int i;
+
+    for (i = 0; i < arrlenu(world->lights); i++) {
+        light = &world->lights[i];
+
+        if (light->type == SCENE_DIR_LIGHT && dir_light == NULL)
+            dir_light = light;
+        else if (light->type == SCENE_SPOT_LIGHT && spot_light == NULL)
+            spot_light = light;
+        else if (light->type == SCENE_POINT_LIGHT
+                 && num_points < NUM_POINT_LIGHTS)
+            fill_point_light(&lights->point_lights[num_points++], light);
+    }
+
+    /* Unused point lights are never in a light mask, but stay well formed */
+    for (; num_points < NUM_POINT_LIGHTS; num_points++)
+        fill_point_light(&lights->point_lights[num_points], NULL);
+
+    /* Directional light properties */
+    if (dir_light != NULL) {
+        glm_vec3_copy((float *)dir_light->direction, dir->direction);
+        glm_vec3_copy((float *)dir_light->ambient, dir->ambient);
+        glm_vec3_copy((float *)dir_light->diffuse, dir->diffuse);
+        glm_vec3_copy((float *)dir_light->specular, dir->specular);
+    }
+    else {
+        glm_vec3_copy((vec3){0.0f, -1.0f, 0.0f}, dir->direction);
+        glm_vec3_copy(GLM_VEC3_ZERO, dir->ambient);
+        glm_vec3_copy(GLM_VEC3_ZERO, dir->diffuse);
+        glm_vec3_copy(GLM_VEC3_ZERO, dir->specular);
+    }
+
+    /* Spot light properties, it follows the camera */
+    glm_vec3_copy((float *)frame->camera_pos, spot->position);
+    glm_vec3_copy((float *)frame->camera_front, spot->direction);
+
+    if (spot_light != NULL) {
+        glm_vec3_copy((float *)spot_light->ambient, spot->ambient);
+        glm_vec3_copy((float *)spot_light->diffuse, spot->diffuse);
+        glm_vec3_copy((float *)spot_light->specular, spot->specular);
+
+        spot->constant = spot_light->constant;
+        spot->linear = spot_light->linear;
+        spot->quadratic = spot_light->quadratic;
+
+        spot->inner_cut_off = spot_light->inner_cut_off;
+        spot->outer_cut_off = spot_light->outer_cut_off;
+    }
+    else {
+        glm_vec3_copy(GLM_VEC3_ZERO, spot->ambient);
+        glm_vec3_copy(GLM_VEC3_ZERO, spot->diffuse);
+        glm_vec3_copy(GLM_VEC3_ZERO, spot->specular);
+
+        spot->constant = 1.0f;
+        spot->linear = 0.0f;
+        spot->quadratic = 0.0f;
+
+        spot->inner_cut_off = 1.0f;
+        spot->outer_cut_off = 0.0f;
+    }
+}
+
+void
+fill_point_light(point_light_block *point, const scene_light *light)
+{
+    if (light != NULL) {
+        glm_vec3_copy((float *)light->position, point->position);
+        glm_vec3_copy((float *)light->ambient, point->ambient);
+        glm_vec3_copy((float *)light->diffuse, point->diffuse);
+        glm_vec3_copy((float *)light->specular, point->specular);
+
+        point->constant = light->constant;
+        point->linear = light->linear;
+        point->quadratic = light->quadratic;
+    }
+    else {
+        glm_vec3_copy(GLM_VEC3_ZERO, point->position);
+        glm_vec3_copy(GLM_VEC3_ZERO, point->ambient);
+        glm_vec3_copy(GLM_VEC3_ZERO, point->diffuse);
+        glm_vec3_copy(GLM_VEC3_ZERO, point->specular);
+
+        point->constant = 1.0f;
+        point->linear = 0.0f;
+        point->quadratic = 0.0f;
+    }
+}
+
+void
+set_cube_instances(unsigned int vao, unsigned int buffer, size_t offset,
+                   bool compact)
+{
+    unsigned int i;
+    unsigned int loc;
+    size_t stride = compact ? sizeof(cube_instance_compact)
+                            : sizeof(cube_instance);
+    size_t light_mask = compact ? offsetof(cube_instance_compact, light_mask)
+                                : offsetof(cube_instance, light_mask);
+    size_t material = compact ? offsetof(cube_instance_compact, material)
+                              : offsetof(cube_instance, material);
+
+    state_bind_vertex_array(vao);
+    state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+    /* A mat4 takes up four vec4 locations, a mat3 three vec3 ones */
+    for (i = 0; i < 4; i++) {
+        loc = INSTANCE_ATTRIB + i;
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, stride,
+                              (void *)(offset + offsetof(cube_instance, model)
+                                       + i * sizeof(float[4])));
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+
+    for (i = 0; i < 3; i++) {
+        loc = INSTANCE_ATTRIB + 4 + i;
+
+        /* Left enabled, the last instance would read past the compact data */
+        if (compact) {
+            glDisableVertexAttribArray(loc);
+            continue;
+        }
+
+        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *)(offset + offsetof(cube_instance, norm)
+                                       + i * sizeof(float[3])));
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+
+    loc = INSTANCE_ATTRIB + 7;
+    glVertexAttribIPointer(loc, 1, GL_INT, stride,
+                           (void *)(offset + light_mask));
+    glEnableVertexAttribArray(loc);
+    glVertexAttribDivisor(loc, 1);
+
+    loc = INSTANCE_ATTRIB + 8;
+    glVertexAttribIPointer(loc, 1, GL_INT, stride,
+                           (void *)(offset + material));
+    glEnableVertexAttribArray(loc);
+    glVertexAttribDivisor(loc, 1);
+}
+
+void
+set_light_instances(unsigned int vao, unsigned int buffer, size_t offset)
+{
+    unsigned int i;
+    unsigned int loc;
+
+    state_bind_vertex_array(vao);
+    state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+    for (i = 0; i < 4; i++) {
+        loc = INSTANCE_ATTRIB + i;
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE,
+                              sizeof(light_instance),
+                              (void *)(offset + offsetof(light_instance, model)
+                                       + i * sizeof(float[4])));
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+
+    loc = INSTANCE_ATTRIB + 4;
+    glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(light_instance),
+                          (void *)(offset + offsetof(light_instance, color)));
+    glEnableVertexAttribArray(loc);
+    glVertexAttribDivisor(loc, 1);
+}
+
+void
+begin_pass(unsigned int pass, void *user)
+{
+    pass_state *passes = user;
+
+    begin_gpu_timer(&passes->timers[pass]);
+
+    switch (pass) {
+    case PASS_DEPTH:
+        state_color_mask(GL_FALSE);
+        break;
+
+    case PASS_OPAQUE:
+        /* Only the nearest fragment of each pixel passes after a pre-pass */
+        if (passes->depth_prepass) {
+            state_depth_func(GL_EQUAL);
+            state_depth_mask(GL_FALSE);
+        }
+        break;
+    }
+}
+
+void
+end_pass(unsigned int pass, void *user)
+{
+    pass_state *passes = user;
+
+    switch (pass) {
+    case PASS_DEPTH:
+        state_color_mask(GL_TRUE);
+        break;
+
+    case PASS_OPAQUE:
+        if (passes->depth_prepass) {
+            state_depth_func(GL_LESS);
+            state_depth_mask(GL_TRUE);
+        }
+        break;
+    }
+
+    end_gpu_timer(&passes->timers[pass]);
+}
+
+float
+point_light_radius(const scene_light *light)
+{
+    /*
+     * Solve for where the attenuated light drops below 5 / 256. Every term
+     * is attenuated, so the brightest of them sets the reach
+     */
+    float max_intensity = glm_max(glm_vec3_max((float *)light->ambient),
+                                  glm_max(glm_vec3_max((float *)light->diffuse),
+                                          glm_vec3_max(
+                                              (float *)light->specular)));
+    float c = light->constant - max_intensity * 256.0f / 5.0f;
+    float l = light->linear;
+    float q = light->quadratic;
+
+    if (c >= 0.0f)
+        return 0.0f;
+
+    /* Without falloff the light reaches everything */
+    if (q <= 0.0f)
+        return l > 0.0f ? -c / l : FLT_MAX;
+
+    return (-l + sqrtf(l * l - 4.0f * q * c)) / (2.0f * q);
+}
+
+float
+cube_radius(const scene *world, unsigned int id)
+{
+    vec4 *model = world->transforms.world[id];
+
+    /* The longest axis of the transformed cube */
+    return CUBE_RADIUS * sqrtf(glm_max(glm_vec3_norm2(model[0]),
+                                       glm_max(glm_vec3_norm2(model[1]),
+                                               glm_vec3_norm2(model[2]))));
+}
+
+void
+job_slice(unsigned int task, unsigned int num_tasks, unsigned int count,
+          unsigned int *start, unsigned int *end)
+{
+    *start = count * task / num_tasks;
+    *end = count * (task + 1) / num_tasks;
+}
+
+void
+cull_cubes(unsigned int task, void *data)
+{
+    cube_batch *cubes = data;
+
+    unsigned int start;
+    unsigned int end;
+    unsigned int i;
+    unsigned int p;
+    float radius;
+    float *position;
+
+    job_slice(task, cubes->num_tasks, cubes->num_cubes, &start, &end);
+
+    for (i = start; i < end; i++) {
+        cubes->visible[i] = true;
+        radius = cube_radius(cubes->world, i);
+        position = cubes->world->transforms.world[i][3];
+
+        /* The bounding sphere does not change when the cube rotates */
+        for (p = 0; p < 6; p++) {
+            if (glm_vec3_dot(cubes->planes[p], position)
+                + cubes->planes[p][3] < -radius) {
+                cubes->visible[i] = false;
+                break;
+            }
+        }
+    }
+}
+
+void
+bin_lights(unsigned int task, void *data)
+{
+    cube_batch *cubes = data;
+
+    unsigned int start;
+    unsigned int end;
+    unsigned int i;
+    unsigned int l;
+    float radius;
+
+    job_slice(task, cubes->num_tasks, cubes->num_cubes, &start, &end);
+
+    for (i = start; i < end; i++) {
+        cubes->light_masks[i] = 0;
+        radius = cube_radius(cubes->world, i);
+
+        for (l = 0; l < cubes->num_lights; l++)
+            if (glm_vec3_distance(cubes->world->transforms.world[i][3],
+                                  cubes->light_pos[l])
+                < cubes->light_radii[l] + radius)
+                cubes->light_masks[i] |= 1u << l;
+    }
+}
+
+void
+fill_cube_instances(unsigned int task, void *data)
+{
+    cube_batch *cubes = data;
+    const transform_hierarchy *transforms = &cubes->world->transforms;
+    cube_instance *instance;
+    cube_instance_compact *compact;
+    CGLM_ALIGN_MAT mat4 model;
+    mat3 norm;
+
+    unsigned int start;
+    unsigned int end;
+    unsigned int i;
+    unsigned int id;
+
+    job_slice(task, cubes->num_tasks, cubes->num_visible, &start, &end);
+
+    if (cubes->gpu_normals) {
+        for (i = start; i < end; i++) {
+            id = cubes->visible_ids[i];
+            compact = &cubes->compact_instances[i];
+
+            memcpy(compact->model, transforms->world[id],
+                   sizeof(compact->model));
+            compact->light_mask = cubes->light_masks[id];
+            compact->material = cubes->world->material_ids[id];
+        }
+
+        return;
+    }
+
+    for (i = start; i < end; i++) {
+        id = cubes->visible_ids[i];
+        instance = &cubes->instances[i];
+
+        /*
+         * The normal matrix comes from the cache too, so neither this nor
+         * the vertex shader inverts anything. GPU mode falls back here when
+         * an uneven scale is in view, and then the cache was skipped. The
+         * instances live in mapped memory, so they are only written
+         */
+        memcpy(instance->model, transforms->world[id],
+               sizeof(instance->model));
+
+        if (transforms->skip_normals) {
+            memcpy(model, transforms->world[id], sizeof(model));
+            normal_matrix(model, norm);
+            memcpy(instance->norm, norm, sizeof(instance->norm));
+        }
+        else {
+            memcpy(instance->norm, transforms->normal[id],
+                   sizeof(instance->norm));
+        }
+        instance->light_mask = cubes->light_masks[id];
+        instance->material = cubes->world->material_ids[id];
+    }
+}
+
+void
+decode_image(job *j, const void *data)
+{
+    image_load *load = *(image_load *const *)data;
+
+    (void)j;
+
+    load_image(&load->img, load->path, IMAGE_FLIP);
+}
+
+void
+update_transforms(job *j, const void *data)
+{
+    transform_update *update = *(transform_update *const *)data;
+
+    (void)j;
+
+    update->updated = update_world_transforms(update->transforms);
+}
+
+texture_region
+upload_image(texture_array *textures, image_load *load)
+{
+    texture_region region = {.layer = 0, .rect = {0.0f, 0.0f, 1.0f, 1.0f}};
+
+    if (load->img.pixels)
+        region = add_texture_image(textures, load->img.pixels,
+                                   load->img.width, load->img.height,
+                                   load->img.num_channels, load->mip_flags);
+    else
+        fprintf(stderr, "Error: Failed to load texture: %s", load->path);
+
+    free_image(&load->img);
+
+    return region;
+}
 /* EOF */
@@ -0,0 +1,451 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/mem_tracker.h"
+
+/* The smallest table of tracked blocks or objects */
+#define MIN_TABLE_SIZE 1024
+
+/* GPU objects are keyed by name, with textures kept apart from buffers */
+#define TEXTURE_KEY_BIT ((uintptr_t)1 << (sizeof(uintptr_t) * 8 - 1))
+
+typedef struct tracked_entry tracked_entry;
+typedef struct tracked_table tracked_table;
+
+/* A heap block or GL object, keyed by address or name. Key 0 is empty */
+struct tracked_entry
+{
+    uintptr_t key;
+    size_t size;
+    unsigned int category;
+};
+
+/* An open addressing table with linear probing, and the totals it feeds */
+struct tracked_table
+{
+    pthread_mutex_t lock;
+
+    tracked_entry *entries;
+    size_t capacity;
+    size_t count;
+
+    size_t live[MEMORY_CATEGORY_COUNT];
+    size_t high_water[MEMORY_CATEGORY_COUNT];
+    size_t blocks[MEMORY_CATEGORY_COUNT];
+};
+
+static tracked_table cpu = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static tracked_table gpu = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Per thread, so loader and worker threads do not show up in a frame's count */
+static _Thread_local unsigned long heap_count;
+static _Thread_local memory_category thread_category;
+
+static const char *const category_names[MEMORY_CATEGORY_COUNT] = {
+    "other", "mesh", "texture", "shader", "scratch"
+};
+
+#ifdef MEMORY_TRACKING
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *memory);
+#else
+/* Nothing is wrapped, so the GPU table uses the allocator directly */
+#define __real_calloc calloc
+#define __real_free free
+#endif
+
+/**
+ * @brief Adds or resizes an entry and updates the totals
+ *
+ * @param[in, out] table The table, locked
+ * @param[in] key The key, not 0
+ * @param[in] size The size in bytes
+ * @param[in] category The category
+ */
+static void table_set(tracked_table *table, uintptr_t key, size_t size,
+                      memory_category category);
+
+/**
+ * @brief Removes an entry and updates the totals
+ *
+ * @param[in, out] table The table, locked
+ * @param[in] key The key
+ * @param[out] category The category the entry had. May be NULL
+ * @param[out] size The size the entry had. May be NULL
+ *
+ * @return Whether there was an entry
+ */
+static bool table_remove(tracked_table *table, uintptr_t key,
+                         memory_category *category, size_t *size);
+
+/**
+ * @brief Gets the slot a key hashes to
+ *
+ * @param[in] key The key
+ * @param[in] mask The table size minus one
+ *
+ * @return The slot index
+ */
+static size_t home_slot(uintptr_t key, size_t mask);
+
+/**
+ * @brief Finds the slot of a key, or the empty slot it would go in
+ *
+ * @param[in] table The table
+ * @param[in] key The key
+ *
+ * @return The slot index
+ */
+static size_t table_find(const tracked_table *table, uintptr_t key);
+
+/**
+ * @brief Doubles the size of a table, or creates it
+ *
+ * @param[in, out] table The table, locked
+ */
+static void table_grow(tracked_table *table);
+
+#ifdef MEMORY_TRACKING
+/**
+ * @brief Charges a new heap block to the thread's category
+ *
+ * @param[in] memory The block, may be NULL
+ * @param[in] size Its size
+ * @param[in] category The category to charge
+ */
+static void track_block(void *memory, size_t size, memory_category category);
+#endif
+
+memory_category
+get_memory_category(void)
+{
+    return thread_category;
+}
+
+memory_category
+set_memory_category(memory_category category)
+{
+    memory_category previous = thread_category;
+
+    thread_category = category;
+
+    return previous;
+}
+
+void
+track_gpu_buffer(unsigned int buffer, memory_category category, size_t size)
+{
+    if (buffer == 0)
+        return;
+
+    pthread_mutex_lock(&gpu.lock);
+    table_set(&gpu, buffer, size, category);
+    pthread_mutex_unlock(&gpu.lock);
+}
+
+void
+track_gpu_texture(unsigned int texture, memory_category category, size_t size)
+{
+    if (texture == 0)
+        return;
+
+    pthread_mutex_lock(&gpu.lock);
+    table_set(&gpu, texture | TEXTURE_KEY_BIT, size, category);
+    pthread_mutex_unlock(&gpu.lock);
+}
+
+void
+untrack_gpu_buffer(unsigned int buffer)
+{
+    pthread_mutex_lock(&gpu.lock);
+    table_remove(&gpu, buffer, NULL, NULL);
+    pthread_mutex_unlock(&gpu.lock);
+}
+
+void
+untrack_gpu_texture(unsigned int texture)
+{
+    pthread_mutex_lock(&gpu.lock);
+    table_remove(&gpu, texture | TEXTURE_KEY_BIT, NULL, NULL);
+    pthread_mutex_unlock(&gpu.lock);
+}
+
+memory_usage
+get_memory_usage(memory_category category)
+{
+    memory_usage usage;
+
+    pthread_mutex_lock(&cpu.lock);
+    usage.cpu_live = cpu.live[category];
+    usage.cpu_high_water = cpu.high_water[category];
+    usage.cpu_blocks = cpu.blocks[category];
+    pthread_mutex_unlock(&cpu.lock);
+
+    pthread_mutex_lock(&gpu.lock);
+    usage.gpu_live = gpu.live[category];
+    usage.gpu_high_water = gpu.high_water[category];
+    pthread_mutex_unlock(&gpu.lock);
+
+    return usage;
+}
+
+const char *
+memory_category_name(memory_category category)
+{
+    return category_names[category];
+}
+
+void
+log_memory_usage(FILE *fp)
+{
+    memory_usage usage;
+    unsigned int i;
+
+    fprintf(fp, "Memory KB live/peak:");
+
+    for (i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        usage = get_memory_usage(i);
+
+#ifdef MEMORY_TRACKING
+        fprintf(fp, "%s %s CPU %zu/%zu (%zu blocks) GPU %zu/%zu",
+                i == 0 ? "" : ",", category_names[i],
+                usage.cpu_live / 1024, usage.cpu_high_water / 1024,
+                usage.cpu_blocks, usage.gpu_live / 1024,
+                usage.gpu_high_water / 1024);
+#else
+        fprintf(fp, "%s %s GPU %zu/%zu", i == 0 ? "" : ",",
+                category_names[i], usage.gpu_live / 1024,
+                usage.gpu_high_water / 1024);
+#endif
+    }
+
+    fprintf(fp, "\n");
+}
+
+unsigned long
+heap_allocations(void)
+{
+    return heap_count;
+}
+
+#ifdef MEMORY_TRACKING
+/* The linker sends this program's calls here with -Wl,--wrap=malloc etc. */
+void *
+__wrap_malloc(size_t size)
+{
+    void *memory = __real_malloc(size);
+
+    track_block(memory, size, thread_category);
+
+    return memory;
+}
+
+void *
+__wrap_calloc(size_t count, size_t size)
+{
+    void *memory = __real_calloc(count, size);
+
+    /* Cannot overflow if the allocation succeeded */
+    track_block(memory, count * size, thread_category);
+
+    return memory;
+}
+
+void *
+__wrap_realloc(void *memory, size_t size)
+{
+    memory_category category = thread_category;
+    size_t old_size = 0;
+    bool tracked = false;
+    void *resized;
+
+    heap_count++;
+
+    /*
+     * The old entry goes before the real call rather than holding the lock
+     * across it. If the block moves, another thread can then be handed the
+     * old address and track it without this removing its entry
+     */
+    if (memory != NULL) {
+        pthread_mutex_lock(&cpu.lock);
+        /* A grown array stays in the category it was made in */
+        tracked = table_remove(&cpu, (uintptr_t)memory, &category, &old_size);
+        pthread_mutex_unlock(&cpu.lock);
+    }
+
+    resized = __real_realloc(memory, size);
+
+    if (resized != NULL) {
+        pthread_mutex_lock(&cpu.lock);
+        table_set(&cpu, (uintptr_t)resized, size, category);
+        pthread_mutex_unlock(&cpu.lock);
+    } else if (size != 0 && tracked) {
+        /* On failure the old block is still there */
+        pthread_mutex_lock(&cpu.lock);
+        table_set(&cpu, (uintptr_t)memory, old_size, category);
+        pthread_mutex_unlock(&cpu.lock);
+    }
+
+    return resized;
+}
+
+void *
+__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    void *memory = __real_aligned_alloc(alignment, size);
+
+    track_block(memory, size, thread_category);
+
+    return memory;
+}
+
+void
+__wrap_free(void *memory)
+{
+    if (memory != NULL) {
+        pthread_mutex_lock(&cpu.lock);
+        table_remove(&cpu, (uintptr_t)memory, NULL, NULL);
+        pthread_mutex_unlock(&cpu.lock);
+    }
+
+    __real_free(memory);
+}
+
+static void
+track_block(void *memory, size_t size, memory_category category)
+{
+    heap_count++;
+
+    if (memory == NULL)
+        return;
+
+    pthread_mutex_lock(&cpu.lock);
+    table_set(&cpu, (uintptr_t)memory, size, category);
+    pthread_mutex_unlock(&cpu.lock);
+}
+#endif
+
+static void
+table_set(tracked_table *table, uintptr_t key, size_t size,
+          memory_category category)
+{
+    tracked_entry *entry;
+
+    if ((table->count + 1) * 2 > table->capacity)
+        table_grow(table);
+
+    entry = &table->entries[table_find(table, key)];
+
+    if (entry->key == key) {
+        table->live[entry->category] -= entry->size;
+        table->blocks[entry->category]--;
+    }
+    else {
+        entry->key = key;
+        table->count++;
+    }
+
+    entry->size = size;
+    entry->category = category;
+
+    table->live[category] += size;
+    table->blocks[category]++;
+
+    if (table->live[category] > table->high_water[category])
+        table->high_water[category] = table->live[category];
+}
+
+static bool
+table_remove(tracked_table *table, uintptr_t key, memory_category *category,
+             size_t *size)
+{
+    size_t mask = table->capacity - 1;
+    size_t hole;
+    size_t i;
+
+    if (table->capacity == 0)
+        return false;
+
+    hole = table_find(table, key);
+
+    if (table->entries[hole].key != key)
+        return false;
+
+    table->live[table->entries[hole].category] -= table->entries[hole].size;
+    table->blocks[table->entries[hole].category]--;
+    table->count--;
+
+    if (category != NULL)
+        *category = table->entries[hole].category;
+    if (size != NULL)
+        *size = table->entries[hole].size;
+
+    /*
+     * Shift later entries of the run back into the hole, so lookups never
+     * stop early at it and no tombstones are needed
+     */
+    for (i = (hole + 1) & mask; table->entries[i].key != 0;
+         i = (i + 1) & mask) {
+        size_t home = home_slot(table->entries[i].key, mask);
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table->entries[hole] = table->entries[i];
+            hole = i;
+        }
+    }
+
+    table->entries[hole].key = 0;
+
+    return true;
+}
+
+static size_t
+home_slot(uintptr_t key, size_t mask)
+{
+    return (size_t)(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> 17) & mask;
+}
+
+static size_t
+table_find(const tracked_table *table, uintptr_t key)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = home_slot(key, mask);
+
+    while (table->entries[i].key != 0 && table->entries[i].key != key)
+        i = (i + 1) & mask;
+
+    return i;
+}
+
+static void
+table_grow(tracked_table *table)
+{
+    tracked_entry *old = table->entries;
+    size_t old_capacity = table->capacity;
+    size_t i;
+
+    table->capacity = old_capacity == 0 ? MIN_TABLE_SIZE : old_capacity * 2;
+
+    /* The real allocator, or this would track itself */
+    table->entries = __real_calloc(table->capacity, sizeof(*table->entries));
+
+    if (table->entries == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory tracking table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < old_capacity; i++)
+        if (old[i].key != 0)
+            table->entries[table_find(table, old[i].key)] = old[i];
+
+    __real_free(old);
+}
+
+/* EOF */
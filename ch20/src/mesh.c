@@ -1,6 +1,15 @@
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "../include/affine.h"
+#include "../include/allocator.h"
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
 #include "../include/mesh.h"
+#include "../include/mesh_file.h"
 #include "../include/shader.h"
 
 #define STB_DS_IMPLEMENTATION
@@ -8,27 +17,188 @@
 
 #include <glad/glad.h>
 
+/**
+ * @brief Allocates a mesh and fills in everything but the buffers
+ *
+ * @param[in] vertices The mesh's vertices, may be NULL
+ * @param[in] indices The indices of each vertex, may be NULL
+ * @param[in] textures The mesh's textures
+ *
+ * @return The mesh
+ */
+static mesh *alloc_mesh(vertex *vertices, unsigned int *indices,
+                        texture *textures);
+
+/* Every mesh record, created with the first mesh */
+static object_pool mesh_records;
+
 mesh *
 create_mesh(vertex *vertices, unsigned int *indices, texture *textures)
 {
-    mesh *m = malloc(sizeof(*m));
+    mesh *m = alloc_mesh(vertices, indices, textures);
 
-    if (m == NULL) {
-        fprintf(stderr, "Error: Could not allocate memory for mesh\n");
-        exit(EXIT_FAILURE);
+    m->num_indices = arrlen(indices);
+    m->index_type = GL_UNSIGNED_INT;
+    m->lods[0].count = m->num_indices;
+    m->num_lods = 1;
+
+    setup_mesh(m);
+
+    return m;
+}
+
+mesh *
+create_lod_mesh(vertex *vertices, unsigned int *indices, texture *textures,
+                const mesh_lod *lods, unsigned int num_lods)
+{
+    mesh *m = create_mesh(vertices, indices, textures);
+
+    memcpy(m->lods, lods, num_lods * sizeof(*lods));
+    m->num_lods = num_lods;
+    m->num_indices = lods[0].count;
+
+    return m;
+}
+
+mesh *
+create_mesh_from_buffers(const void *vertex_data, size_t vertex_size,
+                         const vertex_attribute *attributes,
+                         unsigned int num_attributes, const void *index_data,
+                         size_t num_indices, unsigned int index_type,
+                         texture *textures)
+{
+    mesh *m = alloc_mesh(NULL, NULL, textures);
+    unsigned int i;
+
+    m->num_indices = num_indices;
+    m->index_type = index_type;
+    m->lods[0].count = num_indices;
+    m->num_lods = 1;
+
+    glGenVertexArrays(1, &m->vao);
+    glGenBuffers(1, &m->vbo);
+    glGenBuffers(1, &m->ebo);
+
+    state_bind_vertex_array(m->vao);
+
+    state_bind_buffer(GL_ARRAY_BUFFER, m->vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertex_size, vertex_data, GL_STATIC_DRAW);
+
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, m->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 num_indices * (index_type == GL_UNSIGNED_SHORT ? 2 : 4),
+                 index_data, GL_STATIC_DRAW);
+
+    track_gpu_buffer(m->vbo, MEMORY_MESH, vertex_size);
+    track_gpu_buffer(m->ebo, MEMORY_MESH,
+                     num_indices * (index_type == GL_UNSIGNED_SHORT ? 2 : 4));
+
+    for (i = 0; i < num_attributes; i++) {
+        glEnableVertexAttribArray(attributes[i].location);
+        glVertexAttribPointer(attributes[i].location, attributes[i].components,
+                              attributes[i].type, attributes[i].normalized,
+                              attributes[i].stride,
+                              (void *)(uintptr_t)attributes[i].offset);
     }
 
-    m->vertices = vertices;
-    m->indices = indices;
-    m->textures = textures;
+    state_bind_vertex_array(0);
 
-    setup_mesh(m);
+    return m;
+}
+
+mesh *
+load_mesh(const char *path, texture *textures)
+{
+    vertex_attribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+    mesh_file mf;
+    const mesh_file_header *header;
+    mesh *m;
+    uint32_t i;
+
+    if (!open_mesh_file(&mf, path))
+        return NULL;
+
+    header = mf.header;
+
+    for (i = 0; i < header->num_attributes; i++) {
+        attributes[i].location = header->attributes[i].location;
+        attributes[i].components = header->attributes[i].components;
+        attributes[i].type = header->attributes[i].type;
+        attributes[i].normalized = header->attributes[i].normalized;
+        attributes[i].stride = header->vertex_stride;
+        attributes[i].offset = header->attributes[i].offset;
+    }
+
+    /* The pages are read in as the driver copies them */
+    m = create_mesh_from_buffers(mf.vertices,
+                                 header->num_vertices * header->vertex_stride,
+                                 attributes, header->num_attributes,
+                                 mf.indices, header->num_indices,
+                                 header->index_type, textures);
+
+    /* glBufferData copied everything, the mapping is no longer needed */
+    close_mesh_file(&mf);
 
     return m;
 }
 
+void
+delete_mesh(mesh *mesh)
+{
+    if (mesh == NULL)
+        return;
+
+    state_delete_vertex_array(mesh->vao);
+    state_delete_buffer(mesh->vbo);
+    state_delete_buffer(mesh->ebo);
+
+    object_pool_free(&mesh_records, mesh);
+}
+
 void
 draw_mesh(mesh *mesh, shader *shader)
+{
+    draw_mesh_lod(mesh, shader, 0);
+}
+
+void
+draw_mesh_lod(mesh *mesh, shader *shader, unsigned int lod)
+{
+    size_t index_size = mesh->index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    unsigned int i;
+
+    set_mesh_samplers(mesh, shader);
+
+    for (i = 0; i < arrlen(mesh->textures); i++)
+        state_bind_texture(i, GL_TEXTURE_2D, mesh->textures[i].id);
+
+    state_bind_vertex_array(mesh->vao);
+    glDrawElements(GL_TRIANGLES, mesh->lods[lod].count, mesh->index_type,
+                   (void *)(mesh->lods[lod].first_index * index_size));
+}
+
+unsigned int
+select_mesh_lod(const mesh *mesh, float distance, float pixels_per_unit,
+                float max_error, unsigned int previous)
+{
+    unsigned int lod = previous < mesh->num_lods ? previous : 0;
+    float scale = pixels_per_unit / glm_max(distance, 1e-4f);
+
+    /* Finer as soon as the current one shows too much */
+    while (lod > 0 && mesh->lods[lod].error * scale > max_error)
+        lod--;
+
+    /* Coarser only once the next one is well under the limit */
+    while (lod + 1 < mesh->num_lods
+           && mesh->lods[lod + 1].error * scale
+              <= max_error * LOD_HYSTERESIS)
+        lod++;
+
+    return lod;
+}
+
+void
+set_mesh_samplers(mesh *mesh, shader *shader)
 {
     unsigned int diffuse_num = 1;
     unsigned int specular_num = 1;
@@ -40,8 +210,6 @@ draw_mesh(mesh *mesh, shader *shader)
     char sampler_uniform_str[28];
 
     for (i = 0; i < arrlen(mesh->textures); i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
-
         name = mesh->textures[i].type;
 
         if (strcmp(name, "texture_diffuse") == 0) {
@@ -54,15 +222,28 @@ draw_mesh(mesh *mesh, shader *shader)
         }
 
         snprintf(sampler_uniform_str, 27, "material.%s%s", name, number);
-        set_shader_1f(shader->ID, sampler_uniform_str, i);
-        glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
+        set_shader_1i(shader->ID, sampler_uniform_str, i);
     }
+}
 
-    glActiveTexture(GL_TEXTURE0);
+void
+submit_mesh(render_queue *rq, mesh *mesh, const program_info *program,
+            unsigned int pass, mat4 model, float depth, unsigned int lod)
+{
+    draw_packet *packet = push_draw_packet(rq);
 
-    glBindVertexArray(mesh->vao);
-    glDrawElements(GL_TRIANGLES, arrlen(mesh->indices), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    packet->key = make_render_key(pass, program->id, mesh->material.id,
+                                  mesh->vao, depth);
+    packet->program = program;
+    packet->material = &mesh->material;
+    packet->vao = mesh->vao;
+    packet->count = mesh->lods[lod].count;
+    packet->first_index = mesh->lods[lod].first_index;
+    packet->index_type = mesh->index_type;
+
+    glm_mat4_copy(model, packet->model);
+
+    normal_matrix(model, packet->norm);
 }
 
 void
@@ -72,29 +253,71 @@ setup_mesh(mesh *mesh)
     glGenBuffers(1, &mesh->vbo);
     glGenBuffers(1, &mesh->ebo);
 
-    glBindVertexArray(mesh->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    state_bind_vertex_array(mesh->vao);
+    state_bind_buffer(GL_ARRAY_BUFFER, mesh->vbo);
 
     glBufferData(GL_ARRAY_BUFFER, arrlen(mesh->vertices) * sizeof(vertex),
                  &mesh->vertices[0], GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  arrlen(mesh->indices) * sizeof(unsigned int),
                  &mesh->indices[0], GL_STATIC_DRAW);
 
+    track_gpu_buffer(mesh->vbo, MEMORY_MESH,
+                     arrlen(mesh->vertices) * sizeof(vertex));
+    track_gpu_buffer(mesh->ebo, MEMORY_MESH,
+                     arrlen(mesh->indices) * sizeof(unsigned int));
+
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *)0);
 
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(unsigned int),
-                          offsetof(struct vertex, normal));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void *)offsetof(struct vertex, normal));
 
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(texture),
-                          offsetof(struct vertex, tex_coords));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void *)offsetof(struct vertex, tex_coords));
+
+    /* Keep later element array binds from landing in this mesh's vao */
+    state_bind_vertex_array(0);
+}
+
+static mesh *
+alloc_mesh(vertex *vertices, unsigned int *indices, texture *textures)
+{
+    memory_category category;
+    mesh *m;
+    unsigned int i;
+
+    if (mesh_records.base == NULL) {
+        category = set_memory_category(MEMORY_MESH);
+        create_object_pool(&mesh_records, "meshes", sizeof(mesh), MAX_MESHES);
+        set_memory_category(category);
+    }
+
+    m = object_pool_alloc(&mesh_records);
 
-    glBindVertexArray(0);
+    if (m == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for mesh, the most "
+                "is %d\n", MAX_MESHES);
+        exit(EXIT_FAILURE);
+    }
+
+    m->vertices = vertices;
+    m->indices = indices;
+    m->textures = textures;
+
+    init_material(&m->material, NULL, 0, 32.0f);
+
+    m->lods[0].first_index = 0;
+    m->lods[0].error = 0.0f;
+
+    for (i = 0; i < arrlen(textures) && i < MAX_MATERIAL_TEXTURES; i++)
+        m->material.textures[m->material.num_textures++] = textures[i].id;
+
+    return m;
 }
 
 /* EOF */
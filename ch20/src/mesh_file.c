@@ -0,0 +1,291 @@
+#include <fcntl.h>
+#include <float.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/file_parse.h"
+#include "../include/mesh_file.h"
+
+#include <glad/glad.h>
+
+/* Indices converted to 16 bits per write when writing short indices */
+#define WRITE_CHUNK 4096
+
+/**
+ * @brief Grows a bounding box to contain the vertices of an index range
+ *
+ * @param[in, out] aabb_min The minimum corner
+ * @param[in, out] aabb_max The maximum corner
+ * @param[in] vertices The vertices
+ * @param[in] indices The indices of the range
+ * @param[in] count The number of indices
+ * @param[in] base_vertex Added to every index
+ */
+static void grow_bounds(float *aabb_min, float *aabb_max,
+                        const vertex *vertices, const unsigned int *indices,
+                        size_t count, int base_vertex);
+
+bool
+open_mesh_file(mesh_file *mf, const char *path)
+{
+    const mesh_file_header *header;
+    const mesh_file_submesh *submesh;
+    struct stat info;
+    uint64_t index_size;
+    uint32_t i;
+    int fd;
+
+    memset(mf, 0, sizeof(*mf));
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(*header)) {
+        close(fd);
+        return false;
+    }
+
+    mf->size = info.st_size;
+    mf->mapping = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* The mapping keeps its own reference to the file */
+    close(fd);
+
+    if (mf->mapping == MAP_FAILED) {
+        mf->mapping = NULL;
+        return false;
+    }
+
+    /* The GL reads the sections front to back exactly once */
+    madvise(mf->mapping, mf->size, MADV_SEQUENTIAL);
+    madvise(mf->mapping, mf->size, MADV_WILLNEED);
+
+    header = mf->mapping;
+    mf->header = header;
+
+    index_size = header->index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+
+    if (memcmp(header->magic, MESH_FILE_MAGIC, 4) != 0
+        || header->version != MESH_FILE_VERSION
+        || header->byte_order != MESH_FILE_BYTE_ORDER
+        || header->num_attributes > MESH_FILE_MAX_ATTRIBUTES
+        || (header->index_type != GL_UNSIGNED_SHORT
+            && header->index_type != GL_UNSIGNED_INT)
+        || !check_section(mf->size, header->vertex_offset,
+                          header->num_vertices, header->vertex_stride,
+                          MESH_FILE_ALIGNMENT)
+        || !check_section(mf->size, header->index_offset,
+                          header->num_indices, index_size,
+                          MESH_FILE_ALIGNMENT)
+        || !check_section(mf->size, header->submesh_offset,
+                          header->num_submeshes, sizeof(mesh_file_submesh),
+                          MESH_FILE_ALIGNMENT)
+        || !check_section(mf->size, header->material_offset,
+                          header->num_materials, sizeof(mesh_file_material),
+                          MESH_FILE_ALIGNMENT)) {
+        close_mesh_file(mf);
+        return false;
+    }
+
+    for (i = 0; i < header->num_attributes; i++) {
+        if (header->attributes[i].offset >= header->vertex_stride) {
+            close_mesh_file(mf);
+            return false;
+        }
+    }
+
+    mf->vertices = (const char *)mf->mapping + header->vertex_offset;
+    mf->indices = (const char *)mf->mapping + header->index_offset;
+    mf->submeshes = (const mesh_file_submesh *)((const char *)mf->mapping
+                                                + header->submesh_offset);
+    mf->materials = (const mesh_file_material *)((const char *)mf->mapping
+                                                 + header->material_offset);
+
+    for (i = 0; i < header->num_submeshes; i++) {
+        submesh = &mf->submeshes[i];
+
+        if ((uint64_t)submesh->first_index + submesh->count
+            > header->num_indices
+            || (submesh->material != ~0u
+                && submesh->material >= header->num_materials)) {
+            close_mesh_file(mf);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+close_mesh_file(mesh_file *mf)
+{
+    if (mf->mapping != NULL)
+        munmap(mf->mapping, mf->size);
+
+    memset(mf, 0, sizeof(*mf));
+}
+
+bool
+write_mesh_file(const char *path, const vertex *vertices, size_t num_vertices,
+                const unsigned int *indices, size_t num_indices,
+                const mesh_file_submesh *submeshes, size_t num_submeshes,
+                const char *const *materials, size_t num_materials)
+{
+    mesh_file_header header = {0};
+    mesh_file_submesh whole = {0};
+    mesh_file_submesh submesh;
+    mesh_file_material material;
+    uint16_t shorts[WRITE_CHUNK];
+    FILE *file;
+    size_t i;
+    size_t j;
+    size_t chunk;
+    int c;
+    bool ok;
+
+    /* No submeshes means one covering everything, without a material */
+    if (submeshes == NULL) {
+        whole.count = num_indices;
+        whole.material = ~0u;
+        submeshes = &whole;
+        num_submeshes = 1;
+    }
+
+    memcpy(header.magic, MESH_FILE_MAGIC, 4);
+    header.version = MESH_FILE_VERSION;
+    header.byte_order = MESH_FILE_BYTE_ORDER;
+
+    /* The same layout setup_mesh gives the vertex struct */
+    header.vertex_stride = sizeof(vertex);
+    header.num_attributes = 3;
+    header.attributes[0] = (mesh_file_attribute){0, 3, GL_FLOAT, 0,
+                                                 offsetof(vertex, position)};
+    header.attributes[1] = (mesh_file_attribute){1, 3, GL_FLOAT, 0,
+                                                 offsetof(vertex, normal)};
+    header.attributes[2] = (mesh_file_attribute){2, 2, GL_FLOAT, 0,
+                                                 offsetof(vertex, tex_coords)};
+
+    header.index_type = num_vertices <= 65536 ? GL_UNSIGNED_SHORT
+                                              : GL_UNSIGNED_INT;
+
+    header.num_submeshes = num_submeshes;
+    header.num_materials = num_materials;
+    header.num_vertices = num_vertices;
+    header.num_indices = num_indices;
+
+    header.vertex_offset = align_offset(sizeof(header), MESH_FILE_ALIGNMENT);
+    header.index_offset = align_offset(
+        header.vertex_offset + num_vertices * sizeof(vertex),
+        MESH_FILE_ALIGNMENT);
+    header.submesh_offset = align_offset(
+        header.index_offset
+        + num_indices * (header.index_type == GL_UNSIGNED_SHORT ? 2 : 4),
+        MESH_FILE_ALIGNMENT);
+    header.material_offset = align_offset(
+        header.submesh_offset + num_submeshes * sizeof(mesh_file_submesh),
+        MESH_FILE_ALIGNMENT);
+
+    for (c = 0; c < 3; c++) {
+        header.aabb_min[c] = num_vertices > 0 ? FLT_MAX : 0.0f;
+        header.aabb_max[c] = num_vertices > 0 ? -FLT_MAX : 0.0f;
+    }
+
+    for (i = 0; i < num_vertices; i++) {
+        for (c = 0; c < 3; c++) {
+            if (vertices[i].position[c] < header.aabb_min[c])
+                header.aabb_min[c] = vertices[i].position[c];
+            if (vertices[i].position[c] > header.aabb_max[c])
+                header.aabb_max[c] = vertices[i].position[c];
+        }
+    }
+
+    file = fopen(path, "wb");
+
+    if (file == NULL)
+        return false;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1
+         && pad_to(file, header.vertex_offset)
+         && fwrite(vertices, sizeof(vertex), num_vertices, file)
+            == num_vertices
+         && pad_to(file, header.index_offset);
+
+    if (ok && header.index_type == GL_UNSIGNED_INT) {
+        ok = fwrite(indices, sizeof(*indices), num_indices, file)
+             == num_indices;
+    }
+    else {
+        for (i = 0; i < num_indices && ok; i += chunk) {
+            chunk = num_indices - i < WRITE_CHUNK ? num_indices - i
+                                                  : WRITE_CHUNK;
+
+            for (j = 0; j < chunk; j++)
+                shorts[j] = indices[i + j];
+
+            ok = fwrite(shorts, sizeof(*shorts), chunk, file) == chunk;
+        }
+    }
+
+    ok = ok && pad_to(file, header.submesh_offset);
+
+    for (i = 0; i < num_submeshes && ok; i++) {
+        submesh = submeshes[i];
+
+        for (c = 0; c < 3; c++) {
+            submesh.aabb_min[c] = FLT_MAX;
+            submesh.aabb_max[c] = -FLT_MAX;
+        }
+
+        grow_bounds(submesh.aabb_min, submesh.aabb_max, vertices,
+                    indices + submesh.first_index, submesh.count,
+                    submesh.base_vertex);
+
+        ok = fwrite(&submesh, sizeof(submesh), 1, file) == 1;
+    }
+
+    ok = ok && pad_to(file, header.material_offset);
+
+    for (i = 0; i < num_materials && ok; i++) {
+        memset(&material, 0, sizeof(material));
+        snprintf(material.name, sizeof(material.name), "%s", materials[i]);
+
+        ok = fwrite(&material, sizeof(material), 1, file) == 1;
+    }
+
+    if (fclose(file) != 0)
+        ok = false;
+
+    if (!ok)
+        remove(path);
+
+    return ok;
+}
+
+static void
+grow_bounds(float *aabb_min, float *aabb_max, const vertex *vertices,
+            const unsigned int *indices, size_t count, int base_vertex)
+{
+    const float *position;
+    size_t i;
+    int c;
+
+    for (i = 0; i < count; i++) {
+        position = vertices[indices[i] + base_vertex].position;
+
+        for (c = 0; c < 3; c++) {
+            if (position[c] < aabb_min[c])
+                aabb_min[c] = position[c];
+            if (position[c] > aabb_max[c])
+                aabb_max[c] = position[c];
+        }
+    }
+}
+
+/* EOF */
@@ -0,0 +1,94 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+#include "../include/mesh_pool.h"
+
+#include <glad/glad.h>
+
+void
+create_mesh_pool(mesh_pool *pool, size_t max_vertices, size_t max_indices)
+{
+    pool->max_vertices = max_vertices;
+    pool->max_indices = max_indices;
+    pool->num_vertices = 0;
+    pool->num_indices = 0;
+
+    glGenVertexArrays(1, &pool->vao);
+    glGenBuffers(1, &pool->vbo);
+    glGenBuffers(1, &pool->ebo);
+
+    state_bind_vertex_array(pool->vao);
+
+    state_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+    glBufferData(GL_ARRAY_BUFFER, max_vertices * sizeof(vertex), NULL,
+                 GL_STATIC_DRAW);
+
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_indices * sizeof(unsigned int),
+                 NULL, GL_STATIC_DRAW);
+
+    track_gpu_buffer(pool->vbo, MEMORY_MESH, max_vertices * sizeof(vertex));
+    track_gpu_buffer(pool->ebo, MEMORY_MESH,
+                     max_indices * sizeof(unsigned int));
+
+    /* The same layout as setup_mesh, so the same shaders work on both */
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *)0);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void *)offsetof(struct vertex, normal));
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void *)offsetof(struct vertex, tex_coords));
+
+    state_bind_vertex_array(0);
+}
+
+pool_mesh
+add_pool_mesh(mesh_pool *pool, const vertex *vertices, size_t num_vertices,
+              const unsigned int *indices, size_t num_indices)
+{
+    pool_mesh m;
+
+    if (pool->num_vertices + num_vertices > pool->max_vertices
+        || pool->num_indices + num_indices > pool->max_indices) {
+        fprintf(stderr, "Error: Mesh pool is full\n");
+        exit(EXIT_FAILURE);
+    }
+
+    m.first_index = pool->num_indices;
+    m.count = num_indices;
+    m.base_vertex = pool->num_vertices;
+
+    /* Indices stay mesh-relative, base_vertex offsets them when drawing */
+    state_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, pool->num_vertices * sizeof(vertex),
+                    num_vertices * sizeof(vertex), vertices);
+
+    state_bind_vertex_array(pool->vao);
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                    pool->num_indices * sizeof(unsigned int),
+                    num_indices * sizeof(unsigned int), indices);
+    state_bind_vertex_array(0);
+
+    pool->num_vertices += num_vertices;
+    pool->num_indices += num_indices;
+
+    return m;
+}
+
+void
+delete_mesh_pool(mesh_pool *pool)
+{
+    state_delete_vertex_array(pool->vao);
+    state_delete_buffer(pool->vbo);
+    state_delete_buffer(pool->ebo);
+}
+
+/* EOF */
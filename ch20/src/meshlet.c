@@ -0,0 +1,400 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/affine.h"
+#include "../include/meshlet.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+/**
+ * @brief Lists the triangles around each vertex
+ *
+ * @param[out] offsets Where each vertex's triangles start in the list, room
+ * for num_vertices + 1
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The triangle list
+ * @param[in] num_indices The number of indices
+ *
+ * @return The triangles of every vertex back to back, to be freed by the
+ * caller
+ */
+static unsigned int *build_adjacency(unsigned int *offsets,
+                                     size_t num_vertices,
+                                     const unsigned int *indices,
+                                     size_t num_indices);
+
+/**
+ * @brief Computes the bounding sphere and normal cone of a meshlet
+ *
+ * @param[in, out] m The meshlet, its range already set
+ * @param[in] vertices The vertices
+ * @param[in] indices The reordered indices
+ */
+static void compute_bounds(meshlet *m, const vertex *vertices,
+                           const unsigned int *indices);
+
+void
+build_meshlets(meshlet_mesh *mm, const vertex *vertices, size_t num_vertices,
+               const unsigned int *indices, size_t num_indices)
+{
+    size_t num_triangles = num_indices / 3;
+
+    unsigned int *offsets;
+    unsigned int *adjacent;
+    unsigned int *vertex_meshlet;
+    unsigned int *candidate_meshlet;
+    unsigned char *emitted;
+    unsigned int *candidates = NULL;
+    const unsigned int *tri;
+
+    size_t seed = 0;
+    size_t next;
+    size_t best;
+    size_t c;
+    unsigned int best_added;
+    unsigned int added;
+    unsigned int id;
+    unsigned int k;
+    unsigned int v;
+    unsigned int a;
+    unsigned int t;
+    meshlet m;
+
+    mm->meshlets = NULL;
+    mm->indices = NULL;
+
+    if (num_triangles == 0)
+        return;
+
+    offsets = malloc((num_vertices + 1) * sizeof(*offsets));
+    vertex_meshlet = malloc(num_vertices * sizeof(*vertex_meshlet));
+    candidate_meshlet = malloc(num_triangles * sizeof(*candidate_meshlet));
+    emitted = calloc(num_triangles, 1);
+
+    if (offsets == NULL || vertex_meshlet == NULL
+        || candidate_meshlet == NULL || emitted == NULL) {
+        fprintf(stderr, "Error: Failed to allocate meshlet memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    adjacent = build_adjacency(offsets, num_vertices, indices, num_indices);
+
+    /* No meshlet has claimed any vertex or triangle yet */
+    memset(vertex_meshlet, 0xff, num_vertices * sizeof(*vertex_meshlet));
+    memset(candidate_meshlet, 0xff,
+           num_triangles * sizeof(*candidate_meshlet));
+    arrsetcap(mm->indices, num_triangles * 3);
+
+    for (id = 0; ; id++) {
+        while (seed < num_triangles && emitted[seed])
+            seed++;
+
+        if (seed == num_triangles)
+            break;
+
+        memset(&m, 0, sizeof(m));
+        m.first_index = arrlen(mm->indices);
+        arrsetlen(candidates, 0);
+        next = seed;
+
+        /*
+         * Grow the meshlet one triangle at a time, preferring the neighbor
+         * that adds the fewest vertices so it stays round and small
+         */
+        while (m.num_triangles < MESHLET_MAX_TRIANGLES) {
+            tri = &indices[next * 3];
+            best_added = 4;
+            best = 0;
+
+            emitted[next] = 1;
+            m.num_triangles++;
+
+            for (k = 0; k < 3; k++) {
+                v = tri[k];
+                arrput(mm->indices, v);
+
+                if (vertex_meshlet[v] == id)
+                    continue;
+
+                vertex_meshlet[v] = id;
+                m.num_vertices++;
+
+                for (a = offsets[v]; a < offsets[v + 1]; a++) {
+                    t = adjacent[a];
+
+                    if (!emitted[t] && candidate_meshlet[t] != id) {
+                        candidate_meshlet[t] = id;
+                        arrput(candidates, t);
+                    }
+                }
+            }
+
+            for (c = 0; c < arrlenu(candidates) && best_added > 0; ) {
+                t = candidates[c];
+                added = 0;
+
+                if (emitted[t]) {
+                    arrdelswap(candidates, c);
+                    continue;
+                }
+
+                for (k = 0; k < 3; k++)
+                    added += vertex_meshlet[indices[t * 3 + k]] != id;
+
+                if (added < best_added
+                    && m.num_vertices + added <= MESHLET_MAX_VERTICES) {
+                    best_added = added;
+                    best = t;
+                }
+
+                c++;
+            }
+
+            if (best_added <= 3) {
+                next = best;
+                continue;
+            }
+
+            /*
+             * Nothing connected is left, as with a mesh split on its seams.
+             * Carry on in index order, which is usually close by
+             */
+            while (seed < num_triangles && emitted[seed])
+                seed++;
+
+            if (arrlenu(candidates) > 0 || seed == num_triangles)
+                break;
+
+            if (m.num_vertices + 3 > MESHLET_MAX_VERTICES)
+                break;
+
+            next = seed;
+        }
+
+        compute_bounds(&m, vertices, mm->indices);
+        arrput(mm->meshlets, m);
+    }
+
+    arrfree(candidates);
+    free(emitted);
+    free(candidate_meshlet);
+    free(vertex_meshlet);
+    free(adjacent);
+    free(offsets);
+}
+
+void
+cull_meshlets(const meshlet_mesh *mm, const pool_mesh *placement,
+              mat4 model, vec4 planes[6], vec3 camera, multi_draw *md,
+              meshlet_stats *stats)
+{
+    const meshlet *m;
+    mat4 inverse;
+    vec4 local_planes[6];
+    vec3 eye;
+    vec3 to_center;
+    pool_mesh run;
+    size_t i;
+    unsigned int p;
+    unsigned int j;
+    float length;
+    bool visible;
+
+    /*
+     * Cull in model space so the spheres and cones need no transforming.
+     * Planes map with the transpose of the model matrix and are scaled back
+     * to unit normals, so any scale is handled
+     */
+    affine_inverse(model, inverse);
+    glm_mat4_mulv3(inverse, camera, 1.0f, eye);
+
+    for (p = 0; p < 6; p++) {
+        for (j = 0; j < 4; j++)
+            local_planes[p][j] = glm_vec4_dot(model[j], planes[p]);
+
+        length = glm_vec3_norm(local_planes[p]);
+
+        if (length > 0.0f)
+            glm_vec4_scale(local_planes[p], 1.0f / length, local_planes[p]);
+    }
+
+    run.first_index = 0;
+    run.count = 0;
+    run.base_vertex = placement->base_vertex;
+
+    for (i = 0; i < arrlenu(mm->meshlets); i++) {
+        m = &mm->meshlets[i];
+        visible = true;
+
+        stats->meshlets++;
+        stats->triangles += m->num_triangles;
+
+        for (p = 0; p < 6; p++) {
+            if (glm_vec3_dot(local_planes[p], (float *)m->center)
+                + local_planes[p][3] < -m->radius) {
+                visible = false;
+                break;
+            }
+        }
+
+        if (!visible) {
+            stats->triangles_frustum_culled += m->num_triangles;
+            continue;
+        }
+
+        glm_vec3_sub((float *)m->center, eye, to_center);
+
+        if (glm_vec3_dot(to_center, (float *)m->cone_axis)
+            > m->cone_cutoff * glm_vec3_norm(to_center) + m->radius) {
+            stats->triangles_backface_culled += m->num_triangles;
+            continue;
+        }
+
+        stats->meshlets_drawn++;
+
+        /* Meshlets are back to back, so survivors in a row are one draw */
+        if (run.count > 0
+            && run.first_index + run.count
+                == placement->first_index + m->first_index) {
+            run.count += m->num_triangles * 3;
+            continue;
+        }
+
+        if (run.count > 0) {
+            push_multi_draw(md, &run, 1, 0);
+            stats->draws++;
+        }
+
+        run.first_index = placement->first_index + m->first_index;
+        run.count = m->num_triangles * 3;
+    }
+
+    if (run.count > 0) {
+        push_multi_draw(md, &run, 1, 0);
+        stats->draws++;
+    }
+}
+
+void
+free_meshlets(meshlet_mesh *mm)
+{
+    arrfree(mm->meshlets);
+    arrfree(mm->indices);
+}
+
+static unsigned int *
+build_adjacency(unsigned int *offsets, size_t num_vertices,
+                const unsigned int *indices, size_t num_indices)
+{
+    unsigned int *adjacent = malloc((num_indices + 1) * sizeof(*adjacent));
+    size_t i;
+
+    if (adjacent == NULL) {
+        fprintf(stderr, "Error: Failed to allocate meshlet memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(offsets, 0, (num_vertices + 1) * sizeof(*offsets));
+
+    for (i = 0; i < num_indices; i++)
+        offsets[indices[i]]++;
+
+    for (i = 1; i < num_vertices; i++)
+        offsets[i] += offsets[i - 1];
+
+    offsets[num_vertices] = num_indices;
+
+    /* Each vertex's offset counts down from its end to its start */
+    for (i = num_indices; i-- > 0; )
+        adjacent[--offsets[indices[i]]] = i / 3;
+
+    return adjacent;
+}
+
+static void
+compute_bounds(meshlet *m, const vertex *vertices,
+               const unsigned int *indices)
+{
+    const unsigned int *tris = &indices[m->first_index];
+    unsigned int count = m->num_triangles * 3;
+    vec3 lo;
+    vec3 hi;
+    vec3 axis = { 0.0f, 0.0f, 0.0f };
+    vec3 e1;
+    vec3 e2;
+    vec3 n;
+    float radius = 0.0f;
+    float min_dot = 1.0f;
+    float d;
+    unsigned int i;
+
+    glm_vec3_copy((float *)vertices[tris[0]].position, lo);
+    glm_vec3_copy((float *)vertices[tris[0]].position, hi);
+
+    for (i = 1; i < count; i++) {
+        glm_vec3_minv(lo, (float *)vertices[tris[i]].position, lo);
+        glm_vec3_maxv(hi, (float *)vertices[tris[i]].position, hi);
+    }
+
+    glm_vec3_center(lo, hi, m->center);
+
+    for (i = 0; i < count; i++) {
+        d = glm_vec3_distance(m->center, (float *)vertices[tris[i]].position);
+
+        if (d > radius)
+            radius = d;
+    }
+
+    m->radius = radius;
+
+    /* The cone is built from face normals, degenerate triangles skipped */
+    for (i = 0; i < count; i += 3) {
+        glm_vec3_sub((float *)vertices[tris[i + 1]].position,
+                     (float *)vertices[tris[i]].position, e1);
+        glm_vec3_sub((float *)vertices[tris[i + 2]].position,
+                     (float *)vertices[tris[i]].position, e2);
+        glm_vec3_cross(e1, e2, n);
+
+        if (glm_vec3_norm(n) > 1e-12f) {
+            glm_vec3_normalize(n);
+            glm_vec3_add(axis, n, axis);
+        }
+    }
+
+    if (glm_vec3_norm(axis) < 1e-6f) {
+        glm_vec3_copy(GLM_ZUP, m->cone_axis);
+        m->cone_cutoff = 1.0f;
+        return;
+    }
+
+    glm_vec3_normalize(axis);
+
+    for (i = 0; i < count; i += 3) {
+        glm_vec3_sub((float *)vertices[tris[i + 1]].position,
+                     (float *)vertices[tris[i]].position, e1);
+        glm_vec3_sub((float *)vertices[tris[i + 2]].position,
+                     (float *)vertices[tris[i]].position, e2);
+        glm_vec3_cross(e1, e2, n);
+
+        if (glm_vec3_norm(n) > 1e-12f) {
+            glm_vec3_normalize(n);
+            min_dot = glm_min(min_dot, glm_vec3_dot(axis, n));
+        }
+    }
+
+    glm_vec3_copy(axis, m->cone_axis);
+
+    /*
+     * Every normal is within acos(min_dot) of the axis, so a view direction
+     * within 90 degrees less than that sees only back faces, cos of which is
+     * sqrt(1 - min_dot^2). Past a hemisphere no view can
+     */
+    m->cone_cutoff = min_dot <= 0.0f ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+}
+
+/* EOF */
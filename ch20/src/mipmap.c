@@ -0,0 +1,451 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../include/job.h"
+#include "../include/mipmap.h"
+
+#include <glad/glad.h>
+
+/* Bumped whenever the cache file layout or the filtering changes */
+#define MIP_CACHE_VERSION 2
+
+/*
+ * The linear to sRGB table is indexed by 16-bit linear values. Anything
+ * coarser merges the darkest sRGB values, which are very close in linear
+ */
+#define LINEAR_STEPS 65536
+
+typedef struct mip_level_work mip_level_work;
+typedef struct mip_cache_header mip_cache_header;
+
+/* What the jobs filtering one level share */
+struct mip_level_work
+{
+    mip_chain *chain;
+    int level;
+    int bands;
+    const unsigned int *layer_flags;
+};
+
+/* Followed by levels 1 and up, level 0 is the image the chain is built from */
+struct mip_cache_header
+{
+    char magic[4];
+    uint32_t version;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t num_levels;
+    uint32_t srgb_layers;
+    uint32_t reserved;
+
+    /* Of the level 0 pixels and the flags of each layer */
+    uint64_t hash;
+};
+
+static const char *cache_dir = NULL;
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static float srgb_to_linear[256];
+static unsigned char linear_to_srgb[LINEAR_STEPS];
+
+/**
+ * @brief Fills the sRGB conversion tables
+ */
+static void init_srgb_tables(void);
+
+/**
+ * @brief Box filters a band of rows of one layer from the level before.
+ * Runs on the worker threads
+ *
+ * @param[in] task The layer times the bands per layer plus the band
+ * @param[in, out] data The mip_level_work
+ */
+static void filter_band(unsigned int task, void *data);
+
+/**
+ * @brief Hashes the level 0 pixels of a chain, and how each layer is
+ * filtered, with 64-bit FNV-1a
+ *
+ * @param[in] chain The mip chain
+ * @param[in] layer_flags The flags of each layer
+ *
+ * @return The hash
+ */
+static uint64_t hash_pixels(const mip_chain *chain,
+                            const unsigned int *layer_flags);
+
+/**
+ * @brief Builds the path of the cache file of an image
+ *
+ * @param[out] path The path
+ * @param[in] size The size of path
+ * @param[in] hash The hash of the image and its flags
+ *
+ * @return Whether the path fit
+ */
+static bool cache_path(char *path, size_t size, uint64_t hash);
+
+/**
+ * @brief Reads levels 1 and up of a chain from the cache
+ *
+ * @param[in, out] chain The mip chain, with level 0 and the sizes filled in
+ * @param[in] srgb_layers The number of layers filtered as sRGB
+ * @param[in] hash The hash of level 0 and the flags
+ *
+ * @return Whether a matching cache file was read. If not, the chain is left
+ * with only level 0
+ */
+static bool load_cached_chain(mip_chain *chain, unsigned int srgb_layers,
+                              uint64_t hash);
+
+/**
+ * @brief Writes levels 1 and up of a chain to the cache
+ *
+ * @param[in] chain The mip chain
+ * @param[in] srgb_layers The number of layers filtered as sRGB
+ * @param[in] hash The hash of level 0 and the flags
+ */
+static void save_cached_chain(const mip_chain *chain,
+                              unsigned int srgb_layers, uint64_t hash);
+
+void
+set_mip_cache_dir(const char *dir)
+{
+    cache_dir = dir;
+}
+
+void
+create_mip_chain(mip_chain *chain, unsigned char *pixels, int width,
+                 int height, int layers, const unsigned int *layer_flags)
+{
+    mip_level_work work;
+    int size = width > height ? width : height;
+    uint64_t hash = 0;
+    unsigned int srgb_layers = 0;
+    int rows;
+    int level;
+    int layer;
+
+    memset(chain, 0, sizeof(*chain));
+
+    chain->width = width;
+    chain->height = height;
+    chain->layers = layers;
+    chain->levels[0] = pixels;
+    chain->num_levels = 1;
+
+    while ((size >> chain->num_levels) > 0
+           && chain->num_levels < MIP_MAX_LEVELS)
+        chain->num_levels++;
+
+    for (layer = 0; layer < layers; layer++)
+        srgb_layers += (layer_flags[layer] & MIP_SRGB) != 0;
+
+    if (cache_dir != NULL) {
+        hash = hash_pixels(chain, layer_flags);
+
+        if (load_cached_chain(chain, srgb_layers, hash))
+            return;
+    }
+
+    if (srgb_layers > 0)
+        pthread_once(&tables_once, init_srgb_tables);
+
+    work.chain = chain;
+    work.layer_flags = layer_flags;
+
+    /* Each level needs the one before it, the bands of a level do not */
+    for (level = 1; level < chain->num_levels; level++) {
+        chain->levels[level] = malloc((size_t)mip_level_size(width, level)
+                                      * mip_level_size(height, level)
+                                      * layers * 4);
+
+        if (chain->levels[level] == NULL) {
+            fprintf(stderr, "Error: Could not allocate memory for mip "
+                    "level\n");
+            exit(EXIT_FAILURE);
+        }
+
+        rows = mip_level_size(height, level);
+
+        work.level = level;
+        work.bands = (rows + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+
+        parallel_for(layers * work.bands, filter_band, &work);
+    }
+
+    if (cache_dir != NULL)
+        save_cached_chain(chain, srgb_layers, hash);
+}
+
+void
+upload_mip_chain(const mip_chain *chain, GLenum target)
+{
+    int level;
+    int w;
+    int h;
+
+    for (level = 0; level < chain->num_levels; level++) {
+        w = mip_level_size(chain->width, level);
+        h = mip_level_size(chain->height, level);
+
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(target, level, GL_RGBA8, w, h, chain->layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, chain->levels[level]);
+        else
+            glTexImage2D(target, level, GL_RGBA8, w, h, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, chain->levels[level]);
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, chain->num_levels - 1);
+}
+
+void
+delete_mip_chain(mip_chain *chain)
+{
+    int level;
+
+    for (level = 0; level < chain->num_levels; level++) {
+        free(chain->levels[level]);
+        chain->levels[level] = NULL;
+    }
+
+    chain->num_levels = 0;
+}
+
+int
+mip_level_size(int size, int level)
+{
+    size >>= level;
+
+    return size > 0 ? size : 1;
+}
+
+static void
+init_srgb_tables(void)
+{
+    float c;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        c = i / 255.0f;
+        srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f
+                                          : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (i = 0; i < LINEAR_STEPS; i++) {
+        c = (float)i / (LINEAR_STEPS - 1);
+        c = c <= 0.0031308f ? c * 12.92f
+                            : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+        linear_to_srgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+}
+
+static void
+filter_band(unsigned int task, void *data)
+{
+    const mip_level_work *work = data;
+    const mip_chain *chain = work->chain;
+    int level = work->level;
+
+    int layer = task / work->bands;
+    int band = task % work->bands;
+    bool srgb = work->layer_flags[layer] & MIP_SRGB;
+
+    int src_w = mip_level_size(chain->width, level - 1);
+    int src_h = mip_level_size(chain->height, level - 1);
+    int w = mip_level_size(chain->width, level);
+    int h = mip_level_size(chain->height, level);
+
+    int y_start = band * MIP_BAND_ROWS;
+    int y_end = y_start + MIP_BAND_ROWS < h ? y_start + MIP_BAND_ROWS : h;
+
+    const unsigned char *src = chain->levels[level - 1]
+                               + (size_t)layer * src_w * src_h * 4;
+    unsigned char *dst = chain->levels[level] + (size_t)layer * w * h * 4;
+
+    const unsigned char *texels[4];
+    float sum;
+    int x;
+    int y;
+    int x1;
+    int y1;
+    int c;
+
+    for (y = y_start; y < y_end; y++) {
+        /* Odd sizes repeat the last row or column */
+        y1 = 2 * y + 1 < src_h ? 2 * y + 1 : src_h - 1;
+
+        for (x = 0; x < w; x++) {
+            x1 = 2 * x + 1 < src_w ? 2 * x + 1 : src_w - 1;
+
+            texels[0] = src + ((size_t)2 * y * src_w + 2 * x) * 4;
+            texels[1] = src + ((size_t)2 * y * src_w + x1) * 4;
+            texels[2] = src + ((size_t)y1 * src_w + 2 * x) * 4;
+            texels[3] = src + ((size_t)y1 * src_w + x1) * 4;
+
+            for (c = 0; c < 4; c++) {
+                if (srgb && c < 3) {
+                    sum = srgb_to_linear[texels[0][c]]
+                          + srgb_to_linear[texels[1][c]]
+                          + srgb_to_linear[texels[2][c]]
+                          + srgb_to_linear[texels[3][c]];
+                    dst[((size_t)y * w + x) * 4 + c] = linear_to_srgb[
+                        (int)(sum * 0.25f * (LINEAR_STEPS - 1) + 0.5f)];
+                }
+                else {
+                    dst[((size_t)y * w + x) * 4 + c] =
+                        (texels[0][c] + texels[1][c] + texels[2][c]
+                         + texels[3][c] + 2) / 4;
+                }
+            }
+        }
+    }
+}
+
+static uint64_t
+hash_pixels(const mip_chain *chain, const unsigned int *layer_flags)
+{
+    const unsigned char *pixels = chain->levels[0];
+    size_t size = (size_t)chain->width * chain->height * chain->layers * 4;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i;
+    int layer;
+
+    for (i = 0; i < size; i++) {
+        hash ^= pixels[i];
+        hash *= 1099511628211ull;
+    }
+
+    /*
+     * The same image filtered differently gets a file of its own. Only the
+     * flags that change the result are part of the key
+     */
+    for (layer = 0; layer < chain->layers; layer++) {
+        hash ^= (layer_flags[layer] & MIP_SRGB) != 0;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static bool
+cache_path(char *path, size_t size, uint64_t hash)
+{
+    return snprintf(path, size, "%s/%016llx.mip", cache_dir,
+                    (unsigned long long)hash) < (int)size;
+}
+
+static bool
+load_cached_chain(mip_chain *chain, unsigned int srgb_layers, uint64_t hash)
+{
+    mip_cache_header header;
+    char path[1024];
+    FILE *file;
+    size_t size;
+    int level;
+    bool ok = true;
+
+    if (!cache_path(path, sizeof(path), hash))
+        return false;
+
+    file = fopen(path, "rb");
+
+    if (file == NULL)
+        return false;
+
+    /* A different image with the same hash is caught by the sizes at least */
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, "MIPC", 4) != 0
+        || header.version != MIP_CACHE_VERSION
+        || header.width != (uint32_t)chain->width
+        || header.height != (uint32_t)chain->height
+        || header.layers != (uint32_t)chain->layers
+        || header.num_levels != (uint32_t)chain->num_levels
+        || header.srgb_layers != srgb_layers || header.hash != hash) {
+        fclose(file);
+        return false;
+    }
+
+    for (level = 1; level < chain->num_levels && ok; level++) {
+        size = (size_t)mip_level_size(chain->width, level)
+               * mip_level_size(chain->height, level) * chain->layers * 4;
+
+        chain->levels[level] = malloc(size);
+
+        ok = chain->levels[level] != NULL
+             && fread(chain->levels[level], size, 1, file) == 1;
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        for (level = 1; level < chain->num_levels; level++) {
+            free(chain->levels[level]);
+            chain->levels[level] = NULL;
+        }
+    }
+
+    return ok;
+}
+
+static void
+save_cached_chain(const mip_chain *chain, unsigned int srgb_layers,
+                  uint64_t hash)
+{
+    mip_cache_header header = {0};
+    char path[1024];
+    char temp_path[1040];
+    FILE *file;
+    size_t size;
+    int level;
+    bool ok;
+
+    if (!cache_path(path, sizeof(path), hash))
+        return;
+
+    memcpy(header.magic, "MIPC", 4);
+    header.version = MIP_CACHE_VERSION;
+    header.width = chain->width;
+    header.height = chain->height;
+    header.layers = chain->layers;
+    header.num_levels = chain->num_levels;
+    header.srgb_layers = srgb_layers;
+    header.hash = hash;
+
+    /* Fails harmlessly if it already exists */
+    mkdir(cache_dir, 0755);
+
+    /* Written under another name first so a crash never leaves half a file */
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    file = fopen(temp_path, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not write mip cache: %s\n", temp_path);
+        return;
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (level = 1; level < chain->num_levels && ok; level++) {
+        size = (size_t)mip_level_size(chain->width, level)
+               * mip_level_size(chain->height, level) * chain->layers * 4;
+
+        ok = fwrite(chain->levels[level], size, 1, file) == 1;
+    }
+
+    if (fclose(file) != 0 || !ok || rename(temp_path, path) != 0) {
+        fprintf(stderr, "Error: Could not write mip cache: %s\n", path);
+        remove(temp_path);
+    }
+}
+
+/* EOF */
@@ -0,0 +1,143 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/gl_ext.h"
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+#include "../include/multi_draw.h"
+
+#include <stb_ds.h>
+#include <glad/glad.h>
+
+void
+create_multi_draw(multi_draw *md)
+{
+    md->commands = NULL;
+    md->counts = NULL;
+    md->offsets = NULL;
+    md->base_vertices = NULL;
+
+    md->buffer = 0;
+    md->buffer_size = 0;
+
+    if (gl_ext.multi_draw_indirect)
+        glGenBuffers(1, &md->buffer);
+}
+
+void
+reset_multi_draw(multi_draw *md)
+{
+    arrsetlen(md->commands, 0);
+    arrsetlen(md->counts, 0);
+    arrsetlen(md->offsets, 0);
+    arrsetlen(md->base_vertices, 0);
+}
+
+void
+push_multi_draw(multi_draw *md, const pool_mesh *mesh,
+                unsigned int instance_count, unsigned int base_instance)
+{
+    draw_indirect_command cmd;
+
+    cmd.count = mesh->count;
+    cmd.instance_count = instance_count;
+    cmd.first_index = mesh->first_index;
+    cmd.base_vertex = mesh->base_vertex;
+    cmd.base_instance = base_instance;
+
+    arrput(md->commands, cmd);
+}
+
+void
+upload_multi_draw(multi_draw *md)
+{
+    size_t size = arrlen(md->commands) * sizeof(*md->commands);
+    size_t i;
+
+    if (md->buffer != 0) {
+        state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, md->buffer);
+
+        if (size > md->buffer_size) {
+            md->buffer_size = size * 2;
+            track_gpu_buffer(md->buffer, MEMORY_SCRATCH, md->buffer_size);
+        }
+
+        /* Orphan the old storage so the GPU can keep reading last frame's */
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, md->buffer_size, NULL,
+                     GL_STREAM_DRAW);
+
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, md->commands);
+        return;
+    }
+
+    arrsetlen(md->counts, 0);
+    arrsetlen(md->offsets, 0);
+    arrsetlen(md->base_vertices, 0);
+
+    for (i = 0; i < arrlen(md->commands); i++) {
+        if (md->commands[i].instance_count != 1)
+            continue;
+
+        arrput(md->counts, md->commands[i].count);
+        arrput(md->offsets, (const void *)(uintptr_t)
+               (md->commands[i].first_index * sizeof(unsigned int)));
+        arrput(md->base_vertices, md->commands[i].base_vertex);
+    }
+}
+
+unsigned int
+draw_multi_draw(const multi_draw *md, GLenum mode)
+{
+    const draw_indirect_command *cmd;
+    unsigned int calls = 0;
+    size_t i;
+
+    if (arrlen(md->commands) == 0)
+        return 0;
+
+    if (md->buffer != 0) {
+        state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, md->buffer);
+        gl_ext.glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, NULL,
+                                           arrlen(md->commands), 0);
+        return 1;
+    }
+
+    if (arrlen(md->counts) > 0) {
+        glMultiDrawElementsBaseVertex(mode, md->counts, GL_UNSIGNED_INT,
+                                      (const void *const *)md->offsets,
+                                      arrlen(md->counts),
+                                      md->base_vertices);
+        calls++;
+    }
+
+    for (i = 0; i < arrlen(md->commands); i++) {
+        cmd = &md->commands[i];
+
+        if (cmd->instance_count == 1 || cmd->instance_count == 0)
+            continue;
+
+        glDrawElementsInstancedBaseVertex(mode, cmd->count, GL_UNSIGNED_INT,
+                                          (void *)(uintptr_t)
+                                          (cmd->first_index
+                                           * sizeof(unsigned int)),
+                                          cmd->instance_count,
+                                          cmd->base_vertex);
+        calls++;
+    }
+
+    return calls;
+}
+
+void
+delete_multi_draw(multi_draw *md)
+{
+    arrfree(md->commands);
+    arrfree(md->counts);
+    arrfree(md->offsets);
+    arrfree(md->base_vertices);
+
+    if (md->buffer != 0)
+        state_delete_buffer(md->buffer);
+}
+
+/* EOF */
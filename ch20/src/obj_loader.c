@@ -0,0 +1,879 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/file_parse.h"
+#include "../include/job.h"
+#include "../include/obj_loader.h"
+#include "../include/weld.h"
+
+#include <stb_ds.h>
+
+/* An index a face corner does not have */
+#define NO_INDEX INT_MIN
+
+/* Marks an empty slot of the vertex table */
+#define NO_VERTEX UINT32_MAX
+
+/* Bits of obj_corner.relative */
+#define RELATIVE_V 0x1
+#define RELATIVE_VT 0x2
+#define RELATIVE_VN 0x4
+
+typedef struct obj_corner obj_corner;
+typedef struct obj_usemtl obj_usemtl;
+typedef struct obj_chunk obj_chunk;
+typedef struct vertex_key vertex_key;
+typedef struct vertex_table vertex_table;
+
+/*
+ * One corner of a triangle. Positive OBJ indices are global and stored
+ * 0-based. Negative ones count back from the elements the chunk has parsed
+ * so far, which is only known once every chunk is parsed, so they are
+ * stored relative to the start of the chunk and flagged
+ */
+struct obj_corner
+{
+    int v;
+    int vt;
+    int vn;
+    unsigned int relative;
+};
+
+/* A material switch, taking effect at a corner of the chunk */
+struct obj_usemtl
+{
+    size_t corner;
+    char name[MESH_FILE_NAME_SIZE];
+};
+
+/* The part of the file one job parses, and what it found there */
+struct obj_chunk
+{
+    const char *start;
+    const char *end;
+
+    /* stb_ds arrays */
+    vec3 *positions;
+    vec2 *tex_coords;
+    vec3 *normals;
+    obj_corner *corners;
+    obj_usemtl *usemtls;
+    char (*mtllibs)[OBJ_PATH_SIZE];
+
+    unsigned int bad_lines;
+};
+
+/* The vt and vn a vertex was made from, its position is the chain it is in */
+struct vertex_key
+{
+    uint32_t vt;
+    uint32_t vn;
+
+    /* The next vertex made from the same position, or NO_VERTEX */
+    uint32_t next;
+};
+
+/*
+ * A hash table keyed on the position index, which is a perfect hash: each
+ * position heads a chain of the vertices made from it, and chains only grow
+ * past one at seams. Faces mostly use nearby positions, so lookups walk both
+ * arrays almost in order rather than jumping around a big open table
+ */
+struct vertex_table
+{
+    /* One per position */
+    uint32_t *heads;
+
+    /* stb_ds array, one per vertex */
+    vertex_key *keys;
+};
+
+/**
+ * @brief Parses one chunk of the file. Runs on the worker threads
+ *
+ * @param[in] task The index of the chunk
+ * @param[in, out] data The array of obj_chunk
+ */
+static void parse_chunk(unsigned int task, void *data);
+
+/**
+ * @brief Parses a face line into triangles
+ *
+ * @param[in, out] chunk The chunk the line is in
+ * @param[in] p The first character after the "f"
+ * @param[in] end The end of the chunk
+ *
+ * @return Whether the whole line was valid
+ */
+static bool parse_face(obj_chunk *chunk, const char *p, const char *end);
+
+/**
+ * @brief Parses one v, v/vt, v//vn or v/vt/vn face corner
+ *
+ * @param[in, out] p The cursor, moved past the corner
+ * @param[in] end The end of the text
+ * @param[in] chunk The chunk, for the counts negative indices are relative to
+ * @param[out] corner The corner
+ *
+ * @return Whether the corner was valid
+ */
+static bool parse_corner(const char **p, const char *end,
+                         const obj_chunk *chunk, obj_corner *corner);
+
+/**
+ * @brief Turns an OBJ index into a stored one
+ *
+ * @param[in] value The index as written, 1-based or negative
+ * @param[in] local_count The elements of this kind the chunk has so far
+ * @param[in] flag The RELATIVE_* bit of this kind of index
+ * @param[in, out] corner The corner whose relative bits to set
+ *
+ * @return The 0-based global index, or the chunk-relative one if flagged
+ */
+static int store_index(int value, size_t local_count, unsigned int flag,
+                       obj_corner *corner);
+
+/**
+ * @brief Parses a decimal integer
+ *
+ * @param[in, out] p The cursor, moved past the number
+ * @param[in] end The end of the text
+ * @param[out] value The number
+ *
+ * @return Whether there were any digits
+ */
+static bool parse_int(const char **p, const char *end, int *value);
+
+/**
+ * @brief Parses floats separated by blanks
+ *
+ * @param[in] p The first character after the keyword
+ * @param[in] end The end of the text
+ * @param[out] values The numbers, missing ones are 0
+ * @param[in] count How many numbers to read
+ */
+static void parse_floats(const char *p, const char *end, float *values,
+                         int count);
+
+/**
+ * @brief Copies the rest of a line without the surrounding blanks
+ *
+ * @param[in] p The first character after the keyword
+ * @param[in] end The end of the text
+ * @param[out] dst Where to copy to, always terminated
+ * @param[in] size The size of dst
+ */
+static void copy_rest(const char *p, const char *end, char *dst, size_t size);
+
+/**
+ * @brief Resolves the stored index of a corner against the stitched arrays
+ *
+ * @param[in] index The stored index
+ * @param[in] relative Whether it is chunk-relative
+ * @param[in] base Where the chunk's elements start in the stitched array
+ * @param[in] count The length of the stitched array
+ * @param[out] resolved The global index, NO_VERTEX for a missing index
+ *
+ * @return Whether the index is in range
+ */
+static bool resolve_index(int index, bool relative, size_t base, size_t count,
+                          uint32_t *resolved);
+
+/**
+ * @brief Finds the vertex of a v/vt/vn combination, adding it if it is new
+ *
+ * @param[in, out] table The vertex table
+ * @param[in, out] model The model the vertex is added to
+ * @param[in] v The position index
+ * @param[in] vt The texture coordinate index, or NO_VERTEX
+ * @param[in] vn The normal index, or NO_VERTEX
+ * @param[in] positions The stitched positions
+ * @param[in] tex_coords The stitched texture coordinates
+ * @param[in] normals The stitched normals
+ *
+ * @return The index of the vertex
+ */
+static uint32_t find_vertex(vertex_table *table, obj_model *model,
+                            uint32_t v, uint32_t vt, uint32_t vn,
+                            const vec3 *positions, const vec2 *tex_coords,
+                            const vec3 *normals);
+
+/**
+ * @brief Loads the materials of an MTL file into a model
+ *
+ * @param[in, out] model The model
+ * @param[in] path The path to the MTL file
+ */
+static void load_mtl(obj_model *model, const char *path);
+
+/**
+ * @brief Finds a material by name, adding a default one if there is none
+ *
+ * @param[in, out] model The model
+ * @param[in] name The material name
+ *
+ * @return The index of the material
+ */
+static uint32_t find_material(obj_model *model, const char *name);
+
+/**
+ * @brief Starts a new submesh, or extends the last one if it continues it
+ *
+ * @param[in, out] model The model
+ * @param[in] first_index The first index of the range
+ * @param[in] count The number of indices
+ * @param[in] material The material index
+ */
+static void push_submesh(obj_model *model, size_t first_index, size_t count,
+                         uint32_t material);
+
+/**
+ * @brief Joins the directory of a file and a relative path
+ *
+ * @param[out] dst The joined path
+ * @param[in] size The size of dst
+ * @param[in] file The file whose directory to use
+ * @param[in] relative The relative path
+ */
+static void join_path(char *dst, size_t size, const char *file,
+                      const char *relative);
+
+bool
+load_obj(obj_model *model, const char *path)
+{
+    obj_chunk *chunks = NULL;
+    obj_chunk *chunk;
+    vertex_table table = {0};
+    uint32_t v;
+    uint32_t vt;
+    uint32_t vn;
+    obj_corner *corner;
+    struct stat info;
+    const char *text;
+    char mtl_path[OBJ_PATH_SIZE];
+
+    vec3 *positions = NULL;
+    vec2 *tex_coords = NULL;
+    vec3 *normals = NULL;
+    size_t num_positions = 0;
+    size_t num_tex_coords = 0;
+    size_t num_normals = 0;
+    size_t num_corners = 0;
+    size_t base_positions;
+    size_t base_tex_coords;
+    size_t base_normals;
+    size_t base_corners;
+
+    unsigned int num_chunks;
+    unsigned int bad_lines = 0;
+    uint32_t material = ~0u;
+    size_t run_start = 0;
+    size_t size;
+    size_t i;
+    size_t j;
+    unsigned int c;
+    bool ok = true;
+    int fd;
+
+    memset(model, 0, sizeof(*model));
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Could not open OBJ file: %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    size = info.st_size;
+
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (text == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map OBJ file: %s\n", path);
+        return false;
+    }
+
+    madvise((void *)text, size, MADV_SEQUENTIAL);
+
+    /* A few chunks per thread so uneven chunks still balance out */
+    num_chunks = size / OBJ_MIN_CHUNK_BYTES;
+
+    if (num_chunks > num_job_threads() * 4)
+        num_chunks = num_job_threads() * 4;
+    if (num_chunks < 1)
+        num_chunks = 1;
+
+    chunks = calloc(num_chunks, sizeof(*chunks));
+
+    if (chunks == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for OBJ chunks\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Every chunk but the first starts on the line after its even split */
+    for (c = 0; c < num_chunks; c++) {
+        chunks[c].start = c == 0 ? text
+                                 : next_line(text + size * c / num_chunks - 1,
+                                             text + size);
+        chunks[c].end = text + size;
+
+        if (c > 0) {
+            if (chunks[c].start < chunks[c - 1].start)
+                chunks[c].start = chunks[c - 1].start;
+            chunks[c - 1].end = chunks[c].start;
+        }
+    }
+
+    parallel_for(num_chunks, parse_chunk, chunks);
+
+    /* Stitch the elements of the chunks together in file order */
+    for (c = 0; c < num_chunks; c++) {
+        num_positions += arrlen(chunks[c].positions);
+        num_tex_coords += arrlen(chunks[c].tex_coords);
+        num_normals += arrlen(chunks[c].normals);
+        num_corners += arrlen(chunks[c].corners);
+        bad_lines += chunks[c].bad_lines;
+    }
+
+    positions = malloc((num_positions + 1) * sizeof(*positions));
+    tex_coords = malloc((num_tex_coords + 1) * sizeof(*tex_coords));
+    normals = malloc((num_normals + 1) * sizeof(*normals));
+
+    if (positions == NULL || tex_coords == NULL || normals == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for OBJ data\n");
+        exit(EXIT_FAILURE);
+    }
+
+    base_positions = 0;
+    base_tex_coords = 0;
+    base_normals = 0;
+
+    for (c = 0; c < num_chunks; c++) {
+        chunk = &chunks[c];
+
+        if (arrlen(chunk->positions) > 0)
+            memcpy(positions + base_positions, chunk->positions,
+                   arrlen(chunk->positions) * sizeof(*positions));
+        if (arrlen(chunk->tex_coords) > 0)
+            memcpy(tex_coords + base_tex_coords, chunk->tex_coords,
+                   arrlen(chunk->tex_coords) * sizeof(*tex_coords));
+        if (arrlen(chunk->normals) > 0)
+            memcpy(normals + base_normals, chunk->normals,
+                   arrlen(chunk->normals) * sizeof(*normals));
+
+        base_positions += arrlen(chunk->positions);
+        base_tex_coords += arrlen(chunk->tex_coords);
+        base_normals += arrlen(chunk->normals);
+    }
+
+    /* The materials have to be known before usemtl names can be resolved */
+    for (c = 0; c < num_chunks; c++) {
+        for (i = 0; i < arrlen(chunks[c].mtllibs); i++) {
+            join_path(mtl_path, sizeof(mtl_path), path, chunks[c].mtllibs[i]);
+            load_mtl(model, mtl_path);
+        }
+    }
+
+    table.heads = malloc((num_positions + 1) * sizeof(*table.heads));
+
+    if (table.heads == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for OBJ vertices\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(table.heads, 0xff, num_positions * sizeof(*table.heads));
+
+    /* Usually about as many vertices as positions, seams add a few more */
+    arrsetcap(table.keys, num_positions);
+    arrsetcap(model->vertices, num_positions);
+    arrsetlen(model->indices, num_corners);
+
+    base_positions = 0;
+    base_tex_coords = 0;
+    base_normals = 0;
+    base_corners = 0;
+
+    for (c = 0; c < num_chunks && ok; c++) {
+        chunk = &chunks[c];
+
+        for (i = 0, j = 0; i < arrlen(chunk->corners) && ok; i++) {
+            corner = &chunk->corners[i];
+
+            /* Close the material run at each usemtl in this chunk */
+            for (; j < arrlen(chunk->usemtls) && chunk->usemtls[j].corner <= i;
+                 j++) {
+                if (base_corners + i > run_start)
+                    push_submesh(model, run_start,
+                                 base_corners + i - run_start, material);
+
+                material = find_material(model, chunk->usemtls[j].name);
+                run_start = base_corners + i;
+            }
+
+            ok = resolve_index(corner->v, corner->relative & RELATIVE_V,
+                               base_positions, num_positions, &v)
+                 && v != NO_VERTEX
+                 && resolve_index(corner->vt, corner->relative & RELATIVE_VT,
+                                  base_tex_coords, num_tex_coords, &vt)
+                 && resolve_index(corner->vn, corner->relative & RELATIVE_VN,
+                                  base_normals, num_normals, &vn);
+
+            if (ok)
+                model->indices[base_corners + i] =
+                    find_vertex(&table, model, v, vt, vn, positions,
+                                tex_coords, normals);
+        }
+
+        /* A usemtl after the last face of the chunk */
+        for (; j < arrlen(chunk->usemtls) && ok; j++) {
+            if (base_corners + i > run_start)
+                push_submesh(model, run_start, base_corners + i - run_start,
+                             material);
+
+            material = find_material(model, chunk->usemtls[j].name);
+            run_start = base_corners + i;
+        }
+
+        base_positions += arrlen(chunk->positions);
+        base_tex_coords += arrlen(chunk->tex_coords);
+        base_normals += arrlen(chunk->normals);
+        base_corners += arrlen(chunk->corners);
+    }
+
+    if (ok && num_corners > run_start)
+        push_submesh(model, run_start, num_corners - run_start, material);
+
+    /*
+     * The table only merges corners with the same v/vt/vn indices. Files
+     * that repeat a v line for every face still have duplicates, and the
+     * index count and so the submeshes are not changed by welding them
+     */
+    if (ok)
+        weld_vertices(&model->vertices, &model->indices, NULL);
+
+    if (!ok)
+        fprintf(stderr, "Error: Face index out of range in OBJ file: %s\n",
+                path);
+    else if (bad_lines > 0)
+        fprintf(stderr, "Error: Skipped %u malformed lines in OBJ file: %s\n",
+                bad_lines, path);
+
+    for (c = 0; c < num_chunks; c++) {
+        arrfree(chunks[c].positions);
+        arrfree(chunks[c].tex_coords);
+        arrfree(chunks[c].normals);
+        arrfree(chunks[c].corners);
+        arrfree(chunks[c].usemtls);
+        arrfree(chunks[c].mtllibs);
+    }
+
+    free(chunks);
+    free(table.heads);
+    arrfree(table.keys);
+    free(positions);
+    free(tex_coords);
+    free(normals);
+    munmap((void *)text, size);
+
+    if (!ok)
+        free_obj(model);
+
+    return ok;
+}
+
+void
+free_obj(obj_model *model)
+{
+    arrfree(model->vertices);
+    arrfree(model->indices);
+    arrfree(model->submeshes);
+    arrfree(model->materials);
+}
+
+static void
+parse_chunk(unsigned int task, void *data)
+{
+    obj_chunk *chunk = (obj_chunk *)data + task;
+    const char *end = chunk->end;
+    const char *p = chunk->start;
+    const char *rest;
+    float *values;
+    obj_usemtl usemtl;
+
+    for (; p < end; p = next_line(p, end)) {
+        p = skip_blanks(p, end);
+
+        if (p == end)
+            break;
+
+        /* Sorted roughly by how common each line is */
+        if ((rest = match_keyword(p, end, "v")) != NULL) {
+            values = *arraddnptr(chunk->positions, 1);
+            parse_floats(rest, end, values, 3);
+        }
+        else if ((rest = match_keyword(p, end, "f")) != NULL) {
+            if (!parse_face(chunk, rest, end))
+                chunk->bad_lines++;
+        }
+        else if ((rest = match_keyword(p, end, "vn")) != NULL) {
+            values = *arraddnptr(chunk->normals, 1);
+            parse_floats(rest, end, values, 3);
+        }
+        else if ((rest = match_keyword(p, end, "vt")) != NULL) {
+            values = *arraddnptr(chunk->tex_coords, 1);
+            parse_floats(rest, end, values, 2);
+        }
+        else if ((rest = match_keyword(p, end, "usemtl")) != NULL) {
+            usemtl.corner = arrlen(chunk->corners);
+            copy_rest(rest, end, usemtl.name, sizeof(usemtl.name));
+            arrput(chunk->usemtls, usemtl);
+        }
+        else if ((rest = match_keyword(p, end, "mtllib")) != NULL) {
+            copy_rest(rest, end, *arraddnptr(chunk->mtllibs, 1),
+                      OBJ_PATH_SIZE);
+        }
+    }
+}
+
+static bool
+parse_face(obj_chunk *chunk, const char *p, const char *end)
+{
+    obj_corner first;
+    obj_corner prev;
+    obj_corner corner;
+    unsigned int count = 0;
+
+    for (;;) {
+        p = skip_blanks(p, end);
+
+        if (p == end || *p == '\n' || *p == '\r' || *p == '#')
+            break;
+
+        if (!parse_corner(&p, end, chunk, &corner))
+            return false;
+
+        /* Polygons become a fan around the first corner */
+        if (count == 0) {
+            first = corner;
+        }
+        else if (count >= 2) {
+            arrput(chunk->corners, first);
+            arrput(chunk->corners, prev);
+            arrput(chunk->corners, corner);
+        }
+
+        prev = corner;
+        count++;
+    }
+
+    return count >= 3;
+}
+
+static bool
+parse_corner(const char **p, const char *end, const obj_chunk *chunk,
+             obj_corner *corner)
+{
+    int value;
+
+    corner->relative = 0;
+    corner->vt = NO_INDEX;
+    corner->vn = NO_INDEX;
+
+    if (!parse_int(p, end, &value) || value == 0)
+        return false;
+
+    corner->v = store_index(value, arrlen(chunk->positions), RELATIVE_V,
+                            corner);
+
+    if (*p == end || **p != '/')
+        return true;
+
+    (*p)++;
+
+    if (*p < end && **p != '/') {
+        if (!parse_int(p, end, &value) || value == 0)
+            return false;
+
+        corner->vt = store_index(value, arrlen(chunk->tex_coords), RELATIVE_VT,
+                                 corner);
+    }
+
+    if (*p == end || **p != '/')
+        return true;
+
+    (*p)++;
+
+    if (!parse_int(p, end, &value) || value == 0)
+        return false;
+
+    corner->vn = store_index(value, arrlen(chunk->normals), RELATIVE_VN,
+                             corner);
+
+    return true;
+}
+
+static int
+store_index(int value, size_t local_count, unsigned int flag,
+            obj_corner *corner)
+{
+    if (value > 0)
+        return value - 1;
+
+    /* May point before the chunk, resolving adds the chunk's base */
+    corner->relative |= flag;
+
+    return (int)local_count + value;
+}
+
+static bool
+parse_int(const char **p, const char *end, int *value)
+{
+    const char *s = *p;
+    const char *digits;
+    bool negative = false;
+    long result = 0;
+
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    for (digits = s; s < end && *s >= '0' && *s <= '9'; s++)
+        if (result <= INT_MAX)
+            result = result * 10 + (*s - '0');
+
+    if (s == digits || result > INT_MAX)
+        return false;
+
+    *p = s;
+    *value = negative ? -(int)result : (int)result;
+
+    return true;
+}
+
+static void
+parse_floats(const char *p, const char *end, float *values, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        p = skip_blanks(p, end);
+        values[i] = parse_float(&p, end);
+    }
+}
+
+static void
+copy_rest(const char *p, const char *end, char *dst, size_t size)
+{
+    const char *last;
+    size_t length;
+
+    p = skip_blanks(p, end);
+
+    for (last = p; last < end && *last != '\n' && *last != '\r'; last++)
+        ;
+
+    while (last > p && (last[-1] == ' ' || last[-1] == '\t'))
+        last--;
+
+    length = (size_t)(last - p) < size - 1 ? (size_t)(last - p) : size - 1;
+
+    memcpy(dst, p, length);
+    dst[length] = '\0';
+}
+
+static bool
+resolve_index(int index, bool relative, size_t base, size_t count,
+              uint32_t *resolved)
+{
+    long global;
+
+    if (index == NO_INDEX) {
+        *resolved = NO_VERTEX;
+        return true;
+    }
+
+    global = relative ? (long)base + index : index;
+
+    if (global < 0 || (size_t)global >= count)
+        return false;
+
+    *resolved = global;
+
+    return true;
+}
+
+static uint32_t
+find_vertex(vertex_table *table, obj_model *model, uint32_t v, uint32_t vt,
+            uint32_t vn, const vec3 *positions, const vec2 *tex_coords,
+            const vec3 *normals)
+{
+    vertex_key key;
+    vertex *new_vertex;
+    uint32_t index;
+
+    for (index = table->heads[v]; index != NO_VERTEX;
+         index = table->keys[index].next) {
+        if (table->keys[index].vt == vt && table->keys[index].vn == vn)
+            return index;
+    }
+
+    index = arrlen(model->vertices);
+
+    key.vt = vt;
+    key.vn = vn;
+    key.next = table->heads[v];
+    table->heads[v] = index;
+    arrput(table->keys, key);
+
+    new_vertex = arraddnptr(model->vertices, 1);
+
+    memcpy(new_vertex->position, positions[v], sizeof(new_vertex->position));
+
+    if (vt != NO_VERTEX)
+        memcpy(new_vertex->tex_coords, tex_coords[vt],
+               sizeof(new_vertex->tex_coords));
+    else
+        memset(new_vertex->tex_coords, 0, sizeof(new_vertex->tex_coords));
+
+    if (vn != NO_VERTEX)
+        memcpy(new_vertex->normal, normals[vn], sizeof(new_vertex->normal));
+    else
+        memset(new_vertex->normal, 0, sizeof(new_vertex->normal));
+
+    return index;
+}
+
+static void
+load_mtl(obj_model *model, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    obj_material *mat = NULL;
+    char line[1024];
+    char map[OBJ_PATH_SIZE];
+    const char *end;
+    const char *p;
+    const char *rest;
+    const char *name;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open MTL file: %s\n", path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        end = line + strlen(line);
+        p = skip_blanks(line, end);
+
+        if ((rest = match_keyword(p, end, "newmtl")) != NULL) {
+            mat = arraddnptr(model->materials, 1);
+            memset(mat, 0, sizeof(*mat));
+            copy_rest(rest, end, mat->name, sizeof(mat->name));
+
+            /* The MTL defaults */
+            mat->diffuse[0] = mat->diffuse[1] = mat->diffuse[2] = 0.8f;
+            mat->shininess = 32.0f;
+            continue;
+        }
+
+        if (mat == NULL)
+            continue;
+
+        if ((rest = match_keyword(p, end, "Kd")) != NULL)
+            parse_floats(rest, end, mat->diffuse, 3);
+        else if ((rest = match_keyword(p, end, "Ks")) != NULL)
+            parse_floats(rest, end, mat->specular, 3);
+        else if ((rest = match_keyword(p, end, "Ns")) != NULL)
+            parse_floats(rest, end, &mat->shininess, 1);
+        else if ((rest = match_keyword(p, end, "map_Kd")) != NULL
+                 || (rest = match_keyword(p, end, "map_Ks")) != NULL
+                 || (rest = match_keyword(p, end, "map_Bump")) != NULL
+                 || (rest = match_keyword(p, end, "map_bump")) != NULL
+                 || (rest = match_keyword(p, end, "bump")) != NULL
+                 || (rest = match_keyword(p, end, "norm")) != NULL) {
+            /* Options like -bm 1 come first, the file name is last */
+            copy_rest(rest, end, map, sizeof(map));
+            name = strrchr(map, ' ');
+            name = name != NULL ? name + 1 : map;
+
+            if (p[4] == 'K' && p[5] == 'd')
+                join_path(mat->diffuse_map, OBJ_PATH_SIZE, path, name);
+            else if (p[4] == 'K' && p[5] == 's')
+                join_path(mat->specular_map, OBJ_PATH_SIZE, path, name);
+            else
+                join_path(mat->normal_map, OBJ_PATH_SIZE, path, name);
+        }
+    }
+
+    fclose(file);
+}
+
+static uint32_t
+find_material(obj_model *model, const char *name)
+{
+    obj_material *mat;
+    size_t i;
+
+    for (i = 0; i < arrlen(model->materials); i++)
+        if (strcmp(model->materials[i].name, name) == 0)
+            return i;
+
+    /* Not in any MTL file, draw it plain grey rather than fail */
+    mat = arraddnptr(model->materials, 1);
+    memset(mat, 0, sizeof(*mat));
+    snprintf(mat->name, sizeof(mat->name), "%s", name);
+    mat->diffuse[0] = mat->diffuse[1] = mat->diffuse[2] = 0.8f;
+    mat->shininess = 32.0f;
+
+    return arrlen(model->materials) - 1;
+}
+
+static void
+push_submesh(obj_model *model, size_t first_index, size_t count,
+             uint32_t material)
+{
+    mesh_file_submesh submesh = {0};
+    mesh_file_submesh *last;
+
+    if (arrlen(model->submeshes) > 0) {
+        last = &arrlast(model->submeshes);
+
+        if (last->material == material
+            && last->first_index + last->count == first_index) {
+            last->count += count;
+            return;
+        }
+    }
+
+    submesh.first_index = first_index;
+    submesh.count = count;
+    submesh.material = material;
+
+    arrput(model->submeshes, submesh);
+}
+
+static void
+join_path(char *dst, size_t size, const char *file, const char *relative)
+{
+    const char *slash = strrchr(file, '/');
+
+    if (relative[0] == '/' || slash == NULL)
+        snprintf(dst, size, "%s", relative);
+    else
+        snprintf(dst, size, "%.*s/%s", (int)(slash - file), file, relative);
+}
+
+/* EOF */
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+#include "../include/pbo_ring.h"
+
+#include <glad/glad.h>
+
+/* How long to block on a fence before checking again, in nanoseconds */
+#define FENCE_TIMEOUT 1000000000
+
+/**
+ * @brief Blocks until the GPU has read a buffer, then drops its fence
+ *
+ * @param[in, out] ring The ring
+ * @param[in] slot The buffer about to be rewritten
+ */
+static void wait_slot(pbo_ring *ring, unsigned int slot);
+
+void
+create_pbo_ring(pbo_ring *ring)
+{
+    unsigned int i;
+
+    glGenBuffers(PBO_RING_SIZE, ring->buffers);
+
+    for (i = 0; i < PBO_RING_SIZE; i++) {
+        ring->sizes[i] = 0;
+        ring->fences[i] = NULL;
+    }
+
+    ring->slot = 0;
+    ring->stalls = 0;
+}
+
+unsigned char *
+begin_pixel_upload(pbo_ring *ring, size_t size)
+{
+    unsigned int slot = ring->slot;
+    unsigned char *mapped;
+
+    wait_slot(ring, slot);
+
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring->buffers[slot]);
+
+    /* Buffers only grow, so they settle at the largest upload */
+    if (size > ring->sizes[slot]) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        ring->sizes[slot] = size;
+        track_gpu_buffer(ring->buffers[slot], MEMORY_TEXTURE, size);
+    }
+
+    /* The fence already did the synchronizing, so the driver need not */
+    mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                              GL_MAP_WRITE_BIT
+                              | GL_MAP_INVALIDATE_BUFFER_BIT
+                              | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    if (mapped == NULL) {
+        fprintf(stderr, "Error: Could not map pixel upload buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return mapped;
+}
+
+void
+end_pixel_upload(pbo_ring *ring)
+{
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring->buffers[ring->slot]);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+void
+finish_pixel_upload(pbo_ring *ring)
+{
+    ring->fences[ring->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    /* Later uploads from client memory must not read from the buffer */
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    ring->slot = (ring->slot + 1) % PBO_RING_SIZE;
+}
+
+void
+delete_pbo_ring(pbo_ring *ring)
+{
+    unsigned int i;
+
+    for (i = 0; i < PBO_RING_SIZE; i++) {
+        if (ring->fences[i] != NULL)
+            glDeleteSync(ring->fences[i]);
+        ring->fences[i] = NULL;
+
+        state_delete_buffer(ring->buffers[i]);
+    }
+}
+
+static void
+wait_slot(pbo_ring *ring, unsigned int slot)
+{
+    GLenum status;
+
+    if (ring->fences[slot] == NULL)
+        return;
+
+    status = glClientWaitSync(ring->fences[slot], 0, 0);
+
+    if (status == GL_TIMEOUT_EXPIRED) {
+        ring->stalls++;
+
+        do {
+            status = glClientWaitSync(ring->fences[slot],
+                                      GL_SYNC_FLUSH_COMMANDS_BIT,
+                                      FENCE_TIMEOUT);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+    if (status == GL_WAIT_FAILED) {
+        fprintf(stderr, "Error: Waiting on a pixel upload fence failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    glDeleteSync(ring->fences[slot]);
+    ring->fences[slot] = NULL;
+}
+
+/* EOF */
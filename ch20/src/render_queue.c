@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/cmd_buffer.h"
+#include "../include/job.h"
+#include "../include/render_queue.h"
+
+#include <stb_ds.h>
+#include <glad/glad.h>
+
+/* Marks GL state that has not been set yet during a flush */
+#define UNKNOWN_STATE (~0u)
+
+/*
+ * Below this many packets per thread, recording in parallel is not worth it.
+ * main batches its cubes into a few instanced packets, so it always records
+ * on one thread. bench_frame queues a packet per cube and pass, which is
+ * what runs the parallel path
+ */
+#define MIN_PACKETS_PER_CHUNK 512
+
+/**
+ * @brief Sorts the items by key with an 8-bit LSD radix sort
+ *
+ * @param[in, out] items The items to sort
+ * @param[in, out] scratch A buffer at least as long as items
+ * @param[in] count The number of items
+ *
+ * @return Whichever of the two buffers holds the sorted items
+ */
+static sort_item *radix_sort(sort_item *items, sort_item *scratch,
+                             size_t count);
+
+/**
+ * @brief Records one contiguous range of the sorted packets into the chunk's
+ * own command buffer. Runs on the worker threads
+ *
+ * @param[in] chunk The index of the range
+ * @param[in, out] data The render queue
+ */
+static void record_chunk(unsigned int chunk, void *data);
+
+/**
+ * @brief Records the commands for a range of the sorted packets, skipping
+ * state that is already set
+ *
+ * @param[in] rq The render queue, already sorted
+ * @param[in, out] cb The command buffer to record into
+ * @param[in] start The first sorted packet to record
+ * @param[in] end One past the last sorted packet to record
+ * @param[out] stats The bind counters of the range
+ */
+static void record_packets(render_queue *rq, cmd_buffer *cb, size_t start,
+                           size_t end, render_stats *stats);
+
+void
+create_render_queue(render_queue *rq,
+                    void (*begin_pass)(unsigned int pass, void *user),
+                    void (*end_pass)(unsigned int pass, void *user),
+                    void *user)
+{
+    memset(rq, 0, sizeof(*rq));
+
+    rq->begin_pass = begin_pass;
+    rq->end_pass = end_pass;
+    rq->user = user;
+}
+
+void
+init_program_info(program_info *info, const shader *sh)
+{
+    info->id = sh->ID;
+
+    info->model_loc = glGetUniformLocation(sh->ID, "model");
+    info->norm_loc = glGetUniformLocation(sh->ID, "norm");
+    info->shininess_loc = glGetUniformLocation(sh->ID, "material.shininess");
+}
+
+void
+init_material(material *mat, const unsigned int *textures,
+              unsigned int num_textures, float shininess)
+{
+    /* 0 is reserved for draws without a material */
+    static unsigned int next_id = 1;
+
+    if (num_textures > MAX_MATERIAL_TEXTURES) {
+        fprintf(stderr, "Error: Materials can use at most %d textures\n",
+                MAX_MATERIAL_TEXTURES);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(mat, 0, sizeof(*mat));
+
+    mat->id = next_id++;
+
+    if (num_textures > 0)
+        memcpy(mat->textures, textures, num_textures * sizeof(*textures));
+    mat->num_textures = num_textures;
+    mat->texture_target = GL_TEXTURE_2D;
+    mat->shininess = shininess;
+}
+
+uint64_t
+make_render_key(unsigned int pass, unsigned int program, unsigned int material,
+                unsigned int vao, float depth)
+{
+    uint64_t key = 0;
+    uint64_t depth_bits;
+
+    if (depth < 0.0f)
+        depth = 0.0f;
+    if (depth > 1.0f)
+        depth = 1.0f;
+
+    depth_bits = (uint64_t)(depth * ((1u << KEY_DEPTH_BITS) - 1));
+
+    key |= ((uint64_t)pass & ((1u << KEY_PASS_BITS) - 1)) << KEY_PASS_SHIFT;
+    key |= ((uint64_t)program & ((1u << KEY_PROGRAM_BITS) - 1))
+           << KEY_PROGRAM_SHIFT;
+    key |= ((uint64_t)material & ((1u << KEY_MATERIAL_BITS) - 1))
+           << KEY_MATERIAL_SHIFT;
+    key |= ((uint64_t)vao & ((1u << KEY_VAO_BITS) - 1)) << KEY_VAO_SHIFT;
+    key |= depth_bits << KEY_DEPTH_SHIFT;
+
+    return key;
+}
+
+draw_packet *
+push_draw_packet(render_queue *rq)
+{
+    return reserve_draw_packets(rq, 1);
+}
+
+draw_packet *
+reserve_draw_packets(render_queue *rq, size_t count)
+{
+    draw_packet *packets = arraddnptr(rq->packets, count);
+
+    memset(packets, 0, count * sizeof(*packets));
+
+    return packets;
+}
+
+void
+flush_render_queue(render_queue *rq)
+{
+    record_render_queue(rq);
+    replay_render_queue(rq);
+}
+
+void
+record_render_queue(render_queue *rq)
+{
+    size_t count = arrlen(rq->packets);
+    size_t i;
+    unsigned int num_chunks;
+
+    rq->num_chunks = 0;
+
+    if (count == 0)
+        return;
+
+    /* Growing keeps its capacity, so steady-state frames never allocate */
+    arrsetlen(rq->items, count);
+    arrsetlen(rq->scratch, count);
+
+    for (i = 0; i < count; i++) {
+        rq->items[i].key = rq->packets[i].key;
+        rq->items[i].index = i;
+    }
+
+    rq->sorted = radix_sort(rq->items, rq->scratch, count);
+
+    /* Small queues are recorded on this thread alone */
+    num_chunks = count / MIN_PACKETS_PER_CHUNK;
+
+    if (num_chunks < 1)
+        num_chunks = 1;
+    if (num_chunks > num_job_threads())
+        num_chunks = num_job_threads();
+
+    while (arrlen(rq->buffers) < num_chunks)
+        create_cmd_buffer(arraddnptr(rq->buffers, 1));
+
+    arrsetlen(rq->chunk_stats, num_chunks);
+    rq->num_chunks = num_chunks;
+
+    parallel_for(num_chunks, record_chunk, rq);
+
+    /* The commands hold copies of everything they use from the packets */
+    arrsetlen(rq->packets, 0);
+}
+
+void
+replay_render_queue(render_queue *rq)
+{
+    unsigned int chunk;
+    render_stats *stats;
+
+    memset(&rq->stats, 0, sizeof(rq->stats));
+
+    /* GL only gets touched here, in sorted order, on the context's thread */
+    for (chunk = 0; chunk < rq->num_chunks; chunk++) {
+        replay_cmd_buffer(&rq->buffers[chunk], rq->begin_pass, rq->end_pass,
+                          rq->user);
+
+        stats = &rq->chunk_stats[chunk];
+
+        rq->stats.draws += stats->draws;
+        rq->stats.program_binds += stats->program_binds;
+        rq->stats.program_skips += stats->program_skips;
+        rq->stats.texture_binds += stats->texture_binds;
+        rq->stats.texture_skips += stats->texture_skips;
+        rq->stats.vao_binds += stats->vao_binds;
+        rq->stats.vao_skips += stats->vao_skips;
+    }
+}
+
+void
+delete_render_queue(render_queue *rq)
+{
+    size_t i;
+
+    for (i = 0; i < arrlen(rq->buffers); i++)
+        delete_cmd_buffer(&rq->buffers[i]);
+
+    arrfree(rq->buffers);
+    arrfree(rq->chunk_stats);
+    arrfree(rq->packets);
+    arrfree(rq->items);
+    arrfree(rq->scratch);
+}
+
+static void
+record_chunk(unsigned int chunk, void *data)
+{
+    render_queue *rq = data;
+    size_t count = arrlen(rq->packets);
+
+    size_t start = count * chunk / rq->num_chunks;
+    size_t end = count * (chunk + 1) / rq->num_chunks;
+
+    reset_cmd_buffer(&rq->buffers[chunk]);
+    record_packets(rq, &rq->buffers[chunk], start, end,
+                   &rq->chunk_stats[chunk]);
+}
+
+static void
+record_packets(render_queue *rq, cmd_buffer *cb, size_t start, size_t end,
+               render_stats *stats)
+{
+    size_t count = arrlen(rq->packets);
+    size_t i;
+    unsigned int unit;
+
+    const draw_packet *packet;
+    const draw_packet *prev;
+
+    unsigned int pass = UNKNOWN_STATE;
+    unsigned int cur_program = UNKNOWN_STATE;
+    const material *cur_material = NULL;
+    unsigned int cur_vao = UNKNOWN_STATE;
+    unsigned int bound_textures[MAX_MATERIAL_TEXTURES];
+
+    unsigned int index_type;
+    size_t offset;
+    bool program_changed;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (unit = 0; unit < MAX_MATERIAL_TEXTURES; unit++)
+        bound_textures[unit] = UNKNOWN_STATE;
+
+    /*
+     * The chunks before this one are replayed first, so the state they leave
+     * behind is whatever the previous packet set. Textures bound further back
+     * are not known here, so a chunk may record a bind the state cache then
+     * filters on replay
+     */
+    if (start > 0) {
+        prev = &rq->packets[rq->sorted[start - 1].index];
+
+        pass = prev->key >> KEY_PASS_SHIFT;
+        cur_program = prev->program->id;
+        cur_material = prev->material;
+        cur_vao = prev->vao;
+
+        if (prev->material != NULL)
+            for (unit = 0; unit < prev->material->num_textures; unit++)
+                bound_textures[unit] = prev->material->textures[unit];
+    }
+
+    for (i = start; i < end; i++) {
+        packet = &rq->packets[rq->sorted[i].index];
+
+        if ((packet->key >> KEY_PASS_SHIFT) != pass) {
+            if (pass != UNKNOWN_STATE)
+                cmd_end_pass(cb, pass);
+
+            pass = packet->key >> KEY_PASS_SHIFT;
+            cmd_begin_pass(cb, pass);
+        }
+
+        program_changed = packet->program->id != cur_program;
+
+        if (program_changed) {
+            cmd_use_program(cb, packet->program->id);
+            cur_program = packet->program->id;
+            stats->program_binds++;
+        }
+        else {
+            stats->program_skips++;
+        }
+
+        /* Uniforms are per-program state, so a new program needs them again */
+        if (packet->material != NULL
+            && (program_changed || packet->material != cur_material)) {
+            for (unit = 0; unit < packet->material->num_textures; unit++) {
+                if (bound_textures[unit] == packet->material->textures[unit]) {
+                    stats->texture_skips++;
+                    continue;
+                }
+
+                cmd_bind_texture(cb, unit, packet->material->texture_target,
+                                 packet->material->textures[unit]);
+                bound_textures[unit] = packet->material->textures[unit];
+                stats->texture_binds++;
+            }
+
+            if (packet->program->shininess_loc >= 0)
+                cmd_uniform_1f(cb, packet->program->shininess_loc,
+                               packet->material->shininess);
+
+            cur_material = packet->material;
+        }
+        else if (packet->material != NULL) {
+            stats->texture_skips += packet->material->num_textures;
+        }
+
+        if (packet->vao != cur_vao) {
+            cmd_bind_vertex_array(cb, packet->vao);
+            cur_vao = packet->vao;
+            stats->vao_binds++;
+        }
+        else {
+            stats->vao_skips++;
+        }
+
+        if (packet->multi != NULL) {
+            cmd_multi_draw(cb, packet->multi, GL_TRIANGLES);
+            stats->draws++;
+            continue;
+        }
+
+        /* The offset is in bytes, so it scales with the index size */
+        index_type = packet->index_type != 0 ? packet->index_type
+                                             : GL_UNSIGNED_INT;
+        offset = packet->first_index
+                 * (index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t)
+                                                    : sizeof(uint32_t));
+
+        if (packet->instance_count > 0) {
+            cmd_draw_elements_instanced(cb, GL_TRIANGLES, packet->count,
+                                        index_type, offset,
+                                        packet->instance_count);
+            stats->draws++;
+            continue;
+        }
+
+        if (packet->program->model_loc >= 0)
+            cmd_uniform_mat4fv(cb, packet->program->model_loc,
+                               (const float *)packet->model);
+
+        if (packet->program->norm_loc >= 0)
+            cmd_uniform_mat3fv(cb, packet->program->norm_loc,
+                               (const float *)packet->norm);
+
+        cmd_draw_elements(cb, GL_TRIANGLES, packet->count, index_type,
+                          offset);
+        stats->draws++;
+    }
+
+    /* The pass only ends here if the next chunk does not continue it */
+    if (pass != UNKNOWN_STATE
+        && (end == count
+            || (rq->packets[rq->sorted[end].index].key >> KEY_PASS_SHIFT)
+               != pass))
+        cmd_end_pass(cb, pass);
+}
+
+static sort_item *
+radix_sort(sort_item *items, sort_item *scratch, size_t count)
+{
+    size_t histogram[8][256];
+    size_t offsets[256];
+    size_t i;
+    size_t sum;
+    unsigned int byte;
+    unsigned int b;
+
+    sort_item *src = items;
+    sort_item *dst = scratch;
+    sort_item *temp;
+
+    memset(histogram, 0, sizeof(histogram));
+
+    /* Build every histogram in a single pass over the keys */
+    for (i = 0; i < count; i++)
+        for (byte = 0; byte < 8; byte++)
+            histogram[byte][(items[i].key >> (byte * 8)) & 0xff]++;
+
+    for (byte = 0; byte < 8; byte++) {
+        /* Every key has the same value in this byte, nothing to reorder */
+        if (histogram[byte][(items[0].key >> (byte * 8)) & 0xff] == count)
+            continue;
+
+        sum = 0;
+        for (b = 0; b < 256; b++) {
+            offsets[b] = sum;
+            sum += histogram[byte][b];
+        }
+
+        for (i = 0; i < count; i++)
+            dst[offsets[(src[i].key >> (byte * 8)) & 0xff]++] = src[i];
+
+        temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    return src;
+}
+
+/* EOF */
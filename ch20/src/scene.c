@@ -0,0 +1,558 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/file_parse.h"
+#include "../include/scene.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+_Static_assert(sizeof(unsigned int) == sizeof(uint32_t),
+               "Parents and material ids are copied straight from cooked "
+               "files");
+
+/**
+ * @brief Fills a scene from the text form
+ *
+ * @param[out] s The scene, zeroed
+ * @param[in] p The start of the text
+ * @param[in] end The end of the text
+ * @param[in] path The path, for errors
+ *
+ * @return Whether every line was valid
+ */
+static bool parse_scene_text(scene *s, const char *p, const char *end,
+                             const char *path);
+
+/**
+ * @brief Fills a scene from the cooked form
+ *
+ * @param[out] s The scene, zeroed
+ * @param[in] data The file
+ * @param[in] size The size of the file
+ *
+ * @return Whether the file is a valid scene file of this version
+ */
+static bool load_cooked_scene(scene *s, const char *data, size_t size);
+
+/**
+ * @brief Parses the rest of an object line and adds the object
+ *
+ * @param[in, out] s The scene
+ * @param[in] p After the keyword
+ * @param[in] end The end of the text
+ *
+ * @return Whether the line was valid
+ */
+static bool parse_object(scene *s, const char *p, const char *end);
+
+/**
+ * @brief Parses the rest of a material line and adds the material
+ *
+ * @param[in, out] s The scene
+ * @param[in] p After the keyword
+ * @param[in] end The end of the text
+ *
+ * @return Whether the line was valid
+ */
+static bool parse_material(scene *s, const char *p, const char *end);
+
+/**
+ * @brief Parses the rest of a light line and adds the light
+ *
+ * @param[in, out] s The scene
+ * @param[in] type The type of light the keyword named
+ * @param[in] p After the keyword
+ * @param[in] end The end of the text
+ *
+ * @return Whether the line was valid
+ */
+static bool parse_light(scene *s, scene_light_type type, const char *p,
+                        const char *end);
+
+/**
+ * @brief Parses a run of blank separated numbers
+ *
+ * @param[in, out] p The cursor, moved past the numbers
+ * @param[in] end The end of the text
+ * @param[out] values The numbers
+ * @param[in] count How many to parse
+ *
+ * @return Whether every number was there
+ */
+static bool parse_floats(const char **p, const char *end, float *values,
+                         int count);
+
+/**
+ * @brief Parses a blank separated unsigned integer
+ *
+ * @param[in, out] p The cursor, moved past the number
+ * @param[in] end The end of the text
+ * @param[out] value The number
+ *
+ * @return Whether there was a number and it fit in 32 bits
+ */
+static bool parse_uint(const char **p, const char *end, unsigned int *value);
+
+/**
+ * @brief Copies a blank separated word
+ *
+ * @param[in, out] p The cursor, moved past the word
+ * @param[in] end The end of the text
+ * @param[out] dst The buffer
+ * @param[in] size The size of the buffer
+ *
+ * @return Whether there was a word and it fit
+ */
+static bool copy_word(const char **p, const char *end, char *dst,
+                      size_t size);
+
+/**
+ * @brief Tests whether only blanks and a comment are left on a line
+ *
+ * @param[in] p The cursor
+ * @param[in] end The end of the text
+ *
+ * @return Whether the line is done
+ */
+static bool at_line_end(const char *p, const char *end);
+
+bool
+load_scene(scene *s, const char *path)
+{
+    struct stat info;
+    void *mapping;
+    size_t size;
+    bool ok;
+    int fd;
+
+    memset(s, 0, sizeof(*s));
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Could not open scene %s\n", path);
+
+        if (fd >= 0)
+            close(fd);
+
+        return false;
+    }
+
+    size = info.st_size;
+
+    /* An empty file is an empty scene, and cannot be mapped */
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map scene %s\n", path);
+        return false;
+    }
+
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    if (size >= 4 && memcmp(mapping, SCENE_FILE_MAGIC, 4) == 0) {
+        ok = load_cooked_scene(s, mapping, size);
+
+        if (!ok)
+            fprintf(stderr, "Error: %s is not a valid scene file of "
+                    "version %d\n", path, SCENE_FILE_VERSION);
+    }
+    else {
+        ok = parse_scene_text(s, mapping, (const char *)mapping + size,
+                              path);
+    }
+
+    munmap(mapping, size);
+
+    if (!ok)
+        free_scene(s);
+
+    return ok;
+}
+
+bool
+write_scene_file(const scene *s, const char *path)
+{
+    const transform_hierarchy *t = &s->transforms;
+    scene_file_header header = {0};
+    FILE *file;
+    bool ok;
+
+    memcpy(header.magic, SCENE_FILE_MAGIC, 4);
+    header.version = SCENE_FILE_VERSION;
+    header.byte_order = SCENE_FILE_BYTE_ORDER;
+
+    header.num_materials = arrlenu(s->materials);
+    header.num_lights = arrlenu(s->lights);
+    header.num_objects = t->count;
+
+    header.parent_offset = align_offset(sizeof(header), SCENE_FILE_ALIGNMENT);
+    header.position_offset = align_offset(
+        header.parent_offset + t->count * sizeof(uint32_t),
+        SCENE_FILE_ALIGNMENT);
+    header.rotation_offset = align_offset(
+        header.position_offset + t->count * sizeof(vec3),
+        SCENE_FILE_ALIGNMENT);
+    header.scale_offset = align_offset(
+        header.rotation_offset + t->count * sizeof(versor),
+        SCENE_FILE_ALIGNMENT);
+    header.material_id_offset = align_offset(
+        header.scale_offset + t->count * sizeof(vec3), SCENE_FILE_ALIGNMENT);
+    header.material_offset = align_offset(
+        header.material_id_offset + t->count * sizeof(uint32_t),
+        SCENE_FILE_ALIGNMENT);
+    header.light_offset = align_offset(
+        header.material_offset
+        + header.num_materials * sizeof(scene_material),
+        SCENE_FILE_ALIGNMENT);
+
+    file = fopen(path, "wb");
+
+    if (file == NULL)
+        return false;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1
+         && pad_to(file, header.parent_offset)
+         && fwrite(t->parents, sizeof(uint32_t), t->count, file) == t->count
+         && pad_to(file, header.position_offset)
+         && fwrite(t->positions, sizeof(vec3), t->count, file) == t->count
+         && pad_to(file, header.rotation_offset)
+         && fwrite(t->rotations, sizeof(versor), t->count, file) == t->count
+         && pad_to(file, header.scale_offset)
+         && fwrite(t->scales, sizeof(vec3), t->count, file) == t->count
+         && pad_to(file, header.material_id_offset)
+         && fwrite(s->material_ids, sizeof(uint32_t), t->count, file)
+            == t->count
+         && pad_to(file, header.material_offset)
+         && fwrite(s->materials, sizeof(scene_material),
+                   header.num_materials, file) == header.num_materials
+         && pad_to(file, header.light_offset)
+         && fwrite(s->lights, sizeof(scene_light), header.num_lights, file)
+            == header.num_lights;
+
+    if (fclose(file) != 0)
+        ok = false;
+
+    if (!ok)
+        remove(path);
+
+    return ok;
+}
+
+void
+free_scene(scene *s)
+{
+    free_transforms(&s->transforms);
+    arrfree(s->material_ids);
+    arrfree(s->materials);
+    arrfree(s->lights);
+
+    memset(s, 0, sizeof(*s));
+}
+
+static bool
+parse_scene_text(scene *s, const char *p, const char *end, const char *path)
+{
+    const char *rest;
+    size_t line;
+    size_t i;
+    bool ok;
+
+    for (line = 1; p < end; p = next_line(p, end), line++) {
+        p = skip_blanks(p, end);
+
+        if (at_line_end(p, end))
+            continue;
+
+        /* Objects come first, there are far more of them than the rest */
+        if ((rest = match_keyword(p, end, "object")) != NULL)
+            ok = parse_object(s, rest, end);
+        else if ((rest = match_keyword(p, end, "material")) != NULL)
+            ok = parse_material(s, rest, end);
+        else if ((rest = match_keyword(p, end, "dir_light")) != NULL)
+            ok = parse_light(s, SCENE_DIR_LIGHT, rest, end);
+        else if ((rest = match_keyword(p, end, "point_light")) != NULL)
+            ok = parse_light(s, SCENE_POINT_LIGHT, rest, end);
+        else if ((rest = match_keyword(p, end, "spot_light")) != NULL)
+            ok = parse_light(s, SCENE_SPOT_LIGHT, rest, end);
+        else
+            ok = false;
+
+        if (!ok) {
+            fprintf(stderr, "Error: %s:%zu: Malformed scene entry\n", path,
+                    line);
+            return false;
+        }
+    }
+
+    /* Materials may come after the objects that use them */
+    for (i = 0; i < s->transforms.count; i++) {
+        if (s->material_ids[i] >= arrlenu(s->materials)) {
+            fprintf(stderr, "Error: %s: Object %zu uses material %u of %zu\n",
+                    path, i, s->material_ids[i], arrlenu(s->materials));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+load_cooked_scene(scene *s, const char *data, size_t size)
+{
+    const scene_file_header *header = (const scene_file_header *)data;
+    transform_hierarchy *t = &s->transforms;
+    size_t n;
+    size_t i;
+
+    if (size < sizeof(*header)
+        || header->version != SCENE_FILE_VERSION
+        || header->byte_order != SCENE_FILE_BYTE_ORDER
+        || header->num_objects > SIZE_MAX / sizeof(versor)
+        || !check_section(size, header->parent_offset, header->num_objects,
+                          sizeof(uint32_t), SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->position_offset, header->num_objects,
+                          sizeof(vec3), SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->rotation_offset, header->num_objects,
+                          sizeof(versor), SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->scale_offset, header->num_objects,
+                          sizeof(vec3), SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->material_id_offset,
+                          header->num_objects, sizeof(uint32_t),
+                          SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->material_offset,
+                          header->num_materials, sizeof(scene_material),
+                          SCENE_FILE_ALIGNMENT)
+        || !check_section(size, header->light_offset, header->num_lights,
+                          sizeof(scene_light), SCENE_FILE_ALIGNMENT))
+        return false;
+
+    n = header->num_objects;
+
+    /* Each component array is one copy, nothing is parsed */
+    arrsetlen(t->parents, n);
+    arrsetlen(t->positions, n);
+    arrsetlen(t->rotations, n);
+    arrsetlen(t->scales, n);
+    arrsetlen(t->dirty, n);
+    arrsetlen(s->material_ids, n);
+    arrsetlen(s->materials, header->num_materials);
+    arrsetlen(s->lights, header->num_lights);
+
+    memcpy(t->parents, data + header->parent_offset, n * sizeof(uint32_t));
+    memcpy(t->positions, data + header->position_offset, n * sizeof(vec3));
+    memcpy(t->rotations, data + header->rotation_offset, n * sizeof(versor));
+    memcpy(t->scales, data + header->scale_offset, n * sizeof(vec3));
+    memcpy(s->material_ids, data + header->material_id_offset,
+           n * sizeof(uint32_t));
+    memcpy(s->materials, data + header->material_offset,
+           header->num_materials * sizeof(scene_material));
+    memcpy(s->lights, data + header->light_offset,
+           header->num_lights * sizeof(scene_light));
+
+    /* Every world matrix is computed on the first update */
+    memset(t->dirty, 1, n);
+    t->count = n;
+    t->first_dirty = 0;
+
+    for (i = 0; i < n; i++)
+        if (s->material_ids[i] >= header->num_materials
+            || (t->parents[i] != TRANSFORM_NO_PARENT && t->parents[i] >= i))
+            return false;
+
+    for (i = 0; i < header->num_materials; i++) {
+        s->materials[i].diffuse_map[SCENE_PATH_SIZE - 1] = '\0';
+        s->materials[i].specular_map[SCENE_PATH_SIZE - 1] = '\0';
+    }
+
+    for (i = 0; i < header->num_lights; i++)
+        if (s->lights[i].type > SCENE_SPOT_LIGHT)
+            return false;
+
+    return true;
+}
+
+static bool
+parse_object(scene *s, const char *p, const char *end)
+{
+    /* Position, rotation axis, angle and scale */
+    float values[10];
+    versor rotation;
+    unsigned int material;
+    unsigned int parent = TRANSFORM_NO_PARENT;
+
+    if (!parse_floats(&p, end, values, 10) || !parse_uint(&p, end, &material))
+        return false;
+
+    /* Parents come first, so the hierarchy is sorted as it is read */
+    if (!at_line_end(p, end)
+        && (!parse_uint(&p, end, &parent)
+            || parent >= s->transforms.count))
+        return false;
+
+    if (!at_line_end(p, end))
+        return false;
+
+    /* glm_quatv would divide a zero axis by its zero length */
+    if (glm_vec3_norm2(values + 3) > 0.0f)
+        glm_quatv(rotation, glm_rad(values[6]), values + 3);
+    else
+        glm_quat_identity(rotation);
+
+    add_transform(&s->transforms, parent, values, rotation, values + 7);
+    arrput(s->material_ids, material);
+
+    return true;
+}
+
+static bool
+parse_material(scene *s, const char *p, const char *end)
+{
+    scene_material material = {0};
+
+    if (!copy_word(&p, end, material.diffuse_map,
+                   sizeof(material.diffuse_map))
+        || !copy_word(&p, end, material.specular_map,
+                      sizeof(material.specular_map))
+        || !parse_floats(&p, end, &material.shininess, 1)
+        || !at_line_end(p, end))
+        return false;
+
+    arrput(s->materials, material);
+
+    return true;
+}
+
+static bool
+parse_light(scene *s, scene_light_type type, const char *p, const char *end)
+{
+    scene_light light = {0};
+    float cut_offs[2];
+    bool ok;
+
+    light.type = type;
+
+    switch (type) {
+    case SCENE_DIR_LIGHT:
+        ok = parse_floats(&p, end, light.direction, 3)
+             && parse_floats(&p, end, light.ambient, 3)
+             && parse_floats(&p, end, light.diffuse, 3)
+             && parse_floats(&p, end, light.specular, 3);
+        break;
+
+    case SCENE_POINT_LIGHT:
+        ok = parse_floats(&p, end, light.position, 3)
+             && parse_floats(&p, end, light.ambient, 3)
+             && parse_floats(&p, end, light.diffuse, 3)
+             && parse_floats(&p, end, light.specular, 3)
+             && parse_floats(&p, end, &light.constant, 1)
+             && parse_floats(&p, end, &light.linear, 1)
+             && parse_floats(&p, end, &light.quadratic, 1);
+        break;
+
+    default:
+        ok = parse_floats(&p, end, light.ambient, 3)
+             && parse_floats(&p, end, light.diffuse, 3)
+             && parse_floats(&p, end, light.specular, 3)
+             && parse_floats(&p, end, &light.constant, 1)
+             && parse_floats(&p, end, &light.linear, 1)
+             && parse_floats(&p, end, &light.quadratic, 1)
+             && parse_floats(&p, end, cut_offs, 2);
+
+        light.inner_cut_off = cosf(glm_rad(cut_offs[0]));
+        light.outer_cut_off = cosf(glm_rad(cut_offs[1]));
+        break;
+    }
+
+    if (!ok || !at_line_end(p, end))
+        return false;
+
+    arrput(s->lights, light);
+
+    return true;
+}
+
+static bool
+parse_floats(const char **p, const char *end, float *values, int count)
+{
+    const char *start;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        start = skip_blanks(*p, end);
+        *p = start;
+        values[i] = parse_float(p, end);
+
+        /* A number ends at a blank or the end of the line */
+        if (*p == start || (*p < end && **p != ' ' && **p != '\t'
+                            && **p != '\r' && **p != '\n' && **p != '#'))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+parse_uint(const char **p, const char *end, unsigned int *value)
+{
+    const char *s = skip_blanks(*p, end);
+    const char *digits;
+    uint64_t result = 0;
+
+    for (digits = s; s < end && *s >= '0' && *s <= '9'; s++)
+        if (result <= UINT32_MAX)
+            result = result * 10 + (*s - '0');
+
+    if (s == digits || result > UINT32_MAX)
+        return false;
+
+    *p = s;
+    *value = result;
+
+    return true;
+}
+
+static bool
+copy_word(const char **p, const char *end, char *dst, size_t size)
+{
+    const char *s = skip_blanks(*p, end);
+    const char *last;
+
+    for (last = s; last < end && *last != ' ' && *last != '\t'
+                   && *last != '\r' && *last != '\n'; last++)
+        ;
+
+    if (last == s || (size_t)(last - s) >= size)
+        return false;
+
+    memcpy(dst, s, last - s);
+    dst[last - s] = '\0';
+    *p = last;
+
+    return true;
+}
+
+static bool
+at_line_end(const char *p, const char *end)
+{
+    p = skip_blanks(p, end);
+
+    return p == end || *p == '\n' || *p == '\r' || *p == '#';
+}
+
+/* EOF */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../include/allocator.h"
 #include "../include/shader.h"
 
 void
@@ -26,6 +27,9 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     char *fragment_info_log;
     char *shader_program_info_log;
 
+    /* Sources and logs only live until the program is linked */
+    size_t mark = arena_mark(&shader_arena);
+
     /* === Vertex Shader === */
     if ((vs_fp = fopen(vertex_path, "rb")) == NULL) {
         fprintf(stderr, "Error: Could not open file %s\n", vertex_path);
@@ -35,7 +39,7 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     fseek(vs_fp, 0, SEEK_END);
     length = ftell(vs_fp);
 
-    vs_buf = calloc(length + 1, sizeof(*vs_buf));
+    vs_buf = arena_alloc(&shader_arena, length + 1, 1);
 
     if (vs_buf == NULL) {
         fprintf(stderr, "Error when trying to parse vertex shader: %s\n",
@@ -59,19 +63,19 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     if (!is_vertex_compiled) {
         glGetShaderiv(vs, GL_INFO_LOG_LENGTH, &max_length);
 
-        vertex_info_log = calloc(max_length, sizeof(*vertex_info_log));
-
-        glGetShaderInfoLog(vs, max_length, NULL, vertex_info_log);
+        vertex_info_log = arena_alloc(&shader_arena, max_length, 1);
 
         fprintf(stderr, "Error: Vertex Shader Compilation Failed: %s\n",
                 vertex_path);
-        fprintf(stderr, "%s", vertex_info_log);
 
-        free(vertex_info_log);
+        if (vertex_info_log != NULL) {
+            glGetShaderInfoLog(vs, max_length, NULL, vertex_info_log);
+            fprintf(stderr, "%s", vertex_info_log);
+        }
+
         vertex_info_log = NULL;
     }
 
-    free(vs_buf);
     vs_buf = NULL;
 
     /* === Fragment Shader === */
@@ -83,7 +87,7 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     fseek(fs_fp, 0, SEEK_END);
     length = ftell(fs_fp);
 
-    fs_buf = calloc(length + 1, sizeof(*fs_buf));
+    fs_buf = arena_alloc(&shader_arena, length + 1, 1);
 
     if (fs_buf == NULL) {
         fprintf(stderr, "Error when trying to parse fragment shader: %s\n",
@@ -107,19 +111,19 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     if (!is_fragment_compiled) {
         glGetShaderiv(fs, GL_INFO_LOG_LENGTH, &max_length);
 
-        fragment_info_log = calloc(max_length, sizeof(*fragment_info_log));
-
-        glGetShaderInfoLog(fs, max_length, NULL, fragment_info_log);
+        fragment_info_log = arena_alloc(&shader_arena, max_length, 1);
 
         fprintf(stderr, "Error: Fragment Shader Compilation Failed: %s\n",
                 fragment_path);
-        fprintf(stderr, "%s", fragment_info_log);
 
-        free(fragment_info_log);
+        if (fragment_info_log != NULL) {
+            glGetShaderInfoLog(fs, max_length, NULL, fragment_info_log);
+            fprintf(stderr, "%s", fragment_info_log);
+        }
+
         fragment_info_log = NULL;
     }
 
-    free(fs_buf);
     fs_buf = NULL;
 
     /* === Shader Program === */
@@ -132,20 +136,23 @@ create_shader(shader *sh, const char *vertex_path, const char *fragment_path)
     if (!is_sp_linked) {
         glGetProgramiv(sh->ID, GL_INFO_LOG_LENGTH, &max_length);
 
-        shader_program_info_log = calloc(max_length,
-                                         sizeof(*shader_program_info_log));
-
-        glGetProgramInfoLog(sh->ID, max_length, NULL, shader_program_info_log);
+        shader_program_info_log = arena_alloc(&shader_arena, max_length, 1);
 
         fprintf(stderr, "Error: Shader Program Linking Failed\n");
-        fprintf(stderr, "%s", shader_program_info_log);
 
-        free(shader_program_info_log);
+        if (shader_program_info_log != NULL) {
+            glGetProgramInfoLog(sh->ID, max_length, NULL,
+                                shader_program_info_log);
+            fprintf(stderr, "%s", shader_program_info_log);
+        }
+
         shader_program_info_log = NULL;
     }
 
     glDeleteShader(vs);
     glDeleteShader(fs);
+
+    arena_release(&shader_arena, mark);
 }
 
 void
@@ -321,4 +328,15 @@ set_shader_mat3fv(unsigned int id, const char *name, GLsizei count,
 {
     glUniformMatrix3fv(glGetUniformLocation(id, name), count, transpose, value);
 }
+
+void
+set_shader_block_binding(unsigned int id, const char *name,
+                         unsigned int binding)
+{
+    unsigned int index = glGetUniformBlockIndex(id, name);
+
+    /* Blocks the compiler optimized away have nothing to bind */
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(id, index, binding);
+}
 /* EOF */
@@ -0,0 +1,655 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/simplify.h"
+
+#include <stb_ds.h>
+
+/* Marks an empty slot of the position and edge tables */
+#define EMPTY_SLOT UINT32_MAX
+
+/*
+ * A collapse is rejected if it turns any remaining triangle further than
+ * this, as the cosine between its old and new normal. Stops fold-overs and
+ * the slivers just short of them
+ */
+#define MIN_NORMAL_COS 0.25f
+
+typedef struct quadric quadric;
+typedef struct collapse collapse;
+typedef struct edge_slot edge_slot;
+
+/*
+ * The summed squared distance to a set of planes, as the symmetric 4x4
+ * matrix of the plane equations. Weighted by triangle area, with the total
+ * weight kept to turn it back into an average
+ */
+struct quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+/* Moving vertex u onto vertex v */
+struct collapse
+{
+    unsigned int u;
+    unsigned int v;
+    float cost;
+};
+
+struct edge_slot
+{
+    unsigned int a;
+    unsigned int b;
+    unsigned int count;
+};
+
+/**
+ * @brief Gives every vertex the index of the first vertex at the same
+ * position
+ *
+ * @param[in] vertices The vertices
+ * @param[in] num_vertices The number of vertices
+ *
+ * @return The canonical index of each vertex, to be freed by the caller
+ */
+static unsigned int *weld_positions(const vertex *vertices,
+                                    size_t num_vertices);
+
+/**
+ * @brief Locks the positions on attribute seams, open borders and
+ * non-manifold edges
+ *
+ * @param[out] locked One flag per canonical vertex, zeroed
+ * @param[in] canon The canonical index of each vertex
+ * @param[in] num_vertices The number of vertices
+ * @param[in] indices The triangle list
+ * @param[in] num_indices The number of indices
+ */
+static void lock_vertices(unsigned char *locked, const unsigned int *canon,
+                          size_t num_vertices, const unsigned int *indices,
+                          size_t num_indices);
+
+/**
+ * @brief Adds the plane of a triangle to a quadric, weighted by its area
+ *
+ * @param[in, out] q The quadric
+ * @param[in] p0 The first corner
+ * @param[in] p1 The second corner
+ * @param[in] p2 The third corner
+ */
+static void add_plane(quadric *q, const float *p0, const float *p1,
+                      const float *p2);
+
+/**
+ * @brief Adds one quadric to another
+ *
+ * @param[in, out] dst The sum
+ * @param[in] src The quadric to add
+ */
+static void add_quadric(quadric *dst, const quadric *src);
+
+/**
+ * @brief Evaluates the average squared distance of a point to the planes of
+ * two quadrics
+ *
+ * @param[in] q0 The first quadric
+ * @param[in] q1 The second quadric
+ * @param[in] p The point
+ *
+ * @return The error
+ */
+static float collapse_cost(const quadric *q0, const quadric *q1,
+                           const float *p);
+
+/**
+ * @brief Checks whether a collapse would turn over a triangle around the
+ * vertex that moves
+ *
+ * @param[in] vertices The vertices
+ * @param[in] canon The canonical index of each vertex
+ * @param[in] remap Where each vertex has collapsed to so far
+ * @param[in] indices The triangle list
+ * @param[in] fan The triangles around u, as index offsets
+ * @param[in] fan_size The number of triangles around u
+ * @param[in] u The vertex that moves
+ * @param[in] v The vertex it moves onto
+ *
+ * @return Whether a triangle turns too far
+ */
+static bool collapse_flips(const vertex *vertices, const unsigned int *canon,
+                           const unsigned int *remap,
+                           const unsigned int *indices,
+                           const unsigned int *fan, unsigned int fan_size,
+                           unsigned int u, unsigned int v);
+
+/**
+ * @brief Orders collapses from cheapest to most expensive, for qsort
+ *
+ * @param[in] a The first collapse
+ * @param[in] b The second collapse
+ *
+ * @return Less than, equal to or greater than zero
+ */
+static int compare_collapses(const void *a, const void *b);
+
+size_t
+simplify_mesh(unsigned int *dst, const vertex *vertices, size_t num_vertices,
+              const unsigned int *indices, size_t num_indices,
+              size_t target_indices, float *error)
+{
+    unsigned int *canon;
+    unsigned int *remap;
+    unsigned int *fan_offsets;
+    unsigned int *fan;
+    unsigned char *locked;
+    unsigned char *touched;
+    quadric *quadrics;
+    collapse *collapses = NULL;
+    collapse c;
+    size_t count = num_indices - num_indices % 3;
+    size_t new_count;
+    size_t needed;
+    size_t done;
+    size_t limit_index;
+    size_t i;
+    float max_cost = 0.0f;
+    float limit;
+    unsigned int a;
+    unsigned int b;
+    unsigned int d;
+    int e;
+
+    memcpy(dst, indices, count * sizeof(*dst));
+
+    if (error != NULL)
+        *error = 0.0f;
+
+    if (count <= target_indices)
+        return count;
+
+    canon = weld_positions(vertices, num_vertices);
+    locked = calloc(num_vertices, 1);
+    touched = malloc(num_vertices);
+    quadrics = calloc(num_vertices, sizeof(*quadrics));
+    remap = malloc(num_vertices * sizeof(*remap));
+    fan_offsets = malloc((num_vertices + 1) * sizeof(*fan_offsets));
+    fan = malloc(count * sizeof(*fan));
+
+    if (locked == NULL || touched == NULL || quadrics == NULL || remap == NULL
+        || fan_offsets == NULL || fan == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory to simplify mesh\n");
+        exit(EXIT_FAILURE);
+    }
+
+    lock_vertices(locked, canon, num_vertices, dst, count);
+
+    /* Every corner of a triangle gets its plane */
+    for (i = 0; i < count; i += 3) {
+        for (e = 0; e < 3; e++)
+            add_plane(&quadrics[canon[dst[i + e]]], vertices[dst[i]].position,
+                      vertices[dst[i + 1]].position,
+                      vertices[dst[i + 2]].position);
+    }
+
+    for (i = 0; i < num_vertices; i++)
+        remap[i] = i;
+
+    /*
+     * Collapse in passes. Each pass sorts every possible collapse by cost and
+     * takes the cheap ones greedily, at most one per vertex so the fans it
+     * checks against stay valid until the indices are rewritten
+     */
+    while (count > target_indices) {
+        memset(fan_offsets, 0, (num_vertices + 1) * sizeof(*fan_offsets));
+
+        for (i = 0; i < count; i++)
+            fan_offsets[dst[i] + 1]++;
+        for (i = 0; i < num_vertices; i++)
+            fan_offsets[i + 1] += fan_offsets[i];
+        for (i = 0; i < count; i++)
+            fan[fan_offsets[dst[i]]++] = i - i % 3;
+        for (i = num_vertices; i > 0; i--)
+            fan_offsets[i] = fan_offsets[i - 1];
+
+        fan_offsets[0] = 0;
+        arrsetlen(collapses, 0);
+
+        /* Both directions of every edge, unless the moving end is locked */
+        for (i = 0; i < count; i++) {
+            a = dst[i];
+            b = dst[i - i % 3 + (i + 1) % 3];
+
+            if (canon[a] == canon[b])
+                continue;
+
+            if (!locked[canon[a]]) {
+                c.u = a;
+                c.v = b;
+                c.cost = collapse_cost(&quadrics[canon[a]],
+                                       &quadrics[canon[b]],
+                                       vertices[b].position);
+                arrput(collapses, c);
+            }
+
+            if (!locked[canon[b]]) {
+                c.u = b;
+                c.v = a;
+                c.cost = collapse_cost(&quadrics[canon[a]],
+                                       &quadrics[canon[b]],
+                                       vertices[a].position);
+                arrput(collapses, c);
+            }
+        }
+
+        if (arrlen(collapses) == 0)
+            break;
+
+        qsort(collapses, arrlen(collapses), sizeof(*collapses),
+              compare_collapses);
+
+        /*
+         * Each collapse removes about two triangles. Every edge is listed
+         * about twice in each direction, so the cheapest collapses enough to
+         * reach the target reach about this far into the sorted list
+         */
+        needed = (count - target_indices) / 6 + 1;
+        limit_index = needed * 4 < (size_t)arrlen(collapses)
+                          ? needed * 4
+                          : arrlen(collapses) - 1;
+        limit = collapses[limit_index].cost;
+
+        memset(touched, 0, num_vertices);
+        done = 0;
+
+        for (i = 0; i < arrlen(collapses) && done < needed; i++) {
+            c = collapses[i];
+
+            if (c.cost > limit)
+                break;
+
+            if (touched[canon[c.u]] || touched[canon[c.v]]
+                || collapse_flips(vertices, canon, remap, dst,
+                                  fan + fan_offsets[c.u],
+                                  fan_offsets[c.u + 1] - fan_offsets[c.u],
+                                  c.u, c.v))
+                continue;
+
+            remap[c.u] = c.v;
+            touched[canon[c.u]] = 1;
+            touched[canon[c.v]] = 1;
+            add_quadric(&quadrics[canon[c.v]], &quadrics[canon[c.u]]);
+
+            if (c.cost > max_cost)
+                max_cost = c.cost;
+
+            done++;
+        }
+
+        if (done == 0)
+            break;
+
+        /* Targets were touched, so one step of remap is the final vertex */
+        for (i = 0, new_count = 0; i < count; i += 3) {
+            a = remap[dst[i]];
+            b = remap[dst[i + 1]];
+            d = remap[dst[i + 2]];
+
+            if (canon[a] == canon[b] || canon[b] == canon[d]
+                || canon[d] == canon[a])
+                continue;
+
+            dst[new_count++] = a;
+            dst[new_count++] = b;
+            dst[new_count++] = d;
+        }
+
+        count = new_count;
+    }
+
+    if (error != NULL)
+        *error = sqrtf(max_cost);
+
+    arrfree(collapses);
+    free(canon);
+    free(locked);
+    free(touched);
+    free(quadrics);
+    free(remap);
+    free(fan_offsets);
+    free(fan);
+
+    return count;
+}
+
+unsigned int
+build_lod_chain(const vertex *vertices, size_t num_vertices,
+                unsigned int **indices, mesh_lod *lods, unsigned int max_lods)
+{
+    unsigned int *scratch;
+    size_t full = arrlen(*indices);
+    size_t target;
+    size_t count;
+    unsigned int num_lods = 1;
+    float error;
+
+    lods[0].first_index = 0;
+    lods[0].count = full;
+    lods[0].error = 0.0f;
+
+    if (max_lods > MESH_MAX_LODS)
+        max_lods = MESH_MAX_LODS;
+
+    scratch = malloc((full + 1) * sizeof(*scratch));
+
+    if (scratch == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for LODs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (num_lods < max_lods) {
+        target = (size_t)(lods[num_lods - 1].count * LOD_RATIO) / 3 * 3;
+
+        if (target < 3)
+            break;
+
+        /* From the full mesh every time, so the error is measured against it */
+        count = simplify_mesh(scratch, vertices, num_vertices, *indices, full,
+                              target, &error);
+
+        if (count > lods[num_lods - 1].count * (1.0f - LOD_MIN_REDUCTION))
+            break;
+
+        lods[num_lods].first_index = arrlen(*indices);
+        lods[num_lods].count = count;
+        lods[num_lods].error = glm_max(error, lods[num_lods - 1].error);
+
+        memcpy(arraddnptr(*indices, count), scratch, count * sizeof(*scratch));
+        num_lods++;
+    }
+
+    free(scratch);
+
+    return num_lods;
+}
+
+static unsigned int *
+weld_positions(const vertex *vertices, size_t num_vertices)
+{
+    unsigned int *canon = malloc((num_vertices + 1) * sizeof(*canon));
+    unsigned int *table;
+    uint32_t bits[3];
+    uint32_t hash;
+    size_t capacity = 16;
+    size_t mask;
+    size_t slot;
+    size_t i;
+
+    while (capacity < num_vertices * 2)
+        capacity *= 2;
+
+    table = malloc(capacity * sizeof(*table));
+
+    if (canon == NULL || table == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory to simplify mesh\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(table, 0xff, capacity * sizeof(*table));
+    mask = capacity - 1;
+
+    for (i = 0; i < num_vertices; i++) {
+        memcpy(bits, vertices[i].position, sizeof(bits));
+
+        hash = bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+        hash ^= hash >> 16;
+
+        for (slot = hash & mask; table[slot] != EMPTY_SLOT;
+             slot = (slot + 1) & mask) {
+            if (memcmp(vertices[table[slot]].position, vertices[i].position,
+                       sizeof(bits)) == 0)
+                break;
+        }
+
+        if (table[slot] == EMPTY_SLOT)
+            table[slot] = i;
+
+        canon[i] = table[slot];
+    }
+
+    free(table);
+
+    return canon;
+}
+
+static void
+lock_vertices(unsigned char *locked, const unsigned int *canon,
+              size_t num_vertices, const unsigned int *indices,
+              size_t num_indices)
+{
+    unsigned int *first_vertex = malloc((num_vertices + 1)
+                                        * sizeof(*first_vertex));
+    edge_slot *edges;
+    uint32_t hash;
+    size_t capacity = 16;
+    size_t mask;
+    size_t slot;
+    size_t i;
+    unsigned int a;
+    unsigned int b;
+    unsigned int t;
+
+    while (capacity < num_indices * 2)
+        capacity *= 2;
+
+    edges = malloc(capacity * sizeof(*edges));
+
+    if (first_vertex == NULL || edges == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory to simplify mesh\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* A position used by two different vertices is on a seam */
+    memset(first_vertex, 0xff, num_vertices * sizeof(*first_vertex));
+
+    for (i = 0; i < num_indices; i++) {
+        a = indices[i];
+
+        if (first_vertex[canon[a]] == EMPTY_SLOT)
+            first_vertex[canon[a]] = a;
+        else if (first_vertex[canon[a]] != a)
+            locked[canon[a]] = 1;
+    }
+
+    /* An edge without exactly two triangles is on a border or non-manifold */
+    for (i = 0; i < capacity; i++)
+        edges[i].count = 0;
+
+    mask = capacity - 1;
+
+    for (i = 0; i < num_indices; i++) {
+        a = canon[indices[i]];
+        b = canon[indices[i - i % 3 + (i + 1) % 3]];
+
+        if (a > b) {
+            t = a;
+            a = b;
+            b = t;
+        }
+
+        hash = a * 0x9e3779b1u ^ b * 0x85ebca77u;
+        hash ^= hash >> 15;
+
+        for (slot = hash & mask; edges[slot].count != 0;
+             slot = (slot + 1) & mask) {
+            if (edges[slot].a == a && edges[slot].b == b)
+                break;
+        }
+
+        edges[slot].a = a;
+        edges[slot].b = b;
+        edges[slot].count++;
+    }
+
+    for (i = 0; i < capacity; i++) {
+        if (edges[i].count != 0 && edges[i].count != 2) {
+            locked[edges[i].a] = 1;
+            locked[edges[i].b] = 1;
+        }
+    }
+
+    free(first_vertex);
+    free(edges);
+}
+
+static void
+add_plane(quadric *q, const float *p0, const float *p1, const float *p2)
+{
+    double e1[3];
+    double e2[3];
+    double n[3];
+    double length;
+    double area;
+    double d;
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        e1[k] = p1[k] - p0[k];
+        e2[k] = p2[k] - p0[k];
+    }
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    if (length == 0.0)
+        return;
+
+    area = length * 0.5;
+
+    for (k = 0; k < 3; k++)
+        n[k] /= length;
+
+    d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+
+    q->a00 += area * n[0] * n[0];
+    q->a01 += area * n[0] * n[1];
+    q->a02 += area * n[0] * n[2];
+    q->a11 += area * n[1] * n[1];
+    q->a12 += area * n[1] * n[2];
+    q->a22 += area * n[2] * n[2];
+    q->b0 += area * n[0] * d;
+    q->b1 += area * n[1] * d;
+    q->b2 += area * n[2] * d;
+    q->c += area * d * d;
+    q->w += area;
+}
+
+static void
+add_quadric(quadric *dst, const quadric *src)
+{
+    dst->a00 += src->a00;
+    dst->a01 += src->a01;
+    dst->a02 += src->a02;
+    dst->a11 += src->a11;
+    dst->a12 += src->a12;
+    dst->a22 += src->a22;
+    dst->b0 += src->b0;
+    dst->b1 += src->b1;
+    dst->b2 += src->b2;
+    dst->c += src->c;
+    dst->w += src->w;
+}
+
+static float
+collapse_cost(const quadric *q0, const quadric *q1, const float *p)
+{
+    quadric q = *q0;
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double error;
+
+    add_quadric(&q, q1);
+
+    error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+            + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+            + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+    /* Rounding can take a zero error slightly negative */
+    return q.w > 0.0 && error > 0.0 ? error / q.w : 0.0f;
+}
+
+static bool
+collapse_flips(const vertex *vertices, const unsigned int *canon,
+               const unsigned int *remap, const unsigned int *indices,
+               const unsigned int *fan, unsigned int fan_size, unsigned int u,
+               unsigned int v)
+{
+    const float *p[3];
+    unsigned int corner[3];
+    unsigned int i;
+    vec3 e1;
+    vec3 e2;
+    vec3 before;
+    vec3 after;
+    float dot;
+    int k;
+    int moved;
+
+    for (i = 0; i < fan_size; i++) {
+        moved = -1;
+
+        for (k = 0; k < 3; k++) {
+            corner[k] = remap[indices[fan[i] + k]];
+
+            if (corner[k] == u)
+                moved = k;
+        }
+
+        /* Triangles on the edge disappear, so cannot turn over */
+        if (moved < 0 || canon[corner[0]] == canon[v]
+            || canon[corner[1]] == canon[v] || canon[corner[2]] == canon[v])
+            continue;
+
+        for (k = 0; k < 3; k++)
+            p[k] = vertices[corner[k]].position;
+
+        glm_vec3_sub((float *)p[1], (float *)p[0], e1);
+        glm_vec3_sub((float *)p[2], (float *)p[0], e2);
+        glm_vec3_cross(e1, e2, before);
+
+        p[moved] = vertices[v].position;
+
+        glm_vec3_sub((float *)p[1], (float *)p[0], e1);
+        glm_vec3_sub((float *)p[2], (float *)p[0], e2);
+        glm_vec3_cross(e1, e2, after);
+
+        dot = glm_vec3_dot(before, after);
+
+        if (dot <= MIN_NORMAL_COS * glm_vec3_norm(before)
+                       * glm_vec3_norm(after))
+            return true;
+    }
+
+    return false;
+}
+
+static int
+compare_collapses(const void *a, const void *b)
+{
+    float cost_a = ((const collapse *)a)->cost;
+    float cost_b = ((const collapse *)b)->cost;
+
+    return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+/* EOF */
@@ -0,0 +1,200 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/gl_ext.h"
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+#include "../include/stream_buffer.h"
+
+#include <glad/glad.h>
+
+/* How long to block on a fence before checking again, in nanoseconds */
+#define FENCE_TIMEOUT 1000000000
+
+/*
+ * The buffer is only ever bound here for mapping, so using the copy target
+ * leaves the vertex and uniform bindings alone
+ */
+#define STREAM_TARGET GL_COPY_WRITE_BUFFER
+
+/**
+ * @brief Blocks until the GPU is done with a region, then drops its fence
+ *
+ * @param[in, out] sb The stream buffer
+ * @param[in] region The region about to be rewritten
+ */
+static void wait_region(stream_buffer *sb, unsigned int region);
+
+void
+create_stream_buffer(stream_buffer *sb, size_t region_size)
+{
+    GLint alignment = 0;
+    GLbitfield flags;
+    size_t size;
+    unsigned int i;
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    sb->alignment = alignment > 16 ? alignment : 16;
+    sb->region_size = (region_size + sb->alignment - 1)
+                      / sb->alignment * sb->alignment;
+    sb->region = STREAM_REGIONS - 1;
+    sb->offset = 0;
+    sb->persistent = NULL;
+    sb->mapped = NULL;
+    sb->started = false;
+    sb->stalls = 0;
+
+    for (i = 0; i < STREAM_REGIONS; i++)
+        sb->fences[i] = NULL;
+
+    size = sb->region_size * STREAM_REGIONS;
+
+    glGenBuffers(1, &sb->buffer);
+    state_bind_buffer(STREAM_TARGET, sb->buffer);
+
+    if (gl_ext.buffer_storage) {
+        /* Mapped once for good, the fences alone keep the GPU safe */
+        flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        gl_ext.glBufferStorage(STREAM_TARGET, size, NULL, flags);
+        sb->persistent = glMapBufferRange(STREAM_TARGET, 0, size, flags);
+
+        if (sb->persistent == NULL) {
+            fprintf(stderr, "Error: Could not map stream buffer\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        glBufferData(STREAM_TARGET, size, NULL, GL_STREAM_DRAW);
+    }
+
+    track_gpu_buffer(sb->buffer, MEMORY_SCRATCH, size);
+}
+
+void
+begin_stream_frame(stream_buffer *sb)
+{
+    /* Everything that reads the last region has been submitted by now */
+    if (sb->started)
+        sb->fences[sb->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    sb->started = true;
+    sb->region = (sb->region + 1) % STREAM_REGIONS;
+    sb->offset = 0;
+
+    wait_region(sb, sb->region);
+
+    if (sb->persistent != NULL) {
+        sb->mapped = sb->persistent + sb->region * sb->region_size;
+        return;
+    }
+
+    /* The fence already did the synchronizing, so the driver need not */
+    state_bind_buffer(STREAM_TARGET, sb->buffer);
+    sb->mapped = glMapBufferRange(STREAM_TARGET,
+                                  sb->region * sb->region_size,
+                                  sb->region_size,
+                                  GL_MAP_WRITE_BIT
+                                  | GL_MAP_UNSYNCHRONIZED_BIT
+                                  | GL_MAP_INVALIDATE_RANGE_BIT
+                                  | GL_MAP_FLUSH_EXPLICIT_BIT);
+
+    if (sb->mapped == NULL) {
+        fprintf(stderr, "Error: Could not map stream buffer region\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void *
+stream_alloc(stream_buffer *sb, size_t size, size_t *offset)
+{
+    size_t start = (sb->offset + sb->alignment - 1)
+                   / sb->alignment * sb->alignment;
+
+    if (sb->mapped == NULL) {
+        fprintf(stderr, "Error: Stream buffer written outside of a frame\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (start + size > sb->region_size) {
+        fprintf(stderr, "Error: Stream buffer region is full, %zu of %zu "
+                "bytes used\n", sb->offset, sb->region_size);
+        exit(EXIT_FAILURE);
+    }
+
+    sb->offset = start + size;
+    *offset = sb->region * sb->region_size + start;
+
+    return sb->mapped + start;
+}
+
+void
+end_stream_frame(stream_buffer *sb)
+{
+    sb->mapped = NULL;
+
+    /* Coherent persistent mappings need neither a flush nor an unmap */
+    if (sb->persistent != NULL)
+        return;
+
+    state_bind_buffer(STREAM_TARGET, sb->buffer);
+
+    if (sb->offset > 0)
+        glFlushMappedBufferRange(STREAM_TARGET, 0, sb->offset);
+
+    glUnmapBuffer(STREAM_TARGET);
+}
+
+void
+delete_stream_buffer(stream_buffer *sb)
+{
+    unsigned int i;
+
+    for (i = 0; i < STREAM_REGIONS; i++) {
+        if (sb->fences[i] != NULL)
+            glDeleteSync(sb->fences[i]);
+        sb->fences[i] = NULL;
+    }
+
+    if (sb->persistent != NULL) {
+        state_bind_buffer(STREAM_TARGET, sb->buffer);
+        glUnmapBuffer(STREAM_TARGET);
+        sb->persistent = NULL;
+    }
+
+    state_delete_buffer(sb->buffer);
+}
+
+static void
+wait_region(stream_buffer *sb, unsigned int region)
+{
+    GLenum status;
+
+    if (sb->fences[region] == NULL)
+        return;
+
+    status = glClientWaitSync(sb->fences[region], 0, 0);
+
+    if (status == GL_TIMEOUT_EXPIRED) {
+        sb->stalls++;
+
+        do {
+            status = glClientWaitSync(sb->fences[region],
+                                      GL_SYNC_FLUSH_COMMANDS_BIT,
+                                      FENCE_TIMEOUT);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+    if (status == GL_WAIT_FAILED) {
+        fprintf(stderr, "Error: Waiting on a stream buffer fence failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    glDeleteSync(sb->fences[region]);
+    sb->fences[region] = NULL;
+}
+
+/* EOF */
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/gl_state.h"
+#include "../include/image.h"
+#include "../include/mem_tracker.h"
+#include "../include/mipmap.h"
+#include "../include/texture_array.h"
+#include "../include/texture_streamer.h"
+
+#include <glad/glad.h>
+
+/**
+ * @brief Takes a new, cleared layer from the array
+ *
+ * @param[in, out] ta The texture array
+ * @param[in] mip_flags The mip flags of the images that go in it
+ *
+ * @return The layer
+ */
+static int new_layer(texture_array *ta, unsigned int mip_flags);
+
+/**
+ * @brief Gets the GPU size of the array's first levels
+ *
+ * @param[in] ta The texture array
+ * @param[in] num_levels The number of levels, 0 for the full chain
+ *
+ * @return The size in bytes
+ */
+static size_t array_bytes(const texture_array *ta, int num_levels);
+
+void
+create_texture_array(texture_array *ta, int width, int height, int max_layers)
+{
+    int i;
+
+    ta->id = 0;
+    ta->streamed = false;
+    ta->pixels = NULL;
+    ta->layer_flags = NULL;
+
+    ta->width = width;
+    ta->height = height;
+    ta->max_layers = max_layers;
+    ta->num_layers = 0;
+
+    for (i = 0; i < 2; i++) {
+        ta->shelves[i].layer = -1;
+        ta->shelves[i].x = 0;
+        ta->shelves[i].y = 0;
+        ta->shelves[i].height = 0;
+    }
+}
+
+texture_region
+add_texture_image(texture_array *ta, const unsigned char *pixels, int width,
+                  int height, int num_channels, unsigned int mip_flags)
+{
+    atlas_shelf *shelf;
+    texture_region region;
+    unsigned char *dst;
+    int x;
+    int y;
+    int row;
+
+    if (width > ta->width || height > ta->height || num_channels < 1
+        || num_channels > 4) {
+        fprintf(stderr, "Error: %dx%d image with %d channels does not fit a "
+                "%dx%d texture array\n", width, height, num_channels,
+                ta->width, ta->height);
+        exit(EXIT_FAILURE);
+    }
+
+    if (width == ta->width && height == ta->height) {
+        /* Full-size images take a layer of their own */
+        region.layer = new_layer(ta, mip_flags);
+        x = 0;
+        y = 0;
+    }
+    else {
+        shelf = &ta->shelves[mip_flags & MIP_SRGB ? ATLAS_COLOR : ATLAS_DATA];
+
+        /* Start a new shelf, then a new layer, when the image does not fit */
+        if (shelf->layer >= 0 && shelf->x + width > ta->width) {
+            shelf->x = 0;
+            shelf->y += shelf->height + ATLAS_PADDING;
+            shelf->height = 0;
+        }
+
+        if (shelf->layer < 0 || shelf->y + height > ta->height) {
+            shelf->layer = new_layer(ta, mip_flags);
+            shelf->x = 0;
+            shelf->y = 0;
+            shelf->height = 0;
+        }
+
+        region.layer = shelf->layer;
+        x = shelf->x;
+        y = shelf->y;
+
+        shelf->x += width + ATLAS_PADDING;
+
+        if (height > shelf->height)
+            shelf->height = height;
+    }
+
+    region.rect[0] = (float)x / ta->width;
+    region.rect[1] = (float)y / ta->height;
+    region.rect[2] = (float)width / ta->width;
+    region.rect[3] = (float)height / ta->height;
+
+    for (row = 0; row < height; row++) {
+        dst = ta->pixels + (((size_t)region.layer * ta->height + y + row)
+                            * ta->width + x) * 4;
+
+        convert_to_rgba(dst, pixels + (size_t)row * width * num_channels,
+                        num_channels, width);
+    }
+
+    return region;
+}
+
+void
+finish_texture_array(texture_array *ta, unsigned int mip_flags)
+{
+    mip_chain chain;
+    int layer;
+
+    /* glGenerateMipmap would average the sRGB layers as if they were linear */
+    for (layer = 0; layer < ta->num_layers; layer++)
+        mip_flags |= ta->layer_flags[layer] & MIP_SRGB;
+
+    glGenTextures(1, &ta->id);
+    state_bind_texture(0, GL_TEXTURE_2D_ARRAY, ta->id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (mip_flags & (MIP_CPU | MIP_SRGB)) {
+        create_mip_chain(&chain, ta->pixels, ta->width, ta->height,
+                         ta->num_layers, ta->layer_flags);
+        upload_mip_chain(&chain, GL_TEXTURE_2D_ARRAY);
+        track_gpu_texture(ta->id, MEMORY_TEXTURE,
+                          array_bytes(ta, chain.num_levels));
+        delete_mip_chain(&chain);
+    }
+    else {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ta->width, ta->height,
+                     ta->num_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, ta->pixels);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        track_gpu_texture(ta->id, MEMORY_TEXTURE, array_bytes(ta, 0));
+        free(ta->pixels);
+    }
+
+    ta->pixels = NULL;
+}
+
+unsigned int
+stream_texture_array(texture_array *ta, texture_streamer *ts)
+{
+    unsigned int handle = add_streamed_texture(ts, GL_TEXTURE_2D_ARRAY,
+                                               ta->width, ta->height,
+                                               ta->num_layers, ta->pixels,
+                                               ta->layer_flags);
+
+    ta->id = streamed_texture_id(ts, handle);
+    ta->streamed = true;
+    ta->pixels = NULL;
+
+    return handle;
+}
+
+void
+delete_texture_array(texture_array *ta)
+{
+    if (ta->id != 0 && !ta->streamed)
+        state_delete_texture(ta->id);
+
+    free(ta->pixels);
+    free(ta->layer_flags);
+
+    ta->id = 0;
+    ta->pixels = NULL;
+    ta->layer_flags = NULL;
+}
+
+static int
+new_layer(texture_array *ta, unsigned int mip_flags)
+{
+    size_t layer_size = (size_t)ta->width * ta->height * 4;
+    unsigned char *pixels;
+    unsigned int *layer_flags;
+
+    if (ta->num_layers == ta->max_layers) {
+        fprintf(stderr, "Error: Texture array is out of layers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pixels = realloc(ta->pixels, (ta->num_layers + 1) * layer_size);
+
+    if (pixels == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for texture layer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ta->pixels = pixels;
+    memset(ta->pixels + ta->num_layers * layer_size, 0, layer_size);
+
+    layer_flags = realloc(ta->layer_flags,
+                          (ta->num_layers + 1) * sizeof(*layer_flags));
+
+    if (layer_flags == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for texture layer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ta->layer_flags = layer_flags;
+    ta->layer_flags[ta->num_layers] = mip_flags;
+
+    return ta->num_layers++;
+}
+
+static size_t
+array_bytes(const texture_array *ta, int num_levels)
+{
+    size_t bytes = 0;
+    int level;
+
+    for (level = 0; num_levels == 0 || level < num_levels; level++) {
+        bytes += (size_t)mip_level_size(ta->width, level)
+                 * mip_level_size(ta->height, level) * ta->num_layers * 4;
+
+        if (num_levels == 0 && mip_level_size(ta->width, level) == 1
+            && mip_level_size(ta->height, level) == 1)
+            break;
+    }
+
+    return bytes;
+}
+
+/* EOF */
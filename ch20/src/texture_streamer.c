@@ -0,0 +1,360 @@
+#include <math.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/allocator.h"
+#include "../include/gl_state.h"
+#include "../include/mem_tracker.h"
+#include "../include/texture_streamer.h"
+
+#include <stb_ds.h>
+#include <glad/glad.h>
+
+/**
+ * @brief Gets how many bytes a level of a texture takes up
+ *
+ * @param[in] t The streamed texture
+ * @param[in] level The level
+ *
+ * @return The size in bytes, all layers included
+ */
+static size_t level_bytes(const streamed_texture *t, int level);
+
+/**
+ * @brief Gets how many bytes the GL holds for a texture from a level down
+ *
+ * @param[in] t The streamed texture
+ * @param[in] level The finest level
+ *
+ * @return The size in bytes
+ */
+static size_t chain_bytes(const streamed_texture *t, int level);
+
+/**
+ * @brief Respecifies a texture with the levels from one level down
+ *
+ * @param[in, out] ts The texture streamer
+ * @param[in, out] t The streamed texture
+ * @param[in] level The new finest level
+ */
+static void set_resident(texture_streamer *ts, streamed_texture *t, int level);
+
+/**
+ * @brief Drops the fine levels of the least recently used texture that has
+ * more than it needs
+ *
+ * @param[in, out] ts The texture streamer
+ * @param[in] keep A texture that must not be touched
+ *
+ * @return Whether anything was dropped
+ */
+static bool evict_one(texture_streamer *ts, const streamed_texture *keep);
+
+/**
+ * @brief Orders textures by how far they are from the detail they want
+ *
+ * @param[in] a A pointer to the first streamed_texture pointer
+ * @param[in] b A pointer to the second streamed_texture pointer
+ *
+ * @return Negative if a is needier than b
+ */
+static int compare_need(const void *a, const void *b);
+
+void
+create_texture_streamer(texture_streamer *ts, size_t budget,
+                        pbo_ring *uploads)
+{
+    ts->textures = NULL;
+    ts->uploads = uploads;
+    ts->budget = budget;
+    ts->resident_bytes = 0;
+    ts->frame = 0;
+    ts->uploaded_bytes = 0;
+    ts->evictions = 0;
+}
+
+unsigned int
+add_streamed_texture(texture_streamer *ts, GLenum target, int width,
+                     int height, int layers, unsigned char *pixels,
+                     const unsigned int *layer_flags)
+{
+    streamed_texture t = {0};
+    mip_chain chain;
+    int size = width > height ? width : height;
+
+    t.target = target;
+    t.width = width;
+    t.height = height;
+    t.layers = layers;
+
+    /* The texture takes over the levels of the chain */
+    create_mip_chain(&chain, pixels, width, height, layers, layer_flags);
+    memcpy(t.levels, chain.levels, sizeof(t.levels));
+    t.num_levels = chain.num_levels;
+
+    /* The first level small enough to keep no matter what */
+    for (t.floor = 0; t.floor < t.num_levels - 1; t.floor++)
+        if (mip_level_size(size, t.floor) <= STREAM_MIN_SIZE)
+            break;
+
+    t.wanted = t.floor;
+    t.resident = t.num_levels;
+    t.last_used = ts->frame;
+
+    glGenTextures(1, &t.id);
+    state_bind_texture(0, target, t.id);
+
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    arrput(ts->textures, t);
+    set_resident(ts, &arrlast(ts->textures), t.floor);
+
+    return arrlen(ts->textures) - 1;
+}
+
+unsigned int
+streamed_texture_id(const texture_streamer *ts, unsigned int handle)
+{
+    return ts->textures[handle].id;
+}
+
+void
+request_texture_detail(texture_streamer *ts, unsigned int handle,
+                       float screen_size)
+{
+    streamed_texture *t = &ts->textures[handle];
+    int size = t->width > t->height ? t->width : t->height;
+    int level = t->floor;
+
+    /* One texel per pixel is all the detail a draw can show */
+    if (screen_size >= 1.0f)
+        level = (int)floorf(log2f(size / screen_size));
+
+    if (level < 0)
+        level = 0;
+
+    if (level < t->wanted)
+        t->wanted = level;
+
+    t->last_used = ts->frame;
+}
+
+void
+update_texture_streamer(texture_streamer *ts)
+{
+    streamed_texture **needy;
+    streamed_texture *t;
+    size_t num_needy = 0;
+    size_t extra;
+    size_t i;
+
+    ts->uploaded_bytes = 0;
+    ts->evictions = 0;
+
+    /* Textures nobody asked for in a while only keep their coarse levels */
+    for (i = 0; i < arrlen(ts->textures); i++) {
+        t = &ts->textures[i];
+
+        if (t->resident < t->floor
+            && ts->frame - t->last_used >= STREAM_EVICT_FRAMES) {
+            set_resident(ts, t, t->floor);
+            ts->evictions++;
+        }
+    }
+
+    /* Frame scratch, gone when the frame arena is next reset */
+    needy = arena_alloc(&frame_arena, arrlen(ts->textures) * sizeof(*needy),
+                        alignof(streamed_texture *));
+
+    if (needy == NULL) {
+        fprintf(stderr, "Error: Frame arena too small to stream textures\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < arrlen(ts->textures); i++)
+        if (ts->textures[i].wanted < ts->textures[i].resident)
+            needy[num_needy++] = &ts->textures[i];
+
+    if (num_needy > 0)
+        qsort(needy, num_needy, sizeof(*needy), compare_need);
+
+    /* One level at a time, so every texture sharpens from coarse to fine */
+    for (i = 0; i < num_needy; i++) {
+        t = needy[i];
+
+        if (ts->uploaded_bytes > 0
+            && ts->uploaded_bytes + chain_bytes(t, t->resident - 1)
+               > STREAM_UPLOAD_BYTES)
+            break;
+
+        extra = chain_bytes(t, t->resident - 1) - chain_bytes(t, t->resident);
+
+        while (ts->resident_bytes + extra > ts->budget && evict_one(ts, t))
+            ts->evictions++;
+
+        if (ts->resident_bytes + extra > ts->budget)
+            continue;
+
+        set_resident(ts, t, t->resident - 1);
+    }
+
+    for (i = 0; i < arrlen(ts->textures); i++)
+        ts->textures[i].wanted = ts->textures[i].floor;
+
+    ts->frame++;
+}
+
+void
+delete_texture_streamer(texture_streamer *ts)
+{
+    size_t i;
+    int level;
+
+    for (i = 0; i < arrlen(ts->textures); i++) {
+        state_delete_texture(ts->textures[i].id);
+
+        for (level = 0; level < ts->textures[i].num_levels; level++)
+            free(ts->textures[i].levels[level]);
+    }
+
+    arrfree(ts->textures);
+    ts->resident_bytes = 0;
+}
+
+static size_t
+level_bytes(const streamed_texture *t, int level)
+{
+    return (size_t)mip_level_size(t->width, level)
+        * mip_level_size(t->height, level) * t->layers * 4;
+}
+
+static size_t
+chain_bytes(const streamed_texture *t, int level)
+{
+    size_t bytes = 0;
+
+    for (; level < t->num_levels; level++)
+        bytes += level_bytes(t, level);
+
+    return bytes;
+}
+
+static void
+set_resident(texture_streamer *ts, streamed_texture *t, int level)
+{
+    unsigned char *mapped;
+    const void *pixels;
+    size_t offset = 0;
+    int l;
+    int w;
+    int h;
+
+    if (t->resident < t->num_levels)
+        ts->resident_bytes -= chain_bytes(t, t->resident);
+
+    /* Staged in a pixel buffer, the glTexImage calls return right away */
+    if (ts->uploads != NULL) {
+        mapped = begin_pixel_upload(ts->uploads, chain_bytes(t, level));
+
+        for (l = level; l < t->num_levels; l++) {
+            memcpy(mapped + offset, t->levels[l], level_bytes(t, l));
+            offset += level_bytes(t, l);
+        }
+
+        end_pixel_upload(ts->uploads);
+        offset = 0;
+    }
+
+    /*
+     * GL 3.3 cannot free part of a texture, so the whole chain is respecified
+     * with the new finest level as level 0. UVs are normalized, so sampling
+     * is unaffected
+     */
+    state_bind_texture(0, t->target, t->id);
+
+    for (l = level; l < t->num_levels; l++) {
+        w = mip_level_size(t->width, l);
+        h = mip_level_size(t->height, l);
+
+        pixels = ts->uploads != NULL ? (const void *)(uintptr_t)offset
+                                     : t->levels[l];
+        offset += level_bytes(t, l);
+
+        if (t->target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(t->target, l - level, GL_RGBA8, w, h, t->layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        else
+            glTexImage2D(t->target, l - level, GL_RGBA8, w, h, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, pixels);
+    }
+
+    if (ts->uploads != NULL)
+        finish_pixel_upload(ts->uploads);
+
+    track_gpu_texture(t->id, MEMORY_TEXTURE, chain_bytes(t, level));
+
+    glTexParameteri(t->target, GL_TEXTURE_MAX_LEVEL,
+                    t->num_levels - 1 - level);
+
+    t->resident = level;
+    ts->resident_bytes += chain_bytes(t, level);
+    ts->uploaded_bytes += chain_bytes(t, level);
+}
+
+static bool
+evict_one(texture_streamer *ts, const streamed_texture *keep)
+{
+    streamed_texture *victim = NULL;
+    streamed_texture *t;
+    int need;
+    size_t i;
+
+    for (i = 0; i < arrlen(ts->textures); i++) {
+        t = &ts->textures[i];
+
+        if (t == keep || t->resident >= t->floor)
+            continue;
+
+        /* Textures asked for this frame keep what they asked for */
+        need = t->last_used == ts->frame ? t->wanted : t->floor;
+
+        if (t->resident >= need)
+            continue;
+
+        if (victim == NULL || t->last_used < victim->last_used)
+            victim = t;
+    }
+
+    if (victim == NULL)
+        return false;
+
+    set_resident(ts, victim,
+                 victim->last_used == ts->frame ? victim->wanted
+                                                : victim->floor);
+
+    return true;
+}
+
+static int
+compare_need(const void *a, const void *b)
+{
+    const streamed_texture *ta = *(streamed_texture *const *)a;
+    const streamed_texture *tb = *(streamed_texture *const *)b;
+    int need_a = ta->resident - ta->wanted;
+    int need_b = tb->resident - tb->wanted;
+
+    if (need_a != need_b)
+        return need_b - need_a;
+
+    /* Then the most recently used first */
+    return (tb->last_used > ta->last_used) - (tb->last_used < ta->last_used);
+}
+
+/* EOF */
@@ -0,0 +1,202 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/affine.h"
+#include "../include/transform.h"
+
+#include <stb_ds.h>
+#include <cglm/cglm.h>
+
+/**
+ * @brief Checks whether a local scale is the same on every axis
+ *
+ * @param[in] scale The scale
+ *
+ * @return Whether the components match within a small tolerance
+ */
+static bool is_uniform_scale(vec3 scale);
+
+/**
+ * @brief Grows the caches to hold every node
+ *
+ * @param[in, out] h The hierarchy
+ */
+static void grow_caches(transform_hierarchy *h);
+
+unsigned int
+add_transform(transform_hierarchy *h, unsigned int parent, vec3 position,
+              versor rotation, vec3 scale)
+{
+    size_t node = h->count;
+
+    if (parent != TRANSFORM_NO_PARENT && parent >= node) {
+        fprintf(stderr, "Error: Transform parent %u does not exist\n",
+                parent);
+        exit(EXIT_FAILURE);
+    }
+
+    h->count++;
+
+    arrput(h->parents, parent);
+    arrsetlen(h->positions, h->count);
+    arrsetlen(h->rotations, h->count);
+    arrsetlen(h->scales, h->count);
+    arrput(h->dirty, 1);
+
+    glm_vec3_copy(position, h->positions[node]);
+    glm_quat_copy(rotation, h->rotations[node]);
+    glm_vec3_copy(scale, h->scales[node]);
+
+    if (node < h->first_dirty)
+        h->first_dirty = node;
+
+    return node;
+}
+
+void
+set_transform(transform_hierarchy *h, unsigned int node, vec3 position,
+              versor rotation, vec3 scale)
+{
+    glm_vec3_copy(position, h->positions[node]);
+    glm_quat_copy(rotation, h->rotations[node]);
+    glm_vec3_copy(scale, h->scales[node]);
+
+    mark_transform_dirty(h, node);
+}
+
+void
+mark_transform_dirty(transform_hierarchy *h, unsigned int node)
+{
+    h->dirty[node] = 1;
+
+    if (node < h->first_dirty)
+        h->first_dirty = node;
+}
+
+void
+skip_normal_matrices(transform_hierarchy *h, bool skip)
+{
+    if (h->skip_normals && !skip && h->count > 0) {
+        memset(h->dirty, 1, h->count);
+        h->first_dirty = 0;
+    }
+
+    h->skip_normals = skip;
+}
+
+size_t
+update_world_transforms(transform_hierarchy *h)
+{
+    CGLM_ALIGN_MAT mat4 local;
+    size_t updated = 0;
+    size_t i;
+    unsigned int parent;
+
+    if (h->first_dirty >= h->count)
+        return 0;
+
+    if (h->capacity < h->count)
+        grow_caches(h);
+
+    for (i = h->first_dirty; i < h->count; i++) {
+        parent = h->parents[i];
+
+        /* Parents come first, so a recomputed one is already marked */
+        if (!h->dirty[i]
+            && (parent == TRANSFORM_NO_PARENT || !h->dirty[parent]))
+            continue;
+
+        h->dirty[i] = 1;
+
+        /* Scaled, then rotated, then moved into place */
+        glm_translate_make(local, h->positions[i]);
+        glm_quat_rotate(local, h->rotations[i], local);
+        glm_scale(local, h->scales[i]);
+
+        if (parent == TRANSFORM_NO_PARENT) {
+            glm_mat4_copy(local, h->world[i]);
+            h->uniform_scale[i] = is_uniform_scale(h->scales[i]);
+        }
+        else {
+            glm_mat4_mul(h->world[parent], local, h->world[i]);
+
+            /* Rotating between two uniform scales keeps it uniform */
+            h->uniform_scale[i] = h->uniform_scale[parent]
+                && is_uniform_scale(h->scales[i]);
+        }
+
+        /* Translation does not move normals, so the 3x3 part is enough */
+        if (!h->skip_normals)
+            normal_matrix(h->world[i], h->normal[i]);
+
+        updated++;
+    }
+
+    memset(h->dirty + h->first_dirty, 0, h->count - h->first_dirty);
+    h->first_dirty = h->count;
+
+    return updated;
+}
+
+void
+free_transforms(transform_hierarchy *h)
+{
+    arrfree(h->parents);
+    arrfree(h->positions);
+    arrfree(h->rotations);
+    arrfree(h->scales);
+    arrfree(h->dirty);
+
+    free(h->world);
+    free(h->normal);
+    free(h->uniform_scale);
+
+    memset(h, 0, sizeof(*h));
+}
+
+static bool
+is_uniform_scale(vec3 scale)
+{
+    float largest = glm_max(fabsf(scale[0]),
+                            glm_max(fabsf(scale[1]), fabsf(scale[2])));
+
+    return fabsf(scale[0] - scale[1]) <= 1e-5f * largest
+        && fabsf(scale[0] - scale[2]) <= 1e-5f * largest;
+}
+
+static void
+grow_caches(transform_hierarchy *h)
+{
+    size_t capacity = h->capacity > 0 ? h->capacity : 64;
+    mat4 *world;
+    mat3 *normal;
+    bool *uniform_scale;
+
+    while (capacity < h->count)
+        capacity *= 2;
+
+    /* SIMD builds of cglm load and store whole aligned matrices */
+    world = aligned_alloc(_Alignof(mat4), capacity * sizeof(*world));
+    normal = realloc(h->normal, capacity * sizeof(*normal));
+    uniform_scale = realloc(h->uniform_scale,
+                            capacity * sizeof(*uniform_scale));
+
+    if (world == NULL || normal == NULL || uniform_scale == NULL) {
+        fprintf(stderr, "Error: Failed to allocate transform memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (h->world != NULL)
+        memcpy(world, h->world, h->capacity * sizeof(*world));
+
+    free(h->world);
+
+    h->world = world;
+    h->normal = normal;
+    h->uniform_scale = uniform_scale;
+    h->capacity = capacity;
+}
+
+/* EOF */
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/triple_buffer.h"
+
+/* Set in middle when the writer published a slot the reader has not taken */
+#define SLOT_FRESH 4u
+
+#define SLOT_INDEX 3u
+
+void
+create_triple_buffer(triple_buffer *tb, size_t size)
+{
+    tb->data = calloc(3, size);
+
+    if (tb->data == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for triple "
+                "buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tb->size = size;
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+void *
+write_triple_buffer(triple_buffer *tb)
+{
+    return tb->data + tb->back * tb->size;
+}
+
+void
+publish_triple_buffer(triple_buffer *tb)
+{
+    unsigned int old;
+
+    /* Release makes the writes to the slot visible before the swap */
+    old = atomic_exchange_explicit(&tb->middle, tb->back | SLOT_FRESH,
+                                   memory_order_acq_rel);
+    tb->back = old & SLOT_INDEX;
+}
+
+const void *
+read_triple_buffer(triple_buffer *tb)
+{
+    unsigned int old;
+
+    if (atomic_load_explicit(&tb->middle, memory_order_relaxed) & SLOT_FRESH) {
+        old = atomic_exchange_explicit(&tb->middle, tb->front,
+                                       memory_order_acq_rel);
+        tb->front = old & SLOT_INDEX;
+    }
+
+    return tb->data + tb->front * tb->size;
+}
+
+void
+delete_triple_buffer(triple_buffer *tb)
+{
+    free(tb->data);
+    tb->data = NULL;
+}
+
+/* EOF */
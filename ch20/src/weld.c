@@ -0,0 +1,239 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/weld.h"
+
+#include <stb_ds.h>
+
+/* Ends a chain of the hash grid */
+#define END_OF_CHAIN UINT32_MAX
+
+/* Keeps cell coordinates of huge or infinite positions in range */
+#define MAX_CELL 1e15
+
+typedef struct weld_cell weld_cell;
+
+/* A kept vertex, chained into the hash grid by the cell it is in */
+struct weld_cell
+{
+    int64_t key[3];
+    unsigned int vertex;
+    unsigned int next;
+};
+
+/**
+ * @brief Finds the grid cell of a position
+ *
+ * @param[out] key The cell coordinates
+ * @param[in] position The position
+ * @param[in] epsilon The cell size, or 0 to key on the exact bits
+ */
+static void cell_key(int64_t *key, const float *position, float epsilon);
+
+/**
+ * @brief Hashes cell coordinates
+ *
+ * @param[in] key The cell coordinates
+ * @param[in] mask The table size minus one
+ *
+ * @return The bucket
+ */
+static size_t hash_cell(const int64_t *key, size_t mask);
+
+/**
+ * @brief Tests whether two vertices are within epsilon of each other
+ *
+ * @param[in] a The first vertex
+ * @param[in] b The second vertex
+ * @param[in] epsilon The tolerances
+ *
+ * @return Whether b can be welded onto a
+ */
+static bool vertices_match(const vertex *a, const vertex *b,
+                           const weld_epsilon *epsilon);
+
+/**
+ * @brief Tests whether every component of two vectors is within epsilon
+ *
+ * @param[in] a The first vector
+ * @param[in] b The second vector
+ * @param[in] length The number of components
+ * @param[in] epsilon The tolerance
+ *
+ * @return Whether they match
+ */
+static bool components_match(const float *a, const float *b,
+                             unsigned int length, float epsilon);
+
+size_t
+weld_vertices(vertex **vertices, unsigned int **indices,
+              const weld_epsilon *epsilon)
+{
+    static const weld_epsilon exact = { 0.0f, 0.0f, 0.0f };
+
+    vertex *v = *vertices;
+    size_t num_vertices = arrlenu(v);
+    size_t table_size = 16;
+    size_t kept = 0;
+    size_t bucket;
+    size_t i;
+
+    unsigned int *heads;
+    unsigned int *remap;
+    weld_cell *cells;
+    unsigned int match;
+    unsigned int c;
+    int64_t key[3];
+    int64_t probe[3];
+    int reach;
+    int dx;
+    int dy;
+    int dz;
+
+    if (epsilon == NULL)
+        epsilon = &exact;
+
+    if (num_vertices == 0)
+        return 0;
+
+    /* Exact matches can only be in the same cell */
+    reach = epsilon->position > 0.0f ? 1 : 0;
+
+    while (table_size < num_vertices * 2)
+        table_size *= 2;
+
+    heads = malloc(table_size * sizeof(*heads));
+    remap = malloc(num_vertices * sizeof(*remap));
+    cells = malloc(num_vertices * sizeof(*cells));
+
+    if (heads == NULL || remap == NULL || cells == NULL) {
+        fprintf(stderr, "Error: Failed to allocate welding memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(heads, 0xff, table_size * sizeof(*heads));
+
+    for (i = 0; i < num_vertices; i++) {
+        match = END_OF_CHAIN;
+        cell_key(key, v[i].position, epsilon->position);
+
+        for (dz = -reach; dz <= reach && match == END_OF_CHAIN; dz++) {
+            for (dy = -reach; dy <= reach && match == END_OF_CHAIN; dy++) {
+                for (dx = -reach; dx <= reach && match == END_OF_CHAIN; dx++) {
+                    probe[0] = key[0] + dx;
+                    probe[1] = key[1] + dy;
+                    probe[2] = key[2] + dz;
+
+                    c = heads[hash_cell(probe, table_size - 1)];
+
+                    for (; c != END_OF_CHAIN; c = cells[c].next) {
+                        if (memcmp(cells[c].key, probe, sizeof(probe)) == 0
+                            && vertices_match(&v[cells[c].vertex], &v[i],
+                                              epsilon)) {
+                            match = cells[c].vertex;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (match != END_OF_CHAIN) {
+            remap[i] = match;
+            continue;
+        }
+
+        /* Kept vertices move down in place, ahead of any still to compare */
+        v[kept] = v[i];
+        remap[i] = kept;
+
+        bucket = hash_cell(key, table_size - 1);
+        memcpy(cells[kept].key, key, sizeof(key));
+        cells[kept].vertex = kept;
+        cells[kept].next = heads[bucket];
+        heads[bucket] = kept;
+
+        kept++;
+    }
+
+    if (*indices == NULL) {
+        arrsetlen(*indices, num_vertices);
+
+        for (i = 0; i < num_vertices; i++)
+            (*indices)[i] = remap[i];
+    }
+    else {
+        for (i = 0; i < arrlenu(*indices); i++)
+            (*indices)[i] = remap[(*indices)[i]];
+    }
+
+    arrsetlen(*vertices, kept);
+
+    free(cells);
+    free(remap);
+    free(heads);
+
+    return num_vertices - kept;
+}
+
+static void
+cell_key(int64_t *key, const float *position, float epsilon)
+{
+    unsigned int i;
+    double cell;
+    float value;
+    uint32_t bits;
+
+    for (i = 0; i < 3; i++) {
+        if (epsilon > 0.0f) {
+            cell = floor((double)position[i] / epsilon);
+            key[i] = (int64_t)fmax(-MAX_CELL, fmin(cell, MAX_CELL));
+        }
+        else {
+            /* Adding zero turns -0 into 0 so the two share a cell */
+            value = position[i] + 0.0f;
+            memcpy(&bits, &value, sizeof(bits));
+            key[i] = bits;
+        }
+    }
+}
+
+static size_t
+hash_cell(const int64_t *key, size_t mask)
+{
+    uint64_t h = (uint64_t)key[0] * 0x9e3779b97f4a7c15ull;
+
+    h = (h ^ (uint64_t)key[1]) * 0xc2b2ae3d27d4eb4full;
+    h = (h ^ (uint64_t)key[2]) * 0x165667b19e3779f9ull;
+
+    return (size_t)(h ^ (h >> 29)) & mask;
+}
+
+static bool
+vertices_match(const vertex *a, const vertex *b, const weld_epsilon *epsilon)
+{
+    return components_match(a->position, b->position, 3, epsilon->position)
+           && components_match(a->normal, b->normal, 3, epsilon->normal)
+           && components_match(a->tex_coords, b->tex_coords, 2,
+                               epsilon->tex_coords);
+}
+
+static bool
+components_match(const float *a, const float *b, unsigned int length,
+                 float epsilon)
+{
+    unsigned int i;
+
+    for (i = 0; i < length; i++) {
+        if (!(fabsf(a[i] - b[i]) <= epsilon))
+            return false;
+    }
+
+    return true;
+}
+
+/* EOF */